@@ -0,0 +1,121 @@
+#include <precomp.h>
+#include <glfw_initialization.h>
+#include <glfw_window.h>
+#include <graphics.h>
+#include <light_clustering.h>
+#include <logging.h>
+#include <spdlog/spdlog.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <array>
+#include <random>
+
+// Renders offscreen frames of a screen-filling wall lit by a field of point lights in front of
+// it and reads the GPU timestamps around the light clustering dispatch and the scene pass that
+// shades the wall, so the cost of both shows at the light counts a scene would use. Run it from
+// the build directory, where the compiled shaders are.
+
+namespace {
+
+constexpr std::int32_t kWidth = 1920;
+constexpr std::int32_t kHeight = 1080;
+constexpr std::uint32_t kWarmupFrames = 30;
+constexpr std::uint32_t kMeasuredFrames = 200;
+constexpr std::float_t kWallDistance = 50.0f;
+
+struct PassTimes {
+	std::double_t best = std::numeric_limits<std::double_t>::max();
+	std::double_t total = 0.0;
+
+	void Add(std::double_t milliseconds)
+	{
+		best = std::min(best, milliseconds);
+		total += milliseconds;
+	}
+};
+
+// Lights in view space, spread over the part of the wall the camera sees and a few units in
+// front of and behind it
+std::vector<veng::PointLight> ScatterLights(std::uint32_t count)
+{
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<std::float_t> x(-60.0f, 60.0f);
+	std::uniform_real_distribution<std::float_t> y(-35.0f, 35.0f);
+	std::uniform_real_distribution<std::float_t> z(-kWallDistance - 5.0f, -kWallDistance + 10.0f);
+	std::uniform_real_distribution<std::float_t> radius(2.0f, 6.0f);
+	std::uniform_real_distribution<std::float_t> channel(0.2f, 1.0f);
+	std::vector<veng::PointLight> lights(count);
+	for (veng::PointLight& light : lights) {
+		light.position = glm::vec3(x(random), y(random), z(random));
+		light.radius = radius(random);
+		light.color = glm::vec3(channel(random), channel(random), channel(random));
+	}
+	return lights;
+}
+
+}  // namespace
+
+int main()
+{
+	const veng::LoggingInitialization _logging;
+	const veng::GlfwInitialization _glfw;
+
+	const std::float_t kFovY = glm::radians(60.0f);
+	const std::float_t aspect = static_cast<std::float_t>(kWidth) / static_cast<std::float_t>(kHeight);
+	const glm::mat4 projection = veng::PerspectiveReverseZ(kFovY, aspect, 0.1f);
+	const glm::mat4 view(1.0f);
+
+	veng::Window window("VulkanEngine lighting benchmark", glm::ivec2(kWidth, kHeight), false);
+	veng::GraphicsSettings settings;
+	settings.offscreen = true;
+	settings.clustered_lighting = true;
+	settings.max_lights = 10'000;
+	veng::Graphics graphics(&window, settings);
+
+	// The hard-coded triangle, facing the camera and large enough to cover the whole view
+	const glm::mat4 wall = projection * glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -kWallDistance)), glm::vec3(400.0f));
+	const std::array<std::uint32_t, 1> instances = {0};
+
+	spdlog::info(
+	    "{}x{} offscreen, cluster grid {}x{}x{}, {} lights per cluster at most",
+	    kWidth,
+	    kHeight,
+	    settings.light_clusters.tiles_x,
+	    settings.light_clusters.tiles_y,
+	    settings.light_clusters.slices,
+	    settings.light_clusters.max_lights_per_cluster);
+
+	for (std::uint32_t light_count : {1'000u, 10'000u}) {
+		const std::vector<veng::PointLight> lights = ScatterLights(light_count);
+		PassTimes clustering;
+		PassTimes scene;
+		std::uint32_t measured = 0;
+		for (std::uint32_t frame = 0; frame < kWarmupFrames + kMeasuredFrames; frame++) {
+			graphics.SetLights(lights, view, projection);
+			if (!graphics.BeginFrame()) {
+				continue;
+			}
+			graphics.GetInstanceBuffer()[0] = wall;
+			graphics.RenderTriangleInstances(instances);
+			graphics.EndFrame();
+			// The times are those of the frame retired by BeginFrame
+			if (frame >= kWarmupFrames) {
+				clustering.Add(graphics.GetGpuLightClusteringTime());
+				scene.Add(graphics.GetGpuSceneTime());
+				measured++;
+			}
+		}
+		if (measured == 0 || scene.total == 0.0) {
+			spdlog::error("No GPU timestamps were read; the graphics queue may not support them");
+			return EXIT_FAILURE;
+		}
+
+		spdlog::info(
+		    "{:>6} lights  light clustering: {:7.3f} ms best, {:7.3f} ms avg  scene shading: {:7.3f} ms best, {:7.3f} ms avg",
+		    light_count,
+		    clustering.best,
+		    clustering.total / measured,
+		    scene.best,
+		    scene.total / measured);
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,145 @@
+#include <precomp.h>
+#include <frustum_culling.h>
+#include <spdlog/spdlog.h>
+#include <chrono>
+#include <random>
+
+// Compares the SoA culling kernels against a straightforward per-object glm loop.
+
+namespace {
+
+struct NaiveObject {
+	glm::vec3 sphere_center;
+	std::float_t sphere_radius;
+	glm::vec3 aabb_min;
+	glm::vec3 aabb_max;
+};
+
+std::size_t NaiveCull(const std::vector<NaiveObject>& objects, const veng::Frustum& frustum, std::vector<std::uint32_t>& visible)
+{
+	visible.clear();
+	for (std::uint32_t i = 0; i < objects.size(); i++) {
+		const NaiveObject& object = objects[i];
+		bool inside = true;
+		for (const glm::vec4& plane : frustum.planes) {
+			const glm::vec3 normal(plane.x, plane.y, plane.z);
+			if (glm::dot(normal, object.sphere_center) + plane.w < -object.sphere_radius) {
+				inside = false;
+				break;
+			}
+
+			const glm::vec3 positive(
+			    normal.x >= 0.0f ? object.aabb_max.x : object.aabb_min.x,
+			    normal.y >= 0.0f ? object.aabb_max.y : object.aabb_min.y,
+			    normal.z >= 0.0f ? object.aabb_max.z : object.aabb_min.z);
+			if (glm::dot(normal, positive) + plane.w < 0.0f) {
+				inside = false;
+				break;
+			}
+		}
+		if (inside) {
+			visible.push_back(i);
+		}
+	}
+	return visible.size();
+}
+
+template <typename Function>
+double MeasureBestMilliseconds(std::int32_t repetitions, Function&& function)
+{
+	double best = std::numeric_limits<double>::max();
+	for (std::int32_t i = 0; i < repetitions; i++) {
+		auto start = std::chrono::steady_clock::now();
+		function();
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+		best = std::min(best, elapsed.count());
+	}
+	return best;
+}
+
+}  // namespace
+
+int main()
+{
+	const glm::mat4 projection = veng::PerspectiveReverseZ(glm::radians(60.0f), 16.0f / 9.0f, 0.1f);
+	const glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	const veng::Frustum frustum = veng::Frustum::FromViewProjection(projection * view);
+	const veng::CullingKernel best_kernel = veng::DetectCullingKernel();
+	veng::JobSystem jobs;
+
+	spdlog::info("Best available kernel: {}", veng::GetCullingKernelName(best_kernel));
+
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<std::float_t> position(-500.0f, 500.0f);
+	std::uniform_real_distribution<std::float_t> size(0.5f, 5.0f);
+
+	bool all_match = true;
+	for (std::size_t object_count : {10'000u, 100'000u, 1'000'000u}) {
+		std::vector<NaiveObject> objects(object_count);
+		veng::BoundingVolumes volumes;
+		volumes.Reserve(object_count);
+
+		for (NaiveObject& object : objects) {
+			const glm::vec3 center(position(random), position(random), position(random));
+			const glm::vec3 half_extent(size(random), size(random), size(random));
+			object.sphere_center = center;
+			object.sphere_radius = glm::length(half_extent);
+			object.aabb_min = center - half_extent;
+			object.aabb_max = center + half_extent;
+			volumes.Add(object.sphere_center, object.sphere_radius, object.aabb_min, object.aabb_max);
+		}
+
+		std::vector<std::uint32_t> naive_visible;
+		naive_visible.reserve(object_count);
+		std::vector<std::uint32_t> visible(object_count);
+
+		const std::int32_t repetitions = object_count >= 1'000'000 ? 10 : 50;
+		std::size_t naive_count = 0;
+		const double naive_ms = MeasureBestMilliseconds(repetitions, [&]() {
+			naive_count = NaiveCull(objects, frustum, naive_visible);
+		});
+		spdlog::info("{:>8} objects  naive glm: {:8.3f} ms  ({} visible)", object_count, naive_ms, naive_count);
+
+		for (veng::CullingKernel kernel : {veng::CullingKernel::kScalar, veng::CullingKernel::kSse, veng::CullingKernel::kAvx2}) {
+			if (kernel > best_kernel) {
+				continue;
+			}
+
+			std::size_t count = 0;
+			const double kernel_ms = MeasureBestMilliseconds(repetitions, [&]() {
+				count = veng::CullFrustum(volumes, frustum, visible, kernel);
+			});
+
+			const bool matches = count == naive_count && std::equal(naive_visible.begin(), naive_visible.end(), visible.begin());
+			all_match = all_match && matches;
+			spdlog::info(
+			    "{:>8} objects  {:>9}: {:8.3f} ms  ({:.1f}x){}",
+			    object_count,
+			    veng::GetCullingKernelName(kernel),
+			    kernel_ms,
+			    naive_ms / kernel_ms,
+			    matches ? "" : "  MISMATCH");
+		}
+
+		std::size_t parallel_count = 0;
+		const double parallel_ms = MeasureBestMilliseconds(repetitions, [&]() {
+			parallel_count = veng::CullFrustum(volumes, frustum, visible, best_kernel, jobs);
+		});
+		const bool parallel_matches = parallel_count == naive_count && std::equal(naive_visible.begin(), naive_visible.end(), visible.begin());
+		all_match = all_match && parallel_matches;
+		spdlog::info(
+		    "{:>8} objects  {:>5} x{:<2}: {:8.3f} ms  ({:.1f}x){}",
+		    object_count,
+		    veng::GetCullingKernelName(best_kernel),
+		    jobs.GetConcurrency(),
+		    parallel_ms,
+		    naive_ms / parallel_ms,
+		    parallel_matches ? "" : "  MISMATCH");
+	}
+
+	if (!all_match) {
+		spdlog::error("A kernel's visible set differs from the naive one");
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
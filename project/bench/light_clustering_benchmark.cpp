@@ -0,0 +1,131 @@
+#include <precomp.h>
+#include <light_clustering.h>
+#include <spdlog/spdlog.h>
+#include <chrono>
+#include <random>
+
+// Bins point lights into the cluster grid the way light_cluster.comp does (every cluster tests
+// every light) and with the light-centric CPU binning, then samples fragments at random to
+// show how many lights a clustered fragment walks compared to the full light count a plain
+// forward shader would loop over.
+
+namespace {
+
+template <typename Function>
+double MeasureBestMilliseconds(std::int32_t repetitions, Function&& function)
+{
+	double best = std::numeric_limits<double>::max();
+	for (std::int32_t i = 0; i < repetitions; i++) {
+		auto start = std::chrono::steady_clock::now();
+		function();
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+		best = std::min(best, elapsed.count());
+	}
+	return best;
+}
+
+bool HaveSameClusters(const veng::LightClusterer& left, const veng::LightClusterer& right)
+{
+	for (std::uint32_t cluster = 0; cluster < veng::GetClusterCount(left.GetSettings()); cluster++) {
+		const gsl::span<const std::uint32_t> left_lights = left.GetClusterLights(cluster);
+		const gsl::span<const std::uint32_t> right_lights = right.GetClusterLights(cluster);
+		if (!std::equal(left_lights.begin(), left_lights.end(), right_lights.begin(), right_lights.end())) {
+			return false;
+		}
+	}
+	return true;
+}
+
+}  // namespace
+
+int main()
+{
+	const std::float_t kFovY = glm::radians(60.0f);
+	constexpr std::float_t kAspect = 16.0f / 9.0f;
+	constexpr std::uint32_t kFragmentSamples = 200'000;
+	const glm::mat4 projection = veng::PerspectiveReverseZ(kFovY, kAspect, 0.1f);
+	const veng::ClusterSettings settings;
+
+	veng::LightClusterer clusterer(settings);
+	veng::LightClusterer reference(settings);
+	clusterer.SetProjection(projection);
+	reference.SetProjection(projection);
+
+	spdlog::info(
+	    "Cluster grid {}x{}x{} ({} clusters), depth {}..{}, {} lights per cluster at most",
+	    settings.tiles_x,
+	    settings.tiles_y,
+	    settings.slices,
+	    veng::GetClusterCount(settings),
+	    settings.near,
+	    settings.far,
+	    settings.max_lights_per_cluster);
+
+	bool all_match = true;
+	for (std::uint32_t light_count : {1'000u, 10'000u, 50'000u}) {
+		// A wide street-level field of small lights in front of the camera, in view space
+		std::mt19937 random(1234);
+		std::uniform_real_distribution<std::float_t> x(-300.0f, 300.0f);
+		std::uniform_real_distribution<std::float_t> y(-5.0f, 30.0f);
+		std::uniform_real_distribution<std::float_t> z(-500.0f, -1.0f);
+		std::uniform_real_distribution<std::float_t> radius(2.0f, 8.0f);
+		std::vector<veng::PointLight> lights(light_count);
+		for (veng::PointLight& light : lights) {
+			light.position = glm::vec3(x(random), y(random), z(random));
+			light.radius = radius(random);
+		}
+
+		const std::int32_t repetitions = light_count >= 50'000 ? 3 : 10;
+		const double brute_force_ms = MeasureBestMilliseconds(repetitions, [&]() { reference.BuildBruteForce(lights); });
+		const double binned_ms = MeasureBestMilliseconds(repetitions * 5, [&]() { clusterer.Build(lights); });
+		const bool matches = HaveSameClusters(clusterer, reference) && clusterer.GetOverflowCount() == reference.GetOverflowCount();
+		all_match = all_match && matches;
+
+		// Fragments at random screen positions and depths
+		std::uniform_real_distribution<std::float_t> ndc(-1.0f, 1.0f);
+		std::uniform_real_distribution<std::float_t> depth(0.5f, settings.far);
+		const std::float_t focal = 1.0f / std::tan(kFovY * 0.5f);
+		std::uint64_t walked = 0;
+		std::uint64_t contributing = 0;
+		std::uint32_t most_walked = 0;
+		for (std::uint32_t sample = 0; sample < kFragmentSamples; sample++) {
+			const glm::vec2 point_ndc(ndc(random), ndc(random));
+			const std::float_t point_depth = depth(random);
+			// Inverse of PerspectiveReverseZ at that depth; its y axis points down
+			const glm::vec3 position(point_ndc.x * kAspect / focal * point_depth, -point_ndc.y / focal * point_depth, -point_depth);
+
+			const std::uint32_t tile_x = std::min(static_cast<std::uint32_t>((point_ndc.x * 0.5f + 0.5f) * settings.tiles_x), settings.tiles_x - 1);
+			const std::uint32_t tile_y = std::min(static_cast<std::uint32_t>((point_ndc.y * 0.5f + 0.5f) * settings.tiles_y), settings.tiles_y - 1);
+			const std::uint32_t slice = veng::GetClusterSlice(settings, point_depth);
+			const gsl::span<const std::uint32_t> cluster_lights = clusterer.GetClusterLights(clusterer.GetClusterIndex(tile_x, tile_y, slice));
+
+			walked += cluster_lights.size();
+			most_walked = std::max(most_walked, static_cast<std::uint32_t>(cluster_lights.size()));
+			for (std::uint32_t light : cluster_lights) {
+				contributing += glm::length(lights[light].position - position) < lights[light].radius ? 1 : 0;
+			}
+		}
+
+		spdlog::info(
+		    "{:>6} lights  per-cluster (compute shader's loop): {:8.3f} ms  light-centric: {:7.3f} ms  ({:.1f}x){}",
+		    light_count,
+		    brute_force_ms,
+		    binned_ms,
+		    brute_force_ms / binned_ms,
+		    matches ? "" : "  MISMATCH");
+		spdlog::info(
+		    "{:>6} lights  lights walked per fragment: {:.2f} avg, {} max, {:.3f} contributing; unclustered: {}  ({} dropped by full clusters)",
+		    light_count,
+		    static_cast<double>(walked) / kFragmentSamples,
+		    most_walked,
+		    static_cast<double>(contributing) / kFragmentSamples,
+		    light_count,
+		    clusterer.GetOverflowCount());
+	}
+
+	if (!all_match) {
+		spdlog::error("The light-centric clusters differ from the per-cluster ones");
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -1,7 +1,8 @@
 #version 450
 #include "common.glsl"
+#include "shading_constants.glsl"
 layout(location = 0) out vec4 out_color;
 
 void main() {
-    out_color = vec4(1.0, 0.0, 0.5, 1.0); // Set the output color to a pinkish hue
+    out_color = vec4(kAlbedo, 1.0);
 }
\ No newline at end of file
@@ -1,6 +1,11 @@
 #version 450
 #include "common.glsl"
 
+layout(location = 0) in mat4 instance_world;
+
+// The depth pre-pass runs this in a pipeline of its own; the color pass must get the same depth
+invariant gl_Position;
+
 vec2 hardcoded_position[3] = vec2[](
     vec2(0.0, -0.5),
     vec2(0.5, 0.5),
@@ -10,5 +15,5 @@ vec2 hardcoded_position[3] = vec2[](
 void main() 
 {
     vec2 current_position = hardcoded_position[gl_VertexIndex];
-    gl_Position = vec4(current_position, 0.0, 1.0);
+    gl_Position = instance_world * vec4(current_position, 0.0, 1.0);
 }
@@ -0,0 +1,51 @@
+#version 450
+#include "common.glsl"
+#include "clustered_lighting.glsl"
+#include "shading_constants.glsl"
+
+// basic.frag's flat color lit by the lights of the fragment's cluster. The view-space position
+// comes from the depth and the inverse projection and the normal from its screen-space
+// derivatives, so the vertex stages stay unchanged. The quality branches and the light cap
+// are specialization constants and fold away in each variant.
+
+layout(location = 0) out vec4 out_color;
+
+void main()
+{
+    if (kShadingQuality == kShadingAmbient) {
+        out_color = vec4(kAlbedo * kAmbient, 1.0);
+        return;
+    }
+
+    vec2 ndc = gl_FragCoord.xy * clusters.viewport.zw * 2.0 - 1.0;
+    vec4 unprojected = clusters.inverse_projection * vec4(ndc, gl_FragCoord.z, 1.0);
+    if (unprojected.w <= 0.0) {
+        out_color = vec4(kAlbedo * kAmbient, 1.0);  // at infinity
+        return;
+    }
+    vec3 position = unprojected.xyz / unprojected.w;
+    vec3 normal = vec3(0.0);
+    if (kShadingQuality != kShadingAttenuation) {
+        normal = normalize(cross(dFdx(position), dFdy(position)));
+        normal = dot(normal, position) > 0.0 ? -normal : normal;  // facing the camera
+    }
+
+    uvec2 tile = min(uvec2(gl_FragCoord.xy * clusters.viewport.zw * vec2(clusters.grid.xy)), clusters.grid.xy - 1);
+    uint slice = uint(clamp(log(-position.z) * clusters.slicing.z - clusters.slicing.w, 0.0, float(clusters.grid.z - 1)));
+    uint cluster = GetClusterIndex(uvec3(tile, slice));
+
+    vec3 lighting = vec3(kAmbient);
+    uint first_slot = cluster * clusters.limits.x;
+    uint count = min(cluster_counts[cluster], kMaxLightsPerFragment);
+    for (uint i = 0; i < count; i++) {
+        PointLight light = lights[cluster_lights[first_slot + i]];
+        vec3 to_light = light.position - position;
+        float distance_squared = dot(to_light, to_light);
+        // Inverse square falloff windowed to reach zero at the radius
+        float window = clamp(1.0 - pow(distance_squared / (light.radius * light.radius), 2.0), 0.0, 1.0);
+        float attenuation = window * window / (distance_squared + 1.0);
+        float diffuse = kShadingQuality == kShadingAttenuation ? 1.0 : max(dot(normal, to_light * inversesqrt(max(distance_squared, 1e-8))), 0.0);
+        lighting += light.color * (light.intensity * attenuation * diffuse);
+    }
+    out_color = vec4(kAlbedo * lighting, 1.0);
+}
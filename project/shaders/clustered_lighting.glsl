@@ -0,0 +1,40 @@
+// Cluster grid and light lists shared by light_cluster.comp and clustered.frag; mirrors
+// ClusterUniforms and PointLight in light_clustering.h. The binning pass defines
+// CLUSTER_LIST_ACCESS to write the lists, the fragment shader only reads them.
+
+#ifndef CLUSTER_LIST_ACCESS
+#define CLUSTER_LIST_ACCESS readonly
+#endif
+
+struct PointLight {
+    vec3 position;  // view space
+    float radius;
+    vec3 color;
+    float intensity;
+};
+
+layout(set = 0, binding = 0, std140) uniform ClusterUniforms {
+    mat4 inverse_projection;
+    uvec4 grid;      // tiles x, tiles y, slices, light count
+    vec4 viewport;   // width, height, 1 / width, 1 / height
+    vec4 slicing;    // near, far, scale, bias
+    uvec4 limits;    // max lights per cluster
+} clusters;
+
+layout(set = 0, binding = 1, std430) readonly buffer Lights {
+    PointLight lights[];
+};
+
+layout(set = 0, binding = 2, std430) CLUSTER_LIST_ACCESS buffer ClusterCounts {
+    uint cluster_counts[];
+};
+
+// limits.x slots per cluster
+layout(set = 0, binding = 3, std430) CLUSTER_LIST_ACCESS buffer ClusterLights {
+    uint cluster_lights[];
+};
+
+uint GetClusterIndex(uvec3 cluster)
+{
+    return (cluster.z * clusters.grid.y + cluster.y) * clusters.grid.x + cluster.x;
+}
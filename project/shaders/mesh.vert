@@ -0,0 +1,20 @@
+#version 450
+#include "common.glsl"
+
+layout(location = 0) in mat4 instance_world;
+// R16G16B16A16_UNORM, relative to the mesh bounds (mesh_format.h)
+layout(location = 4) in vec4 packed_position;
+
+layout(push_constant) uniform MeshBounds {
+    vec4 bounds_min;
+    vec4 bounds_extent;
+} mesh;
+
+// The depth pre-pass runs this in a pipeline of its own; the color pass must get the same depth
+invariant gl_Position;
+
+void main()
+{
+    vec3 position = mesh.bounds_min.xyz + packed_position.xyz * mesh.bounds_extent.xyz;
+    gl_Position = instance_world * vec4(position, 1.0);
+}
@@ -0,0 +1,16 @@
+#version 450
+#include "common.glsl"
+
+// The atlas holds glyph coverage; rectangles sample its solid cell
+
+layout(set = 0, binding = 0) uniform sampler2D glyph_atlas;
+
+layout(location = 0) in vec2 uv;
+layout(location = 1) in vec4 color;
+
+layout(location = 0) out vec4 out_color;
+
+void main()
+{
+    out_color = vec4(color.rgb, color.a * texture(glyph_atlas, uv).r);
+}
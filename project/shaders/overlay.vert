@@ -0,0 +1,23 @@
+#version 450
+#include "common.glsl"
+
+// Overlay quads are given in window pixels with the origin at the top left, which maps onto
+// Vulkan's clip space without a flip. The color arrives as RGBA8 already normalized.
+
+layout(location = 0) in vec2 position;
+layout(location = 1) in vec2 uv;
+layout(location = 2) in vec4 color;
+
+layout(location = 0) out vec2 out_uv;
+layout(location = 1) out vec4 out_color;
+
+layout(push_constant) uniform OverlayTarget {
+    vec2 inverse_size;
+} target;
+
+void main()
+{
+    gl_Position = vec4(position * target.inverse_size * 2.0 - 1.0, 0.0, 1.0);
+    out_uv = uv;
+    out_color = color;
+}
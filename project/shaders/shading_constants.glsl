@@ -0,0 +1,16 @@
+// Tunables of the fragment shaders, set per variant as specialization constants; the ids
+// mirror ShadingConstant in graphics.cpp and the defaults ShadingVariant in graphics.h.
+
+layout(constant_id = 0) const float kAlbedoR = 1.0;
+layout(constant_id = 1) const float kAlbedoG = 0.0;
+layout(constant_id = 2) const float kAlbedoB = 0.5;
+layout(constant_id = 3) const float kAmbient = 0.05;
+// Lights of its cluster a fragment shades at most
+layout(constant_id = 4) const uint kMaxLightsPerFragment = 0xffffffffu;
+// ShadingQuality: ambient only, lights without the diffuse term, or everything
+layout(constant_id = 5) const uint kShadingQuality = 2;
+
+const uint kShadingAmbient = 0;
+const uint kShadingAttenuation = 1;
+
+const vec3 kAlbedo = vec3(kAlbedoR, kAlbedoG, kAlbedoB);
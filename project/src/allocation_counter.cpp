@@ -0,0 +1,58 @@
+#include <precomp.h>
+#include <allocation_counter.h>
+#include <atomic>
+#include <new>
+
+#if !defined(NDEBUG)
+
+static std::atomic<std::uint64_t> global_allocation_count = 0;
+
+// Only the plain forms are replaced; the aligned ones keep their default (matching) pair
+void* operator new(std::size_t size)
+{
+	global_allocation_count.fetch_add(1, std::memory_order_relaxed);
+	if (void* memory = std::malloc(size == 0 ? 1 : size)) {
+		return memory;
+	}
+	throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+	return ::operator new(size);
+}
+
+void operator delete(void* memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete[](void* memory, std::size_t) noexcept
+{
+	std::free(memory);
+}
+
+#endif
+
+namespace veng {
+
+std::uint64_t GetGlobalAllocationCount()
+{
+#if !defined(NDEBUG)
+	return global_allocation_count.load(std::memory_order_relaxed);
+#else
+	return 0;
+#endif
+}
+
+}  // namespace veng
@@ -0,0 +1,18 @@
+#pragma once
+
+namespace veng {
+
+// Number of global operator new calls made so far, across all threads. Only debug builds
+// count (the global operators are replaced there); release builds always return 0.
+std::uint64_t GetGlobalAllocationCount();
+
+constexpr bool IsAllocationCountingEnabled()
+{
+#if !defined(NDEBUG)
+	return true;
+#else
+	return false;
+#endif
+}
+
+}  // namespace veng
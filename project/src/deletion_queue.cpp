@@ -0,0 +1,27 @@
+#include <precomp.h>
+#include <deletion_queue.h>
+
+namespace veng {
+
+void DeletionQueue::Collect(std::uint64_t completed_frame)
+{
+	// Entries are ordered by frame, so the retired ones form a prefix
+	auto retired_end = std::find_if(entries_.begin(), entries_.end(), [completed_frame](const Entry& entry) {
+		return entry.last_use_frame > completed_frame;
+	});
+
+	for (auto it = entries_.begin(); it != retired_end; ++it) {
+		it->destroy(it->parent, it->handle, it->allocator);
+	}
+	entries_.erase(entries_.begin(), retired_end);
+}
+
+void DeletionQueue::Flush()
+{
+	for (const Entry& entry : entries_) {
+		entry.destroy(entry.parent, entry.handle, entry.allocator);
+	}
+	entries_.clear();
+}
+
+}  // namespace veng
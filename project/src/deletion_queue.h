@@ -0,0 +1,87 @@
+#pragma once
+
+#include <vulkan_handle.h>
+#include <type_traits>
+#include <vector>
+
+namespace veng {
+
+// Holds on to Vulkan objects that were released while a frame in flight may still use
+// them, and destroys them once the GPU has finished that frame. Lets resources be
+// replaced at runtime without vkDeviceWaitIdle.
+class DeletionQueue {
+public:
+	DeletionQueue() = default;
+	~DeletionQueue() { Flush(); }
+
+	DeletionQueue(const DeletionQueue&) = delete;
+	DeletionQueue& operator=(const DeletionQueue&) = delete;
+
+	// `last_use_frame`: number of the last frame that may reference the object. Frames must
+	// be non-decreasing between calls.
+	template <typename Parent, typename T, auto Destroy>
+	void Push(VulkanHandle<Parent, T, Destroy>&& handle, std::uint64_t last_use_frame);
+
+	// Destroys everything whose last use is at or before `completed_frame`
+	void Collect(std::uint64_t completed_frame);
+
+	// Destroys everything; the GPU must be idle
+	void Flush();
+
+	std::size_t Size() const { return entries_.size(); }
+
+private:
+	struct Entry {
+		void* parent = nullptr;
+		std::uint64_t handle = 0;
+		const VkAllocationCallbacks* allocator = nullptr;
+		void (*destroy)(void* parent, std::uint64_t handle, const VkAllocationCallbacks* allocator) = nullptr;
+		std::uint64_t last_use_frame = 0;
+	};
+
+	// Non-dispatchable handles are pointers on 64-bit targets and uint64_t on 32-bit ones
+	template <typename T>
+	static std::uint64_t ToBits(T handle)
+	{
+		if constexpr (std::is_pointer_v<T>) {
+			return reinterpret_cast<std::uintptr_t>(handle);
+		}
+		else {
+			return handle;
+		}
+	}
+
+	template <typename T>
+	static T FromBits(std::uint64_t bits)
+	{
+		if constexpr (std::is_pointer_v<T>) {
+			return reinterpret_cast<T>(static_cast<std::uintptr_t>(bits));
+		}
+		else {
+			return bits;
+		}
+	}
+
+	std::vector<Entry> entries_;
+};
+
+template <typename Parent, typename T, auto Destroy>
+void DeletionQueue::Push(VulkanHandle<Parent, T, Destroy>&& handle, std::uint64_t last_use_frame)
+{
+	if (handle.Get() == VK_NULL_HANDLE) {
+		return;
+	}
+	Expects(entries_.empty() || entries_.back().last_use_frame <= last_use_frame);
+
+	Entry entry;
+	entry.parent = static_cast<void*>(handle.GetParent());
+	entry.allocator = handle.GetAllocator();
+	entry.last_use_frame = last_use_frame;
+	entry.handle = ToBits(handle.Release());
+	entry.destroy = [](void* parent, std::uint64_t bits, const VkAllocationCallbacks* allocator) {
+		Destroy(static_cast<Parent>(parent), FromBits<T>(bits), allocator);
+	};
+	entries_.push_back(entry);
+}
+
+}  // namespace veng
@@ -0,0 +1,148 @@
+#include <precomp.h>
+#include <device_features.h>
+#include <spdlog/spdlog.h>
+
+namespace veng {
+
+void DeviceFeatureChain::Link(std::uint32_t api_version, bool khr_dynamic_rendering, bool khr_synchronization2)
+{
+	// Each struct is only legal in the chain if the device (and instance) know about it.
+	void** next = &core.pNext;
+
+	if (api_version >= VK_API_VERSION_1_2) {
+		*next = &vulkan11;
+		next = &vulkan11.pNext;
+		*next = &vulkan12;
+		next = &vulkan12.pNext;
+	}
+
+	if (api_version >= VK_API_VERSION_1_3) {
+		*next = &vulkan13;
+		next = &vulkan13.pNext;
+	}
+	else {
+		if (khr_dynamic_rendering) {
+			*next = &dynamic_rendering_khr;
+			next = &dynamic_rendering_khr.pNext;
+		}
+		if (khr_synchronization2) {
+			*next = &synchronization2_khr;
+			next = &synchronization2_khr.pNext;
+		}
+	}
+
+	*next = nullptr;
+}
+
+static bool HasExtension(gsl::span<const VkExtensionProperties> extensions, gsl::czstring name)
+{
+	return std::any_of(extensions.begin(), extensions.end(), [name](const VkExtensionProperties& properties) {
+		return streq(name, properties.extensionName);
+	});
+}
+
+DeviceFeatures NegotiateDeviceFeatures(
+    VkPhysicalDevice device,
+    std::uint32_t instance_api_version,
+    gsl::span<const VkExtensionProperties> available_extensions,
+    DeviceFeatureChain& supported,
+    DeviceFeatureChain& enabled,
+    std::vector<gsl::czstring>& extensions)
+{
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(device, &properties);
+
+	DeviceFeatures result;
+	result.api_version = std::min(instance_api_version, properties.apiVersion);
+
+	// Before 1.3 dynamic rendering and synchronization2 are only reachable through their KHR
+	// extensions, which in turn need the 1.2 core render pass 2 / depth stencil resolve.
+	const bool has_khr_path = result.api_version >= VK_API_VERSION_1_2 && result.api_version < VK_API_VERSION_1_3;
+	const bool khr_dynamic_rendering = has_khr_path && HasExtension(available_extensions, VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+	const bool khr_synchronization2 = has_khr_path && HasExtension(available_extensions, VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+
+	supported.Link(result.api_version, khr_dynamic_rendering, khr_synchronization2);
+	enabled.Link(result.api_version, khr_dynamic_rendering, khr_synchronization2);
+
+	if (result.api_version >= VK_API_VERSION_1_1) {
+		vkGetPhysicalDeviceFeatures2(device, &supported.core);
+	}
+	else {
+		vkGetPhysicalDeviceFeatures(device, &supported.core.features);
+	}
+
+	// Only copy what the engine uses: enabling everything can cost performance (e.g. robustBufferAccess).
+	const VkPhysicalDeviceFeatures& core = supported.core.features;
+	enabled.core.features.multiDrawIndirect = core.multiDrawIndirect;
+	enabled.core.features.drawIndirectFirstInstance = core.drawIndirectFirstInstance;
+	enabled.core.features.pipelineStatisticsQuery = core.pipelineStatisticsQuery;
+	enabled.core.features.inheritedQueries = core.inheritedQueries;
+	enabled.core.features.samplerAnisotropy = core.samplerAnisotropy;
+	enabled.core.features.sampleRateShading = core.sampleRateShading;
+
+	result.multi_draw_indirect = core.multiDrawIndirect;
+	result.draw_indirect_first_instance = core.drawIndirectFirstInstance;
+	result.pipeline_statistics_query = core.pipelineStatisticsQuery;
+	result.inherited_queries = core.inheritedQueries;
+	result.sampler_anisotropy = core.samplerAnisotropy;
+	result.sample_rate_shading = core.sampleRateShading;
+
+	if (result.api_version >= VK_API_VERSION_1_2) {
+		enabled.vulkan11.shaderDrawParameters = supported.vulkan11.shaderDrawParameters;
+
+		enabled.vulkan12.timelineSemaphore = supported.vulkan12.timelineSemaphore;
+		enabled.vulkan12.bufferDeviceAddress = supported.vulkan12.bufferDeviceAddress;
+		enabled.vulkan12.descriptorIndexing = supported.vulkan12.descriptorIndexing;
+		enabled.vulkan12.runtimeDescriptorArray = supported.vulkan12.runtimeDescriptorArray;
+		enabled.vulkan12.drawIndirectCount = supported.vulkan12.drawIndirectCount;
+		enabled.vulkan12.hostQueryReset = supported.vulkan12.hostQueryReset;
+
+		result.shader_draw_parameters = supported.vulkan11.shaderDrawParameters;
+		result.timeline_semaphore = supported.vulkan12.timelineSemaphore;
+		result.buffer_device_address = supported.vulkan12.bufferDeviceAddress;
+		result.descriptor_indexing = supported.vulkan12.descriptorIndexing;
+		result.draw_indirect_count = supported.vulkan12.drawIndirectCount;
+		result.host_query_reset = supported.vulkan12.hostQueryReset;
+	}
+
+	if (result.api_version >= VK_API_VERSION_1_3) {
+		enabled.vulkan13.dynamicRendering = supported.vulkan13.dynamicRendering;
+		enabled.vulkan13.synchronization2 = supported.vulkan13.synchronization2;
+		enabled.vulkan13.maintenance4 = supported.vulkan13.maintenance4;
+
+		result.dynamic_rendering = supported.vulkan13.dynamicRendering;
+		result.synchronization2 = supported.vulkan13.synchronization2;
+	}
+	else {
+		if (khr_dynamic_rendering && supported.dynamic_rendering_khr.dynamicRendering) {
+			enabled.dynamic_rendering_khr.dynamicRendering = VK_TRUE;
+			extensions.push_back(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+			result.dynamic_rendering = true;
+		}
+		if (khr_synchronization2 && supported.synchronization2_khr.synchronization2) {
+			enabled.synchronization2_khr.synchronization2 = VK_TRUE;
+			extensions.push_back(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+			result.synchronization2 = true;
+		}
+	}
+
+	// Queried through vkGetPhysicalDeviceMemoryProperties2, core since 1.1
+	if (result.api_version >= VK_API_VERSION_1_1 && HasExtension(available_extensions, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME)) {
+		extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+		result.memory_budget = true;
+	}
+
+	SPDLOG_INFO(
+	    "Device API {}.{}.{}, dynamic rendering: {}, synchronization2: {}, timeline semaphores: {}, memory budget: {}",
+	    VK_API_VERSION_MAJOR(result.api_version),
+	    VK_API_VERSION_MINOR(result.api_version),
+	    VK_API_VERSION_PATCH(result.api_version),
+	    result.dynamic_rendering,
+	    result.synchronization2,
+	    result.timeline_semaphore,
+	    result.memory_budget);
+
+	return result;
+}
+
+}  // namespace veng
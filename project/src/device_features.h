@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+namespace veng {
+
+// Summary of the optional device features that were actually enabled on the logical device.
+struct DeviceFeatures {
+	std::uint32_t api_version = VK_API_VERSION_1_0;
+
+	bool dynamic_rendering = false;
+	bool synchronization2 = false;
+	bool timeline_semaphore = false;
+	bool buffer_device_address = false;
+	bool descriptor_indexing = false;
+	bool draw_indirect_count = false;
+	bool host_query_reset = false;
+	bool shader_draw_parameters = false;
+	bool multi_draw_indirect = false;
+	bool draw_indirect_first_instance = false;
+	bool pipeline_statistics_query = false;
+	// Queries may stay active while secondary command buffers execute
+	bool inherited_queries = false;
+	bool sampler_anisotropy = false;
+	bool sample_rate_shading = false;
+	// VK_EXT_memory_budget: per-heap budget and usage from the driver
+	bool memory_budget = false;
+};
+
+// Owns the VkPhysicalDeviceFeatures2 pNext chain. Pointers between members are
+// wired by Link(), so the chain must stay where it was linked.
+struct DeviceFeatureChain {
+	DeviceFeatureChain() = default;
+	DeviceFeatureChain(const DeviceFeatureChain&) = delete;
+	DeviceFeatureChain& operator=(const DeviceFeatureChain&) = delete;
+
+	void Link(std::uint32_t api_version, bool khr_dynamic_rendering, bool khr_synchronization2);
+
+	VkPhysicalDeviceFeatures2 core = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2};
+	VkPhysicalDeviceVulkan11Features vulkan11 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES};
+	VkPhysicalDeviceVulkan12Features vulkan12 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES};
+	VkPhysicalDeviceVulkan13Features vulkan13 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES};
+	VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamic_rendering_khr = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR};
+	VkPhysicalDeviceSynchronization2FeaturesKHR synchronization2_khr = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR};
+};
+
+// Fills `supported` with everything the device exposes, then copies the subset the engine
+// wants into `enabled` and returns the summary. Extension names that must be enabled to back
+// the chosen features are appended to `extensions`.
+DeviceFeatures NegotiateDeviceFeatures(
+    VkPhysicalDevice device,
+    std::uint32_t instance_api_version,
+    gsl::span<const VkExtensionProperties> available_extensions,
+    DeviceFeatureChain& supported,
+    DeviceFeatureChain& enabled,
+    std::vector<gsl::czstring>& extensions);
+
+}  // namespace veng
@@ -0,0 +1,51 @@
+#include <precomp.h>
+#include <dynamic_resolution.h>
+#include <spdlog/spdlog.h>
+
+namespace veng {
+
+DynamicResolutionController::DynamicResolutionController(DynamicResolutionSettings settings) : settings_(settings), scale_(settings.max_scale)
+{
+	Expects(settings_.min_scale > 0.0f && settings_.min_scale <= settings_.max_scale);
+	Expects(settings_.target_gpu_ms > 0.0 && settings_.scale_up_threshold > 0.0 && settings_.scale_up_threshold < 1.0);
+}
+
+std::float_t DynamicResolutionController::Update(std::double_t gpu_ms)
+{
+	// An exponential moving average irons out single spikes such as a shader compile
+	constexpr std::double_t kSmoothing = 0.2;
+	smoothed_ms_ = has_samples_ ? smoothed_ms_ + kSmoothing * (gpu_ms - smoothed_ms_) : gpu_ms;
+	has_samples_ = true;
+
+	// Frames in flight still show the old scale for a while
+	if (cooldown_ > 0) {
+		cooldown_--;
+		return scale_;
+	}
+
+	const std::double_t upper = settings_.target_gpu_ms;
+	const std::double_t lower = settings_.target_gpu_ms * settings_.scale_up_threshold;
+	frames_over_ = smoothed_ms_ > upper ? frames_over_ + 1 : 0;
+	frames_under_ = (smoothed_ms_ < lower && scale_ < settings_.max_scale) ? frames_under_ + 1 : 0;
+
+	if (frames_over_ < settings_.settle_frames && frames_under_ < settings_.settle_frames) {
+		return scale_;
+	}
+
+	// GPU cost follows the pixel count, which is the square of the scale
+	const std::double_t aim = (upper + lower) * 0.5;
+	const std::float_t ideal = scale_ * static_cast<std::float_t>(std::sqrt(aim / std::max(smoothed_ms_, 1e-3)));
+	const std::float_t step_limited = std::clamp(ideal, scale_ * (1.0f - settings_.max_step), scale_ * (1.0f + settings_.max_step));
+	const std::float_t next = std::clamp(step_limited, settings_.min_scale, settings_.max_scale);
+
+	frames_over_ = 0;
+	frames_under_ = 0;
+	if (next != scale_) {
+		SPDLOG_DEBUG("Render scale {:.2f} -> {:.2f} at {:.2f} ms GPU time", scale_, next, smoothed_ms_);
+		scale_ = next;
+		cooldown_ = settings_.settle_frames;
+	}
+	return scale_;
+}
+
+}  // namespace veng
@@ -0,0 +1,44 @@
+#pragma once
+
+namespace veng {
+
+struct DynamicResolutionSettings {
+	bool enabled = false;
+	// GPU time per frame to aim for; leave some headroom below the display interval
+	std::double_t target_gpu_ms = 14.0;
+	std::float_t min_scale = 0.5f;
+	std::float_t max_scale = 1.0f;
+	// Only scale up once the GPU time is below this fraction of the target, so the scale
+	// does not oscillate around it
+	std::double_t scale_up_threshold = 0.8;
+	// Consecutive frames the smoothed time must be out of bounds before the scale changes,
+	// and frames to ignore afterwards while the measurements catch up
+	std::uint32_t settle_frames = 8;
+	// Largest relative change of the scale in one adjustment
+	std::float_t max_step = 0.1f;
+};
+
+// Picks the render scale (per axis) from measured GPU frame times. Times are smoothed, the
+// scale only moves after they have been out of the [threshold * target, target] band for a
+// while, and each move aims for the middle of that band.
+class DynamicResolutionController {
+public:
+	explicit DynamicResolutionController(DynamicResolutionSettings settings = {});
+
+	// Feeds the GPU time of one frame and returns the scale for the next one
+	std::float_t Update(std::double_t gpu_ms);
+
+	std::float_t GetScale() const { return scale_; }
+	std::double_t GetSmoothedGpuMs() const { return smoothed_ms_; }
+
+private:
+	DynamicResolutionSettings settings_;
+	std::float_t scale_;
+	std::double_t smoothed_ms_ = 0.0;
+	bool has_samples_ = false;
+	std::uint32_t frames_over_ = 0;
+	std::uint32_t frames_under_ = 0;
+	std::uint32_t cooldown_ = 0;
+};
+
+}  // namespace veng
@@ -0,0 +1,107 @@
+#include <precomp.h>
+#include <frame_arena.h>
+
+namespace veng {
+
+#pragma region LINEAR_ARENA
+
+LinearArena::LinearArena(std::size_t initial_capacity, std::pmr::memory_resource* upstream) : upstream_(upstream)
+{
+	Expects(upstream_ != nullptr);
+	blocks_.push_back(AllocateBlock(std::max<std::size_t>(initial_capacity, 64)));
+}
+
+LinearArena::~LinearArena()
+{
+	ReleaseBlocks();
+}
+
+std::size_t LinearArena::GetCapacity() const
+{
+	std::size_t capacity = 0;
+	for (const Block& block : blocks_) {
+		capacity += block.size;
+	}
+	return capacity;
+}
+
+void LinearArena::Reset()
+{
+	// Overflowed last time: replace the chain with one block that fits it all
+	if (blocks_.size() > 1) {
+		const std::size_t capacity = GetCapacity();
+		ReleaseBlocks();
+		blocks_.push_back(AllocateBlock(capacity));
+	}
+
+	offset_ = 0;
+	used_bytes_ = 0;
+}
+
+void* LinearArena::do_allocate(std::size_t bytes, std::size_t alignment)
+{
+	Block& block = blocks_.back();
+	const std::uintptr_t base = reinterpret_cast<std::uintptr_t>(block.data);
+	std::size_t aligned_offset = ((base + offset_ + alignment - 1) & ~(std::uintptr_t(alignment) - 1)) - base;
+
+	if (aligned_offset + bytes > block.size) {
+		// Doubling keeps the number of chained blocks logarithmic in the overflow
+		blocks_.push_back(AllocateBlock(std::max(block.size * 2, bytes + alignment)));
+		const std::uintptr_t new_base = reinterpret_cast<std::uintptr_t>(blocks_.back().data);
+		aligned_offset = ((new_base + alignment - 1) & ~(std::uintptr_t(alignment) - 1)) - new_base;
+	}
+
+	void* result = blocks_.back().data + aligned_offset;
+	offset_ = aligned_offset + bytes;
+	used_bytes_ += bytes;
+	peak_bytes_ = std::max(peak_bytes_, used_bytes_);
+	return result;
+}
+
+LinearArena::Block LinearArena::AllocateBlock(std::size_t size)
+{
+	Block block;
+	block.data = static_cast<std::byte*>(upstream_->allocate(size, alignof(std::max_align_t)));
+	block.size = size;
+	return block;
+}
+
+void LinearArena::ReleaseBlocks()
+{
+	for (const Block& block : blocks_) {
+		upstream_->deallocate(block.data, block.size, alignof(std::max_align_t));
+	}
+	blocks_.clear();
+}
+
+#pragma endregion
+
+#pragma region FRAME_ARENAS
+
+FrameArenas::FrameArenas(std::uint32_t frame_count, std::uint32_t thread_count, std::size_t bytes_per_arena) : thread_count_(thread_count)
+{
+	Expects(frame_count > 0 && thread_count > 0);
+
+	arenas_.reserve(frame_count * thread_count);
+	for (std::uint32_t i = 0; i < frame_count * thread_count; i++) {
+		arenas_.push_back(std::make_unique<LinearArena>(bytes_per_arena));
+	}
+}
+
+void FrameArenas::BeginFrame(std::uint32_t frame_index)
+{
+	current_frame_ = frame_index;
+	for (std::uint32_t thread = 0; thread < thread_count_; thread++) {
+		Get(thread).Reset();
+	}
+}
+
+LinearArena& FrameArenas::Get(std::uint32_t thread_index)
+{
+	Expects(thread_index < thread_count_);
+	return *arenas_[current_frame_ * thread_count_ + thread_index];
+}
+
+#pragma endregion
+
+}  // namespace veng
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+namespace veng {
+
+// Bump allocator for transient data. Deallocation is a no-op and Reset() releases
+// everything at once. Running out of space chains a new block from `upstream`; on the
+// next Reset() the blocks are merged into one, so a steady workload stops allocating
+// after its first few iterations.
+class LinearArena : public std::pmr::memory_resource {
+public:
+	explicit LinearArena(std::size_t initial_capacity, std::pmr::memory_resource* upstream = std::pmr::new_delete_resource());
+	~LinearArena() override;
+
+	LinearArena(const LinearArena&) = delete;
+	LinearArena& operator=(const LinearArena&) = delete;
+
+	void Reset();
+
+	std::size_t GetUsedBytes() const { return used_bytes_; }
+	std::size_t GetPeakBytes() const { return peak_bytes_; }
+	std::size_t GetCapacity() const;
+
+private:
+	struct Block {
+		std::byte* data = nullptr;
+		std::size_t size = 0;
+	};
+
+	void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+	void do_deallocate(void*, std::size_t, std::size_t) override {}
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+	Block AllocateBlock(std::size_t size);
+	void ReleaseBlocks();
+
+	std::pmr::memory_resource* upstream_;
+	std::vector<Block> blocks_;
+	std::size_t offset_ = 0;  // into blocks_.back()
+	std::size_t used_bytes_ = 0;
+	std::size_t peak_bytes_ = 0;
+};
+
+// One arena per (frame in flight, thread). A frame's arenas are only reset once the GPU
+// has retired that frame, so recorded commands may reference what was allocated from them.
+// Each thread must only use the arena of its own index, and an index must not be shared by
+// several threads (JobSystem gives all threads outside it the same one).
+class FrameArenas {
+public:
+	FrameArenas(std::uint32_t frame_count, std::uint32_t thread_count, std::size_t bytes_per_arena);
+
+	// Resets every thread's arena of `frame_index` and makes it current
+	void BeginFrame(std::uint32_t frame_index);
+
+	// `thread_index` as given by JobSystem::GetCurrentThreadIndex()
+	LinearArena& Get(std::uint32_t thread_index);
+
+	std::uint32_t GetThreadCount() const { return thread_count_; }
+
+private:
+	std::uint32_t thread_count_;
+	std::uint32_t current_frame_ = 0;
+	std::vector<std::unique_ptr<LinearArena>> arenas_;  // [frame * thread_count + thread]
+};
+
+}  // namespace veng
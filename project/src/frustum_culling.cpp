@@ -0,0 +1,354 @@
+#include <precomp.h>
+#include <frustum_culling.h>
+#include <bit>
+#include <limits>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define VENG_CULLING_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#else
+#define VENG_CULLING_X86 0
+#endif
+
+// MSVC emits AVX2 intrinsics anywhere; GCC and Clang need the function opted in.
+#if VENG_CULLING_X86 && !defined(_MSC_VER)
+#define VENG_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#else
+#define VENG_TARGET_AVX2
+#endif
+
+namespace veng {
+
+#pragma region FRUSTUM
+
+static glm::vec4 NormalizePlane(const glm::vec4& plane)
+{
+	const std::float_t length = glm::length(glm::vec3(plane.x, plane.y, plane.z));
+
+	// A plane at infinity (reverse-Z far plane) contains every point
+	if (length < 1e-6f) {
+		return glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	}
+
+	return plane / length;
+}
+
+Frustum Frustum::FromViewProjection(const glm::mat4& view_projection)
+{
+	auto row = [&view_projection](std::int32_t i) {
+		return glm::vec4(view_projection[0][i], view_projection[1][i], view_projection[2][i], view_projection[3][i]);
+	};
+
+	Frustum frustum;
+	frustum.planes[0] = NormalizePlane(row(3) + row(0));  // left
+	frustum.planes[1] = NormalizePlane(row(3) - row(0));  // right
+	frustum.planes[2] = NormalizePlane(row(3) + row(1));  // bottom
+	frustum.planes[3] = NormalizePlane(row(3) - row(1));  // top
+	frustum.planes[4] = NormalizePlane(row(2));           // z >= 0
+	frustum.planes[5] = NormalizePlane(row(3) - row(2));  // z <= w
+	return frustum;
+}
+
+#pragma endregion
+
+#pragma region BOUNDING_VOLUMES
+
+std::uint32_t BoundingVolumes::Add(const glm::vec3& sphere_center, std::float_t sphere_radius, const glm::vec3& aabb_min, const glm::vec3& aabb_max)
+{
+	const std::uint32_t index = gsl::narrow_cast<std::uint32_t>(size_);
+	size_++;
+	Pad();
+	Set(index, sphere_center, sphere_radius, aabb_min, aabb_max);
+	return index;
+}
+
+void BoundingVolumes::Set(std::uint32_t index, const glm::vec3& sphere_center, std::float_t sphere_radius, const glm::vec3& aabb_min, const glm::vec3& aabb_max)
+{
+	const glm::vec3 box_center = (aabb_min + aabb_max) * 0.5f;
+	const glm::vec3 box_extent = (aabb_max - aabb_min) * 0.5f;
+
+	sphere_x_[index] = sphere_center.x;
+	sphere_y_[index] = sphere_center.y;
+	sphere_z_[index] = sphere_center.z;
+	sphere_radius_[index] = sphere_radius;
+
+	box_center_x_[index] = box_center.x;
+	box_center_y_[index] = box_center.y;
+	box_center_z_[index] = box_center.z;
+	box_extent_x_[index] = box_extent.x;
+	box_extent_y_[index] = box_extent.y;
+	box_extent_z_[index] = box_extent.z;
+}
+
+void BoundingVolumes::Reserve(std::size_t count)
+{
+	const std::size_t padded = (count + kLaneWidth - 1) / kLaneWidth * kLaneWidth;
+	for (std::vector<std::float_t>* array : {&sphere_x_, &sphere_y_, &sphere_z_, &sphere_radius_, &box_center_x_, &box_center_y_, &box_center_z_, &box_extent_x_, &box_extent_y_, &box_extent_z_}) {
+		array->reserve(padded);
+	}
+}
+
+void BoundingVolumes::Clear()
+{
+	size_ = 0;
+	for (std::vector<std::float_t>* array : {&sphere_x_, &sphere_y_, &sphere_z_, &sphere_radius_, &box_center_x_, &box_center_y_, &box_center_z_, &box_extent_x_, &box_extent_y_, &box_extent_z_}) {
+		array->clear();
+	}
+}
+
+void BoundingVolumes::Pad()
+{
+	const std::size_t padded = (size_ + kLaneWidth - 1) / kLaneWidth * kLaneWidth;
+	if (padded == sphere_radius_.size()) {
+		return;
+	}
+
+	for (std::vector<std::float_t>* array : {&sphere_x_, &sphere_y_, &sphere_z_, &box_center_x_, &box_center_y_, &box_center_z_, &box_extent_x_, &box_extent_y_, &box_extent_z_}) {
+		array->resize(padded, 0.0f);
+	}
+	// A hugely negative radius fails the first plane, so padding lanes are never visible
+	sphere_radius_.resize(padded, -std::numeric_limits<std::float_t>::max());
+}
+
+#pragma endregion
+
+#pragma region KERNELS
+
+struct CullingKernels {
+	static std::uint32_t ScalarTest(const BoundingVolumes& volumes, const Frustum& frustum, std::size_t i)
+	{
+		bool inside = true;
+		for (const glm::vec4& plane : frustum.planes) {
+			const std::float_t sphere_distance = plane.x * volumes.sphere_x_[i] + plane.y * volumes.sphere_y_[i] + plane.z * volumes.sphere_z_[i] + plane.w;
+
+			// Distance of the AABB corner furthest along the plane normal
+			const std::float_t box_distance = plane.x * volumes.box_center_x_[i] + plane.y * volumes.box_center_y_[i] + plane.z * volumes.box_center_z_[i] + plane.w +
+			                                  std::abs(plane.x) * volumes.box_extent_x_[i] + std::abs(plane.y) * volumes.box_extent_y_[i] +
+			                                  std::abs(plane.z) * volumes.box_extent_z_[i];
+
+			inside &= (sphere_distance + volumes.sphere_radius_[i] >= 0.0f) & (box_distance >= 0.0f);
+		}
+		return inside ? 1u : 0u;
+	}
+
+	static std::size_t Scalar(const BoundingVolumes& volumes, const Frustum& frustum, std::size_t first, std::size_t last, gsl::span<std::uint32_t> visible)
+	{
+		std::size_t count = 0;
+		for (std::size_t i = first; i < last; i++) {
+			if (ScalarTest(volumes, frustum, i)) {
+				visible[count++] = gsl::narrow_cast<std::uint32_t>(i);
+			}
+		}
+		return count;
+	}
+
+	// Appends the set lanes of `mask` as object indices starting at `base`
+	static std::size_t Compact(std::uint32_t mask, std::size_t base, gsl::span<std::uint32_t> visible, std::size_t count)
+	{
+		while (mask != 0) {
+			const std::int32_t lane = std::countr_zero(mask);
+			visible[count++] = gsl::narrow_cast<std::uint32_t>(base + lane);
+			mask &= mask - 1;
+		}
+		return count;
+	}
+
+	static std::uint32_t ValidLanes(std::size_t base, std::size_t last, std::size_t width)
+	{
+		const std::size_t remaining = last - base;
+		return remaining >= width ? (1u << width) - 1u : (1u << remaining) - 1u;
+	}
+
+#if VENG_CULLING_X86
+	static std::size_t Sse(const BoundingVolumes& volumes, const Frustum& frustum, std::size_t first, std::size_t last, gsl::span<std::uint32_t> visible)
+	{
+		constexpr std::size_t kWidth = 4;
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+		std::size_t count = 0;
+		for (std::size_t base = first; base < last; base += kWidth) {
+			const __m128 sphere_x = _mm_loadu_ps(&volumes.sphere_x_[base]);
+			const __m128 sphere_y = _mm_loadu_ps(&volumes.sphere_y_[base]);
+			const __m128 sphere_z = _mm_loadu_ps(&volumes.sphere_z_[base]);
+			const __m128 radius = _mm_loadu_ps(&volumes.sphere_radius_[base]);
+			const __m128 box_x = _mm_loadu_ps(&volumes.box_center_x_[base]);
+			const __m128 box_y = _mm_loadu_ps(&volumes.box_center_y_[base]);
+			const __m128 box_z = _mm_loadu_ps(&volumes.box_center_z_[base]);
+			const __m128 extent_x = _mm_loadu_ps(&volumes.box_extent_x_[base]);
+			const __m128 extent_y = _mm_loadu_ps(&volumes.box_extent_y_[base]);
+			const __m128 extent_z = _mm_loadu_ps(&volumes.box_extent_z_[base]);
+
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (const glm::vec4& plane : frustum.planes) {
+				const __m128 nx = _mm_set1_ps(plane.x);
+				const __m128 ny = _mm_set1_ps(plane.y);
+				const __m128 nz = _mm_set1_ps(plane.z);
+				const __m128 nw = _mm_set1_ps(plane.w);
+
+				__m128 sphere_distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, sphere_x), _mm_mul_ps(ny, sphere_y)), _mm_add_ps(_mm_mul_ps(nz, sphere_z), nw));
+				sphere_distance = _mm_add_ps(sphere_distance, radius);
+
+				__m128 box_distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, box_x), _mm_mul_ps(ny, box_y)), _mm_add_ps(_mm_mul_ps(nz, box_z), nw));
+				const __m128 box_radius = _mm_add_ps(
+				    _mm_add_ps(_mm_mul_ps(_mm_and_ps(nx, abs_mask), extent_x), _mm_mul_ps(_mm_and_ps(ny, abs_mask), extent_y)),
+				    _mm_mul_ps(_mm_and_ps(nz, abs_mask), extent_z));
+				box_distance = _mm_add_ps(box_distance, box_radius);
+
+				inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmpge_ps(sphere_distance, zero), _mm_cmpge_ps(box_distance, zero)));
+			}
+
+			const std::uint32_t mask = static_cast<std::uint32_t>(_mm_movemask_ps(inside)) & ValidLanes(base, last, kWidth);
+			count = Compact(mask, base, visible, count);
+		}
+		return count;
+	}
+
+	VENG_TARGET_AVX2 static std::size_t Avx2(
+	    const BoundingVolumes& volumes, const Frustum& frustum, std::size_t first, std::size_t last, gsl::span<std::uint32_t> visible)
+	{
+		constexpr std::size_t kWidth = 8;
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+
+		std::size_t count = 0;
+		for (std::size_t base = first; base < last; base += kWidth) {
+			const __m256 sphere_x = _mm256_loadu_ps(&volumes.sphere_x_[base]);
+			const __m256 sphere_y = _mm256_loadu_ps(&volumes.sphere_y_[base]);
+			const __m256 sphere_z = _mm256_loadu_ps(&volumes.sphere_z_[base]);
+			const __m256 radius = _mm256_loadu_ps(&volumes.sphere_radius_[base]);
+			const __m256 box_x = _mm256_loadu_ps(&volumes.box_center_x_[base]);
+			const __m256 box_y = _mm256_loadu_ps(&volumes.box_center_y_[base]);
+			const __m256 box_z = _mm256_loadu_ps(&volumes.box_center_z_[base]);
+			const __m256 extent_x = _mm256_loadu_ps(&volumes.box_extent_x_[base]);
+			const __m256 extent_y = _mm256_loadu_ps(&volumes.box_extent_y_[base]);
+			const __m256 extent_z = _mm256_loadu_ps(&volumes.box_extent_z_[base]);
+
+			__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for (const glm::vec4& plane : frustum.planes) {
+				const __m256 nx = _mm256_set1_ps(plane.x);
+				const __m256 ny = _mm256_set1_ps(plane.y);
+				const __m256 nz = _mm256_set1_ps(plane.z);
+				const __m256 nw = _mm256_set1_ps(plane.w);
+
+				__m256 sphere_distance = _mm256_fmadd_ps(nx, sphere_x, _mm256_fmadd_ps(ny, sphere_y, _mm256_fmadd_ps(nz, sphere_z, nw)));
+				sphere_distance = _mm256_add_ps(sphere_distance, radius);
+
+				__m256 box_distance = _mm256_fmadd_ps(nx, box_x, _mm256_fmadd_ps(ny, box_y, _mm256_fmadd_ps(nz, box_z, nw)));
+				box_distance = _mm256_fmadd_ps(_mm256_and_ps(nx, abs_mask), extent_x, box_distance);
+				box_distance = _mm256_fmadd_ps(_mm256_and_ps(ny, abs_mask), extent_y, box_distance);
+				box_distance = _mm256_fmadd_ps(_mm256_and_ps(nz, abs_mask), extent_z, box_distance);
+
+				inside = _mm256_and_ps(inside, _mm256_and_ps(_mm256_cmp_ps(sphere_distance, zero, _CMP_GE_OQ), _mm256_cmp_ps(box_distance, zero, _CMP_GE_OQ)));
+			}
+
+			const std::uint32_t mask = static_cast<std::uint32_t>(_mm256_movemask_ps(inside)) & ValidLanes(base, last, kWidth);
+			count = Compact(mask, base, visible, count);
+		}
+		return count;
+	}
+#endif
+};
+
+#pragma endregion
+
+CullingKernel DetectCullingKernel()
+{
+#if VENG_CULLING_X86
+#if defined(_MSC_VER)
+	std::array<std::int32_t, 4> info;
+	__cpuid(info.data(), 1);
+	const bool os_saves_ymm = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && ((_xgetbv(0) & 0x6) == 0x6);
+	const bool has_fma = info[2] & (1 << 12);
+	__cpuidex(info.data(), 7, 0);
+	const bool has_avx2 = info[1] & (1 << 5);
+	if (os_saves_ymm && has_fma && has_avx2) {
+		return CullingKernel::kAvx2;
+	}
+#else
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+		return CullingKernel::kAvx2;
+	}
+#endif
+	return CullingKernel::kSse;
+#else
+	return CullingKernel::kScalar;
+#endif
+}
+
+gsl::czstring GetCullingKernelName(CullingKernel kernel)
+{
+	switch (kernel) {
+		case CullingKernel::kSse:
+			return "SSE";
+		case CullingKernel::kAvx2:
+			return "AVX2";
+		default:
+			return "Scalar";
+	}
+}
+
+std::size_t CullFrustum(
+    const BoundingVolumes& volumes, const Frustum& frustum, std::size_t first, std::size_t last, gsl::span<std::uint32_t> visible, CullingKernel kernel)
+{
+	Expects(first % BoundingVolumes::kLaneWidth == 0);
+	Expects(last <= volumes.Size());
+
+	if (first >= last) {
+		return 0;
+	}
+
+	switch (kernel) {
+#if VENG_CULLING_X86
+		case CullingKernel::kAvx2:
+			return CullingKernels::Avx2(volumes, frustum, first, last, visible);
+		case CullingKernel::kSse:
+			return CullingKernels::Sse(volumes, frustum, first, last, visible);
+#endif
+		default:
+			return CullingKernels::Scalar(volumes, frustum, first, last, visible);
+	}
+}
+
+std::size_t CullFrustum(const BoundingVolumes& volumes, const Frustum& frustum, gsl::span<std::uint32_t> visible, CullingKernel kernel)
+{
+	return CullFrustum(volumes, frustum, 0, volumes.Size(), visible, kernel);
+}
+
+std::size_t CullFrustum(const BoundingVolumes& volumes, const Frustum& frustum, gsl::span<std::uint32_t> visible, CullingKernel kernel, JobSystem& jobs)
+{
+	// Blocks are sized so the per-block counts fit on the stack
+	constexpr std::size_t kMaxBlocks = 256;
+	constexpr std::size_t kMinBlockSize = 4096;
+
+	const std::size_t count = volumes.Size();
+	std::size_t block_size = std::max(kMinBlockSize, (count + kMaxBlocks - 1) / kMaxBlocks);
+	block_size = (block_size + BoundingVolumes::kLaneWidth - 1) / BoundingVolumes::kLaneWidth * BoundingVolumes::kLaneWidth;
+	const std::size_t block_count = (count + block_size - 1) / block_size;
+
+	if (block_count <= 1) {
+		return CullFrustum(volumes, frustum, visible, kernel);
+	}
+
+	// Each block writes its survivors at its own offset, which can never overlap the next block
+	std::array<std::size_t, kMaxBlocks> block_visible = {};
+	jobs.ParallelFor(block_count, 1, [&](std::size_t first_block, std::size_t last_block) {
+		for (std::size_t block = first_block; block < last_block; block++) {
+			const std::size_t first = block * block_size;
+			const std::size_t last = std::min(first + block_size, count);
+			block_visible[block] = CullFrustum(volumes, frustum, first, last, visible.subspan(first), kernel);
+		}
+	});
+
+	std::size_t total = block_visible[0];
+	for (std::size_t block = 1; block < block_count; block++) {
+		std::copy_n(visible.begin() + block * block_size, block_visible[block], visible.begin() + total);
+		total += block_visible[block];
+	}
+	return total;
+}
+
+}  // namespace veng
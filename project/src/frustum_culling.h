@@ -0,0 +1,76 @@
+#pragma once
+
+#include <array>
+#include <job_system.h>
+#include <vector>
+
+namespace veng {
+
+// Six inward-facing planes (xyz normal, w distance), normalized so distances are in world units.
+struct Frustum {
+	std::array<glm::vec4, 6> planes;
+
+	// Gribb-Hartmann extraction for Vulkan [0, 1] clip depth. Works with the infinite
+	// reverse-Z projection too: the degenerate far plane becomes an always-pass plane.
+	static Frustum FromViewProjection(const glm::mat4& view_projection);
+};
+
+enum class CullingKernel {
+	kScalar,
+	kSse,   // 4 objects per iteration
+	kAvx2,  // 8 objects per iteration
+};
+
+CullingKernel DetectCullingKernel();
+gsl::czstring GetCullingKernelName(CullingKernel kernel);
+
+// Structure-of-arrays bounding volumes: a sphere and an AABB (stored as center/extents)
+// per object. Arrays are padded to kLaneWidth with volumes that are always culled, so the
+// SIMD kernels never need a scalar tail.
+class BoundingVolumes {
+public:
+	static constexpr std::size_t kLaneWidth = 8;
+
+	std::uint32_t Add(const glm::vec3& sphere_center, std::float_t sphere_radius, const glm::vec3& aabb_min, const glm::vec3& aabb_max);
+	void Set(std::uint32_t index, const glm::vec3& sphere_center, std::float_t sphere_radius, const glm::vec3& aabb_min, const glm::vec3& aabb_max);
+	void Reserve(std::size_t count);
+	void Clear();
+
+	std::size_t Size() const { return size_; }
+	std::size_t PaddedSize() const { return sphere_radius_.size(); }
+
+private:
+	friend struct CullingKernels;
+
+	void Pad();
+
+	std::size_t size_ = 0;
+
+	std::vector<std::float_t> sphere_x_;
+	std::vector<std::float_t> sphere_y_;
+	std::vector<std::float_t> sphere_z_;
+	std::vector<std::float_t> sphere_radius_;
+
+	std::vector<std::float_t> box_center_x_;
+	std::vector<std::float_t> box_center_y_;
+	std::vector<std::float_t> box_center_z_;
+	std::vector<std::float_t> box_extent_x_;
+	std::vector<std::float_t> box_extent_y_;
+	std::vector<std::float_t> box_extent_z_;
+};
+
+// Writes the indices of objects whose sphere and AABB both intersect the frustum into
+// `visible`, in ascending order, and returns how many were written. `visible` must hold at
+// least volumes.Size() entries; nothing is allocated.
+std::size_t CullFrustum(const BoundingVolumes& volumes, const Frustum& frustum, gsl::span<std::uint32_t> visible, CullingKernel kernel);
+
+// Same as above over objects [first, last). `first` must be a multiple of kLaneWidth so
+// ranges can be culled independently and concatenated.
+std::size_t CullFrustum(
+    const BoundingVolumes& volumes, const Frustum& frustum, std::size_t first, std::size_t last, gsl::span<std::uint32_t> visible, CullingKernel kernel);
+
+// Culls fixed-size blocks on the job system, then compacts the per-block results in place.
+// Output is identical to the single-threaded version.
+std::size_t CullFrustum(const BoundingVolumes& volumes, const Frustum& frustum, gsl::span<std::uint32_t> visible, CullingKernel kernel, JobSystem& jobs);
+
+}  // namespace veng
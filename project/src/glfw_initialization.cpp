@@ -7,7 +7,7 @@ namespace veng
 
 void glfw_error_callback(std::int32_t error_code, gsl::czstring message)
 {
-	spdlog::error("Glfw Validation: {}", message);
+	SPDLOG_ERROR("Glfw Validation: {}", message);
 }
 
 GlfwInitialization::GlfwInitialization()
@@ -5,9 +5,10 @@
 
 namespace veng {
 
-Window::Window(gsl::czstring name, glm::ivec2 size)
+Window::Window(gsl::czstring name, glm::ivec2 size, bool visible)
 {
 	glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+	glfwWindowHint(GLFW_VISIBLE, visible ? GLFW_TRUE : GLFW_FALSE);
 	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
 	window_ = glfwCreateWindow(size.x, size.y, name, nullptr, nullptr);
 	if (window_ == nullptr)
@@ -5,7 +5,8 @@ struct GLFWwindow;
 namespace veng {
 class Window {
 public:
-	Window(gsl::czstring name, glm::ivec2 size);
+	// A hidden window still has a size, e.g. for offscreen rendering
+	Window(gsl::czstring name, glm::ivec2 size, bool visible = true);
 	~Window();
 
 	glm::ivec2 GetWindowSize() const;
@@ -1,6 +1,10 @@
 #include <precomp.h>
 #include <graphics.h>
+#include <allocation_counter.h>
+#include <logging.h>
+#include <task_graph.h>
 #include <GLFW/glfw3.h>
+#include <algorithm>
 #include <iostream>
 #include <spdlog/spdlog.h>
 #include <set>
@@ -37,20 +41,26 @@ namespace veng {
 static VKAPI_ATTR VkBool32 VKAPI_CALL ValidationCallback(
     VkDebugUtilsMessageSeverityFlagBitsEXT severity, VkDebugUtilsMessageTypeFlagsEXT type, const VkDebugUtilsMessengerCallbackDataEXT* callback_data, void* user_data)
 {
+	// Runs on whichever thread made the offending call; repeats are dropped before formatting
+	ValidationMessageFilter* filter = static_cast<ValidationMessageFilter*>(user_data);
+	if (filter != nullptr && !filter->ShouldLog(callback_data->messageIdNumber, callback_data->pMessageIdName)) {
+		return VK_FALSE;
+	}
+
 	if (severity > VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT) {
-		spdlog::error("Vulkan Validation: {}", callback_data->pMessage);
+		SPDLOG_ERROR("Vulkan Validation: {}", callback_data->pMessage);
 	}
 	else if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT) {
-		spdlog::warn("Vulkan Validation: {}", callback_data->pMessage);
+		SPDLOG_WARN("Vulkan Validation: {}", callback_data->pMessage);
 	}
 	else {
-		spdlog::debug("Vulkan Validation: {}", callback_data->pMessage);
+		SPDLOG_DEBUG("Vulkan Validation: {}", callback_data->pMessage);
 	}
 
 	return VK_FALSE;
 }
 
-static VkDebugUtilsMessengerCreateInfoEXT GetCreateMessengerInfo()
+static VkDebugUtilsMessengerCreateInfoEXT GetCreateMessengerInfo(ValidationMessageFilter* filter)
 {
 	VkDebugUtilsMessengerCreateInfoEXT creation_info = {};
 	creation_info.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
@@ -59,12 +69,12 @@ static VkDebugUtilsMessengerCreateInfoEXT GetCreateMessengerInfo()
 	creation_info.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT;
 
 	creation_info.pfnUserCallback = ValidationCallback;
-	creation_info.pUserData = nullptr;
+	creation_info.pUserData = filter;
 
 	return creation_info;
 }
 
-std::vector<VkLayerProperties> Graphics::GetSupportedValidationLayers()
+std::pmr::vector<VkLayerProperties> Graphics::GetSupportedValidationLayers(std::pmr::memory_resource* memory)
 {
 	std::uint32_t count;
 	vkEnumerateInstanceLayerProperties(&count, nullptr);
@@ -73,23 +83,24 @@ std::vector<VkLayerProperties> Graphics::GetSupportedValidationLayers()
 		return {};
 	}
 
-	std::vector<VkLayerProperties> properties(count);
+	std::pmr::vector<VkLayerProperties> properties(count, memory);
 	vkEnumerateInstanceLayerProperties(&count, properties.data());
 	return properties;
 }
 
-bool Graphics::AreAllLayersSupported(gsl::span<gsl::czstring> extensions)
+bool Graphics::AreAllLayersSupported(gsl::span<gsl::czstring> extensions, std::pmr::memory_resource* memory)
 {
-	std::vector<VkLayerProperties> supported_layers = GetSupportedValidationLayers();
+	std::pmr::vector<VkLayerProperties> supported_layers = GetSupportedValidationLayers(memory);
 
-	return std::all_of(extensions.begin(), extensions.end(), std::bind_front(IsLayerSupported, supported_layers));
+	// Bound as a span: binding the vector would copy it into the default resource
+	return std::all_of(extensions.begin(), extensions.end(), std::bind_front(IsLayerSupported, gsl::span<VkLayerProperties>(supported_layers)));
 }
 
-Graphics::QueueFamilyIndices Graphics::FindQueueFamilies(VkPhysicalDevice device)
+Graphics::QueueFamilyIndices Graphics::FindQueueFamilies(VkPhysicalDevice device, std::pmr::memory_resource* memory)
 {
-	std::uint_fast32_t queue_family_count = 0;
+	std::uint32_t queue_family_count = 0;
 	vkGetPhysicalDeviceQueueFamilyProperties(device, &queue_family_count, nullptr);
-	std::vector<VkQueueFamilyProperties> families(queue_family_count);
+	std::pmr::vector<VkQueueFamilyProperties> families(queue_family_count, memory);
 	vkGetPhysicalDeviceQueueFamilyProperties(device, &queue_family_count, families.data());
 
 	auto graphics_family_it = std::find_if(families.begin(), families.end(), [device](const VkQueueFamilyProperties& property) {
@@ -99,9 +110,19 @@ Graphics::QueueFamilyIndices Graphics::FindQueueFamilies(VkPhysicalDevice device
 	QueueFamilyIndices result;
 	result.graphics_family = graphics_family_it - families.begin();
 
+	// Nothing is presented, so the graphics queue stands in for the presentation queue
+	if (settings_.offscreen) {
+		result.presentation_family = result.graphics_family;
+		return result;
+	}
+
+	// One queue presents all windows at once, so its family must reach every surface
 	for (std::uint32_t i = 0; i < families.size(); i++) {
-		VkBool32 has_presentation_support = false;
-		vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &has_presentation_support);
+		const bool has_presentation_support = std::all_of(surfaces_.begin(), surfaces_.end(), [device, i](const WindowSurface& surface) {
+			VkBool32 supported = false;
+			vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface.surface, &supported);
+			return supported == VK_TRUE;
+		});
 		if (has_presentation_support) {
 			result.presentation_family = i;
 			break;
@@ -111,20 +132,20 @@ Graphics::QueueFamilyIndices Graphics::FindQueueFamilies(VkPhysicalDevice device
 	return result;
 }
 
-Graphics::SwapChainProperties Graphics::GetSwapChainProperties(VkPhysicalDevice device)
+Graphics::SwapChainProperties Graphics::GetSwapChainProperties(VkPhysicalDevice device, VkSurfaceKHR surface, std::pmr::memory_resource* memory)
 {
-	SwapChainProperties properties;
+	SwapChainProperties properties(memory);
 
-	vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface_, &properties.capabilities);
+	vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface, &properties.capabilities);
 
 	std::uint32_t count;
-	vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface_, &count, nullptr);
+	vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &count, nullptr);
 	properties.formats.resize(count);
-	vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface_, &count, properties.formats.data());
+	vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &count, properties.formats.data());
 
-	vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface_, &count, nullptr);
+	vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &count, nullptr);
 	properties.present_modes.resize(count);
-	vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface_, &count, properties.present_modes.data());
+	vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &count, properties.present_modes.data());
 
 	return properties;
 }
@@ -135,11 +156,12 @@ void Graphics::SetupDebugMessenger()
 		return;
 	}
 
-	VkDebugUtilsMessengerCreateInfoEXT info = GetCreateMessengerInfo();
-	VkResult result = vkCreateDebugUtilsMessengerEXT(instance_, &info, nullptr, &debug_messenger_);
+	VkDebugUtilsMessengerCreateInfoEXT info = GetCreateMessengerInfo(&validation_filter_);
+	const VkAllocationCallbacks* allocator = GetHostAllocator(VK_OBJECT_TYPE_DEBUG_UTILS_MESSENGER_EXT);
+	VkResult result = vkCreateDebugUtilsMessengerEXT(instance_, &info, allocator, debug_messenger_.Put(instance_, allocator));
 
 	if (result != VK_SUCCESS) {
-		spdlog::error("Cannot create debug messenger");
+		SPDLOG_ERROR("Cannot create debug messenger");
 		return;
 	}
 }
@@ -156,22 +178,22 @@ gsl::span<gsl::czstring> Graphics::GetSuggestedInstanceExtensions()
 	return gsl::span<gsl::czstring>(glfwExtensions, glfwExtensionCount);
 }
 
-std::vector<gsl::czstring> Graphics::GetRequiredInstanceExtensions()
+std::pmr::vector<gsl::czstring> Graphics::GetRequiredInstanceExtensions(std::pmr::memory_resource* memory)
 {
 	gsl::span<gsl::czstring> suggested_extensions = GetSuggestedInstanceExtensions();
-	std::vector<gsl::czstring> required_extensions(suggested_extensions.size());
+	std::pmr::vector<gsl::czstring> required_extensions(suggested_extensions.size(), memory);
 	std::copy(suggested_extensions.begin(), suggested_extensions.end(), required_extensions.begin());
 
 	if (validation_enabled_) {
 		required_extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
 	}
-	if (!AreAllExtensionsSupported(required_extensions)) {
-		std::exit(EXIT_FAILURE);
+	if (!AreAllExtensionsSupported(required_extensions, memory)) {
+		throw std::runtime_error("Required instance extensions are not supported");
 	}
 
 	return required_extensions;
 }
-std::vector<VkExtensionProperties> Graphics::GetSupportedInstanceExtensions()
+std::pmr::vector<VkExtensionProperties> Graphics::GetSupportedInstanceExtensions(std::pmr::memory_resource* memory)
 {
 	std::uint32_t count;
 	vkEnumerateInstanceExtensionProperties(nullptr, &count, nullptr);
@@ -180,7 +202,7 @@ std::vector<VkExtensionProperties> Graphics::GetSupportedInstanceExtensions()
 		return {};
 	}
 
-	std::vector<VkExtensionProperties> properties(count);
+	std::pmr::vector<VkExtensionProperties> properties(count, memory);
 	vkEnumerateInstanceExtensionProperties(nullptr, &count, properties.data());
 	return properties;
 }
@@ -195,11 +217,11 @@ bool IsExtensionSupported(const gsl::span<VkExtensionProperties> properties, gsl
 	return std::any_of(properties.begin(), properties.end(), std::bind_front(ExtensionMatchesName, name));
 }
 
-bool Graphics::AreAllExtensionsSupported(gsl::span<gsl::czstring> extensions)
+bool Graphics::AreAllExtensionsSupported(gsl::span<gsl::czstring> extensions, std::pmr::memory_resource* memory)
 {
-	std::vector<VkExtensionProperties> supported_extensions = GetSupportedInstanceExtensions();
+	std::pmr::vector<VkExtensionProperties> supported_extensions = GetSupportedInstanceExtensions(memory);
 
-	return std::all_of(extensions.begin(), extensions.end(), std::bind_front(IsExtensionSupported, supported_extensions));
+	return std::all_of(extensions.begin(), extensions.end(), std::bind_front(IsExtensionSupported, gsl::span<VkExtensionProperties>(supported_extensions)));
 }
 
 bool LayerMatchesName(gsl::czstring name, const VkLayerProperties& properties)
@@ -216,57 +238,72 @@ bool IsLayerSupported(const gsl::span<VkLayerProperties> properties, gsl::czstri
 
 #pragma region DEVICES_AND_QUEUES
 
-std::vector<VkExtensionProperties> Graphics::GetDeviceAvailableExtensions(VkPhysicalDevice device)
+std::pmr::vector<VkExtensionProperties> Graphics::GetDeviceAvailableExtensions(VkPhysicalDevice device, std::pmr::memory_resource* memory)
 {
 	std::uint32_t available_extensions_count;
 	vkEnumerateDeviceExtensionProperties(device, nullptr, &available_extensions_count, nullptr);
-	std::vector<VkExtensionProperties> available_extensions(available_extensions_count);
+	std::pmr::vector<VkExtensionProperties> available_extensions(available_extensions_count, memory);
 	vkEnumerateDeviceExtensionProperties(device, nullptr, &available_extensions_count, available_extensions.data());
 	return available_extensions;
 }
 
+gsl::span<const gsl::czstring> Graphics::GetRequiredDeviceExtensions() const
+{
+	// Offscreen rendering needs no swapchain
+	if (settings_.offscreen) {
+		return {};
+	}
+	return required_device_extensions_;
+}
+
 bool Graphics::AreAllDeviceExtensionsSupported(VkPhysicalDevice device)
 {
-	std::vector<VkExtensionProperties> available_extensions = GetDeviceAvailableExtensions(device);
+	std::pmr::vector<VkExtensionProperties> available_extensions = GetDeviceAvailableExtensions(device, GetScratchMemory());
+	gsl::span<const gsl::czstring> required_extensions = GetRequiredDeviceExtensions();
 
-	return std::all_of(required_device_extensions_.begin(), required_device_extensions_.end(), std::bind_front(IsExtensionSupported, available_extensions));
+	return std::all_of(required_extensions.begin(), required_extensions.end(), std::bind_front(IsExtensionSupported, gsl::span<VkExtensionProperties>(available_extensions)));
 }
 
 bool Graphics::IsDeviceSuitable(VkPhysicalDevice device)
 {
-	QueueFamilyIndices families = FindQueueFamilies(device);
-	return families.IsValid() && AreAllDeviceExtensionsSupported(device) && GetSwapChainProperties(device).IsValid();
+	QueueFamilyIndices families = FindQueueFamilies(device, GetScratchMemory());
+	const bool swap_chains_supported = settings_.offscreen || std::all_of(surfaces_.begin(), surfaces_.end(), [this, device](const WindowSurface& surface) {
+		return GetSwapChainProperties(device, surface.surface, GetScratchMemory()).IsValid();
+	});
+	return families.IsValid() && AreAllDeviceExtensionsSupported(device) && swap_chains_supported;
 }
 
 void Graphics::PickPhysicalDevice()
 {
-	std::vector<VkPhysicalDevice> devices = GetAvailableDevices();
+	std::pmr::vector<VkPhysicalDevice> devices = GetAvailableDevices(GetScratchMemory());
 
 	std::erase_if(devices, std::not_fn(std::bind_front(&Graphics::IsDeviceSuitable, this)));
 
 	if (devices.empty()) {
-		spdlog::error("No physical devices");
-		std::exit(EXIT_FAILURE);
+		throw std::runtime_error("No physical devices");
 	}
 
 	// score and order them...
 
 	physical_device_ = devices[0];
+	vkGetPhysicalDeviceMemoryProperties(physical_device_, &memory_properties_);
+	memory_budgets_.resize(memory_properties_.memoryHeapCount);
 }
 
 void Graphics::CreateLogicalDeviceAndQueues()
 {
-	QueueFamilyIndices picked_device_families = FindQueueFamilies(physical_device_);
+	QueueFamilyIndices picked_device_families = FindQueueFamilies(physical_device_, GetScratchMemory());
 
 	if (!picked_device_families.IsValid()) {
-		std::exit(EXIT_FAILURE);
+		throw std::runtime_error("The physical device has no graphics or presentation queue");
 	}
 
-	std::set<std::uint32_t> unique_queue_families = {picked_device_families.graphics_family.value(), picked_device_families.presentation_family.value()};
+	std::pmr::set<std::uint32_t> unique_queue_families(
+	    {picked_device_families.graphics_family.value(), picked_device_families.presentation_family.value()}, GetScratchMemory());
 
 	std::float_t queue_priority = 1.0f;
 
-	std::vector<VkDeviceQueueCreateInfo> queue_create_infos;
+	std::pmr::vector<VkDeviceQueueCreateInfo> queue_create_infos(GetScratchMemory());
 	for (std::uint32_t unique_queue_family : unique_queue_families) {
 		VkDeviceQueueCreateInfo queue_info = {};
 
@@ -277,29 +314,60 @@ void Graphics::CreateLogicalDeviceAndQueues()
 		queue_create_infos.push_back(queue_info);
 	}
 
-	VkPhysicalDeviceFeatures required_features = {};
+	gsl::span<const gsl::czstring> required_extensions = GetRequiredDeviceExtensions();
+	enabled_device_extensions_.assign(required_extensions.begin(), required_extensions.end());
+
+	std::pmr::vector<VkExtensionProperties> available_extensions = GetDeviceAvailableExtensions(physical_device_, GetScratchMemory());
+	DeviceFeatureChain supported_features;
+	DeviceFeatureChain enabled_features;
+	device_features_ = NegotiateDeviceFeatures(
+	    physical_device_, instance_api_version_, available_extensions, supported_features, enabled_features, enabled_device_extensions_);
 
 	VkDeviceCreateInfo device_info = {};
 
 	device_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 	device_info.queueCreateInfoCount = queue_create_infos.size();
 	device_info.pQueueCreateInfos = queue_create_infos.data();
-	device_info.pEnabledFeatures = &required_features;
-	device_info.enabledExtensionCount = required_device_extensions_.size();
-	device_info.ppEnabledExtensionNames = required_device_extensions_.data();
+	device_info.enabledExtensionCount = enabled_device_extensions_.size();
+	device_info.ppEnabledExtensionNames = enabled_device_extensions_.data();
 	device_info.enabledLayerCount = 0;  // deprecated
 
-	VkResult result = vkCreateDevice(physical_device_, &device_info, nullptr, &logical_device_);
+	// VkPhysicalDeviceFeatures2 in pNext replaces pEnabledFeatures, which needs 1.1
+	if (device_features_.api_version >= VK_API_VERSION_1_1) {
+		device_info.pNext = &enabled_features.core;
+		device_info.pEnabledFeatures = nullptr;
+	}
+	else {
+		device_info.pEnabledFeatures = &enabled_features.core.features;
+	}
+
+	const VkAllocationCallbacks* allocator = GetHostAllocator(VK_OBJECT_TYPE_DEVICE);
+	VkResult result = vkCreateDevice(physical_device_, &device_info, allocator, logical_device_.Put(allocator));
 
 	if (result != VK_SUCCESS) {
-		std::exit(EXIT_FAILURE);
+		throw std::runtime_error("Failed to create the logical device");
 	}
 
+	layout_cache_.emplace(logical_device_, GetHostAllocator(VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT), GetHostAllocator(VK_OBJECT_TYPE_PIPELINE_LAYOUT));
+
+	queue_families_ = picked_device_families;
 	vkGetDeviceQueue(logical_device_, picked_device_families.graphics_family.value(), 0, &graphics_queue_);
 	vkGetDeviceQueue(logical_device_, picked_device_families.presentation_family.value(), 0, &presentation_queue_);
+
+	if (device_features_.dynamic_rendering) {
+		gsl::czstring begin_name = device_features_.api_version >= VK_API_VERSION_1_3 ? "vkCmdBeginRendering" : "vkCmdBeginRenderingKHR";
+		gsl::czstring end_name = device_features_.api_version >= VK_API_VERSION_1_3 ? "vkCmdEndRendering" : "vkCmdEndRenderingKHR";
+		cmd_begin_rendering_ = reinterpret_cast<PFN_vkCmdBeginRenderingKHR>(vkGetDeviceProcAddr(logical_device_, begin_name));
+		cmd_end_rendering_ = reinterpret_cast<PFN_vkCmdEndRenderingKHR>(vkGetDeviceProcAddr(logical_device_, end_name));
+
+		if (cmd_begin_rendering_ == nullptr || cmd_end_rendering_ == nullptr) {
+			SPDLOG_WARN("Dynamic rendering entry points missing, falling back to render passes");
+			device_features_.dynamic_rendering = false;
+		}
+	}
 }
 
-std::vector<VkPhysicalDevice> Graphics::GetAvailableDevices()
+std::pmr::vector<VkPhysicalDevice> Graphics::GetAvailableDevices(std::pmr::memory_resource* memory)
 {
 	std::uint32_t devices_count;
 	vkEnumeratePhysicalDevices(instance_, &devices_count, nullptr);
@@ -308,7 +376,7 @@ std::vector<VkPhysicalDevice> Graphics::GetAvailableDevices()
 		return {};
 	}
 
-	std::vector<VkPhysicalDevice> devices(devices_count);
+	std::pmr::vector<VkPhysicalDevice> devices(devices_count, memory);
 	vkEnumeratePhysicalDevices(instance_, &devices_count, devices.data());
 
 	return devices;
@@ -318,11 +386,18 @@ std::vector<VkPhysicalDevice> Graphics::GetAvailableDevices()
 
 #pragma region PRESENTATION
 
-void Graphics::CreateSurface()
+void Graphics::CreateSurfaces()
 {
-	VkResult result = glfwCreateWindowSurface(instance_, window_->GetHandle(), nullptr, &surface_);
-	if (result != VK_SUCCESS) {
-		std::exit(EXIT_FAILURE);
+	if (settings_.offscreen) {
+		return;
+	}
+
+	for (WindowSurface& surface : surfaces_) {
+		const VkAllocationCallbacks* allocator = GetHostAllocator(VK_OBJECT_TYPE_SURFACE_KHR);
+		VkResult result = glfwCreateWindowSurface(instance_, surface.window->GetHandle(), allocator, surface.surface.Put(instance_, allocator));
+		if (result != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create a window surface");
+		}
 	}
 }
 
@@ -341,6 +416,17 @@ bool IsCorrectFormat(const VkSurfaceFormatKHR& format_properties)
 	return IsRgbaTypeFormat(format_properties) && IsSrgbColorSpace(format_properties);
 }
 
+// Formats the readback can hand out as 8-bit RGBA
+bool IsReadbackFormat(VkFormat format)
+{
+	return format == VK_FORMAT_R8G8B8A8_SRGB || format == VK_FORMAT_R8G8B8A8_UNORM || format == VK_FORMAT_B8G8R8A8_SRGB || format == VK_FORMAT_B8G8R8A8_UNORM;
+}
+
+bool IsBgraFormat(VkFormat format)
+{
+	return format == VK_FORMAT_B8G8R8A8_SRGB || format == VK_FORMAT_B8G8R8A8_UNORM;
+}
+
 VkSurfaceFormatKHR Graphics::ChooseSwapSurfaceFormat(std::span<VkSurfaceFormatKHR> formats)
 {
 	if (formats.size() == 1 && formats[0].format == VK_FORMAT_UNDEFINED) {
@@ -369,7 +455,7 @@ VkPresentModeKHR Graphics::ChooseSwapPresentMode(std::span<VkPresentModeKHR> pre
 
 	return VK_PRESENT_MODE_FIFO_KHR;
 }
-VkExtent2D Graphics::ChooseSwapExtent(const VkSurfaceCapabilitiesKHR capabilities)
+VkExtent2D Graphics::ChooseSwapExtent(const VkSurfaceCapabilitiesKHR capabilities, glm::ivec2 framebuffer_size)
 {
 	constexpr std::uint32_t kInvalidSize = std::numeric_limits<std::uint32_t>::max();
 
@@ -377,8 +463,7 @@ VkExtent2D Graphics::ChooseSwapExtent(const VkSurfaceCapabilitiesKHR capabilitie
 		return capabilities.currentExtent;
 	}
 	else {
-		glm::ivec2 size = window_->GetFramebufferSize();
-		VkExtent2D actual_extent = {static_cast<std::uint32_t>(size.x), static_cast<std::uint32_t>(size.y)};
+		VkExtent2D actual_extent = {static_cast<std::uint32_t>(framebuffer_size.x), static_cast<std::uint32_t>(framebuffer_size.y)};
 
 		actual_extent.width = std::clamp(actual_extent.width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
 		actual_extent.height = std::clamp(actual_extent.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
@@ -396,31 +481,81 @@ std::uint32_t Graphics::ChooseSwapImageCount(const VkSurfaceCapabilitiesKHR& cap
 	return image_count;
 }
 
-void Graphics::CreateSwapChain()
+void Graphics::CreateSwapChains()
 {
-	SwapChainProperties properties = GetSwapChainProperties(physical_device_);
+	if (settings_.offscreen) {
+		CreateOffscreenTargets();
+		return;
+	}
 
+	// The pipelines are built for a single color format, so the primary window picks it for all
+	SwapChainProperties properties = GetSwapChainProperties(physical_device_, surfaces_[0].surface, GetScratchMemory());
 	surface_format_ = ChooseSwapSurfaceFormat(properties.formats);
-	present_mode_ = ChooseSwapPresentMode(properties.present_modes);
-	extent_ = ChooseSwapExtent(properties.capabilities);
 
+	// Captures copy straight out of the primary swapchain images
+	capture_supported_ = (properties.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) && IsReadbackFormat(surface_format_.format);
+	// The scene is blitted into the swapchain images when rendered at a lower resolution
+	if (settings_.dynamic_resolution.enabled) {
+		dynamic_resolution_ = (properties.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT) && IsBlitSupported(surface_format_.format);
+		if (!dynamic_resolution_) {
+			SPDLOG_WARN("Swapchain images cannot be blit targets, dynamic resolution disabled");
+		}
+		// Its scale follows the GPU time of all windows together, but only the primary would shrink
+		else if (surfaces_.size() > 1) {
+			SPDLOG_WARN("Dynamic resolution needs a single window, it stays off");
+			dynamic_resolution_ = false;
+		}
+	}
+
+	for (WindowSurface& surface : surfaces_) {
+		CreateSwapChain(surface);
+	}
+	render_extent_ = surfaces_[0].extent;
+	final_color_layout_ = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+}
+
+void Graphics::CreateSwapChain(WindowSurface& surface)
+{
+	SwapChainProperties properties = GetSwapChainProperties(physical_device_, surface.surface, GetScratchMemory());
+
+	const bool any_format = properties.formats.size() == 1 && properties.formats[0].format == VK_FORMAT_UNDEFINED;
+	const bool format_supported = any_format || std::any_of(properties.formats.begin(), properties.formats.end(), [this](const VkSurfaceFormatKHR& format) {
+		return format.format == surface_format_.format && format.colorSpace == surface_format_.colorSpace;
+	});
+	if (!format_supported) {
+		throw std::runtime_error("A window does not support the surface format of the primary window");
+	}
+
+	surface.present_mode = ChooseSwapPresentMode(properties.present_modes);
+	surface.extent = ChooseSwapExtent(properties.capabilities, surface.framebuffer_size);
+
+	const bool primary = &surface == &surfaces_.front();
 	std::uint32_t image_count = ChooseSwapImageCount(properties.capabilities);
 	VkSwapchainCreateInfoKHR info = {};
 	info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-	info.surface = surface_;
+	info.surface = surface.surface;
 	info.minImageCount = image_count;
 	info.imageFormat = surface_format_.format;
 	info.imageColorSpace = surface_format_.colorSpace;
-	info.imageExtent = extent_;
+	info.imageExtent = surface.extent;
 	info.imageArrayLayers = 1;
 	info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
-	info.presentMode = present_mode_;
+	if (primary && capture_supported_) {
+		info.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	}
+	if (primary && dynamic_resolution_) {
+		info.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	}
+	info.presentMode = surface.present_mode;
 	info.preTransform = properties.capabilities.currentTransform;
 	info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 	info.clipped = VK_TRUE;
-	info.oldSwapchain = VK_NULL_HANDLE;
+	// Handed over when recreating, so the presentation engine can reuse its resources; it is
+	// destroyed once the new one exists
+	UniqueSwapchain old_swap_chain = std::move(surface.swap_chain);
+	info.oldSwapchain = old_swap_chain;
 
-	QueueFamilyIndices indices = FindQueueFamilies(physical_device_);
+	const QueueFamilyIndices& indices = queue_families_;
 
 	if (indices.graphics_family != indices.presentation_family) {
 		std::array<std::uint32_t, 2> family_indices = {indices.graphics_family.value(), indices.presentation_family.value()};
@@ -433,22 +568,54 @@ void Graphics::CreateSwapChain()
 		info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
 	}
 
-	VkResult result = vkCreateSwapchainKHR(logical_device_, &info, nullptr, &swap_chain_);
+	const VkAllocationCallbacks* allocator = GetHostAllocator(VK_OBJECT_TYPE_SWAPCHAIN_KHR);
+	VkResult result = vkCreateSwapchainKHR(logical_device_, &info, allocator, surface.swap_chain.Put(logical_device_, allocator));
 
 	if (result != VK_SUCCESS) {
-		std::exit(EXIT_FAILURE);
+		throw std::runtime_error("Failed to create a swapchain");
 	}
 	std::uint32_t actual_image_count;
-	vkGetSwapchainImagesKHR(logical_device_, swap_chain_, &actual_image_count, nullptr);
-	swap_chain_images_.resize(actual_image_count);
-	vkGetSwapchainImagesKHR(logical_device_, swap_chain_, &actual_image_count, swap_chain_images_.data());
+	vkGetSwapchainImagesKHR(logical_device_, surface.swap_chain, &actual_image_count, nullptr);
+	surface.images.resize(actual_image_count);
+	vkGetSwapchainImagesKHR(logical_device_, surface.swap_chain, &actual_image_count, surface.images.data());
+}
+
+void Graphics::CreateOffscreenTargets()
+{
+	WindowSurface& surface = surfaces_.front();
+	const glm::ivec2 size = surface.framebuffer_size;
+	surface_format_ = {VK_FORMAT_R8G8B8A8_SRGB, VK_COLORSPACE_SRGB_NONLINEAR_KHR};
+	surface.extent = {static_cast<std::uint32_t>(std::max(size.x, 1)), static_cast<std::uint32_t>(std::max(size.y, 1))};
+
+	// One per frame in flight, indexed like the frames; left ready to be copied out
+	offscreen_targets_.clear();
+	surface.images.clear();
+	dynamic_resolution_ = settings_.dynamic_resolution.enabled && IsBlitSupported(surface_format_.format);
+	if (settings_.dynamic_resolution.enabled && !dynamic_resolution_) {
+		SPDLOG_WARN("Offscreen format cannot be blitted, dynamic resolution disabled");
+	}
+	render_extent_ = surface.extent;
+	const VkImageUsageFlags usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	for (std::uint32_t i = 0; i < settings_.frames_in_flight; i++) {
+		offscreen_targets_.push_back(CreateImage(surface.extent, surface_format_.format, usage, VK_IMAGE_ASPECT_COLOR_BIT));
+		surface.images.push_back(offscreen_targets_.back().image);
+	}
+	final_color_layout_ = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	capture_supported_ = true;
 }
 
 void Graphics::CreateImageViews()
 {
-	swap_chain_image_views_.resize(swap_chain_images_.size());
-	std::vector<VkImageView>::iterator image_view_it = swap_chain_image_views_.begin();
-	for (VkImage image : swap_chain_images_) {
+	for (WindowSurface& surface : surfaces_) {
+		CreateImageViews(surface);
+	}
+}
+
+void Graphics::CreateImageViews(WindowSurface& surface)
+{
+	surface.image_views.resize(surface.images.size());
+	std::vector<UniqueImageView>::iterator image_view_it = surface.image_views.begin();
+	for (VkImage image : surface.images) {
 		VkImageViewCreateInfo info = {};
 		info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
 		info.image = image;
@@ -463,396 +630,3499 @@ void Graphics::CreateImageViews()
 		info.subresourceRange.levelCount = 1;
 		info.subresourceRange.baseArrayLayer = 0;
 		info.subresourceRange.layerCount = 1;
-		VkResult result = vkCreateImageView(logical_device_, &info, nullptr, &(*image_view_it));
+		const VkAllocationCallbacks* allocator = GetHostAllocator(VK_OBJECT_TYPE_IMAGE_VIEW);
+		VkResult result = vkCreateImageView(logical_device_, &info, allocator, image_view_it->Put(logical_device_, allocator));
 		if (result != VK_SUCCESS) {
-			std::exit(EXIT_FAILURE);
+			throw std::runtime_error("Failed to create a swapchain image view");
 		}
-		std::next(image_view_it) /* ++ image_view_it */;
+		++image_view_it;
 	}
 }
 
-#pragma endregion
-
-#pragma region GRAPHICS_PIPELINE
-
-VkShaderModule Graphics::CreateShaderModule(gsl::span<std::uint8_t> buffer)
+bool Graphics::RecreateSwapChain(WindowSurface& surface)
 {
-	if (!buffer.size()) {
-		return VK_NULL_HANDLE;
+	// Minimized: there is no extent to create a swapchain for, it stays out of date
+	const glm::ivec2 size = surface.window->GetFramebufferSize();
+	if (size.x <= 0 || size.y <= 0) {
+		return false;
+	}
+	surface.framebuffer_size = size;
+
+	// Rare enough to simply wait for the GPU: the attachments below are shared by every frame
+	vkDeviceWaitIdle(logical_device_);
+	frame_allocations_expected_ = true;
+	CreateSwapChain(surface);
+	CreateImageViews(surface);
+	CreatePresentSemaphores(surface);
+	surface.out_of_date = false;
+
+	// Depth and multisampled color cover the largest window, the scene targets and the depth
+	// pyramid the primary one
+	CreateColorImage();
+	CreateDepthImage();
+	CreateSceneTargets();
+	CreateDepthPyramid();
+	if (!device_features_.dynamic_rendering) {
+		CreateFramebuffers();
 	}
+	ScaleRenderExtent();
 
-	VkShaderModuleCreateInfo info = {};
-	info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	info.codeSize = buffer.size();
-	info.pCode = reinterpret_cast<std::uint32_t*>(buffer.data());
+	SPDLOG_INFO("Swapchain recreated at {}x{}", surface.extent.width, surface.extent.height);
+	return true;
+}
+
+#pragma endregion
 
-	VkShaderModule shader_module;
-	VkResult result = vkCreateShaderModule(logical_device_, &info, nullptr, &shader_module);
+#pragma region IMAGES_AND_MEMORY
 
-	if (result != VK_SUCCESS) {
-		return VK_NULL_HANDLE;
+std::optional<std::uint32_t> Graphics::FindMemoryType(std::uint32_t type_bits, VkMemoryPropertyFlags properties)
+{
+	for (std::uint32_t i = 0; i < memory_properties_.memoryTypeCount; i++) {
+		const bool type_allowed = type_bits & (1u << i);
+		const bool has_properties = (memory_properties_.memoryTypes[i].propertyFlags & properties) == properties;
+		if (type_allowed && has_properties) {
+			return i;
+		}
 	}
 
-	return shader_module;
+	return std::nullopt;
 }
 
-VkViewport Graphics::GetViewport()
+bool HasStencilComponent(VkFormat format)
 {
-	VkViewport viewport = {};
-	viewport.x = 0.0f;
-	viewport.y = 0.0f;
-	viewport.width = static_cast<std::float_t>(extent_.width);
-	viewport.height = static_cast<std::float_t>(extent_.height);
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
-	return viewport;
+	return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D16_UNORM_S8_UINT;
 }
 
-VkRect2D Graphics::GetScissor()
+VkFormat Graphics::FindDepthFormat()
 {
-	VkRect2D scissor = {};
-	scissor.offset = {0, 0};
-	scissor.extent = extent_;
-	return scissor;
+	// Float depth first: with reverse-Z it spreads precision evenly over the whole range
+	std::array<VkFormat, 3> candidates = {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT};
+
+	for (VkFormat format : candidates) {
+		VkFormatProperties properties;
+		vkGetPhysicalDeviceFormatProperties(physical_device_, format, &properties);
+		if (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) {
+			return format;
+		}
+	}
+
+	return VK_FORMAT_UNDEFINED;
 }
 
-void Graphics::CreateGraphicsPipeline()
+VkSampleCountFlagBits Graphics::ChooseSampleCount(std::uint32_t requested)
 {
-	// Loading shaders
-	std::vector<std::uint8_t> basic_vertex_data = ReadFile("./basic.vert.spv");
-	VkShaderModule vertex_shader = CreateShaderModule(basic_vertex_data);
-	gsl::final_action _destroy_vertex([this, vertex_shader]() {
-		vkDestroyShaderModule(logical_device_, vertex_shader, nullptr);
-	});
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physical_device_, &properties);
 
-	std::vector<std::uint8_t> basic_fragment_data = ReadFile("./basic.frag.spv");
-	VkShaderModule fragment_shader = CreateShaderModule(basic_fragment_data);
-	gsl::final_action _destroy_fragment([this, fragment_shader]() {
-		vkDestroyShaderModule(logical_device_, fragment_shader, nullptr);
-	});
+	VkSampleCountFlags supported = properties.limits.framebufferColorSampleCounts & properties.limits.framebufferDepthSampleCounts;
 
-	if (vertex_shader == VK_NULL_HANDLE || fragment_shader == VK_NULL_HANDLE) {
-		std::exit(EXIT_FAILURE);
+	std::array<VkSampleCountFlagBits, 6> counts = {
+	    VK_SAMPLE_COUNT_64_BIT, VK_SAMPLE_COUNT_32_BIT, VK_SAMPLE_COUNT_16_BIT, VK_SAMPLE_COUNT_8_BIT, VK_SAMPLE_COUNT_4_BIT, VK_SAMPLE_COUNT_2_BIT};
+	for (VkSampleCountFlagBits count : counts) {
+		if (count <= requested && (supported & count)) {
+			return count;
+		}
 	}
 
-	VkPipelineShaderStageCreateInfo vertex_stage_info = {};
-	vertex_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	vertex_stage_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
-	vertex_stage_info.module = vertex_shader;
-	vertex_stage_info.pName = "main";
-
-	VkPipelineShaderStageCreateInfo fragment_stage_info = {};
-	fragment_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	fragment_stage_info.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-	fragment_stage_info.module = fragment_shader;
-	fragment_stage_info.pName = "main";
-
-	std::array<VkPipelineShaderStageCreateInfo, 2> stage_infos = {vertex_stage_info, fragment_stage_info};
-
-	// Viewport and scissoring
-
-	std::array<VkDynamicState, 2> dynamic_states = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+	return VK_SAMPLE_COUNT_1_BIT;
+}
 
-	VkPipelineDynamicStateCreateInfo dynamic_state_info = {};
-	dynamic_state_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-	dynamic_state_info.dynamicStateCount = dynamic_states.size();
-	dynamic_state_info.pDynamicStates = dynamic_states.data();
+Graphics::ImageHandle Graphics::CreateImage(
+    VkExtent2D extent, VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect, VkSampleCountFlagBits samples, std::uint32_t mip_levels)
+{
+	ImageHandle handle;
+
+	VkImageCreateInfo image_info = {};
+	image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	image_info.imageType = VK_IMAGE_TYPE_2D;
+	image_info.extent = {extent.width, extent.height, 1};
+	image_info.mipLevels = mip_levels;
+	image_info.arrayLayers = 1;
+	image_info.format = format;
+	image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+	image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	image_info.usage = usage;
+	image_info.samples = samples;
+	image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	const VkAllocationCallbacks* image_allocator = GetHostAllocator(VK_OBJECT_TYPE_IMAGE);
+	if (vkCreateImage(logical_device_, &image_info, image_allocator, handle.image.Put(logical_device_, image_allocator)) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create an image");
+	}
 
-	VkViewport viewport = GetViewport();
+	VkMemoryRequirements requirements;
+	vkGetImageMemoryRequirements(logical_device_, handle.image, &requirements);
 
-	VkRect2D scissor = GetScissor();
+	// Transient attachments never leave tile memory on tilers, so they may not need backing at all
+	std::optional<std::uint32_t> memory_type;
+	if (usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT) {
+		memory_type = FindMemoryType(requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
+	}
+	if (!memory_type.has_value()) {
+		memory_type = FindMemoryType(requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	}
+	if (!memory_type.has_value()) {
+		throw std::runtime_error("No device local memory type for image");
+	}
 
-	VkPipelineViewportStateCreateInfo viewport_state_info = {};
-	viewport_state_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-	viewport_state_info.viewportCount = 1;
-	viewport_state_info.pViewports = &viewport;
-	viewport_state_info.scissorCount = 1;
-	viewport_state_info.pScissors = &scissor;
+	VkMemoryAllocateInfo allocation_info = {};
+	allocation_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocation_info.allocationSize = requirements.size;
+	allocation_info.memoryTypeIndex = memory_type.value();
 
-	// Vertex Input and Rasterization
+	const VkAllocationCallbacks* memory_allocator = GetHostAllocator(VK_OBJECT_TYPE_DEVICE_MEMORY);
+	if (vkAllocateMemory(logical_device_, &allocation_info, memory_allocator, handle.memory.Put(logical_device_, memory_allocator)) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to allocate image memory");
+	}
+	vkBindImageMemory(logical_device_, handle.image, handle.memory, 0);
+	const std::uint32_t heap = memory_properties_.memoryTypes[memory_type.value()].heapIndex;
+	handle.heap_usage = HeapUsage(&heap_usage_[heap], heap, requirements.size);
+
+	VkImageViewCreateInfo view_info = {};
+	view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	view_info.image = handle.image;
+	view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	view_info.format = format;
+	view_info.subresourceRange.aspectMask = aspect;
+	view_info.subresourceRange.baseMipLevel = 0;
+	view_info.subresourceRange.levelCount = mip_levels;
+	view_info.subresourceRange.baseArrayLayer = 0;
+	view_info.subresourceRange.layerCount = 1;
+
+	const VkAllocationCallbacks* view_allocator = GetHostAllocator(VK_OBJECT_TYPE_IMAGE_VIEW);
+	if (vkCreateImageView(logical_device_, &view_info, view_allocator, handle.view.Put(logical_device_, view_allocator)) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create an image view");
+	}
 
-	VkPipelineVertexInputStateCreateInfo vertex_input_info = {};
-	vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vertex_input_info.vertexBindingDescriptionCount = 0;
-	vertex_input_info.vertexAttributeDescriptionCount = 0;
+	return handle;
+}
 
-	VkPipelineInputAssemblyStateCreateInfo input_assembly_info = {};
-	input_assembly_info.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-	input_assembly_info.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-	input_assembly_info.primitiveRestartEnable = VK_FALSE;
+void Graphics::RetireImage(ImageHandle& handle)
+{
+	Retire(handle.view);
+	Retire(handle.image);
+	Retire(handle.memory);
+	RetireHeapUsage(handle.heap_usage);
+}
 
-	VkPipelineRasterizationStateCreateInfo rasterization_state_info = {};
-	rasterization_state_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-	rasterization_state_info.depthClampEnable = VK_FALSE;
-	rasterization_state_info.rasterizerDiscardEnable = VK_FALSE;
-	rasterization_state_info.polygonMode = VK_POLYGON_MODE_FILL;
-	rasterization_state_info.lineWidth = 1.0f;
-	rasterization_state_info.cullMode = VK_CULL_MODE_NONE;
-	rasterization_state_info.frontFace = VK_FRONT_FACE_CLOCKWISE;
-	rasterization_state_info.depthBiasEnable = VK_FALSE;
+Graphics::BufferHandle Graphics::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties)
+{
+	BufferHandle handle;
 
-	// Color blending and layout
-	VkPipelineMultisampleStateCreateInfo multisampling_info = {};
-	multisampling_info.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-	multisampling_info.sampleShadingEnable = VK_FALSE;
-	multisampling_info.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+	VkBufferCreateInfo buffer_info = {};
+	buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buffer_info.size = size;
+	buffer_info.usage = usage;
+	buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-	VkPipelineColorBlendAttachmentState color_blend_attachment = {};
-	color_blend_attachment.blendEnable = VK_FALSE;
-	color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	const VkAllocationCallbacks* buffer_allocator = GetHostAllocator(VK_OBJECT_TYPE_BUFFER);
+	if (vkCreateBuffer(logical_device_, &buffer_info, buffer_allocator, handle.buffer.Put(logical_device_, buffer_allocator)) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create a buffer");
+	}
 
-	VkPipelineColorBlendStateCreateInfo color_blending_info = {};
-	color_blending_info.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-	color_blending_info.logicOpEnable = VK_FALSE;
-	color_blending_info.attachmentCount = 1;
-	color_blending_info.pAttachments = &color_blend_attachment;
+	VkMemoryRequirements requirements;
+	vkGetBufferMemoryRequirements(logical_device_, handle.buffer, &requirements);
 
-	VkPipelineLayoutCreateInfo layout_info = {};
-	layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	std::optional<std::uint32_t> memory_type = FindMemoryType(requirements.memoryTypeBits, properties);
+	if (!memory_type.has_value()) {
+		throw std::runtime_error("No memory type for buffer");
+	}
 
-	VkResult layout_result = vkCreatePipelineLayout(logical_device_, &layout_info, nullptr, &pipeline_layout_);
+	VkMemoryAllocateInfo allocation_info = {};
+	allocation_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocation_info.allocationSize = requirements.size;
+	allocation_info.memoryTypeIndex = memory_type.value();
 
-	if (layout_result != VK_SUCCESS) {
-		std::exit(EXIT_FAILURE);
+	const VkAllocationCallbacks* memory_allocator = GetHostAllocator(VK_OBJECT_TYPE_DEVICE_MEMORY);
+	if (vkAllocateMemory(logical_device_, &allocation_info, memory_allocator, handle.memory.Put(logical_device_, memory_allocator)) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to allocate buffer memory");
 	}
+	vkBindBufferMemory(logical_device_, handle.buffer, handle.memory, 0);
+	const std::uint32_t heap = memory_properties_.memoryTypes[memory_type.value()].heapIndex;
+	handle.heap_usage = HeapUsage(&heap_usage_[heap], heap, requirements.size);
 
-	// Create pipeline
+	// Host visible buffers stay mapped for their whole lifetime
+	if (properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+		vkMapMemory(logical_device_, handle.memory, 0, VK_WHOLE_SIZE, 0, &handle.mapped);
+	}
 
-	VkGraphicsPipelineCreateInfo pipeline_info = {};
-	pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-	pipeline_info.stageCount = stage_infos.size();
-	pipeline_info.pStages = stage_infos.data();
-	pipeline_info.pVertexInputState = &vertex_input_info;
-	pipeline_info.pInputAssemblyState = &input_assembly_info;
-	pipeline_info.pViewportState = &viewport_state_info;
-	pipeline_info.pRasterizationState = &rasterization_state_info;
-	pipeline_info.pMultisampleState = &multisampling_info;
-	pipeline_info.pDepthStencilState = nullptr;
-	pipeline_info.pColorBlendState = &color_blending_info;
-	pipeline_info.pDynamicState = &dynamic_state_info;
-	pipeline_info.layout = pipeline_layout_;
-	pipeline_info.renderPass = render_pass_;
-	pipeline_info.subpass = 0;
+	return handle;
+}
 
-	VkResult pipeline_result = vkCreateGraphicsPipelines(logical_device_, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &pipeline_);
+void Graphics::RetireBuffer(BufferHandle& handle)
+{
+	// Freeing the memory implicitly unmaps it
+	Retire(handle.buffer);
+	Retire(handle.memory);
+	handle.mapped = nullptr;
+	RetireHeapUsage(handle.heap_usage);
+}
 
-	if (pipeline_result != VK_SUCCESS) {
-		std::exit(EXIT_FAILURE);
+void Graphics::RetireHeapUsage(HeapUsage& heap_usage)
+{
+	// Still allocated until the deletion queue frees the memory, but no longer the engine's to
+	// evict for
+	if (heap_usage.GetSize() > 0) {
+		released_memory_.push_back({std::move(heap_usage), frame_number_});
 	}
 }
 
-void Graphics::CreateRenderPass()
+VkExtent2D Graphics::GetAttachmentExtent() const
 {
-	VkAttachmentDescription color_attachment = {};
-	color_attachment.format = surface_format_.format;
-	color_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
-	color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-	color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-	color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	color_attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-	VkAttachmentReference color_attachment_ref = {};
-	color_attachment_ref.attachment = 0;
-	color_attachment_ref.layout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL;
-
-	VkSubpassDescription main_subpass = {};
-	main_subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-	main_subpass.colorAttachmentCount = 1;
-	main_subpass.pColorAttachments = &color_attachment_ref;
-
-	VkRenderPassCreateInfo render_pass_info = {};
-	render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-	render_pass_info.attachmentCount = 1;
-	render_pass_info.pAttachments = &color_attachment;
-	render_pass_info.subpassCount = 1;
-	render_pass_info.pSubpasses = &main_subpass;
-
-	VkResult result = vkCreateRenderPass(logical_device_, &render_pass_info, nullptr, &render_pass_);
-	if (result != VK_SUCCESS) {
-		std::exit(EXIT_FAILURE);
+	VkExtent2D extent = {1, 1};
+	for (const WindowSurface& surface : surfaces_) {
+		extent.width = std::max(extent.width, surface.extent.width);
+		extent.height = std::max(extent.height, surface.extent.height);
 	}
+	return extent;
 }
 
-#pragma endregion
-
-#pragma region
-
-void Graphics::CreateFramebuffers()
+void Graphics::CreateDepthResources()
 {
-	swap_chain_framebuffers_.resize(swap_chain_image_views_.size());
-
-	for (std::uint32_t i = 0; i < swap_chain_framebuffers_.size(); i++) {
-		VkFramebufferCreateInfo info = {};
-		info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-		info.renderPass = render_pass_;
-		info.attachmentCount = 1;
-		info.pAttachments = swap_chain_image_views_.data();
-		info.width = extent_.width;
-		info.height = extent_.height;
-		info.layers = 1;
-
-		VkResult result = vkCreateFramebuffer(logical_device_, &info, nullptr, &swap_chain_framebuffers_[i]);
+	depth_format_ = FindDepthFormat();
+	if (depth_format_ == VK_FORMAT_UNDEFINED) {
+		throw std::runtime_error("No supported depth format");
+	}
 
-		if (result != VK_SUCCESS) {
-			std::exit(EXIT_FAILURE);
-		}
+	// Layout transitions on combined formats must name both aspects
+	depth_aspect_ = VK_IMAGE_ASPECT_DEPTH_BIT;
+	if (HasStencilComponent(depth_format_)) {
+		depth_aspect_ |= VK_IMAGE_ASPECT_STENCIL_BIT;
 	}
+
+	occlusion_culling_ = settings_.occlusion_culling && IsOcclusionCullingSupported();
+	CreateDepthImage();
 }
 
-void Graphics::CreateCommandPool()
+void Graphics::CreateDepthImage()
 {
-	QueueFamilyIndices indices = FindQueueFamilies(physical_device_);
-	VkCommandPoolCreateInfo command_pool_info = {};
-	command_pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-	command_pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-	command_pool_info.queueFamilyIndex = indices.graphics_family.value();
-
-	VkResult result = vkCreateCommandPool(logical_device_, &command_pool_info, nullptr, &command_pool_);
-
-	if (result != VK_SUCCESS) {
-		std::exit(EXIT_FAILURE);
+	// Depth may only be transient, and lazily allocated, while it never leaves the pass. With
+	// dynamic rendering the pre-pass stores it for the color pass's rendering scope, and the
+	// depth pyramid is built from it, which also samples it.
+	VkImageUsageFlags depth_usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	if (occlusion_culling_) {
+		depth_usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
 	}
+	else if (!(settings_.depth_prepass && device_features_.dynamic_rendering)) {
+		depth_usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+	}
+
+	RetireImage(depth_image_);
+	depth_image_ = CreateImage(GetAttachmentExtent(), depth_format_, depth_usage, VK_IMAGE_ASPECT_DEPTH_BIT, msaa_samples_);
 }
 
-void Graphics::CreateCommandBuffer()
+void Graphics::CreateColorResources()
 {
-	VkCommandBufferAllocateInfo command_buffer_info = {};
-	command_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	command_buffer_info.commandPool = command_pool_;
-	command_buffer_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	command_buffer_info.commandBufferCount = 1;
-
-	VkResult result = vkAllocateCommandBuffers(logical_device_, &command_buffer_info, &command_buffer_);
-	if (result != VK_SUCCESS) {
-		std::exit(EXIT_FAILURE);
+	msaa_samples_ = ChooseSampleCount(settings_.msaa_samples);
+	if (static_cast<std::uint32_t>(msaa_samples_) != settings_.msaa_samples) {
+		SPDLOG_WARN("MSAA x{} not supported, using x{}", settings_.msaa_samples, static_cast<std::uint32_t>(msaa_samples_));
 	}
+	CreateColorImage();
 }
 
-void Graphics::BeginCommands(std::uint32_t current_image_index)
+void Graphics::CreateColorImage()
 {
-	VkCommandBufferBeginInfo begin_info = {};
-	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-
-	VkResult begin_state_result = vkBeginCommandBuffer(command_buffer_, &begin_info);
-	if (begin_state_result != VK_SUCCESS) {
-		throw std::runtime_error("Failed to begin command buffer");
+	if (msaa_samples_ == VK_SAMPLE_COUNT_1_BIT) {
+		return;
 	}
 
-	VkRenderPassBeginInfo render_pass_begin_info = {};
-	render_pass_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-	render_pass_begin_info.renderPass = render_pass_;
-	render_pass_begin_info.framebuffer = swap_chain_framebuffers_[current_image_index];
-	render_pass_begin_info.renderArea.offset = {0, 0};
-	render_pass_begin_info.renderArea.extent = extent_;
-
-	VkClearValue clear_color = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
-	render_pass_begin_info.clearValueCount = 1;
-	render_pass_begin_info.pClearValues = &clear_color;
-	vkCmdBeginRenderPass(command_buffer_, &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
-
-	vkCmdBindPipeline(command_buffer_, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_);
-	VkViewport viewport = GetViewport();
-	VkRect2D scissor = GetScissor();
-
-	vkCmdSetViewport(command_buffer_, 0, 1, &viewport);
-	vkCmdSetScissor(command_buffer_, 0, 1, &scissor);
+	RetireImage(color_image_);
+	color_image_ = CreateImage(
+	    GetAttachmentExtent(),
+	    surface_format_.format,
+	    VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+	    VK_IMAGE_ASPECT_COLOR_BIT,
+	    msaa_samples_);
 }
 
-void Graphics::RenderTriangle()
+void Graphics::CreateInstanceBuffer()
 {
-	vkCmdDraw(command_buffer_, 3, 1, 0, 0);
+	// One per frame in flight so the CPU never writes matrices the GPU is still reading
+	for (FrameData& frame : frames_) {
+		// Coherent so the CPU side (transform updates) never needs explicit flushes
+		frame.instance_buffer = CreateBuffer(
+		    sizeof(glm::mat4) * settings_.max_instances, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+		glm::mat4* instances = static_cast<glm::mat4*>(frame.instance_buffer.mapped);
+		std::fill(instances, instances + settings_.max_instances, glm::mat4(1.0f));
+
+		// Written by DrawMeshIndirect while recording, like the matrices above
+		frame.indirect_buffer = CreateBuffer(
+		    sizeof(DrawIndexedCommand) * settings_.max_indirect_draws,
+		    VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+		    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	}
 }
 
-void Graphics::EndCommands()
+gsl::span<glm::mat4> Graphics::GetInstanceBuffer()
 {
-	vkCmdEndRenderPass(command_buffer_);
-	VkResult end_buffer_result = vkEndCommandBuffer(command_buffer_);
-	if (end_buffer_result != VK_SUCCESS)
-	{
-		throw std::runtime_error("Failed to record command buffer!");
-	}
+	return gsl::span<glm::mat4>(static_cast<glm::mat4*>(frames_[current_frame_].instance_buffer.mapped), settings_.max_instances);
 }
 
 #pragma endregion
 
-Graphics::Graphics(gsl::not_null<Window*> window) : window_(window)
+#pragma region GRAPHICS_PIPELINE
+
+UniqueShaderModule Graphics::CreateShaderModule(gsl::span<std::uint8_t> buffer)
 {
-#if !defined(NDEBUG)
-	validation_enabled_ = true;
-#endif
-	InitializeVulkan();
+	if (!buffer.size()) {
+		return {};
+	}
+
+	VkShaderModuleCreateInfo info = {};
+	info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	info.codeSize = buffer.size();
+	info.pCode = reinterpret_cast<std::uint32_t*>(buffer.data());
+
+	UniqueShaderModule shader_module;
+	const VkAllocationCallbacks* allocator = GetHostAllocator(VK_OBJECT_TYPE_SHADER_MODULE);
+	VkResult result = vkCreateShaderModule(logical_device_, &info, allocator, shader_module.Put(logical_device_, allocator));
+
+	if (result != VK_SUCCESS) {
+		shader_module.Release();
+		return {};
+	}
+
+	return shader_module;
+}
+
+ShaderReflection Graphics::ReflectShader(gsl::span<const std::uint8_t> code, gsl::czstring name)
+{
+	std::optional<ShaderReflection> reflection = ReflectSpirv(code);
+	if (!reflection.has_value()) {
+		throw std::runtime_error(fmt::format("Could not reflect {}", name));
+	}
+	return std::move(reflection.value());
+}
+
+PipelineLayoutHandles Graphics::GetPipelineLayout(gsl::span<const ShaderReflection> shaders)
+{
+	const std::optional<PipelineLayoutDescription> description = DescribePipelineLayout(shaders);
+	if (!description.has_value()) {
+		throw std::runtime_error("Could not describe the pipeline layout");
+	}
+
+	PipelineLayoutHandles handles = layout_cache_->GetPipelineLayout(description.value());
+	if (handles.layout == VK_NULL_HANDLE) {
+		throw std::runtime_error("Could not create a pipeline layout");
+	}
+	return handles;
+}
+
+VkViewport Graphics::GetViewport()
+{
+	VkViewport viewport = {};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = static_cast<std::float_t>(render_extent_.width);
+	viewport.height = static_cast<std::float_t>(render_extent_.height);
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	return viewport;
+}
+
+VkRect2D Graphics::GetScissor()
+{
+	VkRect2D scissor = {};
+	scissor.offset = {0, 0};
+	scissor.extent = render_extent_;
+	return scissor;
+}
+
+void Graphics::ReadShaderFiles()
+{
+	vertex_shader_code_ = ReadFile("./basic.vert.spv");
+	mesh_vertex_shader_code_ = ReadFile("./mesh.vert.spv");
+	fragment_shader_code_ = ReadFile(settings_.clustered_lighting ? "./clustered.frag.spv" : "./basic.frag.spv");
+	if (settings_.clustered_lighting) {
+		light_cluster_shader_code_ = ReadFile("./light_cluster.comp.spv");
+	}
+	if (settings_.occlusion_culling) {
+		depth_pyramid_shader_code_ = ReadFile("./depth_pyramid.comp.spv");
+		occlusion_cull_shader_code_ = ReadFile("./occlusion_cull.comp.spv");
+	}
+	if (settings_.overlay) {
+		overlay_vertex_shader_code_ = ReadFile("./overlay.vert.spv");
+		overlay_fragment_shader_code_ = ReadFile("./overlay.frag.spv");
+	}
+}
+
+void Graphics::CreateShaderModules()
+{
+	vertex_shader_ = CreateShaderModule(vertex_shader_code_);
+	mesh_vertex_shader_ = CreateShaderModule(mesh_vertex_shader_code_);
+	fragment_shader_ = CreateShaderModule(fragment_shader_code_);
+
+	if (vertex_shader_ == VK_NULL_HANDLE || mesh_vertex_shader_ == VK_NULL_HANDLE || fragment_shader_ == VK_NULL_HANDLE) {
+		throw std::runtime_error("Failed to create the shader modules");
+	}
+}
+
+// Everything the scene pipelines' create infos point to, in place, so variants can still be
+// created long after CreateGraphicsPipeline returned
+struct Graphics::ScenePipelineState {
+	std::array<VkPipelineShaderStageCreateInfo, 2> stages = {};  // vertex, fragment
+	std::array<VkPipelineShaderStageCreateInfo, 2> mesh_stages = {};
+	std::array<VkDynamicState, 2> dynamic_states = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+	VkPipelineDynamicStateCreateInfo dynamic_state_info = {};
+	VkViewport viewport = {};
+	VkRect2D scissor = {};
+	VkPipelineViewportStateCreateInfo viewport_state_info = {};
+	VkVertexInputBindingDescription instance_binding = {};
+	std::array<VkVertexInputAttributeDescription, 4> instance_attributes = {};
+	VkPipelineVertexInputStateCreateInfo vertex_input_info = {};
+	std::array<VkVertexInputBindingDescription, 2> mesh_bindings = {};
+	std::array<VkVertexInputAttributeDescription, 5> mesh_attributes = {};
+	VkPipelineVertexInputStateCreateInfo mesh_vertex_input_info = {};
+	VkPipelineInputAssemblyStateCreateInfo input_assembly_info = {};
+	VkPipelineRasterizationStateCreateInfo rasterization_state_info = {};
+	VkPipelineMultisampleStateCreateInfo multisampling_info = {};
+	VkPipelineColorBlendAttachmentState color_blend_attachment = {};
+	VkPipelineColorBlendStateCreateInfo color_blending_info = {};
+	VkPipelineDepthStencilStateCreateInfo depth_stencil_info = {};
+	VkPipelineDepthStencilStateCreateInfo main_pass_depth_stencil_info = {};
+	VkPipelineRenderingCreateInfoKHR rendering_info = {};
+	// The color pipelines, fragment stage not yet specialized
+	VkGraphicsPipelineCreateInfo pipeline_info = {};
+	VkGraphicsPipelineCreateInfo mesh_pipeline_info = {};
+};
+
+namespace {
+
+// constant_id values of shaders/shading_constants.glsl
+enum ShadingConstant : std::uint32_t {
+	kShadingAlbedoR = 0,
+	kShadingAlbedoG = 1,
+	kShadingAlbedoB = 2,
+	kShadingAmbient = 3,
+	kShadingMaxLights = 4,
+	kShadingQuality = 5,
+};
+
+SpecializationConstants GetShadingConstants(const ShadingVariant& variant)
+{
+	SpecializationConstants constants;
+	constants.Set(kShadingAlbedoR, variant.albedo.r)
+	    .Set(kShadingAlbedoG, variant.albedo.g)
+	    .Set(kShadingAlbedoB, variant.albedo.b)
+	    .Set(kShadingAmbient, variant.ambient)
+	    .Set(kShadingMaxLights, variant.max_lights_per_fragment)
+	    .Set(kShadingQuality, static_cast<std::uint32_t>(variant.quality));
+	return constants;
+}
+
+}  // namespace
+
+void Graphics::CreateGraphicsPipeline()
+{
+	// The code is only needed to reflect the layout below, the binning shader's included; the
+	// modules stay for the shading variants compiled later
+	gsl::final_action _release_code([this]() {
+		vertex_shader_code_ = {};
+		mesh_vertex_shader_code_ = {};
+		fragment_shader_code_ = {};
+		light_cluster_shader_code_ = {};
+	});
+
+	scene_pipeline_state_ = std::make_unique<ScenePipelineState>();
+	ScenePipelineState& state = *scene_pipeline_state_;
+
+	VkPipelineShaderStageCreateInfo& vertex_stage_info = state.stages[0];
+	vertex_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	vertex_stage_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
+	vertex_stage_info.module = vertex_shader_;
+	vertex_stage_info.pName = "main";
+
+	VkPipelineShaderStageCreateInfo& fragment_stage_info = state.stages[1];
+	fragment_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	fragment_stage_info.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	fragment_stage_info.module = fragment_shader_;
+	fragment_stage_info.pName = "main";
+
+	// Viewport and scissoring
+
+	state.dynamic_state_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	state.dynamic_state_info.dynamicStateCount = state.dynamic_states.size();
+	state.dynamic_state_info.pDynamicStates = state.dynamic_states.data();
+
+	state.viewport = GetViewport();
+
+	state.scissor = GetScissor();
+
+	state.viewport_state_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	state.viewport_state_info.viewportCount = 1;
+	state.viewport_state_info.pViewports = &state.viewport;
+	state.viewport_state_info.scissorCount = 1;
+	state.viewport_state_info.pScissors = &state.scissor;
+
+	// Vertex Input and Rasterization
+
+	// One world matrix per instance, fed as four vec4 columns
+	state.instance_binding.binding = 0;
+	state.instance_binding.stride = sizeof(glm::mat4);
+	state.instance_binding.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+	for (std::uint32_t column = 0; column < state.instance_attributes.size(); column++) {
+		state.instance_attributes[column].location = column;
+		state.instance_attributes[column].binding = 0;
+		state.instance_attributes[column].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+		state.instance_attributes[column].offset = sizeof(glm::vec4) * column;
+	}
+
+	state.vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	state.vertex_input_info.vertexBindingDescriptionCount = 1;
+	state.vertex_input_info.pVertexBindingDescriptions = &state.instance_binding;
+	state.vertex_input_info.vertexAttributeDescriptionCount = state.instance_attributes.size();
+	state.vertex_input_info.pVertexAttributeDescriptions = state.instance_attributes.data();
+
+	state.input_assembly_info.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	state.input_assembly_info.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	state.input_assembly_info.primitiveRestartEnable = VK_FALSE;
+
+	state.rasterization_state_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	state.rasterization_state_info.depthClampEnable = VK_FALSE;
+	state.rasterization_state_info.rasterizerDiscardEnable = VK_FALSE;
+	state.rasterization_state_info.polygonMode = VK_POLYGON_MODE_FILL;
+	state.rasterization_state_info.lineWidth = 1.0f;
+	state.rasterization_state_info.cullMode = VK_CULL_MODE_NONE;
+	state.rasterization_state_info.frontFace = VK_FRONT_FACE_CLOCKWISE;
+	state.rasterization_state_info.depthBiasEnable = VK_FALSE;
+
+	// Color blending and layout
+	state.multisampling_info.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	state.multisampling_info.sampleShadingEnable = VK_FALSE;
+	state.multisampling_info.rasterizationSamples = msaa_samples_;
+
+	state.color_blend_attachment.blendEnable = VK_FALSE;
+	state.color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+	state.color_blending_info.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	state.color_blending_info.logicOpEnable = VK_FALSE;
+	state.color_blending_info.attachmentCount = 1;
+	state.color_blending_info.pAttachments = &state.color_blend_attachment;
+
+	// Depth: reverse-Z, so nearer fragments have the greater depth value
+	state.depth_stencil_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	state.depth_stencil_info.depthTestEnable = VK_TRUE;
+	state.depth_stencil_info.depthWriteEnable = VK_TRUE;
+	state.depth_stencil_info.depthCompareOp = VK_COMPARE_OP_GREATER_OR_EQUAL;
+	state.depth_stencil_info.depthBoundsTestEnable = VK_FALSE;
+	state.depth_stencil_info.stencilTestEnable = VK_FALSE;
+
+	// After a pre-pass depth is final: nothing is written and only the front-most fragment
+	// passes, as nothing nearer is left. The vertex shaders declare gl_Position invariant so
+	// both pipelines compute the same depth; GREATER_OR_EQUAL rather than EQUAL also keeps a
+	// fragment that would come out a bit nearer.
+	state.main_pass_depth_stencil_info = state.depth_stencil_info;
+	state.main_pass_depth_stencil_info.depthWriteEnable = VK_FALSE;
+
+	// One layout for the triangle and mesh pipelines: the mesh shader's dequantization bounds
+	// and, with clustered lighting, the lighting set. The binning shader joins in so that set
+	// gets the compute stage as well and comes out as the very layout its pass allocates from.
+	std::vector<ShaderReflection> shaders;
+	shaders.push_back(ReflectShader(vertex_shader_code_, "basic.vert"));
+	shaders.push_back(ReflectShader(mesh_vertex_shader_code_, "mesh.vert"));
+	shaders.push_back(ReflectShader(fragment_shader_code_, settings_.clustered_lighting ? "clustered.frag" : "basic.frag"));
+	if (settings_.clustered_lighting) {
+		shaders.push_back(ReflectShader(light_cluster_shader_code_, "light_cluster.comp"));
+	}
+	pipeline_layout_ = GetPipelineLayout(shaders).layout;
+
+	if (!AreVertexInputsProvided(shaders[0], state.instance_attributes)) {
+		throw std::runtime_error("basic.vert reads vertex inputs the pipeline does not provide");
+	}
+
+	// Create pipeline
+
+	VkGraphicsPipelineCreateInfo& pipeline_info = state.pipeline_info;
+	pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipeline_info.stageCount = state.stages.size();
+	pipeline_info.pStages = state.stages.data();
+	pipeline_info.pVertexInputState = &state.vertex_input_info;
+	pipeline_info.pInputAssemblyState = &state.input_assembly_info;
+	pipeline_info.pViewportState = &state.viewport_state_info;
+	pipeline_info.pRasterizationState = &state.rasterization_state_info;
+	pipeline_info.pMultisampleState = &state.multisampling_info;
+	pipeline_info.pDepthStencilState = settings_.depth_prepass ? &state.main_pass_depth_stencil_info : &state.depth_stencil_info;
+	pipeline_info.pColorBlendState = &state.color_blending_info;
+	pipeline_info.pDynamicState = &state.dynamic_state_info;
+	pipeline_info.layout = pipeline_layout_;
+	pipeline_info.renderPass = render_pass_;
+	pipeline_info.subpass = settings_.depth_prepass ? 1 : 0;
+
+	// Depth-only variant: vertex stage only and no color attachment
+	VkPipelineColorBlendStateCreateInfo depth_only_blending_info = state.color_blending_info;
+	depth_only_blending_info.attachmentCount = 0;
+	depth_only_blending_info.pAttachments = nullptr;
+
+	VkGraphicsPipelineCreateInfo prepass_pipeline_info = pipeline_info;
+	prepass_pipeline_info.stageCount = 1;
+	prepass_pipeline_info.pStages = &vertex_stage_info;
+	prepass_pipeline_info.pDepthStencilState = &state.depth_stencil_info;
+	prepass_pipeline_info.pColorBlendState = &depth_only_blending_info;
+	prepass_pipeline_info.subpass = 0;
+
+	// Dynamic rendering: attachment formats are declared here instead of through a render pass
+	VkPipelineRenderingCreateInfoKHR prepass_rendering_info = {};
+	if (device_features_.dynamic_rendering) {
+		state.rendering_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR;
+		state.rendering_info.colorAttachmentCount = 1;
+		state.rendering_info.pColorAttachmentFormats = &surface_format_.format;
+		state.rendering_info.depthAttachmentFormat = depth_format_;
+
+		prepass_rendering_info = state.rendering_info;
+		prepass_rendering_info.colorAttachmentCount = 0;
+		prepass_rendering_info.pColorAttachmentFormats = nullptr;
+
+		pipeline_info.pNext = &state.rendering_info;
+		pipeline_info.renderPass = VK_NULL_HANDLE;
+		pipeline_info.subpass = 0;
+		prepass_pipeline_info.pNext = &prepass_rendering_info;
+		prepass_pipeline_info.renderPass = VK_NULL_HANDLE;
+	}
+
+	const VkAllocationCallbacks* pipeline_allocator = GetHostAllocator(VK_OBJECT_TYPE_PIPELINE);
+	if (settings_.depth_prepass) {
+		VkResult prepass_result = vkCreateGraphicsPipelines(
+		    logical_device_, VK_NULL_HANDLE, 1, &prepass_pipeline_info, pipeline_allocator, depth_prepass_pipeline_.Put(logical_device_, pipeline_allocator));
+
+		if (prepass_result != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create the depth pre-pass pipeline");
+		}
+	}
+
+	// Mesh variants: the same state plus the packed vertices of mesh_format.h on binding 1.
+	// Only the position is declared; the flat-color fragment shader needs no normal or UV.
+	state.mesh_bindings = {state.instance_binding, {}};
+	state.mesh_bindings[1].binding = 1;
+	state.mesh_bindings[1].stride = sizeof(PackedVertex);
+	state.mesh_bindings[1].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+	std::copy(state.instance_attributes.begin(), state.instance_attributes.end(), state.mesh_attributes.begin());
+	state.mesh_attributes[4].location = 4;
+	state.mesh_attributes[4].binding = 1;
+	state.mesh_attributes[4].format = VK_FORMAT_R16G16B16A16_UNORM;
+	state.mesh_attributes[4].offset = offsetof(PackedVertex, position);
+
+	state.mesh_vertex_input_info = state.vertex_input_info;
+	state.mesh_vertex_input_info.vertexBindingDescriptionCount = state.mesh_bindings.size();
+	state.mesh_vertex_input_info.pVertexBindingDescriptions = state.mesh_bindings.data();
+	state.mesh_vertex_input_info.vertexAttributeDescriptionCount = state.mesh_attributes.size();
+	state.mesh_vertex_input_info.pVertexAttributeDescriptions = state.mesh_attributes.data();
+
+	if (!AreVertexInputsProvided(shaders[1], state.mesh_attributes)) {
+		throw std::runtime_error("mesh.vert reads vertex inputs the pipeline does not provide");
+	}
+
+	state.mesh_stages = state.stages;
+	state.mesh_stages[0].module = mesh_vertex_shader_;
+
+	state.mesh_pipeline_info = pipeline_info;
+	state.mesh_pipeline_info.pStages = state.mesh_stages.data();
+	state.mesh_pipeline_info.pVertexInputState = &state.mesh_vertex_input_info;
+
+	if (settings_.depth_prepass) {
+		VkGraphicsPipelineCreateInfo mesh_prepass_pipeline_info = prepass_pipeline_info;
+		mesh_prepass_pipeline_info.pStages = &state.mesh_stages[0];
+		mesh_prepass_pipeline_info.pVertexInputState = &state.mesh_vertex_input_info;
+
+		VkResult mesh_prepass_result = vkCreateGraphicsPipelines(
+		    logical_device_, VK_NULL_HANDLE, 1, &mesh_prepass_pipeline_info, pipeline_allocator, mesh_depth_prepass_pipeline_.Put(logical_device_, pipeline_allocator));
+
+		if (mesh_prepass_result != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create the mesh depth pre-pass pipeline");
+		}
+	}
+
+	// The color pipelines: every listed shading variant up front, spread over the job system
+	scene_program_ = shader_variants_.AddProgram(
+	    "scene pipeline", [this](const VkSpecializationInfo& constants) { return CreateScenePipeline(scene_pipeline_state_->pipeline_info, constants); });
+	mesh_program_ = shader_variants_.AddProgram(
+	    "mesh pipeline", [this](const VkSpecializationInfo& constants) { return CreateScenePipeline(scene_pipeline_state_->mesh_pipeline_info, constants); });
+
+	std::vector<SpecializationConstants> variants;
+	std::transform(settings_.shading_variants.begin(), settings_.shading_variants.end(), std::back_inserter(variants), GetShadingConstants);
+	if (!shader_variants_.Precompile(scene_program_, variants, jobs_) || !shader_variants_.Precompile(mesh_program_, variants, jobs_)) {
+		throw std::runtime_error("Could not precompile the shading variants");
+	}
+	SetShadingVariant(settings_.shading_variants.front());
+}
+
+UniquePipeline Graphics::CreateScenePipeline(const VkGraphicsPipelineCreateInfo& pipeline_info, const VkSpecializationInfo& constants)
+{
+	std::array<VkPipelineShaderStageCreateInfo, 2> stages = {pipeline_info.pStages[0], pipeline_info.pStages[1]};
+	stages[1].pSpecializationInfo = &constants;
+
+	VkGraphicsPipelineCreateInfo specialized_info = pipeline_info;
+	specialized_info.pStages = stages.data();
+
+	UniquePipeline pipeline;
+	const VkAllocationCallbacks* allocator = GetHostAllocator(VK_OBJECT_TYPE_PIPELINE);
+	if (vkCreateGraphicsPipelines(logical_device_, VK_NULL_HANDLE, 1, &specialized_info, allocator, pipeline.Put(logical_device_, allocator)) != VK_SUCCESS) {
+		pipeline.Release();
+	}
+	return pipeline;
+}
+
+void Graphics::SetShadingVariant(const ShadingVariant& variant)
+{
+	const SpecializationConstants constants = GetShadingConstants(variant);
+	// A variant not compiled yet is compiled here
+	frame_allocations_expected_ = true;
+	pipeline_ = shader_variants_.Get(scene_program_, constants);
+	mesh_pipeline_ = shader_variants_.Get(mesh_program_, constants);
+	if (pipeline_ == VK_NULL_HANDLE || mesh_pipeline_ == VK_NULL_HANDLE) {
+		throw std::runtime_error("Could not compile the shading variant");
+	}
+	MarkSceneDirty();
+}
+
+void Graphics::CreateRenderPass()
+{
+	const bool multisampled = msaa_samples_ != VK_SAMPLE_COUNT_1_BIT;
+	// A scene target is blitted to the swapchain image afterwards, which RecordUpscale transitions
+	const VkImageLayout output_layout = dynamic_resolution_ ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : final_color_layout_;
+
+	// With MSAA the multisampled color only lives until it is resolved at the end of the subpass
+	VkAttachmentDescription color_attachment = {};
+	color_attachment.format = surface_format_.format;
+	color_attachment.samples = msaa_samples_;
+	color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	color_attachment.storeOp = multisampled ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
+	color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	color_attachment.finalLayout = multisampled ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : output_layout;
+
+	// Depth is only needed while the pass runs, so it is never stored
+	VkAttachmentDescription depth_attachment = {};
+	depth_attachment.format = depth_format_;
+	depth_attachment.samples = msaa_samples_;
+	depth_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depth_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	depth_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depth_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	depth_attachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	VkAttachmentDescription resolve_attachment = {};
+	resolve_attachment.format = surface_format_.format;
+	resolve_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	resolve_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	resolve_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	resolve_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	resolve_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	resolve_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	resolve_attachment.finalLayout = output_layout;
+
+	std::vector<VkAttachmentDescription> attachments = {color_attachment, depth_attachment};
+	if (multisampled) {
+		attachments.push_back(resolve_attachment);
+	}
+
+	VkAttachmentReference color_attachment_ref = {};
+	color_attachment_ref.attachment = 0;
+	color_attachment_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+	VkAttachmentReference depth_attachment_ref = {};
+	depth_attachment_ref.attachment = 1;
+	depth_attachment_ref.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	VkAttachmentReference resolve_attachment_ref = {};
+	resolve_attachment_ref.attachment = 2;
+	resolve_attachment_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+	VkSubpassDescription depth_subpass = {};
+	depth_subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	depth_subpass.colorAttachmentCount = 0;
+	depth_subpass.pDepthStencilAttachment = &depth_attachment_ref;
+
+	VkSubpassDescription main_subpass = {};
+	main_subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	main_subpass.colorAttachmentCount = 1;
+	main_subpass.pColorAttachments = &color_attachment_ref;
+	main_subpass.pDepthStencilAttachment = &depth_attachment_ref;
+	main_subpass.pResolveAttachments = multisampled ? &resolve_attachment_ref : nullptr;
+
+	std::vector<VkSubpassDescription> subpasses;
+	if (settings_.depth_prepass) {
+		subpasses.push_back(depth_subpass);
+	}
+	subpasses.push_back(main_subpass);
+
+	std::vector<VkSubpassDependency> dependencies;
+
+	VkSubpassDependency external_dependency = {};
+	external_dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+	external_dependency.dstSubpass = 0;
+	external_dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	external_dependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	external_dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+	external_dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependencies.push_back(external_dependency);
+
+	if (settings_.depth_prepass) {
+		VkSubpassDependency prepass_dependency = {};
+		prepass_dependency.srcSubpass = 0;
+		prepass_dependency.dstSubpass = 1;
+		prepass_dependency.srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		prepass_dependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		prepass_dependency.dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+		prepass_dependency.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+		prepass_dependency.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+		dependencies.push_back(prepass_dependency);
+	}
+
+	VkRenderPassCreateInfo render_pass_info = {};
+	render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	render_pass_info.attachmentCount = attachments.size();
+	render_pass_info.pAttachments = attachments.data();
+	render_pass_info.subpassCount = subpasses.size();
+	render_pass_info.pSubpasses = subpasses.data();
+	render_pass_info.dependencyCount = dependencies.size();
+	render_pass_info.pDependencies = dependencies.data();
+
+	const VkAllocationCallbacks* allocator = GetHostAllocator(VK_OBJECT_TYPE_RENDER_PASS);
+	VkResult result = vkCreateRenderPass(logical_device_, &render_pass_info, allocator, render_pass_.Put(logical_device_, allocator));
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create the render pass");
+	}
+}
+
+#pragma endregion
+
+#pragma region
+
+void Graphics::CreateFramebuffers()
+{
+	for (WindowSurface& surface : surfaces_) {
+		CreateFramebuffers(surface);
+	}
+}
+
+void Graphics::CreateFramebuffers(WindowSurface& surface)
+{
+	// With dynamic resolution, which only runs with a single window, the pass draws into the
+	// scene targets, one per frame in flight
+	std::pmr::vector<VkImageView> color_views(GetScratchMemory());
+	if (dynamic_resolution_) {
+		for (const ImageHandle& target : scene_targets_) {
+			color_views.push_back(target.view);
+		}
+	}
+	else {
+		color_views.assign(surface.image_views.begin(), surface.image_views.end());
+	}
+	surface.framebuffers.resize(color_views.size());
+
+	for (std::uint32_t i = 0; i < surface.framebuffers.size(); i++) {
+		VkFramebufferCreateInfo info = {};
+		info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+		info.renderPass = render_pass_;
+		// Attachment order matches CreateRenderPass: color, depth, then the resolve target
+		std::pmr::vector<VkImageView> attachments({color_views[i], depth_image_.view}, GetScratchMemory());
+		if (msaa_samples_ != VK_SAMPLE_COUNT_1_BIT) {
+			attachments = {color_image_.view, depth_image_.view, color_views[i]};
+		}
+
+		info.attachmentCount = attachments.size();
+		info.pAttachments = attachments.data();
+		info.width = surface.extent.width;
+		info.height = surface.extent.height;
+		info.layers = 1;
+
+		const VkAllocationCallbacks* allocator = GetHostAllocator(VK_OBJECT_TYPE_FRAMEBUFFER);
+		VkResult result = vkCreateFramebuffer(logical_device_, &info, allocator, surface.framebuffers[i].Put(logical_device_, allocator));
+
+		if (result != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create a framebuffer");
+		}
+	}
+}
+
+void Graphics::CreateCommandPool()
+{
+	const QueueFamilyIndices& indices = queue_families_;
+	VkCommandPoolCreateInfo command_pool_info = {};
+	command_pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	command_pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	command_pool_info.queueFamilyIndex = indices.graphics_family.value();
+
+	const VkAllocationCallbacks* allocator = GetHostAllocator(VK_OBJECT_TYPE_COMMAND_POOL);
+	VkResult result = vkCreateCommandPool(logical_device_, &command_pool_info, allocator, command_pool_.Put(logical_device_, allocator));
+
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create the command pool");
+	}
+}
+
+void Graphics::CreateCommandBuffers()
+{
+	for (FrameData& frame : frames_) {
+		VkCommandBufferAllocateInfo command_buffer_info = {};
+		command_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		command_buffer_info.commandPool = command_pool_;
+		command_buffer_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		command_buffer_info.commandBufferCount = 1;
+
+		VkResult result = vkAllocateCommandBuffers(logical_device_, &command_buffer_info, &frame.command_buffer);
+		if (result != VK_SUCCESS) {
+			throw std::runtime_error("Failed to allocate a command buffer");
+		}
+		if (vkAllocateCommandBuffers(logical_device_, &command_buffer_info, &frame.upload_command_buffer) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to allocate an upload command buffer");
+		}
+
+		if (settings_.reuse_scene_commands) {
+			command_buffer_info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+			for (SceneCommands& scene_commands : frame.scene_commands) {
+				if (vkAllocateCommandBuffers(logical_device_, &command_buffer_info, &scene_commands.buffer) != VK_SUCCESS) {
+					throw std::runtime_error("Failed to allocate a scene command buffer");
+				}
+			}
+		}
+	}
+	command_buffer_ = frames_[current_frame_].command_buffer;
+}
+
+void Graphics::CreateSyncObjects()
+{
+	VkSemaphoreCreateInfo semaphore_info = {};
+	semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+	// Signaled so the first BeginFrame of each frame in flight does not wait
+	VkFenceCreateInfo fence_info = {};
+	fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+	const VkAllocationCallbacks* fence_allocator = GetHostAllocator(VK_OBJECT_TYPE_FENCE);
+	const VkAllocationCallbacks* semaphore_allocator = GetHostAllocator(VK_OBJECT_TYPE_SEMAPHORE);
+	for (FrameData& frame : frames_) {
+		if (vkCreateFence(logical_device_, &fence_info, fence_allocator, frame.in_flight.Put(logical_device_, fence_allocator)) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create a fence");
+		}
+	}
+
+	for (WindowSurface& surface : surfaces_) {
+		surface.image_available.resize(frames_.size());
+		for (UniqueSemaphore& semaphore : surface.image_available) {
+			if (vkCreateSemaphore(logical_device_, &semaphore_info, semaphore_allocator, semaphore.Put(logical_device_, semaphore_allocator)) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to create a semaphore");
+			}
+		}
+		CreatePresentSemaphores(surface);
+	}
+}
+
+void Graphics::CreatePresentSemaphores(WindowSurface& surface)
+{
+	VkSemaphoreCreateInfo semaphore_info = {};
+	semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+	// All new: a present that failed may have left one signaled
+	const VkAllocationCallbacks* allocator = GetHostAllocator(VK_OBJECT_TYPE_SEMAPHORE);
+	surface.render_finished.clear();
+	surface.render_finished.resize(surface.images.size());
+	for (UniqueSemaphore& semaphore : surface.render_finished) {
+		if (vkCreateSemaphore(logical_device_, &semaphore_info, allocator, semaphore.Put(logical_device_, allocator)) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create a semaphore");
+		}
+	}
+}
+
+namespace {
+
+// The passes pipeline statistics are gathered for, by their PipelineStatisticsLog::PassId
+enum StatisticsPass : PipelineStatisticsLog::PassId {
+	kLightClusteringStatistics,
+	kDepthPrepassStatistics,
+	kSceneStatistics,
+	kOcclusionCullingStatistics,
+	kOverlayStatistics,
+};
+
+constexpr std::array<gsl::czstring, 5> kStatisticsPassNames = {"light clustering", "depth pre-pass", "scene", "occlusion culling", "overlay"};
+
+}  // namespace
+
+void Graphics::BeginCommands()
+{
+	VkCommandBufferBeginInfo begin_info = {};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+	VkResult begin_state_result = vkBeginCommandBuffer(command_buffer_, &begin_info);
+	if (begin_state_result != VK_SUCCESS) {
+		throw std::runtime_error("Failed to begin command buffer");
+	}
+
+	if (timestamp_pool_ != VK_NULL_HANDLE) {
+		const std::uint32_t first_query = current_frame_ * kTimestampsPerFrame;
+		vkCmdResetQueryPool(command_buffer_, timestamp_pool_, first_query, kTimestampsPerFrame);
+		vkCmdWriteTimestamp(command_buffer_, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestamp_pool_, first_query);
+	}
+	if (statistics_pool_ != VK_NULL_HANDLE) {
+		vkCmdResetQueryPool(command_buffer_, statistics_pool_, current_frame_ * kMaxStatisticsQueries, kMaxStatisticsQueries);
+		frames_[current_frame_].statistics_frame = frame_number_;
+	}
+
+	// Dispatches cannot be recorded once rendering has begun. Pass timestamps are taken at the
+	// bottom of the pipe, where each waits for the work before it.
+	const std::uint32_t first_pass_timestamp = current_frame_ * kTimestampsPerFrame + 4;
+	if (settings_.clustered_lighting) {
+		if (timestamp_pool_ != VK_NULL_HANDLE) {
+			vkCmdWriteTimestamp(command_buffer_, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestamp_pool_, first_pass_timestamp);
+		}
+		BeginStatisticsQuery(kLightClusteringStatistics);
+		RecordLightClustering(frames_[current_frame_]);
+		EndStatisticsQuery();
+		if (timestamp_pool_ != VK_NULL_HANDLE) {
+			vkCmdWriteTimestamp(command_buffer_, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestamp_pool_, first_pass_timestamp + 1);
+			frames_[current_frame_].light_timestamps_written = true;
+		}
+	}
+	if (timestamp_pool_ != VK_NULL_HANDLE) {
+		vkCmdWriteTimestamp(command_buffer_, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestamp_pool_, first_pass_timestamp + 2);
+	}
+
+	indirect_draw_count_ = 0;
+	current_surface_ = 0;
+	BeginWindowRendering();
+}
+
+void Graphics::BeginWindowRendering()
+{
+	const WindowSurface& surface = surfaces_[current_surface_];
+	if (!dynamic_resolution_) {
+		render_extent_ = surface.extent;
+	}
+
+	// Queries cannot begin in a pass whose draws come from secondary command buffers, so they
+	// wrap the rendering scopes; the subpasses of a render pass count as one scene pass
+	const bool separate_prepass = settings_.depth_prepass && device_features_.dynamic_rendering;
+	BeginStatisticsQuery(separate_prepass ? kDepthPrepassStatistics : kSceneStatistics, std::uint64_t(render_extent_.width) * render_extent_.height);
+
+	if (device_features_.dynamic_rendering) {
+		TransitionImage({
+		    .image = GetColorTarget(),
+		    .aspect = VK_IMAGE_ASPECT_COLOR_BIT,
+		    .old_layout = VK_IMAGE_LAYOUT_UNDEFINED,
+		    .new_layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+		    .src_stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+		    .src_access = 0,
+		    .dst_stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+		    .dst_access = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+		});
+		if (color_image_.image != VK_NULL_HANDLE) {
+			TransitionImage({
+			    .image = color_image_.image,
+			    .aspect = VK_IMAGE_ASPECT_COLOR_BIT,
+			    .old_layout = VK_IMAGE_LAYOUT_UNDEFINED,
+			    .new_layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+			    // The previous window may have drawn into it
+			    .src_stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			    .src_access = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+			    .dst_stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			    .dst_access = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+			});
+		}
+		// Depth contents never survive a window, so it is always discarded on entry
+		TransitionImage({
+		    .image = depth_image_.image,
+		    .aspect = depth_aspect_,
+		    .old_layout = VK_IMAGE_LAYOUT_UNDEFINED,
+		    .new_layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+		    .src_stage = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+		    .src_access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+		    .dst_stage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+		    .dst_access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+		});
+
+		BeginDynamicRendering(settings_.depth_prepass);
+	}
+	else {
+		// Reverse-Z: depth is cleared to the far plane at 0.0
+		std::array<VkClearValue, 2> clear_values = {};
+		clear_values[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+		clear_values[1].depthStencil = {0.0f, 0};
+
+		VkRenderPassBeginInfo render_pass_begin_info = {};
+		render_pass_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		render_pass_begin_info.renderPass = render_pass_;
+		render_pass_begin_info.framebuffer = surface.framebuffers[dynamic_resolution_ ? current_frame_ : surface.image_index];
+		render_pass_begin_info.renderArea.offset = {0, 0};
+		render_pass_begin_info.renderArea.extent = render_extent_;
+
+		render_pass_begin_info.clearValueCount = clear_values.size();
+		render_pass_begin_info.pClearValues = clear_values.data();
+		const VkSubpassContents contents = settings_.reuse_scene_commands ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE;
+		vkCmdBeginRenderPass(command_buffer_, &render_pass_begin_info, contents);
+	}
+
+	window_rendering_ = true;
+	in_depth_prepass_ = settings_.depth_prepass;
+	BeginSceneCommands();
+}
+
+void Graphics::BeginSceneCommands()
+{
+	FrameData& frame = frames_[current_frame_];
+	if (settings_.reuse_scene_commands) {
+		SceneCommands& scene_commands = frame.scene_commands[in_depth_prepass_ ? 0 : 1];
+		replaying_scene_ = scene_commands.version == scene_version_ && scene_commands.extent.width == render_extent_.width &&
+		                   scene_commands.extent.height == render_extent_.height;
+		if (replaying_scene_) {
+			for (MeshId mesh : scene_commands.meshes) {
+				residency_.Touch(meshes_[mesh].residency.value(), frame_number_);
+			}
+			return;
+		}
+		scene_commands.meshes.clear();
+
+		// No framebuffer: the recording does not depend on the swapchain image
+		VkCommandBufferInheritanceInfo inheritance_info = {};
+		inheritance_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		// The pass's statistics query stays active in the primary while the draws execute
+		inheritance_info.pipelineStatistics = statistics_pool_ != VK_NULL_HANDLE ? kPipelineStatisticsFlags : 0;
+		VkCommandBufferInheritanceRenderingInfoKHR rendering_info = {};
+		if (device_features_.dynamic_rendering) {
+			rendering_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO_KHR;
+			rendering_info.colorAttachmentCount = in_depth_prepass_ ? 0 : 1;
+			rendering_info.pColorAttachmentFormats = &surface_format_.format;
+			rendering_info.depthAttachmentFormat = depth_format_;
+			rendering_info.rasterizationSamples = msaa_samples_;
+			inheritance_info.pNext = &rendering_info;
+		}
+		else {
+			inheritance_info.renderPass = render_pass_;
+			inheritance_info.subpass = (settings_.depth_prepass && !in_depth_prepass_) ? 1 : 0;
+		}
+
+		VkCommandBufferBeginInfo begin_info = {};
+		begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		begin_info.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		begin_info.pInheritanceInfo = &inheritance_info;
+		if (vkBeginCommandBuffer(scene_commands.buffer, &begin_info) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to begin scene command buffer");
+		}
+		scene_commands.version = scene_version_;
+		scene_commands.extent = render_extent_;
+		command_buffer_ = scene_commands.buffer;
+	}
+
+	// A secondary command buffer inherits no state, and a new subpass needs its own pipeline
+	// bound even if the handle is the same
+	bound_pipeline_ = VK_NULL_HANDLE;
+	BindGraphicsPipeline(in_depth_prepass_ ? depth_prepass_pipeline_ : pipeline_);
+	if (settings_.clustered_lighting) {
+		vkCmdBindDescriptorSets(command_buffer_, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout_, 0, 1, &frame.lighting_descriptor_set, 0, nullptr);
+	}
+	VkViewport viewport = GetViewport();
+	VkRect2D scissor = GetScissor();
+
+	vkCmdSetViewport(command_buffer_, 0, 1, &viewport);
+	vkCmdSetScissor(command_buffer_, 0, 1, &scissor);
+
+	VkDeviceSize instance_offset = 0;
+	vkCmdBindVertexBuffers(command_buffer_, 0, 1, frame.instance_buffer.buffer.GetAddress(), &instance_offset);
+}
+
+void Graphics::EndSceneCommands()
+{
+	if (!settings_.reuse_scene_commands) {
+		return;
+	}
+
+	FrameData& frame = frames_[current_frame_];
+	const VkCommandBuffer scene_commands = frame.scene_commands[in_depth_prepass_ ? 0 : 1].buffer;
+	if (!replaying_scene_) {
+		if (vkEndCommandBuffer(scene_commands) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to record scene command buffer");
+		}
+		command_buffer_ = frame.command_buffer;
+	}
+	replaying_scene_ = false;
+	vkCmdExecuteCommands(command_buffer_, 1, &scene_commands);
+}
+
+void Graphics::BeginMainPass()
+{
+	if (!settings_.depth_prepass) {
+		return;
+	}
+
+	EndSceneCommands();
+	if (device_features_.dynamic_rendering) {
+		cmd_end_rendering_(command_buffer_);
+		// Pre-pass depth writes must land before the main pass tests against them
+		TransitionImage({
+		    .image = depth_image_.image,
+		    .aspect = depth_aspect_,
+		    .old_layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+		    .new_layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+		    .src_stage = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+		    .src_access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+		    .dst_stage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+		    .dst_access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+		});
+		BeginStatisticsQuery(kSceneStatistics, std::uint64_t(render_extent_.width) * render_extent_.height);
+		BeginDynamicRendering(false);
+	}
+	else {
+		vkCmdNextSubpass(command_buffer_, settings_.reuse_scene_commands ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+	}
+
+	in_depth_prepass_ = false;
+	BeginSceneCommands();
+}
+
+void Graphics::BindGraphicsPipeline(VkPipeline pipeline)
+{
+	if (pipeline != bound_pipeline_) {
+		vkCmdBindPipeline(command_buffer_, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+		bound_pipeline_ = pipeline;
+	}
+}
+
+void Graphics::BeginDynamicRendering(bool depth_only, bool resume)
+{
+	VkRenderingAttachmentInfoKHR color_attachment = {};
+	color_attachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+	color_attachment.imageView = GetColorTargetView();
+	color_attachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	color_attachment.loadOp = resume ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+	color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	color_attachment.clearValue.color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+
+	if (color_image_.view != VK_NULL_HANDLE) {
+		color_attachment.imageView = color_image_.view;
+		color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		color_attachment.resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT;
+		color_attachment.resolveImageView = GetColorTargetView();
+		color_attachment.resolveImageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	}
+
+	// The pass that follows a pre-pass keeps its depth, and only occlusion culling reads depth
+	// after the color pass
+	VkRenderingAttachmentInfoKHR depth_attachment = {};
+	depth_attachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+	depth_attachment.imageView = depth_image_.view;
+	depth_attachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	depth_attachment.loadOp = ((settings_.depth_prepass && !depth_only) || resume) ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+	depth_attachment.storeOp = (depth_only || occlusion_culling_) ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depth_attachment.clearValue.depthStencil = {0.0f, 0};
+
+	VkRenderingInfoKHR rendering_info = {};
+	rendering_info.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR;
+	rendering_info.renderArea.offset = {0, 0};
+	rendering_info.renderArea.extent = render_extent_;
+	rendering_info.layerCount = 1;
+	rendering_info.colorAttachmentCount = depth_only ? 0 : 1;
+	rendering_info.pColorAttachments = depth_only ? nullptr : &color_attachment;
+	rendering_info.pDepthAttachment = &depth_attachment;
+	if (settings_.reuse_scene_commands) {
+		rendering_info.flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT_KHR;
+	}
+	cmd_begin_rendering_(command_buffer_, &rendering_info);
+}
+
+void Graphics::RenderTriangle()
+{
+	if (replaying_scene_) {
+		return;
+	}
+	BindGraphicsPipeline(in_depth_prepass_ ? depth_prepass_pipeline_ : pipeline_);
+	vkCmdDraw(command_buffer_, 3, 1, 0, 0);
+}
+
+void Graphics::RenderTriangleInstances(gsl::span<const std::uint32_t> instances)
+{
+	if (replaying_scene_) {
+		return;
+	}
+	BindGraphicsPipeline(in_depth_prepass_ ? depth_prepass_pipeline_ : pipeline_);
+	std::size_t run_start = 0;
+	for (std::size_t i = 1; i <= instances.size(); i++) {
+		if (i == instances.size() || instances[i] != instances[i - 1] + 1) {
+			vkCmdDraw(command_buffer_, 3, gsl::narrow_cast<std::uint32_t>(i - run_start), 0, instances[run_start]);
+			run_start = i;
+		}
+	}
+}
+
+bool Graphics::BeginWindow(std::uint32_t window)
+{
+	Expects(window > current_surface_ && window < surfaces_.size());
+	// Drawn for the primary window's size and projection alone
+	Expects(!settings_.clustered_lighting);
+
+	if (window_rendering_) {
+		EndWindowRendering();
+	}
+	for (std::uint32_t skipped = current_surface_ + 1; skipped < window; skipped++) {
+		ClearWindow(skipped);
+	}
+	current_surface_ = window;
+	if (!surfaces_[window].acquired) {
+		return false;
+	}
+	BeginWindowRendering();
+	return true;
+}
+
+void Graphics::EndWindowRendering()
+{
+	const WindowSurface& surface = surfaces_[current_surface_];
+	EndSceneCommands();
+	window_rendering_ = false;
+
+	// Only the primary window has an overlay, and only with dynamic rendering
+	const bool overlay = current_surface_ == 0 && overlay_batch_.GetVertexCount() > 0;
+	if (device_features_.dynamic_rendering) {
+		cmd_end_rendering_(command_buffer_);
+		if (!dynamic_resolution_) {
+			ImageTransition transition = {
+			    .image = surface.images[surface.image_index],
+			    .aspect = VK_IMAGE_ASPECT_COLOR_BIT,
+			    .old_layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+			    .new_layout = final_color_layout_,
+			    .src_stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			    .src_access = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+			    .dst_stage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+			    .dst_access = 0,
+			};
+			if (overlay) {
+				// The overlay blends over the resolved scene and moves the image on itself
+				transition.new_layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+				transition.dst_stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+				transition.dst_access = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+			}
+			TransitionImage(transition);
+		}
+	}
+	else {
+		vkCmdEndRenderPass(command_buffer_);
+	}
+	EndStatisticsQuery();
+	// The primary window's scene ends here, ahead of the upscale and the overlay
+	if (current_surface_ == 0 && timestamp_pool_ != VK_NULL_HANDLE) {
+		vkCmdWriteTimestamp(command_buffer_, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestamp_pool_, current_frame_ * kTimestampsPerFrame + 7);
+		frames_[current_frame_].scene_timestamps_written = true;
+	}
+
+	if (dynamic_resolution_) {
+		RecordUpscale(overlay ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : final_color_layout_);
+	}
+	// After the upscale, so it stays sharp at any render scale
+	if (overlay) {
+		RecordOverlay();
+	}
+}
+
+void Graphics::ClearWindow(std::uint32_t window)
+{
+	// Every acquired image is presented, so the windows not drawn this frame are cleared
+	if (!surfaces_[window].acquired) {
+		return;
+	}
+	current_surface_ = window;
+	BeginWindowRendering();
+	BeginMainPass();
+	EndWindowRendering();
+}
+
+void Graphics::EndCommands()
+{
+	if (window_rendering_) {
+		EndWindowRendering();
+	}
+	for (std::uint32_t window = current_surface_ + 1; window < surfaces_.size(); window++) {
+		ClearWindow(window);
+	}
+
+	FrameData& frame = frames_[current_frame_];
+	if (capture_requested_) {
+		RecordReadback(frame);
+		capture_requested_ = false;
+	}
+
+	if (timestamp_pool_ != VK_NULL_HANDLE) {
+		vkCmdWriteTimestamp(command_buffer_, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestamp_pool_, current_frame_ * kTimestampsPerFrame + 1);
+		frame.timestamps_written = true;
+	}
+
+	VkResult end_buffer_result = vkEndCommandBuffer(command_buffer_);
+	if (end_buffer_result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to record command buffer!");
+	}
+}
+
+bool Graphics::BeginFrame()
+{
+	FrameData& frame = frames_[current_frame_];
+
+	CheckFrameAllocations();
+	if (host_allocations_ != nullptr) {
+		host_allocations_->BeginFrame();
+	}
+
+	vkWaitForFences(logical_device_, 1, frame.in_flight.GetAddress(), VK_TRUE, std::numeric_limits<std::uint64_t>::max());
+	// The GPU is done with this frame, so nothing can still point into its arenas
+	frame_arenas_.BeginFrame(current_frame_);
+	// Fences signal in submission order: every frame up to this slot's previous one is done
+	if (frame_number_ >= frames_.size()) {
+		const std::uint64_t completed_frame = frame_number_ - frames_.size();
+		deletion_queue_.Collect(completed_frame);
+		const auto still_in_use = std::find_if(
+		    released_memory_.begin(), released_memory_.end(), [&](const ReleasedMemory& released) { return released.last_use_frame > completed_frame; });
+		released_memory_.erase(released_memory_.begin(), still_in_use);
+		FinishMeshUploads(completed_frame);
+	}
+	UpdateMemoryBudgets();
+	EnforceMemoryBudget();
+	if (overlay_) {
+		const gsl::span<OverlayVertex> vertices(static_cast<OverlayVertex*>(frame.overlay_vertices.mapped), settings_.max_overlay_quads * kOverlayVerticesPerQuad);
+		overlay_batch_ = OverlayBatch(vertices, glyph_atlas_extent_);
+	}
+	DeliverReadback(frame);
+	ReadGpuFrameTime(frame);
+	ReadPipelineStatistics(frame);
+	ReadOcclusionStats(frame);
+
+	// Offscreen targets are indexed like the frames, and the fence already guards them
+	if (settings_.offscreen) {
+		surfaces_.front().image_index = current_frame_;
+		surfaces_.front().acquired = true;
+	}
+	else {
+		// Before any image is held. A minimized primary window skips the frame, another
+		// minimized window only misses it.
+		WindowSurface& primary = surfaces_.front();
+		if (primary.out_of_date && !RecreateSwapChain(primary)) {
+			return false;
+		}
+		for (WindowSurface& surface : surfaces_) {
+			surface.acquired = false;
+			if (surface.out_of_date && &surface != &primary) {
+				RecreateSwapChain(surface);
+			}
+		}
+
+		// The primary window goes first: without its image the frame is skipped before any
+		// other image is held. Another window without an image only misses this frame.
+		for (WindowSurface& surface : surfaces_) {
+			if (surface.out_of_date) {
+				continue;
+			}
+			VkResult acquire_result = vkAcquireNextImageKHR(
+			    logical_device_,
+			    surface.swap_chain,
+			    std::numeric_limits<std::uint64_t>::max(),
+			    surface.image_available[current_frame_],
+			    VK_NULL_HANDLE,
+			    &surface.image_index);
+			surface.acquired = acquire_result == VK_SUCCESS || acquire_result == VK_SUBOPTIMAL_KHR;
+			if (acquire_result == VK_ERROR_OUT_OF_DATE_KHR) {
+				surface.out_of_date = true;
+				if (&surface == &primary) {
+					// Nothing was acquired, so it is recreated right away
+					RecreateSwapChain(primary);
+					return false;
+				}
+				continue;
+			}
+			if (!surface.acquired) {
+				throw std::runtime_error("Failed to acquire swapchain image");
+			}
+			// Still presentable: drawn this frame and recreated by the next
+			if (acquire_result == VK_SUBOPTIMAL_KHR) {
+				surface.out_of_date = true;
+			}
+		}
+	}
+
+	// Only reset once work is guaranteed to be submitted, or the next wait would hang
+	vkResetFences(logical_device_, 1, frame.in_flight.GetAddress());
+
+	command_buffer_ = frame.command_buffer;
+	vkResetCommandBuffer(command_buffer_, 0);
+	BeginCommands();
+	return true;
+}
+
+void Graphics::EndFrame()
+{
+	EndCommands();
+
+	FrameData& frame = frames_[current_frame_];
+	// With dynamic resolution the swapchain image is only needed once the upscale blit runs
+	const VkPipelineStageFlags wait_stage = dynamic_resolution_ ? VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+
+	// One submission waits for every acquired image and one present shows them all. Offscreen
+	// there is no image to wait for and nobody to signal.
+	std::pmr::memory_resource* memory = GetFrameMemory(jobs_ != nullptr ? jobs_->GetCurrentThreadIndex() : 0);
+	std::pmr::vector<VkSemaphore> image_available(memory);
+	std::pmr::vector<VkPipelineStageFlags> wait_stages(memory);
+	std::pmr::vector<VkSemaphore> render_finished(memory);
+	std::pmr::vector<VkSwapchainKHR> swap_chains(memory);
+	std::pmr::vector<std::uint32_t> image_indices(memory);
+	std::pmr::vector<WindowSurface*> presented(memory);
+	if (!settings_.offscreen) {
+		for (WindowSurface& surface : surfaces_) {
+			if (!surface.acquired) {
+				continue;
+			}
+			image_available.push_back(surface.image_available[current_frame_]);
+			wait_stages.push_back(wait_stage);
+			render_finished.push_back(surface.render_finished[surface.image_index]);
+			swap_chains.push_back(surface.swap_chain);
+			image_indices.push_back(surface.image_index);
+			presented.push_back(&surface);
+			surface.acquired = false;
+		}
+	}
+
+	// Mesh uploads go first; their barrier orders the copies before the frame's vertex input
+	const std::array<VkCommandBuffer, 2> command_buffers = {frame.upload_command_buffer, command_buffer_};
+	const std::uint32_t first_command_buffer = frame.uploads_recorded ? 0 : 1;
+	if (frame.uploads_recorded) {
+		if (vkEndCommandBuffer(frame.upload_command_buffer) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to record the upload command buffer");
+		}
+		frame.uploads_recorded = false;
+	}
+
+	VkSubmitInfo submit_info = {};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.waitSemaphoreCount = gsl::narrow_cast<std::uint32_t>(image_available.size());
+	submit_info.pWaitSemaphores = image_available.data();
+	submit_info.pWaitDstStageMask = wait_stages.data();
+	submit_info.commandBufferCount = gsl::narrow_cast<std::uint32_t>(command_buffers.size()) - first_command_buffer;
+	submit_info.pCommandBuffers = command_buffers.data() + first_command_buffer;
+	submit_info.signalSemaphoreCount = gsl::narrow_cast<std::uint32_t>(render_finished.size());
+	submit_info.pSignalSemaphores = render_finished.data();
+
+	VkResult submit_result = vkQueueSubmit(graphics_queue_, 1, &submit_info, frame.in_flight);
+	if (submit_result != VK_SUCCESS) {
+		throw std::runtime_error("Failed to submit draw command buffer");
+	}
+
+	if (!swap_chains.empty()) {
+		// Per swapchain results, so one window going out of date does not hide another's failure
+		std::pmr::vector<VkResult> present_results(swap_chains.size(), VK_SUCCESS, memory);
+
+		VkPresentInfoKHR present_info = {};
+		present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+		present_info.waitSemaphoreCount = gsl::narrow_cast<std::uint32_t>(render_finished.size());
+		present_info.pWaitSemaphores = render_finished.data();
+		present_info.swapchainCount = gsl::narrow_cast<std::uint32_t>(swap_chains.size());
+		present_info.pSwapchains = swap_chains.data();
+		present_info.pImageIndices = image_indices.data();
+		present_info.pResults = present_results.data();
+
+		vkQueuePresentKHR(presentation_queue_, &present_info);
+		for (std::size_t i = 0; i < present_results.size(); i++) {
+			const VkResult present_result = present_results[i];
+			if (present_result != VK_SUCCESS && present_result != VK_SUBOPTIMAL_KHR && present_result != VK_ERROR_OUT_OF_DATE_KHR) {
+				throw std::runtime_error("Failed to present swapchain image");
+			}
+			// Recreated by the next BeginFrame
+			if (present_result != VK_SUCCESS) {
+				presented[i]->out_of_date = true;
+			}
+		}
+	}
+
+	current_frame_ = (current_frame_ + 1) % gsl::narrow_cast<std::uint32_t>(frames_.size());
+	frame_number_++;
+
+	// Otherwise a suppressed burst is only summarized when the next validation message comes
+	validation_filter_.Flush();
+}
+
+std::pmr::memory_resource* Graphics::GetFrameMemory(std::uint32_t thread_index)
+{
+	// The arenas are not synchronized, and a second outside thread would share the main thread's
+	const std::uint32_t outside_thread_index = jobs_ != nullptr ? jobs_->GetWorkerCount() : 0;
+	Expects(thread_index != outside_thread_index || std::this_thread::get_id() == main_thread_);
+	return &frame_arenas_.Get(thread_index);
+}
+
+#pragma region MESHES
+
+MeshId Graphics::UploadMesh(const MeshFile& mesh)
+{
+	const MeshFileHeader& header = mesh.GetHeader();
+	MeshBuffers buffers;
+	buffers.index_count = header.index_count;
+	buffers.index_type = header.index_size == 2 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+	buffers.bounds_min = header.bounds_min;
+	buffers.bounds_max = header.bounds_max;
+	buffers.lods.assign(mesh.GetLods().begin(), mesh.GetLods().end());
+	UploadMeshBuffers(mesh, buffers);
+
+	meshes_.push_back(std::move(buffers));
+	return gsl::narrow_cast<MeshId>(meshes_.size() - 1);
+}
+
+MeshId Graphics::UploadStreamableMesh(std::shared_ptr<const MeshFile> mesh)
+{
+	Expects(mesh != nullptr);
+	const MeshId id = UploadMesh(*mesh);
+	MeshBuffers& buffers = meshes_[id];
+	// Both buffers are device local, so they share a heap
+	buffers.residency = residency_.Add(
+	    buffers.vertices.heap_usage.GetHeap(), buffers.vertices.heap_usage.GetSize() + buffers.indices.heap_usage.GetSize(), frame_number_);
+	buffers.source = std::move(mesh);
+	residency_meshes_.push_back(id);
+	uploading_meshes_.reserve(residency_meshes_.size());
+	for (FrameData& frame : frames_) {
+		for (SceneCommands& scene_commands : frame.scene_commands) {
+			scene_commands.meshes.reserve(residency_meshes_.size());
+		}
+	}
+	return id;
+}
+
+void Graphics::UploadMeshBuffers(const MeshFile& mesh, MeshBuffers& buffers)
+{
+	const BufferHandle staging = StageMeshBuffers(mesh, buffers);
+	SubmitAndWait([&](VkCommandBuffer command_buffer) { RecordMeshCopy(command_buffer, mesh, staging.buffer, buffers); });
+}
+
+Graphics::BufferHandle Graphics::StageMeshBuffers(const MeshFile& mesh, MeshBuffers& buffers)
+{
+	const gsl::span<const std::uint8_t> vertex_bytes = mesh.GetVertexBytes();
+	const gsl::span<const std::uint8_t> index_bytes = mesh.GetIndexBytes();
+	Expects(!vertex_bytes.empty() && !index_bytes.empty());
+
+	// The file is laid out for the GPU already, so the upload is two plain copies
+	BufferHandle staging = CreateBuffer(
+	    vertex_bytes.size() + index_bytes.size(), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	std::memcpy(staging.mapped, vertex_bytes.data(), vertex_bytes.size());
+	std::memcpy(static_cast<std::uint8_t*>(staging.mapped) + vertex_bytes.size(), index_bytes.data(), index_bytes.size());
+
+	buffers.vertices =
+	    CreateBuffer(vertex_bytes.size(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	buffers.indices = CreateBuffer(index_bytes.size(), VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	return staging;
+}
+
+void Graphics::RecordMeshCopy(VkCommandBuffer command_buffer, const MeshFile& mesh, VkBuffer staging, const MeshBuffers& buffers)
+{
+	const VkDeviceSize vertex_size = mesh.GetVertexBytes().size();
+
+	VkBufferCopy vertex_copy = {};
+	vertex_copy.size = vertex_size;
+	vkCmdCopyBuffer(command_buffer, staging, buffers.vertices.buffer, 1, &vertex_copy);
+
+	VkBufferCopy index_copy = {};
+	index_copy.srcOffset = vertex_size;
+	index_copy.size = mesh.GetIndexBytes().size();
+	vkCmdCopyBuffer(command_buffer, staging, buffers.indices.buffer, 1, &index_copy);
+
+	// Makes the copies visible to the vertex input of everything submitted after them
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+VkCommandBuffer Graphics::BeginUploadCommands()
+{
+	FrameData& frame = frames_[current_frame_];
+	if (!frame.uploads_recorded) {
+		vkResetCommandBuffer(frame.upload_command_buffer, 0);
+		VkCommandBufferBeginInfo begin_info = {};
+		begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		if (vkBeginCommandBuffer(frame.upload_command_buffer, &begin_info) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to begin the upload command buffer");
+		}
+		frame.uploads_recorded = true;
+	}
+	return frame.upload_command_buffer;
+}
+
+void Graphics::FinishMeshUploads(std::uint64_t completed_frame)
+{
+	const auto finished = [&](MeshId mesh) {
+		MeshBuffers& buffers = meshes_[mesh];
+		if (buffers.upload_frame.value() > completed_frame) {
+			return false;
+		}
+		buffers.upload_frame.reset();
+		return true;
+	};
+	// Recorded draws left them out
+	if (std::erase_if(uploading_meshes_, finished) > 0) {
+		MarkSceneDirty();
+	}
+}
+
+Graphics::MeshBuffers* Graphics::UseMesh(MeshId mesh)
+{
+	MeshBuffers& buffers = meshes_[mesh];
+	if (!buffers.residency.has_value()) {
+		return &buffers;
+	}
+
+	const ResidencyManager::ResourceId id = buffers.residency.value();
+	if (!residency_.IsResident(id)) {
+		// Copied ahead of this frame's draws, which cannot use it yet: it only counts as
+		// drawable once the frame's fence shows the copy is done, so nothing waits for it.
+		// Over budget now, the next BeginFrame evicts something else.
+		SPDLOG_INFO("Restoring evicted mesh {}", mesh);
+		frame_allocations_expected_ = true;
+		BufferHandle staging = StageMeshBuffers(*buffers.source, buffers);
+		RecordMeshCopy(BeginUploadCommands(), *buffers.source, staging.buffer, buffers);
+		RetireBuffer(staging);
+		buffers.upload_frame = frame_number_;
+		uploading_meshes_.push_back(mesh);
+		residency_.SetRestored(id, frame_number_);
+		return nullptr;
+	}
+	residency_.Touch(id, frame_number_);
+	if (buffers.upload_frame.has_value()) {
+		return nullptr;
+	}
+	if (settings_.reuse_scene_commands) {
+		// Each streamable mesh at most once, which the lists have room for
+		std::vector<MeshId>& recorded = frames_[current_frame_].scene_commands[in_depth_prepass_ ? 0 : 1].meshes;
+		if (std::find(recorded.begin(), recorded.end(), mesh) == recorded.end()) {
+			recorded.push_back(mesh);
+		}
+	}
+	return &buffers;
+}
+
+void Graphics::EvictMesh(MeshId mesh)
+{
+	MeshBuffers& buffers = meshes_[mesh];
+	// Used in the frame that uploads it, so protected until the upload has finished
+	Expects(!buffers.upload_frame.has_value());
+	RetireBuffer(buffers.vertices);
+	RetireBuffer(buffers.indices);
+	residency_.SetEvicted(buffers.residency.value());
+	// Recorded draws may still bind the buffers
+	MarkSceneDirty();
+}
+
+void Graphics::BindMesh(const MeshBuffers& mesh)
+{
+	BindGraphicsPipeline(in_depth_prepass_ ? mesh_depth_prepass_pipeline_ : mesh_pipeline_);
+
+	// Binding 0 keeps the instance matrices bound by BeginSceneCommands
+	VkDeviceSize vertex_offset = 0;
+	vkCmdBindVertexBuffers(command_buffer_, 1, 1, mesh.vertices.buffer.GetAddress(), &vertex_offset);
+	vkCmdBindIndexBuffer(command_buffer_, mesh.indices.buffer, 0, mesh.index_type);
+
+	const std::array<glm::vec4, 2> bounds = {glm::vec4(mesh.bounds_min, 0.0f), glm::vec4(mesh.bounds_max - mesh.bounds_min, 0.0f)};
+	vkCmdPushConstants(command_buffer_, pipeline_layout_, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(bounds), bounds.data());
+}
+
+void Graphics::DrawMesh(MeshId mesh, gsl::span<const DrawIndexedCommand> draws)
+{
+	if (draws.empty() || replaying_scene_) {
+		return;
+	}
+	const MeshBuffers* buffers = UseMesh(mesh);
+	if (buffers == nullptr) {
+		return;
+	}
+	BindMesh(*buffers);
+	for (const DrawIndexedCommand& draw : draws) {
+		vkCmdDrawIndexed(command_buffer_, draw.index_count, draw.instance_count, draw.first_index, draw.vertex_offset, draw.first_instance);
+	}
+}
+
+void Graphics::DrawMeshIndirect(MeshId mesh, gsl::span<const DrawIndexedCommand> draws)
+{
+	static_assert(sizeof(DrawIndexedCommand) == sizeof(VkDrawIndexedIndirectCommand), "DrawIndexedCommand mirrors VkDrawIndexedIndirectCommand");
+	static_assert(offsetof(DrawIndexedCommand, first_instance) == offsetof(VkDrawIndexedIndirectCommand, firstInstance));
+
+	// Run-merged draws start at arbitrary instances and come several to a call
+	if (!device_features_.multi_draw_indirect || !device_features_.draw_indirect_first_instance) {
+		DrawMesh(mesh, draws);
+		return;
+	}
+	// The commands stay in this frame in flight's indirect buffer for the replays
+	if (draws.empty() || replaying_scene_) {
+		return;
+	}
+	Expects(indirect_draw_count_ + draws.size() <= settings_.max_indirect_draws);
+
+	const MeshBuffers* buffers = UseMesh(mesh);
+	if (buffers == nullptr) {
+		return;
+	}
+	BindMesh(*buffers);
+	const FrameData& frame = frames_[current_frame_];
+	const VkDeviceSize offset = VkDeviceSize(indirect_draw_count_) * sizeof(DrawIndexedCommand);
+	std::memcpy(static_cast<std::uint8_t*>(frame.indirect_buffer.mapped) + offset, draws.data(), draws.size_bytes());
+	indirect_draw_count_ += gsl::narrow_cast<std::uint32_t>(draws.size());
+	vkCmdDrawIndexedIndirect(command_buffer_, frame.indirect_buffer.buffer, offset, gsl::narrow_cast<std::uint32_t>(draws.size()), sizeof(DrawIndexedCommand));
+}
+
+#pragma endregion
+
+#pragma region MEMORY_BUDGET
+
+void Graphics::UpdateMemoryBudgets()
+{
+	VkPhysicalDeviceMemoryBudgetPropertiesEXT driver_budget = {};
+	if (device_features_.memory_budget) {
+		driver_budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+		VkPhysicalDeviceMemoryProperties2 properties = {};
+		properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+		properties.pNext = &driver_budget;
+		vkGetPhysicalDeviceMemoryProperties2(physical_device_, &properties);
+	}
+
+	for (std::uint32_t i = 0; i < memory_budgets_.size(); i++) {
+		MemoryHeapBudget& heap = memory_budgets_[i];
+		heap.size = memory_properties_.memoryHeaps[i].size;
+		heap.device_local = memory_properties_.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+		heap.budget = device_features_.memory_budget ? driver_budget.heapBudget[i] : heap.size;
+		heap.usage = device_features_.memory_budget ? driver_budget.heapUsage[i] : heap_usage_[i].load(std::memory_order_relaxed);
+		heap.releasing = 0;
+	}
+	for (const ReleasedMemory& released : released_memory_) {
+		memory_budgets_[released.heap_usage.GetHeap()].releasing += released.heap_usage.GetSize();
+	}
+}
+
+void Graphics::EnforceMemoryBudget()
+{
+	std::pmr::memory_resource* memory = GetFrameMemory(jobs_ != nullptr ? jobs_->GetCurrentThreadIndex() : 0);
+	const std::pmr::vector<ResidencyManager::ResourceId> evictions = residency_.SelectEvictions(memory_budgets_, frame_number_, settings_.memory_budget_fill, memory);
+	for (ResidencyManager::ResourceId id : evictions) {
+		EvictMesh(residency_meshes_[id]);
+	}
+	// The deletion queue takes the buffers
+	frame_allocations_expected_ |= !evictions.empty();
+}
+
+void Graphics::LogMemoryBudgets() const
+{
+	constexpr std::double_t kMiB = 1024.0 * 1024.0;
+	for (std::size_t i = 0; i < memory_budgets_.size(); i++) {
+		const MemoryHeapBudget& heap = memory_budgets_[i];
+		SPDLOG_INFO(
+		    "Memory heap {}{}: {:.1f} of {:.1f} MiB budget used ({:.1f} MiB releasing), {:.1f} MiB in size",
+		    i,
+		    heap.device_local ? " (device local)" : "",
+		    heap.usage / kMiB,
+		    heap.budget / kMiB,
+		    heap.releasing / kMiB,
+		    heap.size / kMiB);
+	}
+	const ResidencyStats stats = residency_.GetStats();
+	SPDLOG_INFO(
+	    "Streamable meshes: {} of {} resident ({:.1f} MiB), {} evictions, {} restores",
+	    stats.resident,
+	    stats.resources,
+	    stats.resident_bytes / kMiB,
+	    stats.evictions,
+	    stats.restores);
+}
+
+#pragma endregion
+
+#pragma region OCCLUSION_CULLING
+
+namespace {
+
+// Push constants of depth_pyramid.comp and occlusion_cull.comp
+struct PyramidConstants {
+	glm::uvec2 source_size;
+	glm::uvec2 destination_size;
+};
+
+struct CullConstants {
+	glm::mat4 view_projection;
+	glm::uvec2 depth_size;
+	std::uint32_t object_count;
+	std::uint32_t late;
+};
+
+// Written by occlusion_cull.comp, in the order of its Statistics block
+struct OcclusionCounters {
+	std::uint32_t drawn_early;
+	std::uint32_t drawn_late;
+	std::uint32_t occluded;
+	std::uint32_t triangles;
+};
+
+constexpr std::uint32_t kPyramidGroupSize = 8;
+constexpr std::uint32_t kCullGroupSize = 64;
+
+std::uint32_t DivideRoundingUp(std::uint32_t value, std::uint32_t divisor)
+{
+	return (value + divisor - 1) / divisor;
+}
+
+}  // namespace
+
+bool Graphics::IsOcclusionCullingSupported()
+{
+	// Culling splits the frame into several rendering scopes and issues one indirect draw per
+	// batch, each starting at its own instance
+	if (!device_features_.dynamic_rendering || !device_features_.multi_draw_indirect || !device_features_.draw_indirect_first_instance) {
+		SPDLOG_WARN("Occlusion culling needs dynamic rendering and multi-draw indirect, it stays off");
+		return false;
+	}
+	// Multisampled depth cannot be downsampled with plain fetches, and the pre-pass already
+	// has its own depth-only scope
+	if (msaa_samples_ != VK_SAMPLE_COUNT_1_BIT || settings_.depth_prepass) {
+		SPDLOG_WARN("Occlusion culling does not combine with MSAA or the depth pre-pass, it stays off");
+		return false;
+	}
+
+	VkFormatProperties properties;
+	vkGetPhysicalDeviceFormatProperties(physical_device_, depth_format_, &properties);
+	if (!(properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)) {
+		SPDLOG_WARN("Depth format cannot be sampled, occlusion culling stays off");
+		return false;
+	}
+	return true;
+}
+
+void Graphics::CreateOcclusionCulling()
+{
+	// Only needed for the pipelines below
+	const auto _release_code = gsl::finally([this]() {
+		depth_pyramid_shader_code_ = {};
+		occlusion_cull_shader_code_ = {};
+	});
+	if (!occlusion_culling_) {
+		return;
+	}
+
+	// The shaders only use texelFetch, so filtering never applies
+	VkSamplerCreateInfo sampler_info = {};
+	sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	sampler_info.magFilter = VK_FILTER_NEAREST;
+	sampler_info.minFilter = VK_FILTER_NEAREST;
+	sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_info.maxLod = VK_LOD_CLAMP_NONE;
+
+	const VkAllocationCallbacks* sampler_allocator = GetHostAllocator(VK_OBJECT_TYPE_SAMPLER);
+	if (vkCreateSampler(logical_device_, &sampler_info, sampler_allocator, depth_sampler_.Put(logical_device_, sampler_allocator)) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create the depth sampler");
+	}
+
+	const VkDeviceSize object_capacity = settings_.max_culled_objects;
+	object_visibility_ = CreateBuffer(
+	    sizeof(std::uint32_t) * object_capacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	for (FrameData& frame : frames_) {
+		frame.culled_objects = CreateBuffer(
+		    sizeof(CulledObject) * object_capacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		// Early commands first, then the late ones
+		frame.culled_commands = CreateBuffer(
+		    sizeof(DrawIndexedCommand) * object_capacity * 2,
+		    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+		    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		frame.occlusion_counters = CreateBuffer(
+		    sizeof(OcclusionCounters),
+		    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	}
+
+	// Nothing counts as visible before the first frame
+	SubmitAndWait([this](VkCommandBuffer command_buffer) {
+		vkCmdFillBuffer(command_buffer, object_visibility_.buffer, 0, VK_WHOLE_SIZE, 0);
+
+		VkBufferMemoryBarrier buffer_barrier = {};
+		buffer_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		buffer_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		buffer_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		buffer_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		buffer_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		buffer_barrier.buffer = object_visibility_.buffer;
+		buffer_barrier.size = VK_WHOLE_SIZE;
+
+		vkCmdPipelineBarrier(
+		    command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &buffer_barrier, 0, nullptr);
+	});
+
+	// Descriptors: the pyramid reads one level (or the depth buffer) and writes the next; the
+	// culling pass sees the frame's buffers and the whole pyramid. Both layouts come from the
+	// shaders, each of which uses set 0 only.
+	const ShaderReflection pyramid_reflection = ReflectShader(depth_pyramid_shader_code_, "depth_pyramid.comp");
+	const ShaderReflection cull_reflection = ReflectShader(occlusion_cull_shader_code_, "occlusion_cull.comp");
+	const PipelineLayoutHandles pyramid_layout = GetPipelineLayout({&pyramid_reflection, 1});
+	const PipelineLayoutHandles cull_layout = GetPipelineLayout({&cull_reflection, 1});
+	Expects(pyramid_layout.set_layouts.size() == 1 && cull_layout.set_layouts.size() == 1);
+	pyramid_pipeline_layout_ = pyramid_layout.layout;
+	cull_pipeline_layout_ = cull_layout.layout;
+	pyramid_set_layout_ = pyramid_layout.set_layouts[0];
+	cull_set_layout_ = cull_layout.set_layouts[0];
+
+	CreateDepthPyramid();
+
+	// Pipelines
+	UniqueShaderModule pyramid_shader = CreateShaderModule(depth_pyramid_shader_code_);
+	UniqueShaderModule cull_shader = CreateShaderModule(occlusion_cull_shader_code_);
+	if (pyramid_shader == VK_NULL_HANDLE || cull_shader == VK_NULL_HANDLE) {
+		throw std::runtime_error("Could not load the occlusion culling shaders");
+	}
+
+	VkComputePipelineCreateInfo pipeline_info = {};
+	pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipeline_info.stage.module = pyramid_shader;
+	pipeline_info.stage.pName = "main";
+	pipeline_info.layout = pyramid_pipeline_layout_;
+	const VkAllocationCallbacks* pipeline_allocator = GetHostAllocator(VK_OBJECT_TYPE_PIPELINE);
+	if (vkCreateComputePipelines(
+	        logical_device_, VK_NULL_HANDLE, 1, &pipeline_info, pipeline_allocator, depth_pyramid_pipeline_.Put(logical_device_, pipeline_allocator)) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create the depth pyramid pipeline");
+	}
+	pipeline_info.stage.module = cull_shader;
+	pipeline_info.layout = cull_pipeline_layout_;
+	if (vkCreateComputePipelines(
+	        logical_device_, VK_NULL_HANDLE, 1, &pipeline_info, pipeline_allocator, occlusion_cull_pipeline_.Put(logical_device_, pipeline_allocator)) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create the occlusion culling pipeline");
+	}
+}
+
+void Graphics::CreateDepthPyramid()
+{
+	if (!occlusion_culling_) {
+		return;
+	}
+
+	// Level 0 is half the depth buffer, rounded up so no edge texel is dropped
+	const VkExtent2D& extent = surfaces_.front().extent;
+	const VkExtent2D pyramid_extent = {std::max(1u, (extent.width + 1) / 2), std::max(1u, (extent.height + 1) / 2)};
+	depth_pyramid_levels_ = static_cast<std::uint32_t>(std::floor(std::log2(std::max(pyramid_extent.width, pyramid_extent.height)))) + 1;
+	RetireImage(depth_pyramid_);
+	depth_pyramid_ = CreateImage(
+	    pyramid_extent, VK_FORMAT_R32_SFLOAT, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_COLOR_BIT, VK_SAMPLE_COUNT_1_BIT, depth_pyramid_levels_);
+
+	for (UniqueImageView& mip : depth_pyramid_mips_) {
+		Retire(mip);
+	}
+	depth_pyramid_mips_.clear();
+	depth_pyramid_mips_.resize(depth_pyramid_levels_);
+	for (std::uint32_t level = 0; level < depth_pyramid_levels_; level++) {
+		VkImageViewCreateInfo view_info = {};
+		view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		view_info.image = depth_pyramid_.image;
+		view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		view_info.format = VK_FORMAT_R32_SFLOAT;
+		view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		view_info.subresourceRange.baseMipLevel = level;
+		view_info.subresourceRange.levelCount = 1;
+		view_info.subresourceRange.layerCount = 1;
+
+		const VkAllocationCallbacks* view_allocator = GetHostAllocator(VK_OBJECT_TYPE_IMAGE_VIEW);
+		if (vkCreateImageView(logical_device_, &view_info, view_allocator, depth_pyramid_mips_[level].Put(logical_device_, view_allocator)) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create a depth pyramid view");
+		}
+	}
+
+	// Every level starts out in GENERAL and stays there
+	SubmitAndWait([this](VkCommandBuffer command_buffer) {
+		VkImageMemoryBarrier image_barrier = {};
+		image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		image_barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		image_barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		image_barrier.image = depth_pyramid_.image;
+		image_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		image_barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		image_barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+		image_barrier.subresourceRange.layerCount = 1;
+
+		vkCmdPipelineBarrier(
+		    command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &image_barrier);
+	});
+
+	// The level count follows the extent, so the pool and its sets are made again with it
+	const std::uint32_t frame_count = gsl::narrow_cast<std::uint32_t>(frames_.size());
+	std::array<VkDescriptorPoolSize, 3> pool_sizes = {};
+	pool_sizes[0] = {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, depth_pyramid_levels_ + frame_count};
+	pool_sizes[1] = {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, depth_pyramid_levels_};
+	pool_sizes[2] = {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4 * frame_count};
+
+	VkDescriptorPoolCreateInfo pool_info = {};
+	pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pool_info.maxSets = depth_pyramid_levels_ + frame_count;
+	pool_info.poolSizeCount = pool_sizes.size();
+	pool_info.pPoolSizes = pool_sizes.data();
+	const VkAllocationCallbacks* pool_allocator = GetHostAllocator(VK_OBJECT_TYPE_DESCRIPTOR_POOL);
+	Retire(occlusion_descriptor_pool_);
+	if (vkCreateDescriptorPool(logical_device_, &pool_info, pool_allocator, occlusion_descriptor_pool_.Put(logical_device_, pool_allocator)) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create the occlusion descriptor pool");
+	}
+
+	std::vector<VkDescriptorSetLayout> set_layouts(depth_pyramid_levels_, pyramid_set_layout_);
+	set_layouts.resize(depth_pyramid_levels_ + frame_count, cull_set_layout_);
+	std::vector<VkDescriptorSet> sets(set_layouts.size());
+
+	VkDescriptorSetAllocateInfo allocate_info = {};
+	allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocate_info.descriptorPool = occlusion_descriptor_pool_;
+	allocate_info.descriptorSetCount = gsl::narrow_cast<std::uint32_t>(set_layouts.size());
+	allocate_info.pSetLayouts = set_layouts.data();
+	if (vkAllocateDescriptorSets(logical_device_, &allocate_info, sets.data()) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to allocate the occlusion descriptor sets");
+	}
+	pyramid_descriptor_sets_.assign(sets.begin(), sets.begin() + depth_pyramid_levels_);
+
+	// Level 0 reads the depth buffer, which is sampled between the early and late draws
+	for (std::uint32_t level = 0; level < depth_pyramid_levels_; level++) {
+		VkDescriptorImageInfo source = {};
+		source.sampler = depth_sampler_;
+		source.imageView = level == 0 ? VkImageView(depth_image_.view) : VkImageView(depth_pyramid_mips_[level - 1]);
+		source.imageLayout = level == 0 ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+
+		VkDescriptorImageInfo destination = {};
+		destination.imageView = depth_pyramid_mips_[level];
+		destination.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		std::array<VkWriteDescriptorSet, 2> writes = {};
+		for (std::uint32_t binding = 0; binding < writes.size(); binding++) {
+			writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[binding].dstSet = pyramid_descriptor_sets_[level];
+			writes[binding].dstBinding = binding;
+			writes[binding].descriptorCount = 1;
+			writes[binding].descriptorType = binding == 0 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		}
+		writes[0].pImageInfo = &source;
+		writes[1].pImageInfo = &destination;
+		vkUpdateDescriptorSets(logical_device_, writes.size(), writes.data(), 0, nullptr);
+	}
+
+	for (std::uint32_t i = 0; i < frame_count; i++) {
+		FrameData& frame = frames_[i];
+		frame.cull_descriptor_set = sets[depth_pyramid_levels_ + i];
+
+		const std::array<VkDescriptorBufferInfo, 4> buffers = {{
+		    {frame.culled_objects.buffer, 0, VK_WHOLE_SIZE},
+		    {frame.culled_commands.buffer, 0, VK_WHOLE_SIZE},
+		    {object_visibility_.buffer, 0, VK_WHOLE_SIZE},
+		    {frame.occlusion_counters.buffer, 0, VK_WHOLE_SIZE},
+		}};
+		VkDescriptorImageInfo pyramid = {};
+		pyramid.sampler = depth_sampler_;
+		pyramid.imageView = depth_pyramid_.view;
+		pyramid.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		std::array<VkWriteDescriptorSet, 5> writes = {};
+		for (std::uint32_t binding = 0; binding < writes.size(); binding++) {
+			writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[binding].dstSet = frame.cull_descriptor_set;
+			writes[binding].dstBinding = binding;
+			writes[binding].descriptorCount = 1;
+			writes[binding].descriptorType = binding < buffers.size() ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			if (binding < buffers.size()) {
+				writes[binding].pBufferInfo = &buffers[binding];
+			}
+		}
+		writes[4].pImageInfo = &pyramid;
+		vkUpdateDescriptorSets(logical_device_, writes.size(), writes.data(), 0, nullptr);
+	}
+}
+
+void Graphics::RecordMemoryBarrier(VkPipelineStageFlags src_stage, VkAccessFlags src_access, VkPipelineStageFlags dst_stage, VkAccessFlags dst_access)
+{
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = src_access;
+	barrier.dstAccessMask = dst_access;
+	vkCmdPipelineBarrier(command_buffer_, src_stage, dst_stage, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void Graphics::ResumeRendering()
+{
+	// Attachment writes of the previous scope must land before this one loads them
+	RecordMemoryBarrier(
+	    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+	    VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+	    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+	    VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+	        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT);
+	BeginDynamicRendering(false, true);
+}
+
+void Graphics::BuildDepthPyramid()
+{
+	TransitionImage({
+	    .image = depth_image_.image,
+	    .aspect = depth_aspect_,
+	    .old_layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+	    .new_layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+	    .src_stage = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+	    .src_access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+	    .dst_stage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+	    .dst_access = VK_ACCESS_SHADER_READ_BIT,
+	});
+
+	// Only the rendered area is reduced; each level is half of the one below, rounded up
+	vkCmdBindPipeline(command_buffer_, VK_PIPELINE_BIND_POINT_COMPUTE, depth_pyramid_pipeline_);
+	VkExtent2D source = render_extent_;
+	for (std::uint32_t level = 0; level < depth_pyramid_levels_; level++) {
+		const VkExtent2D destination = {std::max(1u, (source.width + 1) / 2), std::max(1u, (source.height + 1) / 2)};
+		const PyramidConstants constants = {{source.width, source.height}, {destination.width, destination.height}};
+
+		vkCmdBindDescriptorSets(command_buffer_, VK_PIPELINE_BIND_POINT_COMPUTE, pyramid_pipeline_layout_, 0, 1, &pyramid_descriptor_sets_[level], 0, nullptr);
+		vkCmdPushConstants(command_buffer_, pyramid_pipeline_layout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+		vkCmdDispatch(command_buffer_, DivideRoundingUp(destination.width, kPyramidGroupSize), DivideRoundingUp(destination.height, kPyramidGroupSize), 1);
+		// Covers the next level's reads and, after the last one, the culling pass
+		RecordMemoryBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+		source = destination;
+	}
+
+	TransitionImage({
+	    .image = depth_image_.image,
+	    .aspect = depth_aspect_,
+	    .old_layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+	    .new_layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+	    .src_stage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+	    .src_access = 0,
+	    .dst_stage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+	    .dst_access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+	});
+}
+
+void Graphics::DispatchOcclusionCull(const FrameData& frame, const glm::mat4& view_projection, std::uint32_t object_count, bool late)
+{
+	const CullConstants constants = {view_projection, {render_extent_.width, render_extent_.height}, object_count, late ? 1u : 0u};
+
+	vkCmdBindPipeline(command_buffer_, VK_PIPELINE_BIND_POINT_COMPUTE, occlusion_cull_pipeline_);
+	vkCmdBindDescriptorSets(command_buffer_, VK_PIPELINE_BIND_POINT_COMPUTE, cull_pipeline_layout_, 0, 1, &frame.cull_descriptor_set, 0, nullptr);
+	vkCmdPushConstants(command_buffer_, cull_pipeline_layout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+	vkCmdDispatch(command_buffer_, DivideRoundingUp(object_count, kCullGroupSize), 1, 1);
+
+	// The late pass also leaves the counters for ReadOcclusionStats
+	const VkPipelineStageFlags dst_stage = late ? VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT : VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+	const VkAccessFlags dst_access = late ? VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT : VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+	RecordMemoryBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, dst_stage, dst_access);
+}
+
+void Graphics::DrawCulledBatches(const FrameData& frame, gsl::span<const OcclusionBatch> batches, std::uint32_t object_count, bool late)
+{
+	// Every object has a command; the culled ones draw zero instances
+	VkDeviceSize first_command = late ? object_count : 0;
+	for (const OcclusionBatch& batch : batches) {
+		if (batch.objects.empty()) {
+			continue;
+		}
+		// Culled all the same, so the visibility of its objects is kept for when it is back
+		const MeshBuffers* buffers = UseMesh(batch.mesh);
+		if (buffers != nullptr) {
+			BindMesh(*buffers);
+			vkCmdDrawIndexedIndirect(
+			    command_buffer_,
+			    frame.culled_commands.buffer,
+			    first_command * sizeof(DrawIndexedCommand),
+			    gsl::narrow_cast<std::uint32_t>(batch.objects.size()),
+			    sizeof(DrawIndexedCommand));
+		}
+		first_command += batch.objects.size();
+	}
+}
+
+void Graphics::DrawOcclusionCulled(gsl::span<const OcclusionBatch> batches, const glm::mat4& view_projection)
+{
+	// The pyramid covers the primary window
+	Expects(occlusion_culling_ && !in_depth_prepass_ && current_surface_ == 0);
+	FrameData& frame = frames_[current_frame_];
+	Expects(frame.culled_object_count == 0);
+
+	// The objects of all batches back to back, so their commands line up the same way
+	CulledObject* objects = static_cast<CulledObject*>(frame.culled_objects.mapped);
+	std::uint32_t object_count = 0;
+	for (const OcclusionBatch& batch : batches) {
+		Expects(object_count + batch.objects.size() <= settings_.max_culled_objects);
+		std::copy(batch.objects.begin(), batch.objects.end(), objects + object_count);
+		object_count += gsl::narrow_cast<std::uint32_t>(batch.objects.size());
+	}
+	if (object_count == 0) {
+		return;
+	}
+
+	// Dispatches cannot be recorded inside a rendering scope. The barrier also orders this
+	// frame's culling after the previous frame's visibility writes and pyramid reads.
+	cmd_end_rendering_(command_buffer_);
+	vkCmdFillBuffer(command_buffer_, frame.occlusion_counters.buffer, 0, sizeof(OcclusionCounters), 0);
+	RecordMemoryBarrier(
+	    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+	    VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+	    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+	    VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+	// Phase 1: what was visible last frame, against the frustum only
+	BeginStatisticsQuery(kOcclusionCullingStatistics);
+	DispatchOcclusionCull(frame, view_projection, object_count, false);
+	BeginStatisticsQuery(kSceneStatistics);
+	ResumeRendering();
+	DrawCulledBatches(frame, batches, object_count, false);
+	cmd_end_rendering_(command_buffer_);
+
+	// Phase 2: everything against the depth of phase 1; only the newly visible are drawn
+	BeginStatisticsQuery(kOcclusionCullingStatistics);
+	BuildDepthPyramid();
+	DispatchOcclusionCull(frame, view_projection, object_count, true);
+	BeginStatisticsQuery(kSceneStatistics);
+	ResumeRendering();
+	DrawCulledBatches(frame, batches, object_count, true);
+
+	frame.culled_object_count = object_count;
+}
+
+void Graphics::ReadOcclusionStats(FrameData& frame)
+{
+	if (frame.culled_object_count == 0) {
+		return;
+	}
+
+	// Host coherent, and the fence has signalled
+	const OcclusionCounters* counters = static_cast<const OcclusionCounters*>(frame.occlusion_counters.mapped);
+	occlusion_stats_.objects = frame.culled_object_count;
+	occlusion_stats_.drawn_early = counters->drawn_early;
+	occlusion_stats_.drawn_late = counters->drawn_late;
+	occlusion_stats_.occluded = counters->occluded;
+	occlusion_stats_.triangles = counters->triangles;
+	frame.culled_object_count = 0;
+}
+
+#pragma endregion
+
+#pragma region CLUSTERED_LIGHTING
+
+namespace {
+
+// constant_id of light_cluster.comp's workgroup size
+constexpr std::uint32_t kClusterGroupSizeConstant = 0;
+
+}  // namespace
+
+void Graphics::CreateClusteredLighting()
+{
+	// The code is released by CreateGraphicsPipeline, which reflects it as well
+	if (!settings_.clustered_lighting) {
+		return;
+	}
+
+	pending_lights_.reserve(settings_.max_lights);
+
+	const ClusterSettings& clusters = settings_.light_clusters;
+	const VkDeviceSize cluster_count = GetClusterCount(clusters);
+	cluster_counts_ = CreateBuffer(sizeof(std::uint32_t) * cluster_count, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	cluster_light_indices_ = CreateBuffer(
+	    sizeof(std::uint32_t) * cluster_count * clusters.max_lights_per_cluster, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	for (FrameData& frame : frames_) {
+		frame.light_buffer = CreateBuffer(
+		    sizeof(PointLight) * settings_.max_lights, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		frame.cluster_uniforms = CreateBuffer(
+		    sizeof(ClusterUniforms), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	}
+
+	// One set per frame, the same for binning and shading: the grid, the lights, the
+	// per-cluster counts and the per-cluster light lists. Reflected from both shaders so it
+	// carries both stages, the graphics pipeline layout then shares the set layout.
+	const std::array<ShaderReflection, 2> shaders = {
+	    ReflectShader(light_cluster_shader_code_, "light_cluster.comp"), ReflectShader(fragment_shader_code_, "clustered.frag")};
+	const PipelineLayoutHandles layout = GetPipelineLayout(shaders);
+	Expects(layout.set_layouts.size() == 1);
+	light_cluster_pipeline_layout_ = layout.layout;
+	lighting_set_layout_ = layout.set_layouts[0];
+
+	const std::uint32_t frame_count = gsl::narrow_cast<std::uint32_t>(frames_.size());
+	std::array<VkDescriptorPoolSize, 2> pool_sizes = {};
+	pool_sizes[0] = {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, frame_count};
+	pool_sizes[1] = {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3 * frame_count};
+
+	VkDescriptorPoolCreateInfo pool_info = {};
+	pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pool_info.maxSets = frame_count;
+	pool_info.poolSizeCount = pool_sizes.size();
+	pool_info.pPoolSizes = pool_sizes.data();
+	const VkAllocationCallbacks* pool_allocator = GetHostAllocator(VK_OBJECT_TYPE_DESCRIPTOR_POOL);
+	if (vkCreateDescriptorPool(logical_device_, &pool_info, pool_allocator, lighting_descriptor_pool_.Put(logical_device_, pool_allocator)) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create the lighting descriptor pool");
+	}
+
+	std::vector<VkDescriptorSetLayout> set_layouts(frame_count, lighting_set_layout_);
+	std::vector<VkDescriptorSet> sets(frame_count);
+
+	VkDescriptorSetAllocateInfo allocate_info = {};
+	allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocate_info.descriptorPool = lighting_descriptor_pool_;
+	allocate_info.descriptorSetCount = frame_count;
+	allocate_info.pSetLayouts = set_layouts.data();
+	if (vkAllocateDescriptorSets(logical_device_, &allocate_info, sets.data()) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to allocate the lighting descriptor sets");
+	}
+
+	for (std::uint32_t i = 0; i < frame_count; i++) {
+		FrameData& frame = frames_[i];
+		frame.lighting_descriptor_set = sets[i];
+
+		const std::array<VkDescriptorBufferInfo, 4> buffers = {{
+		    {frame.cluster_uniforms.buffer, 0, VK_WHOLE_SIZE},
+		    {frame.light_buffer.buffer, 0, VK_WHOLE_SIZE},
+		    {cluster_counts_.buffer, 0, VK_WHOLE_SIZE},
+		    {cluster_light_indices_.buffer, 0, VK_WHOLE_SIZE},
+		}};
+
+		std::array<VkWriteDescriptorSet, 4> writes = {};
+		for (std::uint32_t binding = 0; binding < writes.size(); binding++) {
+			writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[binding].dstSet = frame.lighting_descriptor_set;
+			writes[binding].dstBinding = binding;
+			writes[binding].descriptorCount = 1;
+			writes[binding].descriptorType = binding == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writes[binding].pBufferInfo = &buffers[binding];
+		}
+		vkUpdateDescriptorSets(logical_device_, writes.size(), writes.data(), 0, nullptr);
+	}
+
+	UniqueShaderModule cluster_shader = CreateShaderModule(light_cluster_shader_code_);
+	if (cluster_shader == VK_NULL_HANDLE) {
+		throw std::runtime_error("Could not load the light clustering shader");
+	}
+
+	VkComputePipelineCreateInfo pipeline_info = {};
+	pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipeline_info.stage.module = cluster_shader;
+	pipeline_info.stage.pName = "main";
+	pipeline_info.layout = light_cluster_pipeline_layout_;
+
+	// The group size is a specialization constant, so the shared light cache is sized to it
+	SpecializationConstants group_size;
+	group_size.Set(kClusterGroupSizeConstant, settings_.light_cluster_group_size);
+	const VkSpecializationInfo group_size_info = group_size.GetInfo();
+	pipeline_info.stage.pSpecializationInfo = &group_size_info;
+	const VkAllocationCallbacks* pipeline_allocator = GetHostAllocator(VK_OBJECT_TYPE_PIPELINE);
+	if (vkCreateComputePipelines(
+	        logical_device_, VK_NULL_HANDLE, 1, &pipeline_info, pipeline_allocator, light_cluster_pipeline_.Put(logical_device_, pipeline_allocator)) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create the light clustering pipeline");
+	}
+}
+
+void Graphics::SetLights(gsl::span<const PointLight> lights, const glm::mat4& view, const glm::mat4& projection)
+{
+	Expects(settings_.clustered_lighting && lights.size() <= settings_.max_lights);
+	pending_lights_.clear();
+	for (const PointLight& light : lights) {
+		pending_lights_.push_back(TransformLight(light, view));
+	}
+	light_projection_ = projection;
+}
+
+void Graphics::RecordLightClustering(FrameData& frame)
+{
+	// Host coherent, and the frame's fence has signalled
+	std::copy(pending_lights_.begin(), pending_lights_.end(), static_cast<PointLight*>(frame.light_buffer.mapped));
+	const ClusterUniforms uniforms = MakeClusterUniforms(
+	    settings_.light_clusters, light_projection_, {render_extent_.width, render_extent_.height}, gsl::narrow_cast<std::uint32_t>(pending_lights_.size()));
+	std::memcpy(frame.cluster_uniforms.mapped, &uniforms, sizeof(uniforms));
+
+	// The previous frame's fragments are done reading the lists before they are rewritten
+	RecordMemoryBarrier(VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+
+	vkCmdBindPipeline(command_buffer_, VK_PIPELINE_BIND_POINT_COMPUTE, light_cluster_pipeline_);
+	vkCmdBindDescriptorSets(command_buffer_, VK_PIPELINE_BIND_POINT_COMPUTE, light_cluster_pipeline_layout_, 0, 1, &frame.lighting_descriptor_set, 0, nullptr);
+	vkCmdDispatch(command_buffer_, DivideRoundingUp(GetClusterCount(settings_.light_clusters), settings_.light_cluster_group_size), 1, 1);
+
+	RecordMemoryBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+}
+
+#pragma endregion
+
+#pragma region OVERLAY
+
+namespace {
+
+// Push constants of overlay.vert
+struct OverlayConstants {
+	glm::vec2 inverse_size;
+};
+
+}  // namespace
+
+bool Graphics::IsOverlaySupported()
+{
+	// Drawn in a rendering scope of its own after the scene, at one sample per pixel
+	if (!device_features_.dynamic_rendering) {
+		SPDLOG_WARN("The overlay needs dynamic rendering, it stays off");
+		return false;
+	}
+	return true;
+}
+
+void Graphics::CreateOverlay()
+{
+	// Only needed for the pipeline below
+	const auto _release_code = gsl::finally([this]() {
+		overlay_vertex_shader_code_ = {};
+		overlay_fragment_shader_code_ = {};
+	});
+	overlay_ = settings_.overlay && IsOverlaySupported();
+	if (!overlay_) {
+		return;
+	}
+
+	// The atlas is a few kilobytes, uploaded once through a staging buffer
+	const GlyphAtlas atlas = BakeGlyphAtlas();
+	glyph_atlas_extent_ = atlas.extent;
+	glyph_atlas_ = CreateImage(
+	    {atlas.extent.x, atlas.extent.y}, VK_FORMAT_R8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_IMAGE_ASPECT_COLOR_BIT);
+	BufferHandle staging =
+	    CreateBuffer(atlas.pixels.size(), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	std::memcpy(staging.mapped, atlas.pixels.data(), atlas.pixels.size());
+
+	SubmitAndWait([&](VkCommandBuffer command_buffer) {
+		VkImageMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = glyph_atlas_.image;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.levelCount = 1;
+		barrier.subresourceRange.layerCount = 1;
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		VkBufferImageCopy copy = {};
+		copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		copy.imageSubresource.layerCount = 1;
+		copy.imageExtent = {atlas.extent.x, atlas.extent.y, 1};
+		vkCmdCopyBufferToImage(command_buffer, staging.buffer, glyph_atlas_.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
+
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+	});
+
+	// Nearest filtering keeps the glyphs crisp at integer scales
+	VkSamplerCreateInfo sampler_info = {};
+	sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	sampler_info.magFilter = VK_FILTER_NEAREST;
+	sampler_info.minFilter = VK_FILTER_NEAREST;
+	sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+
+	const VkAllocationCallbacks* sampler_allocator = GetHostAllocator(VK_OBJECT_TYPE_SAMPLER);
+	if (vkCreateSampler(logical_device_, &sampler_info, sampler_allocator, overlay_sampler_.Put(logical_device_, sampler_allocator)) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create the overlay sampler");
+	}
+
+	// Rewritten by the CPU every frame, so host visible; the GPU reads each vertex once
+	for (FrameData& frame : frames_) {
+		frame.overlay_vertices = CreateBuffer(
+		    sizeof(OverlayVertex) * kOverlayVerticesPerQuad * settings_.max_overlay_quads,
+		    VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+		    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	}
+
+	// One set with the atlas, shared by all frames; the layout comes from the shaders
+	const std::array<ShaderReflection, 2> shaders = {
+	    ReflectShader(overlay_vertex_shader_code_, "overlay.vert"), ReflectShader(overlay_fragment_shader_code_, "overlay.frag")};
+	const PipelineLayoutHandles layout = GetPipelineLayout(shaders);
+	Expects(layout.set_layouts.size() == 1);
+	overlay_pipeline_layout_ = layout.layout;
+
+	VkDescriptorPoolSize pool_size = {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1};
+	VkDescriptorPoolCreateInfo pool_info = {};
+	pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pool_info.maxSets = 1;
+	pool_info.poolSizeCount = 1;
+	pool_info.pPoolSizes = &pool_size;
+	const VkAllocationCallbacks* pool_allocator = GetHostAllocator(VK_OBJECT_TYPE_DESCRIPTOR_POOL);
+	if (vkCreateDescriptorPool(logical_device_, &pool_info, pool_allocator, overlay_descriptor_pool_.Put(logical_device_, pool_allocator)) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create the overlay descriptor pool");
+	}
+
+	VkDescriptorSetAllocateInfo allocate_info = {};
+	allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocate_info.descriptorPool = overlay_descriptor_pool_;
+	allocate_info.descriptorSetCount = 1;
+	allocate_info.pSetLayouts = &layout.set_layouts[0];
+	if (vkAllocateDescriptorSets(logical_device_, &allocate_info, &overlay_descriptor_set_) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to allocate the overlay descriptor set");
+	}
+
+	VkDescriptorImageInfo atlas_info = {};
+	atlas_info.sampler = overlay_sampler_;
+	atlas_info.imageView = glyph_atlas_.view;
+	atlas_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	VkWriteDescriptorSet write = {};
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.dstSet = overlay_descriptor_set_;
+	write.dstBinding = 0;
+	write.descriptorCount = 1;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	write.pImageInfo = &atlas_info;
+	vkUpdateDescriptorSets(logical_device_, 1, &write, 0, nullptr);
+
+	// Pipeline: alpha-blended quads straight into the output image, no depth and no culling
+	UniqueShaderModule vertex_shader = CreateShaderModule(overlay_vertex_shader_code_);
+	UniqueShaderModule fragment_shader = CreateShaderModule(overlay_fragment_shader_code_);
+	if (vertex_shader == VK_NULL_HANDLE || fragment_shader == VK_NULL_HANDLE) {
+		throw std::runtime_error("Could not load the overlay shaders");
+	}
+
+	std::array<VkPipelineShaderStageCreateInfo, 2> stages = {};
+	stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+	stages[0].module = vertex_shader;
+	stages[0].pName = "main";
+	stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	stages[1].module = fragment_shader;
+	stages[1].pName = "main";
+
+	VkVertexInputBindingDescription binding = {};
+	binding.binding = 0;
+	binding.stride = sizeof(OverlayVertex);
+	binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+	std::array<VkVertexInputAttributeDescription, 3> attributes = {};
+	attributes[0] = {0, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(OverlayVertex, position)};
+	attributes[1] = {1, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(OverlayVertex, uv)};
+	attributes[2] = {2, 0, VK_FORMAT_R8G8B8A8_UNORM, offsetof(OverlayVertex, color)};
+	if (!AreVertexInputsProvided(shaders[0], attributes)) {
+		throw std::runtime_error("overlay.vert reads vertex inputs the pipeline does not provide");
+	}
+
+	VkPipelineVertexInputStateCreateInfo vertex_input_info = {};
+	vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	vertex_input_info.vertexBindingDescriptionCount = 1;
+	vertex_input_info.pVertexBindingDescriptions = &binding;
+	vertex_input_info.vertexAttributeDescriptionCount = attributes.size();
+	vertex_input_info.pVertexAttributeDescriptions = attributes.data();
+
+	VkPipelineInputAssemblyStateCreateInfo input_assembly_info = {};
+	input_assembly_info.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	input_assembly_info.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+	const std::array<VkDynamicState, 2> dynamic_states = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+	VkPipelineDynamicStateCreateInfo dynamic_state_info = {};
+	dynamic_state_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamic_state_info.dynamicStateCount = dynamic_states.size();
+	dynamic_state_info.pDynamicStates = dynamic_states.data();
+
+	VkPipelineViewportStateCreateInfo viewport_state_info = {};
+	viewport_state_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewport_state_info.viewportCount = 1;
+	viewport_state_info.scissorCount = 1;
+
+	VkPipelineRasterizationStateCreateInfo rasterization_state_info = {};
+	rasterization_state_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterization_state_info.polygonMode = VK_POLYGON_MODE_FILL;
+	rasterization_state_info.lineWidth = 1.0f;
+	rasterization_state_info.cullMode = VK_CULL_MODE_NONE;
+	rasterization_state_info.frontFace = VK_FRONT_FACE_CLOCKWISE;
+
+	VkPipelineMultisampleStateCreateInfo multisampling_info = {};
+	multisampling_info.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisampling_info.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+	VkPipelineColorBlendAttachmentState color_blend_attachment = {};
+	color_blend_attachment.blendEnable = VK_TRUE;
+	color_blend_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+	color_blend_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+	color_blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;
+	color_blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	color_blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+	color_blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
+	color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+	VkPipelineColorBlendStateCreateInfo color_blending_info = {};
+	color_blending_info.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	color_blending_info.attachmentCount = 1;
+	color_blending_info.pAttachments = &color_blend_attachment;
+
+	VkPipelineRenderingCreateInfoKHR rendering_info = {};
+	rendering_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR;
+	rendering_info.colorAttachmentCount = 1;
+	rendering_info.pColorAttachmentFormats = &surface_format_.format;
+
+	VkGraphicsPipelineCreateInfo pipeline_info = {};
+	pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipeline_info.pNext = &rendering_info;
+	pipeline_info.stageCount = stages.size();
+	pipeline_info.pStages = stages.data();
+	pipeline_info.pVertexInputState = &vertex_input_info;
+	pipeline_info.pInputAssemblyState = &input_assembly_info;
+	pipeline_info.pViewportState = &viewport_state_info;
+	pipeline_info.pRasterizationState = &rasterization_state_info;
+	pipeline_info.pMultisampleState = &multisampling_info;
+	pipeline_info.pColorBlendState = &color_blending_info;
+	pipeline_info.pDynamicState = &dynamic_state_info;
+	pipeline_info.layout = overlay_pipeline_layout_;
+
+	const VkAllocationCallbacks* pipeline_allocator = GetHostAllocator(VK_OBJECT_TYPE_PIPELINE);
+	if (vkCreateGraphicsPipelines(logical_device_, VK_NULL_HANDLE, 1, &pipeline_info, pipeline_allocator, overlay_pipeline_.Put(logical_device_, pipeline_allocator)) !=
+	    VK_SUCCESS) {
+		throw std::runtime_error("Failed to create the overlay pipeline");
+	}
 }
 
-Graphics::~Graphics()
+void Graphics::RecordOverlay()
 {
-	if (logical_device_ != VK_NULL_HANDLE) {
-		// we don't destroy command buffer as it's not created but allocated, so smartly deallocated at termination
+	const WindowSurface& surface = surfaces_.front();
+	FrameData& frame = frames_[current_frame_];
 
-		if (command_pool_ != VK_NULL_HANDLE) {
-			vkDestroyCommandPool(logical_device_, command_pool_, nullptr);
-		}
+	// Bottom of pipe on both ends: the first waits for the scene, so only the overlay is timed
+	const std::uint32_t first_timestamp = current_frame_ * kTimestampsPerFrame + 2;
+	if (timestamp_pool_ != VK_NULL_HANDLE) {
+		vkCmdWriteTimestamp(command_buffer_, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestamp_pool_, first_timestamp);
+	}
+	BeginStatisticsQuery(kOverlayStatistics, std::uint64_t(surface.extent.width) * surface.extent.height);
 
-		for (VkFramebuffer frame_buffer : swap_chain_framebuffers_) {
-			vkDestroyFramebuffer(logical_device_, frame_buffer, nullptr);
-		}
+	VkRenderingAttachmentInfoKHR color_attachment = {};
+	color_attachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+	color_attachment.imageView = surface.image_views[surface.image_index];
+	color_attachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 
-		if (pipeline_ != VK_NULL_HANDLE) {
-			vkDestroyPipeline(logical_device_, pipeline_, nullptr);
-		}
+	VkRenderingInfoKHR rendering_info = {};
+	rendering_info.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR;
+	rendering_info.renderArea.offset = {0, 0};
+	rendering_info.renderArea.extent = surface.extent;
+	rendering_info.layerCount = 1;
+	rendering_info.colorAttachmentCount = 1;
+	rendering_info.pColorAttachments = &color_attachment;
+	cmd_begin_rendering_(command_buffer_, &rendering_info);
 
-		if (pipeline_layout_ != VK_NULL_HANDLE) {
-			vkDestroyPipelineLayout(logical_device_, pipeline_layout_, nullptr);
-		}
+	BindGraphicsPipeline(overlay_pipeline_);
+	vkCmdBindDescriptorSets(command_buffer_, VK_PIPELINE_BIND_POINT_GRAPHICS, overlay_pipeline_layout_, 0, 1, &overlay_descriptor_set_, 0, nullptr);
 
-		if (render_pass_ != VK_NULL_HANDLE) {
-			vkDestroyRenderPass(logical_device_, render_pass_, nullptr);
-		}
+	// The output's size, not the render extent: dynamic resolution is upscaled already
+	VkViewport viewport = {};
+	viewport.width = static_cast<std::float_t>(surface.extent.width);
+	viewport.height = static_cast<std::float_t>(surface.extent.height);
+	viewport.maxDepth = 1.0f;
+	const VkRect2D scissor = {{0, 0}, surface.extent};
+	vkCmdSetViewport(command_buffer_, 0, 1, &viewport);
+	vkCmdSetScissor(command_buffer_, 0, 1, &scissor);
+
+	const OverlayConstants constants = {1.0f / glm::vec2(surface.extent.width, surface.extent.height)};
+	vkCmdPushConstants(command_buffer_, overlay_pipeline_layout_, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(constants), &constants);
+
+	// Host coherent, so what the batch wrote is visible at submission
+	VkDeviceSize vertex_offset = 0;
+	vkCmdBindVertexBuffers(command_buffer_, 0, 1, frame.overlay_vertices.buffer.GetAddress(), &vertex_offset);
+	vkCmdDraw(command_buffer_, overlay_batch_.GetVertexCount(), 1, 0, 0);
+
+	cmd_end_rendering_(command_buffer_);
+	EndStatisticsQuery();
+	if (timestamp_pool_ != VK_NULL_HANDLE) {
+		vkCmdWriteTimestamp(command_buffer_, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestamp_pool_, first_timestamp + 1);
+		frame.overlay_timestamps_written = true;
+	}
+
+	TransitionImage({
+	    .image = surface.images[surface.image_index],
+	    .aspect = VK_IMAGE_ASPECT_COLOR_BIT,
+	    .old_layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+	    .new_layout = final_color_layout_,
+	    .src_stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+	    .src_access = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+	    .dst_stage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+	    .dst_access = 0,
+	});
+}
+
+#pragma endregion
+
+#pragma region READBACK
 
-		for (VkImageView image_view : swap_chain_image_views_) {
-			vkDestroyImageView(logical_device_, image_view, nullptr);
+void Graphics::CaptureFrame()
+{
+	Expects(capture_supported_);
+	capture_requested_ = true;
+}
+
+void Graphics::RecordReadback(FrameData& frame)
+{
+	// Captures show the primary window
+	const WindowSurface& surface = surfaces_.front();
+	const VkExtent2D& extent = surface.extent;
+	const VkDeviceSize size = VkDeviceSize(extent.width) * extent.height * 4;
+
+	if (frame.readback_buffer.buffer == VK_NULL_HANDLE || frame.readback_extent.width != extent.width || frame.readback_extent.height != extent.height) {
+		// Cached memory makes the CPU side read fast, but may need explicit invalidation
+		if (readback_memory_properties_ == 0) {
+			for (VkMemoryPropertyFlags properties : {
+			         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+			         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT}) {
+				if (FindMemoryType(~0u, properties).has_value()) {
+					readback_memory_properties_ = properties;
+					break;
+				}
+			}
 		}
+		RetireBuffer(frame.readback_buffer);
+		frame.readback_buffer = CreateBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, readback_memory_properties_);
+		frame.readback_extent = extent;
+		// The swizzle target is sized along, so delivering never allocates
+		if (IsBgraFormat(surface_format_.format)) {
+			readback_rgba_.reserve(size);
+		}
+	}
+
+	const VkImage image = surface.images[surface.image_index];
+	TransitionImage({
+	    .image = image,
+	    .aspect = VK_IMAGE_ASPECT_COLOR_BIT,
+	    .old_layout = final_color_layout_,
+	    .new_layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+	    // Written by the render pass, or by the upscale blit with dynamic resolution
+	    .src_stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+	    .src_access = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+	    .dst_stage = VK_PIPELINE_STAGE_TRANSFER_BIT,
+	    .dst_access = VK_ACCESS_TRANSFER_READ_BIT,
+	});
+
+	// Row length 0: tightly packed rows
+	VkBufferImageCopy region = {};
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.layerCount = 1;
+	region.imageExtent = {extent.width, extent.height, 1};
+	vkCmdCopyImageToBuffer(command_buffer_, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, frame.readback_buffer.buffer, 1, &region);
+
+	// Back to what presentation expects; the copy only read it
+	TransitionImage({
+	    .image = image,
+	    .aspect = VK_IMAGE_ASPECT_COLOR_BIT,
+	    .old_layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+	    .new_layout = final_color_layout_,
+	    .src_stage = VK_PIPELINE_STAGE_TRANSFER_BIT,
+	    .src_access = 0,
+	    .dst_stage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+	    .dst_access = 0,
+	});
+
+	VkBufferMemoryBarrier host_barrier = {};
+	host_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	host_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	host_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	host_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	host_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	host_barrier.buffer = frame.readback_buffer.buffer;
+	host_barrier.offset = 0;
+	host_barrier.size = VK_WHOLE_SIZE;
+	vkCmdPipelineBarrier(command_buffer_, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &host_barrier, 0, nullptr);
+
+	frame.readback_frame = frame_number_;
+}
 
-		if (swap_chain_ != VK_NULL_HANDLE) {
-			vkDestroySwapchainKHR(logical_device_, swap_chain_, nullptr);
+void Graphics::DeliverReadback(FrameData& frame)
+{
+	if (!frame.readback_frame.has_value()) {
+		return;
+	}
+	const std::uint64_t frame_number = frame.readback_frame.value();
+	frame.readback_frame.reset();
+
+	if (!readback_handler_) {
+		return;
+	}
+	// Whatever the caller's handler does with the frame
+	frame_allocations_expected_ = true;
+
+	if (!(readback_memory_properties_ & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+		VkMappedMemoryRange range = {};
+		range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+		range.memory = frame.readback_buffer.memory;
+		range.offset = 0;
+		range.size = VK_WHOLE_SIZE;
+		vkInvalidateMappedMemoryRanges(logical_device_, 1, &range);
+	}
+
+	const VkExtent2D extent = frame.readback_extent;
+	const std::size_t size = std::size_t(extent.width) * extent.height * 4;
+	gsl::span<const std::uint8_t> pixels(static_cast<const std::uint8_t*>(frame.readback_buffer.mapped), size);
+
+	if (IsBgraFormat(surface_format_.format)) {
+		readback_rgba_.resize(size);
+		for (std::size_t i = 0; i < size; i += 4) {
+			readback_rgba_[i + 0] = pixels[i + 2];
+			readback_rgba_[i + 1] = pixels[i + 1];
+			readback_rgba_[i + 2] = pixels[i + 0];
+			readback_rgba_[i + 3] = pixels[i + 3];
 		}
-		vkDestroyDevice(logical_device_, nullptr);
+		pixels = readback_rgba_;
+	}
+
+	FrameReadback readback;
+	readback.frame_number = frame_number;
+	readback.width = extent.width;
+	readback.height = extent.height;
+	readback.rgba = pixels;
+	readback_handler_(readback);
+}
+
+void Graphics::FlushReadbacks()
+{
+	vkDeviceWaitIdle(logical_device_);
+
+	// The current slot holds the oldest capture
+	for (std::size_t i = 0; i < frames_.size(); i++) {
+		DeliverReadback(frames_[(current_frame_ + i) % frames_.size()]);
+	}
+}
+
+#pragma endregion
+
+#pragma region DYNAMIC_RESOLUTION
+
+bool Graphics::IsBlitSupported(VkFormat format)
+{
+	VkFormatProperties properties;
+	vkGetPhysicalDeviceFormatProperties(physical_device_, format, &properties);
+	const VkFormatFeatureFlags required = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+	return (properties.optimalTilingFeatures & required) == required;
+}
+
+VkImage Graphics::GetColorTarget()
+{
+	const WindowSurface& surface = surfaces_[current_surface_];
+	return dynamic_resolution_ ? scene_targets_[current_frame_].image : surface.images[surface.image_index];
+}
+
+VkImageView Graphics::GetColorTargetView()
+{
+	const WindowSurface& surface = surfaces_[current_surface_];
+	return dynamic_resolution_ ? scene_targets_[current_frame_].view : VkImageView(surface.image_views[surface.image_index]);
+}
+
+void Graphics::CreateSceneTargets()
+{
+	if (!dynamic_resolution_) {
+		return;
+	}
+
+	// Full size, so changing the scale never reallocates, and one per frame in flight since
+	// earlier frames may still be blitting from theirs
+	for (ImageHandle& target : scene_targets_) {
+		RetireImage(target);
+	}
+	scene_targets_.clear();
+	for (std::uint32_t i = 0; i < settings_.frames_in_flight; i++) {
+		scene_targets_.push_back(CreateImage(
+		    surfaces_.front().extent, surface_format_.format, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_IMAGE_ASPECT_COLOR_BIT));
 	}
-	if (instance_ != VK_NULL_HANDLE) {
-		if (surface_ != VK_NULL_HANDLE) {
-			vkDestroySurfaceKHR(instance_, surface_, nullptr);
+}
+
+void Graphics::CreateTimestampQueries()
+{
+	std::uint32_t family_count = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physical_device_, &family_count, nullptr);
+	std::pmr::vector<VkQueueFamilyProperties> families(family_count, GetScratchMemory());
+	vkGetPhysicalDeviceQueueFamilyProperties(physical_device_, &family_count, families.data());
+
+	const std::uint32_t valid_bits = families[queue_families_.graphics_family.value()].timestampValidBits;
+	if (valid_bits == 0) {
+		if (settings_.dynamic_resolution.enabled) {
+			SPDLOG_WARN("Graphics queue has no timestamps, dynamic resolution stays at full size");
 		}
-		if (debug_messenger_ != VK_NULL_HANDLE) {
-			vkDestroyDebugUtilsMessengerEXT(instance_, debug_messenger_, nullptr);
+		return;
+	}
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physical_device_, &properties);
+	timestamp_period_ns_ = properties.limits.timestampPeriod;
+	timestamp_mask_ = valid_bits >= 64 ? ~std::uint64_t(0) : (std::uint64_t(1) << valid_bits) - 1;
+
+	VkQueryPoolCreateInfo info = {};
+	info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	info.queryCount = settings_.frames_in_flight * kTimestampsPerFrame;
+
+	const VkAllocationCallbacks* allocator = GetHostAllocator(VK_OBJECT_TYPE_QUERY_POOL);
+	VkResult result = vkCreateQueryPool(logical_device_, &info, allocator, timestamp_pool_.Put(logical_device_, allocator));
+	if (result != VK_SUCCESS) {
+		SPDLOG_WARN("Could not create the timestamp query pool");
+		timestamp_pool_.Reset();
+	}
+}
+
+void Graphics::CreatePipelineStatisticsQueries()
+{
+	if (!settings_.pipeline_statistics) {
+		return;
+	}
+	if (!device_features_.pipeline_statistics_query) {
+		SPDLOG_WARN("The device has no pipeline statistics queries");
+		return;
+	}
+	// Replayed draws execute inside the query of their pass
+	if (settings_.reuse_scene_commands && !device_features_.inherited_queries) {
+		SPDLOG_WARN("Pipeline statistics of reused scene commands need inherited queries");
+		return;
+	}
+
+	VkQueryPoolCreateInfo info = {};
+	info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	info.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+	info.queryCount = settings_.frames_in_flight * kMaxStatisticsQueries;
+	info.pipelineStatistics = kPipelineStatisticsFlags;
+
+	const VkAllocationCallbacks* allocator = GetHostAllocator(VK_OBJECT_TYPE_QUERY_POOL);
+	VkResult result = vkCreateQueryPool(logical_device_, &info, allocator, statistics_pool_.Put(logical_device_, allocator));
+	if (result != VK_SUCCESS) {
+		SPDLOG_WARN("Could not create the pipeline statistics query pool");
+		statistics_pool_.Reset();
+		return;
+	}
+	for (gsl::czstring name : kStatisticsPassNames) {
+		pipeline_statistics_.AddPass(name);
+	}
+}
+
+void Graphics::BeginStatisticsQuery(PipelineStatisticsLog::PassId pass, std::uint64_t pixels)
+{
+	if (statistics_pool_ == VK_NULL_HANDLE) {
+		return;
+	}
+	EndStatisticsQuery();
+
+	FrameData& frame = frames_[current_frame_];
+	if (frame.statistics_query_count == kMaxStatisticsQueries) {
+		return;
+	}
+	frame.statistics_queries[frame.statistics_query_count] = {pass, pixels};
+	vkCmdBeginQuery(frame.command_buffer, statistics_pool_, current_frame_ * kMaxStatisticsQueries + frame.statistics_query_count, 0);
+	frame.statistics_query_count++;
+	statistics_query_open_ = true;
+}
+
+void Graphics::EndStatisticsQuery()
+{
+	if (!statistics_query_open_) {
+		return;
+	}
+	const FrameData& frame = frames_[current_frame_];
+	vkCmdEndQuery(frame.command_buffer, statistics_pool_, current_frame_ * kMaxStatisticsQueries + frame.statistics_query_count - 1);
+	statistics_query_open_ = false;
+}
+
+void Graphics::ReadPipelineStatistics(FrameData& frame)
+{
+	const std::uint32_t query_count = frame.statistics_query_count;
+	if (query_count == 0) {
+		return;
+	}
+	frame.statistics_query_count = 0;
+
+	// The fence has signalled, so the results are available without waiting
+	constexpr VkDeviceSize kStride = kPipelineStatisticsCount * sizeof(std::uint64_t);
+	std::array<std::uint64_t, kMaxStatisticsQueries * kPipelineStatisticsCount> results = {};
+	const VkResult result = vkGetQueryPoolResults(
+	    logical_device_, statistics_pool_, current_frame_ * kMaxStatisticsQueries, query_count, query_count * kStride, results.data(), kStride, VK_QUERY_RESULT_64_BIT);
+	if (result != VK_SUCCESS) {
+		return;
+	}
+	for (std::uint32_t i = 0; i < query_count; i++) {
+		const gsl::span<const std::uint64_t, kPipelineStatisticsCount> query_results(&results[i * kPipelineStatisticsCount], kPipelineStatisticsCount);
+		pipeline_statistics_.Add(
+		    frame.statistics_queries[i].pass, frame.statistics_frame, UnpackPipelineStatistics(query_results, frame.statistics_queries[i].pixels));
+	}
+}
+
+void Graphics::LogPipelineStatistics() const
+{
+	if (statistics_pool_ == VK_NULL_HANDLE) {
+		SPDLOG_INFO("Pipeline statistics are not gathered");
+		return;
+	}
+	pipeline_statistics_.LogSummary();
+}
+
+void Graphics::ReadGpuFrameTime(FrameData& frame)
+{
+	if (!frame.timestamps_written) {
+		return;
+	}
+	frame.timestamps_written = false;
+
+	// Milliseconds between a pair of timestamps. Queries never written are not available, so
+	// only the pairs recorded are read; the fence has signalled, so nothing waits.
+	const auto read_pair = [this](std::uint32_t first) -> std::optional<std::double_t> {
+		std::array<std::uint64_t, 2> timestamps = {};
+		const VkResult result = vkGetQueryPoolResults(
+		    logical_device_,
+		    timestamp_pool_,
+		    current_frame_ * kTimestampsPerFrame + first,
+		    gsl::narrow_cast<std::uint32_t>(timestamps.size()),
+		    sizeof(timestamps),
+		    timestamps.data(),
+		    sizeof(std::uint64_t),
+		    VK_QUERY_RESULT_64_BIT);
+		if (result != VK_SUCCESS) {
+			return std::nullopt;
 		}
-		vkDestroyInstance(instance_, nullptr);
+		// Masked subtraction also handles a counter that wrapped in between
+		const std::uint64_t ticks = (timestamps[1] - timestamps[0]) & timestamp_mask_;
+		return static_cast<std::double_t>(ticks) * timestamp_period_ns_ * 1e-6;
+	};
+	const auto read_pass = [&](bool& written, std::uint32_t first) {
+		const std::double_t milliseconds = written ? read_pair(first).value_or(0.0) : 0.0;
+		written = false;
+		return milliseconds;
+	};
+	const std::optional<std::double_t> frame_ms = read_pair(0);
+	gpu_overlay_ms_ = read_pass(frame.overlay_timestamps_written, 2);
+	gpu_light_clustering_ms_ = read_pass(frame.light_timestamps_written, 4);
+	gpu_scene_ms_ = read_pass(frame.scene_timestamps_written, 6);
+	if (!frame_ms.has_value()) {
+		return;
+	}
+	gpu_frame_ms_ = frame_ms.value();
+
+	if (!dynamic_resolution_) {
+		return;
+	}
+	resolution_controller_.Update(gpu_frame_ms_);
+	ScaleRenderExtent();
+}
+
+void Graphics::ScaleRenderExtent()
+{
+	const VkExtent2D& extent = surfaces_.front().extent;
+	if (!dynamic_resolution_) {
+		render_extent_ = extent;
+		return;
+	}
+	const std::float_t scale = resolution_controller_.GetScale();
+	render_extent_.width = std::max(1u, static_cast<std::uint32_t>(std::lround(extent.width * scale)));
+	render_extent_.height = std::max(1u, static_cast<std::uint32_t>(std::lround(extent.height * scale)));
+}
+
+void Graphics::RecordUpscale(VkImageLayout output_layout)
+{
+	// Only with a single window
+	const WindowSurface& surface = surfaces_.front();
+	const VkImage scene = scene_targets_[current_frame_].image;
+	const VkImage output = surface.images[surface.image_index];
+
+	TransitionImage({
+	    .image = scene,
+	    .aspect = VK_IMAGE_ASPECT_COLOR_BIT,
+	    .old_layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+	    .new_layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+	    .src_stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+	    .src_access = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+	    .dst_stage = VK_PIPELINE_STAGE_TRANSFER_BIT,
+	    .dst_access = VK_ACCESS_TRANSFER_READ_BIT,
+	});
+	// The whole image is overwritten, so its previous contents are discarded
+	TransitionImage({
+	    .image = output,
+	    .aspect = VK_IMAGE_ASPECT_COLOR_BIT,
+	    .old_layout = VK_IMAGE_LAYOUT_UNDEFINED,
+	    .new_layout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+	    .src_stage = VK_PIPELINE_STAGE_TRANSFER_BIT,
+	    .src_access = 0,
+	    .dst_stage = VK_PIPELINE_STAGE_TRANSFER_BIT,
+	    .dst_access = VK_ACCESS_TRANSFER_WRITE_BIT,
+	});
+
+	VkImageBlit region = {};
+	region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.srcSubresource.layerCount = 1;
+	region.srcOffsets[1] = {static_cast<std::int32_t>(render_extent_.width), static_cast<std::int32_t>(render_extent_.height), 1};
+	region.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.dstSubresource.layerCount = 1;
+	region.dstOffsets[1] = {static_cast<std::int32_t>(surface.extent.width), static_cast<std::int32_t>(surface.extent.height), 1};
+	vkCmdBlitImage(
+	    command_buffer_, scene, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, output, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region, VK_FILTER_LINEAR);
+
+	// Drawn on by the overlay, or done
+	const bool attachment = output_layout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	TransitionImage({
+	    .image = output,
+	    .aspect = VK_IMAGE_ASPECT_COLOR_BIT,
+	    .old_layout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+	    .new_layout = output_layout,
+	    .src_stage = VK_PIPELINE_STAGE_TRANSFER_BIT,
+	    .src_access = VK_ACCESS_TRANSFER_WRITE_BIT,
+	    .dst_stage = attachment ? VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+	    .dst_access = attachment ? VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT : VkAccessFlags(0),
+	});
+}
+
+#pragma endregion
+
+void Graphics::CheckFrameAllocations()
+{
+	if constexpr (!IsAllocationCountingEnabled()) {
+		return;
+	}
+
+	// Everything since the previous BeginFrame, including the caller's update and culling
+	const std::uint64_t allocation_count = GetGlobalAllocationCount();
+	const std::uint64_t frame_allocations = allocation_count - frame_allocation_count_;
+	frame_allocation_count_ = allocation_count;
+
+	const bool expected = std::exchange(frame_allocations_expected_, false);
+	if (frame_number_ <= kAllocationWarmupFrames || frame_allocations == 0 || expected) {
+		return;
+	}
+	if (allocating_frames_ == 0) {
+		SPDLOG_ERROR("Frame {} made {} heap allocations, transient data should come from the frame arenas", frame_number_, frame_allocations);
+	}
+	allocating_frames_++;
+}
+
+const VkAllocationCallbacks* Graphics::GetHostAllocator(VkObjectType type) const
+{
+	return host_allocations_ != nullptr ? host_allocations_->GetCallbacks(type) : nullptr;
+}
+
+void Graphics::SetHostAllocationTracking(bool enabled)
+{
+	Expects(host_allocations_ != nullptr);
+	host_allocations_->SetEnabled(enabled);
+}
+
+void Graphics::LogHostAllocationStats() const
+{
+	if (host_allocations_ == nullptr) {
+		SPDLOG_INFO("Host allocations are not tracked");
+		return;
+	}
+	host_allocations_->LogStats();
+}
+
+void Graphics::TransitionImage(const ImageTransition& transition)
+{
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.oldLayout = transition.old_layout;
+	barrier.newLayout = transition.new_layout;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = transition.image;
+	barrier.srcAccessMask = transition.src_access;
+	barrier.dstAccessMask = transition.dst_access;
+	barrier.subresourceRange.aspectMask = transition.aspect;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount = 1;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+
+	vkCmdPipelineBarrier(command_buffer_, transition.src_stage, transition.dst_stage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+void Graphics::SubmitAndWait(const std::function<void(VkCommandBuffer)>& record)
+{
+	VkCommandBufferAllocateInfo allocate_info = {};
+	allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocate_info.commandPool = command_pool_;
+	allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocate_info.commandBufferCount = 1;
+
+	VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+	if (vkAllocateCommandBuffers(logical_device_, &allocate_info, &command_buffer) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to allocate a command buffer");
+	}
+	const auto free_command_buffer = gsl::finally([this, &command_buffer]() { vkFreeCommandBuffers(logical_device_, command_pool_, 1, &command_buffer); });
+
+	VkCommandBufferBeginInfo begin_info = {};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(command_buffer, &begin_info);
+	record(command_buffer);
+	vkEndCommandBuffer(command_buffer);
+
+	VkFenceCreateInfo fence_info = {};
+	fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	UniqueFence fence;
+	const VkAllocationCallbacks* allocator = GetHostAllocator(VK_OBJECT_TYPE_FENCE);
+	if (vkCreateFence(logical_device_, &fence_info, allocator, fence.Put(logical_device_, allocator)) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create a fence");
+	}
+
+	VkSubmitInfo submit_info = {};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &command_buffer;
+	if (vkQueueSubmit(graphics_queue_, 1, &submit_info, fence) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to submit commands");
+	}
+	vkWaitForFences(logical_device_, 1, fence.GetAddress(), VK_TRUE, std::numeric_limits<std::uint64_t>::max());
+}
+
+#pragma endregion
+
+Graphics::Graphics(gsl::not_null<Window*> window, GraphicsSettings settings, JobSystem* jobs)
+    : Graphics(gsl::span<const gsl::not_null<Window*>>(&window, 1), settings, jobs)
+{
+}
+
+Graphics::Graphics(gsl::span<const gsl::not_null<Window*>> windows, GraphicsSettings settings, JobSystem* jobs)
+    : resolution_controller_(settings.dynamic_resolution), settings_(settings), jobs_(jobs), frame_arenas_(settings.frames_in_flight, settings.arena_thread_count, settings.frame_arena_bytes)
+{
+	Expects(!windows.empty() && (windows.size() == 1 || !settings_.offscreen));
+	Expects(settings_.frames_in_flight > 0);
+	Expects(!settings_.shading_variants.empty() && settings_.light_cluster_group_size > 0 && settings_.max_overlay_quads > 0);
+	// Culling ends and resumes rendering in the middle of a pass, and every window would need
+	// recordings of its own
+	Expects(!settings_.reuse_scene_commands || (windows.size() == 1 && !settings_.occlusion_culling));
+	Expects(jobs_ == nullptr || settings_.arena_thread_count >= jobs_->GetConcurrency());
+	if (settings_.track_host_allocations) {
+		host_allocations_ = std::make_unique<HostAllocationTracker>(settings_.pool_host_allocations);
+	}
+	// Evicting what the frames in flight just drew would only bring it straight back
+	residency_ = ResidencyManager(settings_.frames_in_flight + 1);
+#if !defined(NDEBUG)
+	validation_enabled_ = true;
+#endif
+	frames_.resize(settings_.frames_in_flight);
+	released_memory_.reserve(kReleasedMemoryReserve);
+	surfaces_.resize(windows.size());
+	for (std::size_t i = 0; i < windows.size(); i++) {
+		surfaces_[i].window = windows[i];
+	}
+	InitializeVulkan();
+}
+
+Graphics::~Graphics()
+{
+	// Members destroy themselves in reverse declaration order, children before the device
+	// and the device before the instance; the GPU only has to be done with them first.
+	// Command buffers are freed with their pool.
+	if (logical_device_ != VK_NULL_HANDLE) {
+		vkDeviceWaitIdle(logical_device_);
 	}
+	deletion_queue_.Flush();
 }
 
 void Graphics::InitializeVulkan()
 {
-	CreateInstance();
-	SetupDebugMessenger();
-	CreateSurface();
-	PickPhysicalDevice();
-	CreateLogicalDeviceAndQueues();
-	CreateSwapChain();
-	CreateRenderPass();
-	CreateGraphicsPipeline();
-	CreateFramebuffers();
-	CreateCommandPool();
-	CreateCommandBuffer();
+	// Instance to device is inherently serial; after that the swapchain chain, shader modules,
+	// buffers and command objects only meet again at the pipeline and framebuffers.
+	TaskGraph startup("Graphics startup", jobs_);
+	for (WindowSurface& surface : surfaces_) {
+		surface.framebuffer_size = surface.window->GetFramebufferSize();
+	}
+
+	const TaskGraph::TaskId shader_files = startup.Add("ReadShaderFiles", [this]() { ReadShaderFiles(); });
+	const TaskGraph::TaskId instance = startup.Add("CreateInstance", [this]() { CreateInstance(); });
+	// Kept ahead of the other instance-level calls so it sees their messages
+	const TaskGraph::TaskId messenger = startup.Add("SetupDebugMessenger", [this]() { SetupDebugMessenger(); }, {instance});
+	const TaskGraph::TaskId surface = startup.Add("CreateSurfaces", [this]() { CreateSurfaces(); }, {messenger});
+	const TaskGraph::TaskId physical_device = startup.Add("PickPhysicalDevice", [this]() { PickPhysicalDevice(); }, {surface});
+	const TaskGraph::TaskId device = startup.Add("CreateLogicalDevice", [this]() { CreateLogicalDeviceAndQueues(); }, {physical_device});
+
+	const TaskGraph::TaskId swap_chain = startup.Add("CreateSwapChains", [this]() { CreateSwapChains(); }, {device});
+	const TaskGraph::TaskId image_views = startup.Add("CreateImageViews", [this]() { CreateImageViews(); }, {swap_chain});
+	const TaskGraph::TaskId attachments = startup.Add(
+	    "CreateAttachments",
+	    [this]() {
+		    CreateColorResources();
+		    CreateDepthResources();
+		    CreateSceneTargets();
+	    },
+	    {swap_chain});
+	// Formats and sample count are known from here on, which is all the pipeline needs
+	const TaskGraph::TaskId render_pass = startup.Add(
+	    "CreateRenderPass",
+	    [this]() {
+		    if (!device_features_.dynamic_rendering) {
+			    CreateRenderPass();
+		    }
+	    },
+	    {attachments});
+
+	const TaskGraph::TaskId shader_modules = startup.Add("CreateShaderModules", [this]() { CreateShaderModules(); }, {device, shader_files});
+	// The pipeline layouts include the lighting set layout
+	const TaskGraph::TaskId clustered_lighting = startup.Add("CreateClusteredLighting", [this]() { CreateClusteredLighting(); }, {device, shader_files});
+	startup.Add("CreateGraphicsPipeline", [this]() { CreateGraphicsPipeline(); }, {render_pass, shader_modules, clustered_lighting});
+	startup.Add(
+	    "CreateFramebuffers",
+	    [this]() {
+		    if (!device_features_.dynamic_rendering) {
+			    CreateFramebuffers();
+		    }
+	    },
+	    {render_pass, image_views});
+
+	startup.Add("CreateInstanceBuffers", [this]() { CreateInstanceBuffer(); }, {device});
+	const TaskGraph::TaskId command_buffers = startup.Add(
+	    "CreateCommandBuffers",
+	    [this]() {
+		    CreateCommandPool();
+		    CreateCommandBuffers();
+	    },
+	    {device});
+	// Needs the depth buffer for its descriptors and the command pool to initialize the pyramid
+	const TaskGraph::TaskId occlusion_culling =
+	    startup.Add("CreateOcclusionCulling", [this]() { CreateOcclusionCulling(); }, {attachments, command_buffers, shader_files});
+	startup.Add("CreateSyncObjects", [this]() { CreateSyncObjects(); }, {swap_chain});
+	startup.Add("CreateTimestampQueries", [this]() { CreateTimestampQueries(); }, {device});
+	startup.Add("CreatePipelineStatisticsQueries", [this]() { CreatePipelineStatisticsQueries(); }, {device});
+	// The pipeline takes the surface format; the atlas upload shares the command pool and queue
+	// with the pyramid initialization, so the two go one after the other
+	startup.Add("CreateOverlay", [this]() { CreateOverlay(); }, {swap_chain, occlusion_culling, shader_files});
+
+	// A failed task throws; leave from here rather than from a worker thread
+	try {
+		startup.Run();
+	}
+	catch (const std::exception& error) {
+		SPDLOG_ERROR("Graphics startup failed: {}", error.what());
+		std::exit(EXIT_FAILURE);
+	}
+	startup.LogTimings();
+
+	const PipelineLayoutCacheStats layouts = layout_cache_->GetStats();
+	SPDLOG_INFO(
+	    "Pipeline layouts reflected from the shaders: {} requested, {} created, {} descriptor set layouts",
+	    layouts.requests,
+	    layouts.pipeline_layouts,
+	    layouts.set_layouts);
+	shader_variants_.LogStats();
+}
+
+std::pmr::memory_resource* Graphics::GetScratchMemory()
+{
+	return GetFrameMemory(jobs_ != nullptr ? jobs_->GetCurrentThreadIndex() : 0);
 }
 
 void Graphics::CreateInstance()
 {
 	std::array<gsl::czstring, 1> validation_layers = {"VK_LAYER_KHRONOS_validation"};
-	if (!AreAllLayersSupported(validation_layers)) {
+	if (!AreAllLayersSupported(validation_layers, GetScratchMemory())) {
 		validation_enabled_ = false;
 	}
 
-	std::vector<gsl::czstring> required_extensions = GetRequiredInstanceExtensions();
+	std::pmr::vector<gsl::czstring> required_extensions = GetRequiredInstanceExtensions(GetScratchMemory());
+
+	// vkEnumerateInstanceVersion does not exist on 1.0 loaders
+	PFN_vkEnumerateInstanceVersion enumerate_version = reinterpret_cast<PFN_vkEnumerateInstanceVersion>(vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion"));
+	std::uint32_t loader_version = VK_API_VERSION_1_0;
+	if (enumerate_version != nullptr) {
+		enumerate_version(&loader_version);
+	}
+	instance_api_version_ = std::min(loader_version, static_cast<std::uint32_t>(VK_API_VERSION_1_3));
 
 	VkApplicationInfo app_info = {};
 	app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
@@ -861,7 +4131,7 @@ void Graphics::CreateInstance()
 	app_info.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
 	app_info.pEngineName = "VEng";
 	app_info.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-	app_info.apiVersion = VK_API_VERSION_1_0;
+	app_info.apiVersion = instance_api_version_;
 
 	VkInstanceCreateInfo instance_creation_info = {};
 	instance_creation_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -870,7 +4140,7 @@ void Graphics::CreateInstance()
 	instance_creation_info.enabledExtensionCount = required_extensions.size();
 	instance_creation_info.ppEnabledExtensionNames = required_extensions.data();
 
-	VkDebugUtilsMessengerCreateInfoEXT messenger_creation_info = GetCreateMessengerInfo();
+	VkDebugUtilsMessengerCreateInfoEXT messenger_creation_info = GetCreateMessengerInfo(&validation_filter_);
 
 	if (validation_enabled_) {
 		instance_creation_info.pNext = &messenger_creation_info;
@@ -881,12 +4151,12 @@ void Graphics::CreateInstance()
 		instance_creation_info.enabledLayerCount = 0;
 		instance_creation_info.ppEnabledLayerNames = nullptr;
 	}
-	instance_creation_info.enabledLayerCount = 0;
 
-	VkResult result = vkCreateInstance(&instance_creation_info, nullptr, &instance_);
+	const VkAllocationCallbacks* allocator = GetHostAllocator(VK_OBJECT_TYPE_INSTANCE);
+	VkResult result = vkCreateInstance(&instance_creation_info, allocator, instance_.Put(allocator));
 
 	if (result != VK_SUCCESS) {
-		std::exit(EXIT_FAILURE);
+		throw std::runtime_error("Failed to create the Vulkan instance");
 	}
 }
 
@@ -1,18 +1,308 @@
 #pragma once
 
 #include <vulkan/vulkan.h>
+#include <deletion_queue.h>
 #include <glfw_window.h>
+#include <host_allocation_tracker.h>
+#include <device_features.h>
+#include <dynamic_resolution.h>
+#include <frame_arena.h>
+#include <job_system.h>
+#include <light_clustering.h>
+#include <lod_selection.h>
+#include <logging.h>
+#include <mesh_file.h>
+#include <overlay.h>
+#include <pipeline_layout_cache.h>
+#include <pipeline_statistics.h>
+#include <residency_manager.h>
+#include <shader_variants.h>
+#include <spirv_reflection.h>
+#include <vulkan_handle.h>
+#include <atomic>
+#include <memory_resource>
 #include <vector>
 #include <optional>
+#include <thread>
 
 namespace veng {
 
+// What the clustered fragment shader computes per light
+enum class ShadingQuality : std::uint32_t {
+	kAmbient,      // no lights at all
+	kAttenuation,  // distance falloff only, no normals
+	kFull,
+};
+
+// Tunables of the fragment shaders, compiled into each variant as specialization constants
+// (shaders/shading_constants.glsl); ambient, light cap and quality only affect clustered
+// lighting
+struct ShadingVariant {
+	glm::vec3 albedo = glm::vec3(1.0f, 0.0f, 0.5f);
+	std::float_t ambient = 0.05f;
+	// Lights of its cluster a fragment shades at most
+	std::uint32_t max_lights_per_fragment = std::numeric_limits<std::uint32_t>::max();
+	ShadingQuality quality = ShadingQuality::kFull;
+};
+
+struct GraphicsSettings {
+	// Lay down depth first, then shade with depth writes off so each pixel is shaded once
+	bool depth_prepass = false;
+	// Requested MSAA sample count, clamped to what the device supports for color and depth
+	std::uint32_t msaa_samples = 1;
+	// Capacity of the per-instance world matrix buffer
+	std::uint32_t max_instances = 1024;
+	// Commands DrawMeshIndirect may queue per frame
+	std::uint32_t max_indirect_draws = 4096;
+	// GPU occlusion culling for DrawOcclusionCulled against a depth pyramid. Needs dynamic
+	// rendering, multi-draw indirect, a sampleable depth format, 1x MSAA and no depth pre-pass.
+	bool occlusion_culling = false;
+	// Objects DrawOcclusionCulled may take per frame
+	std::uint32_t max_culled_objects = 16384;
+	// Record the draws of each pass into secondary command buffers, one set per frame in
+	// flight, and replay them until MarkSceneDirty; only the few commands around them are
+	// recorded every frame. For mostly static scenes: one window and no occlusion culling.
+	bool reuse_scene_commands = false;
+	// Shade with the point lights of SetLights, binned into a view-space cluster grid by a
+	// compute pass at the start of every frame
+	bool clustered_lighting = false;
+	// Lights SetLights may take
+	std::uint32_t max_lights = 16384;
+	ClusterSettings light_clusters;
+	// Invocations per workgroup of the light binning pass, a specialization constant
+	std::uint32_t light_cluster_group_size = 64;
+	// Scene pipeline variants compiled while loading; the first one is used until
+	// SetShadingVariant picks another
+	std::vector<ShadingVariant> shading_variants = {ShadingVariant()};
+	// Frames the CPU may record ahead of the GPU; each has its own command buffer, instance
+	// buffer and arenas
+	std::uint32_t frames_in_flight = 2;
+	// Threads that allocate from the frame arenas, e.g. JobSystem::GetConcurrency()
+	std::uint32_t arena_thread_count = 1;
+	std::size_t frame_arena_bytes = 256 * 1024;
+	// Render into images owned by Graphics instead of a swapchain: no surface and no
+	// presentation, e.g. to capture frames without a display. The window, which may be
+	// hidden, only provides the size.
+	bool offscreen = false;
+	// Render the scene at a fraction of the output size chosen from measured GPU frame times,
+	// then upscale it with a bilinear blit
+	DynamicResolutionSettings dynamic_resolution;
+	// Create every Vulkan object with allocation callbacks that count the driver's host
+	// allocations per scope and object type (GetHostAllocationStats)
+	bool track_host_allocations = false;
+	// With track_host_allocations, serve them from size-class pools instead of the C heap
+	bool pool_host_allocations = false;
+	// Count vertices, primitives and shader invocations of every pass with pipeline statistics
+	// queries, read back as each frame retires (GetPipelineStatistics). Needs inherited queries
+	// with reuse_scene_commands.
+	bool pipeline_statistics = false;
+	// Fraction of each memory heap's budget that streamable meshes are evicted to stay under,
+	// leaving headroom for other processes and for transient allocations
+	std::float_t memory_budget_fill = 0.9f;
+	// 2D overlay drawn over the primary window after everything else, e.g. a performance HUD
+	// (GetOverlay). Needs dynamic rendering.
+	bool overlay = false;
+	// Quads the overlay takes per frame; every glyph, rectangle and graph bar is one
+	std::uint32_t max_overlay_quads = 4096;
+};
+
+// A frame copied back from the GPU. `rgba` is tightly packed 8-bit RGBA, rows top to bottom,
+// and only valid during the handler call.
+struct FrameReadback {
+	std::uint64_t frame_number = 0;
+	std::uint32_t width = 0;
+	std::uint32_t height = 0;
+	gsl::span<const std::uint8_t> rgba;
+};
+
+using ReadbackHandler = std::function<void(const FrameReadback&)>;
+
+// Index of a mesh uploaded with Graphics::UploadMesh
+using MeshId = std::uint32_t;
+
+// One object for the GPU culling pass (std430 layout of occlusion_cull.comp). `sphere` bounds
+// it in the space the culling view-projection maps to clip space; the object is drawn as one
+// instance, `instance`, of the index range [first_index, first_index + index_count).
+struct CulledObject {
+	glm::vec4 sphere = glm::vec4(0.0f);
+	std::uint32_t instance = 0;
+	std::uint32_t first_index = 0;
+	std::uint32_t index_count = 0;
+	std::uint32_t reserved = 0;
+};
+
+struct OcclusionBatch {
+	MeshId mesh = 0;
+	gsl::span<const CulledObject> objects;
+};
+
+struct OcclusionStats {
+	std::uint32_t objects = 0;
+	// Visible last frame and drawn before the depth pyramid was built
+	std::uint32_t drawn_early = 0;
+	// Newly visible after testing against this frame's depth pyramid
+	std::uint32_t drawn_late = 0;
+	// Inside the frustum but hidden
+	std::uint32_t occluded = 0;
+	std::uint32_t triangles = 0;
+};
+
 class Graphics {
 	public:
-	Graphics(gsl::not_null<Window*> window);
+	// With `jobs` startup runs as a task graph so independent steps (shader loading, pipeline
+	// compilation, swapchain and command setup) overlap. `jobs` must outlive the Graphics and
+	// settings.arena_thread_count must cover its threads.
+	Graphics(gsl::not_null<Window*> window, GraphicsSettings settings = {}, JobSystem* jobs = nullptr);
+	// One device drawing into several windows, e.g. one per monitor, with a single submission
+	// and a single present per frame. The first window is the primary one: dynamic resolution
+	// (only with one window), capture, occlusion culling and clustered lighting work on it.
+	// Not with `offscreen`.
+	Graphics(gsl::span<const gsl::not_null<Window*>> windows, GraphicsSettings settings = {}, JobSystem* jobs = nullptr);
 	~Graphics();
 
+	const DeviceFeatures& GetDeviceFeatures() const { return device_features_; }
+
+	// Waits until the oldest frame in flight has retired, recycles its resources, acquires
+	// a swapchain image and starts recording. Returns false when no image could be acquired,
+	// e.g. while the primary window is minimized or its swapchain was just recreated; the
+	// frame is then skipped and EndFrame() must not be called.
+	bool BeginFrame();
+	// Finishes recording, submits and presents every window at once
+	void EndFrame();
+
+	std::uint32_t GetWindowCount() const { return gsl::narrow_cast<std::uint32_t>(surfaces_.size()); }
+	// Ends drawing into the current window and starts on `window`, which clears it; BeginFrame
+	// starts on window 0 and the others follow in increasing order. Returns false when the
+	// window has no image this frame, its draws must be skipped then. Windows left out are
+	// cleared by EndFrame.
+	bool BeginWindow(std::uint32_t window);
+
+	// With the depth pre-pass enabled geometry is recorded twice: BeginFrame opens the
+	// depth-only pass and BeginMainPass switches to the color pass, which tests against it.
+	void BeginMainPass();
+	// With settings.reuse_scene_commands the draws of the next frames are recorded again,
+	// e.g. after the draw list changed. Call outside BeginFrame/EndFrame; instance matrices
+	// and lights may change without it.
+	void MarkSceneDirty() { scene_version_++; }
+	// False while the current pass replays the draws of an earlier frame. Draw calls are
+	// ignored then, so the work of preparing them can be skipped.
+	bool NeedsSceneDraws() const { return !replaying_scene_; }
+	void RenderTriangle();
+	// Draws one triangle instance per index in `instances` (e.g. a frustum culling result);
+	// consecutive indices are merged into a single instanced draw.
+	void RenderTriangleInstances(gsl::span<const std::uint32_t> instances);
+
+	// Copies a cooked mesh straight from its mapping into device-local vertex and index
+	// buffers. Waits for the copy, so it belongs to load time rather than the frame loop.
+	MeshId UploadMesh(const MeshFile& mesh);
+	// Same, but the mesh may be evicted when a memory heap runs over its budget. The next draw
+	// that needs it records a copy from `mesh` ahead of its frame and is skipped, as are the
+	// draws after it, until that frame has retired; nothing waits for the copy.
+	MeshId UploadStreamableMesh(std::shared_ptr<const MeshFile> mesh);
+	// LOD chain of an uploaded mesh, finest first, and the radius its errors relate to
+	gsl::span<const MeshLod> GetMeshLods(MeshId mesh) const { return meshes_[mesh].lods; }
+	std::float_t GetMeshRadius(MeshId mesh) const { return glm::length(meshes_[mesh].bounds_max - meshes_[mesh].bounds_min) * 0.5f; }
+	// Draws index ranges of `mesh` with the instance buffer's world matrices, e.g. from
+	// LodSelector::BuildDraws: one vkCmdDrawIndexed per command.
+	void DrawMesh(MeshId mesh, gsl::span<const DrawIndexedCommand> draws);
+	// Same, but the commands are copied into this frame's indirect buffer and issued as a
+	// single multi-draw; falls back to DrawMesh where the device lacks multiDrawIndirect or
+	// drawIndirectFirstInstance.
+	void DrawMeshIndirect(MeshId mesh, gsl::span<const DrawIndexedCommand> draws);
+
+	// Two-phase occlusion culling of all objects of `batches`, at most once per frame. The
+	// objects visible last frame are drawn first; a depth pyramid is built from the result and
+	// the remaining objects are tested against it and drawn if they show. Visibility is kept
+	// per object position across batches, so the objects should come in the same order every
+	// frame; a changed order costs extra draws for a frame but never hides anything.
+	void DrawOcclusionCulled(gsl::span<const OcclusionBatch> batches, const glm::mat4& view_projection);
+	bool IsOcclusionCullingEnabled() const { return occlusion_culling_; }
+	// Counters of the most recently retired frame that called DrawOcclusionCulled
+	const OcclusionStats& GetOcclusionStats() const { return occlusion_stats_; }
+
+	// World-space point lights for the frames begun from now on, moved into view space with
+	// `view`. `projection` must be the one the instance matrices use; the fragment shader
+	// reconstructs view-space positions with its inverse. Call outside BeginFrame/EndFrame.
+	void SetLights(gsl::span<const PointLight> lights, const glm::mat4& view, const glm::mat4& projection);
+	bool IsClusteredLightingEnabled() const { return settings_.clustered_lighting; }
+
+	// Draws from now on with the scene pipelines of `variant`. Variants of
+	// settings.shading_variants are ready; any other is compiled here, which stalls. Call
+	// outside BeginFrame/EndFrame.
+	void SetShadingVariant(const ShadingVariant& variant);
+	ShaderVariantStats GetShaderVariantStats() const { return shader_variants_.GetStats(); }
+
+	// Persistently mapped world matrices of the current frame, indexed by instance (e.g.
+	// TransformHierarchy::Update with one buffer per frame in flight). Valid after BeginFrame.
+	gsl::span<glm::mat4> GetInstanceBuffer();
+
+	// Transient memory of the current frame for the calling thread (its
+	// JobSystem::GetCurrentThreadIndex()); released when this frame in flight retires. Every
+	// thread outside the job system gets the same index, so of those only the thread that
+	// created the Graphics may call this.
+	std::pmr::memory_resource* GetFrameMemory(std::uint32_t thread_index);
+
+	// Copies the frame being recorded (call between BeginFrame and EndFrame) into a host
+	// visible buffer of its frame in flight. The handler receives it when that frame slot
+	// comes around again, frames_in_flight frames later, so capturing never stalls.
+	void CaptureFrame();
+	void SetReadbackHandler(ReadbackHandler handler) { readback_handler_ = std::move(handler); }
+	// Waits for the GPU and hands over the captures still in flight, e.g. before shutdown
+	void FlushReadbacks();
+	// Needs an 8-bit RGBA or BGRA target that can be a transfer source
+	bool IsCaptureSupported() const { return capture_supported_; }
+
+	// GPU time of the most recently retired frame, from timestamp queries; 0 if unsupported
+	std::double_t GetGpuFrameTime() const { return gpu_frame_ms_; }
+	// Per-axis scale the scene is rendered at; 1 unless dynamic resolution is active
+	std::float_t GetRenderScale() const { return dynamic_resolution_ ? resolution_controller_.GetScale() : 1.0f; }
+
+	// Driver host allocations so far, with the churn of the last complete frame; all zero
+	// unless settings.track_host_allocations
+	HostAllocationStats GetHostAllocationStats() const { return host_allocations_ != nullptr ? host_allocations_->GetStats() : HostAllocationStats(); }
+	// Pauses or resumes the counting; needs settings.track_host_allocations, since only
+	// objects created with the callbacks report to them
+	void SetHostAllocationTracking(bool enabled);
+	void LogHostAllocationStats() const;
+
+	// Frames past the warm-up that made heap allocations outside one-off work such as swapchain
+	// recreation; always 0 in release builds, which do not count allocations
+	std::uint64_t GetAllocatingFrameCount() const { return allocating_frames_; }
+
+	// Per-pass totals of settings.pipeline_statistics, up to the most recently retired frame
+	gsl::span<const PassStatistics> GetPipelineStatistics() const { return pipeline_statistics_.GetPasses(); }
+	void LogPipelineStatistics() const;
+
+	// Budget and usage of every memory heap as of the latest BeginFrame
+	gsl::span<const MemoryHeapBudget> GetMemoryBudgets() const { return memory_budgets_; }
+	ResidencyStats GetResidencyStats() const { return residency_.GetStats(); }
+	void LogMemoryBudgets() const;
+
+	// The current frame's overlay in pixels of the primary window, emptied by BeginFrame. It is
+	// drawn in one draw call at output resolution once the primary window's rendering ends, so
+	// it must be complete by the first BeginWindow or EndFrame. Without settings.overlay, or
+	// where it is unsupported, it has no room and drops everything.
+	OverlayBatch& GetOverlay() { return overlay_batch_; }
+	bool IsOverlayEnabled() const { return overlay_; }
+	// GPU time of the most recently retired frame's overlay; 0 without timestamps
+	std::double_t GetGpuOverlayTime() const { return gpu_overlay_ms_; }
+	// GPU time of the most recently retired frame's light clustering dispatch; 0 without
+	// clustered lighting or timestamps
+	std::double_t GetGpuLightClusteringTime() const { return gpu_light_clustering_ms_; }
+	// GPU time of the most recently retired frame's scene passes in the primary window, from
+	// the depth pre-pass or occlusion culling to the last shaded fragment; 0 without timestamps
+	std::double_t GetGpuSceneTime() const { return gpu_scene_ms_; }
+
 	private:
+	// Frames allowed to allocate while arenas and caches warm up
+	static constexpr std::uint64_t kAllocationWarmupFrames = 8;
+	// Retired allocations tracked before released_memory_ has to grow
+	static constexpr std::size_t kReleasedMemoryReserve = 256;
+	// Pipeline statistics queries per frame in flight; scopes beyond go unmeasured
+	static constexpr std::uint32_t kMaxStatisticsQueries = 32;
+	// Per frame in flight: the frame's begin and end, then the overlay's, the light
+	// clustering's and the primary window's scene passes'
+	static constexpr std::uint32_t kTimestampsPerFrame = 8;
 
 	struct QueueFamilyIndices {
 		std::optional<std::uint32_t> graphics_family = std::nullopt;
@@ -20,10 +310,179 @@ class Graphics {
 		bool IsValid() const { return graphics_family.has_value() && presentation_family.has_value(); }
 	};
 
+	// Counts a device memory allocation against its heap for as long as it is alive
+	class HeapUsage {
+		public:
+		HeapUsage() = default;
+		HeapUsage(std::atomic<VkDeviceSize>* counter, std::uint32_t heap, VkDeviceSize size) : counter_(counter), heap_(heap), size_(size)
+		{
+			counter_->fetch_add(size_, std::memory_order_relaxed);
+		}
+		HeapUsage(HeapUsage&& other) noexcept : counter_(std::exchange(other.counter_, nullptr)), heap_(other.heap_), size_(other.size_) {}
+		HeapUsage& operator=(HeapUsage&& other) noexcept
+		{
+			HeapUsage(std::move(other)).Swap(*this);
+			return *this;
+		}
+		~HeapUsage()
+		{
+			if (counter_ != nullptr) {
+				counter_->fetch_sub(size_, std::memory_order_relaxed);
+			}
+		}
+
+		std::uint32_t GetHeap() const { return heap_; }
+		VkDeviceSize GetSize() const { return counter_ != nullptr ? size_ : 0; }
+
+		private:
+		void Swap(HeapUsage& other)
+		{
+			std::swap(counter_, other.counter_);
+			std::swap(heap_, other.heap_);
+			std::swap(size_, other.size_);
+		}
+
+		std::atomic<VkDeviceSize>* counter_ = nullptr;
+		std::uint32_t heap_ = 0;
+		VkDeviceSize size_ = 0;
+	};
+
+	// Memory first so it is freed last
+	struct ImageHandle {
+		HeapUsage heap_usage;
+		UniqueDeviceMemory memory;
+		UniqueImage image;
+		UniqueImageView view;
+	};
+
+	struct BufferHandle {
+		HeapUsage heap_usage;
+		UniqueDeviceMemory memory;
+		UniqueBuffer buffer;
+		void* mapped = nullptr;
+	};
+
+	struct ImageTransition {
+		VkImage image = VK_NULL_HANDLE;
+		VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+		VkImageLayout old_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VkImageLayout new_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VkPipelineStageFlags src_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		VkAccessFlags src_access = 0;
+		VkPipelineStageFlags dst_stage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+		VkAccessFlags dst_access = 0;
+	};
+
+	struct MeshBuffers {
+		BufferHandle vertices;
+		BufferHandle indices;
+		std::uint32_t index_count = 0;
+		VkIndexType index_type = VK_INDEX_TYPE_UINT16;
+		// Dequantizes the positions: bounds_min + position * (bounds_max - bounds_min)
+		glm::vec3 bounds_min = glm::vec3(0.0f);
+		glm::vec3 bounds_max = glm::vec3(0.0f);
+		std::vector<MeshLod> lods;
+		// Streamable meshes: what they are uploaded again from after an eviction
+		std::shared_ptr<const MeshFile> source;
+		std::optional<ResidencyManager::ResourceId> residency = std::nullopt;
+		// While uploaded again: the frame that copies it, after which it may be drawn
+		std::optional<std::uint64_t> upload_frame = std::nullopt;
+	};
+
+	// Memory retired with RetireBuffer or RetireImage, counted until `last_use_frame` retires
+	struct ReleasedMemory {
+		HeapUsage heap_usage;
+		std::uint64_t last_use_frame = 0;
+	};
+
+	// Secondary command buffer with the draws of one pass, valid while the scene version and
+	// render extent it was recorded for are current
+	struct SceneCommands {
+		VkCommandBuffer buffer = VK_NULL_HANDLE;
+		std::uint64_t version = 0;  // 0: never recorded
+		VkExtent2D extent = {};
+		// The streamable meshes it draws, kept resident while it is replayed
+		std::vector<MeshId> meshes;
+	};
+
+	struct StatisticsQuery {
+		PipelineStatisticsLog::PassId pass = 0;
+		std::uint64_t pixels = 0;
+	};
+
+	struct FrameData {
+		VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+		// Mesh restores, begun by the first one of the frame and submitted ahead of
+		// `command_buffer`
+		VkCommandBuffer upload_command_buffer = VK_NULL_HANDLE;
+		bool uploads_recorded = false;
+		// reuse_scene_commands: the depth pre-pass draws, then the color pass draws
+		std::array<SceneCommands, 2> scene_commands;
+		UniqueFence in_flight;
+		BufferHandle instance_buffer;
+		BufferHandle indirect_buffer;
+		// Copy of a captured frame, read once `in_flight` has been waited on
+		BufferHandle readback_buffer;
+		std::optional<std::uint64_t> readback_frame = std::nullopt;
+		VkExtent2D readback_extent = {};
+		bool timestamps_written = false;
+		bool overlay_timestamps_written = false;
+		bool light_timestamps_written = false;
+		bool scene_timestamps_written = false;
+		// The pipeline statistics queries recorded, in query order
+		std::array<StatisticsQuery, kMaxStatisticsQueries> statistics_queries;
+		std::uint32_t statistics_query_count = 0;
+		std::uint64_t statistics_frame = 0;
+		// Occlusion culling: the frame's objects, their early and late draw commands and the
+		// counters the culling pass accumulates
+		BufferHandle culled_objects;
+		BufferHandle culled_commands;
+		BufferHandle occlusion_counters;
+		VkDescriptorSet cull_descriptor_set = VK_NULL_HANDLE;
+		std::uint32_t culled_object_count = 0;  // non-zero once the counters are written
+		// Clustered lighting: the frame's view-space lights and cluster grid
+		BufferHandle light_buffer;
+		BufferHandle cluster_uniforms;
+		VkDescriptorSet lighting_descriptor_set = VK_NULL_HANDLE;
+		// Overlay quads, written through OverlayBatch while the frame is recorded
+		BufferHandle overlay_vertices;
+	};
+
+	// Everything tied to one window; the device, pipelines and attachments are shared. Only
+	// parents come before their children, so it destroys itself in a valid order.
+	struct WindowSurface {
+		Window* window = nullptr;
+		// Read on the main thread, which GLFW requires, for the startup tasks to size from
+		glm::ivec2 framebuffer_size = {};
+		UniqueSurface surface;
+		UniqueSwapchain swap_chain;
+		VkPresentModeKHR present_mode = VK_PRESENT_MODE_FIFO_KHR;
+		VkExtent2D extent = {};
+		std::vector<VkImage> images;  // the offscreen targets when offscreen
+		std::vector<UniqueImageView> image_views;
+		std::vector<UniqueFramebuffer> framebuffers;
+		// Indexed by frame in flight
+		std::vector<UniqueSemaphore> image_available;
+		// Indexed by swapchain image: presentation may still wait on it after the frame's fence
+		std::vector<UniqueSemaphore> render_finished;
+		// This frame's image, if one could be acquired
+		std::uint32_t image_index = 0;
+		bool acquired = false;
+		// Acquire or present found the swapchain no longer matching the surface; the next
+		// BeginFrame creates it again
+		bool out_of_date = false;
+	};
+
+	// Everything the scene pipelines are created from, kept so that shading variants can be
+	// compiled at any time. Filled in place: the create infos point into it.
+	struct ScenePipelineState;
+
 	struct SwapChainProperties {
+		explicit SwapChainProperties(std::pmr::memory_resource* memory) : formats(memory), present_modes(memory) {}
+
 		VkSurfaceCapabilitiesKHR capabilities;
-		std::vector<VkSurfaceFormatKHR> formats;
-		std::vector<VkPresentModeKHR> present_modes;
+		std::pmr::vector<VkSurfaceFormatKHR> formats;
+		std::pmr::vector<VkPresentModeKHR> present_modes;
 
 		bool IsValid() const { return !formats.empty() && !present_modes.empty(); }
 	};
@@ -35,76 +494,353 @@ class Graphics {
 	void SetupDebugMessenger();
 	void PickPhysicalDevice();
 	void CreateLogicalDeviceAndQueues();
-	void CreateSurface();
-	void CreateSwapChain();
+	void CreateSurfaces();
+	void CreateSwapChains();
+	void CreateSwapChain(WindowSurface& surface);
+	void CreateOffscreenTargets();
 	void CreateImageViews();
+	void CreateImageViews(WindowSurface& surface);
+	// Waits for the GPU and creates the swapchain of `surface` again, with everything sized
+	// from it; false while the window is minimized
+	bool RecreateSwapChain(WindowSurface& surface);
+	void CreateColorResources();
+	void CreateDepthResources();
+	// Replace the attachments sized from the windows, e.g. after a swapchain was recreated
+	void CreateColorImage();
+	void CreateDepthImage();
+	void CreateSceneTargets();
 	void CreateRenderPass();
+	void ReadShaderFiles();
+	void CreateShaderModules();
 	void CreateGraphicsPipeline();
+	// Creates one of the color pipelines of the scene pipeline state with its fragment stage
+	// specialized by `constants`
+	UniquePipeline CreateScenePipeline(const VkGraphicsPipelineCreateInfo& pipeline_info, const VkSpecializationInfo& constants);
 	void CreateFramebuffers();
+	void CreateFramebuffers(WindowSurface& surface);
+	void CreateInstanceBuffer();
 	void CreateCommandPool();
-	void CreateCommandBuffer();
+	void CreateCommandBuffers();
+	void CreateSyncObjects();
+	void CreatePresentSemaphores(WindowSurface& surface);
+	void CreateTimestampQueries();
+	void CreatePipelineStatisticsQueries();
+	bool IsOcclusionCullingSupported();
+	void CreateOcclusionCulling();
+	// The pyramid for the primary window's extent, its level views and descriptor sets
+	void CreateDepthPyramid();
+	void CreateClusteredLighting();
+	bool IsOverlaySupported();
+	void CreateOverlay();
 
 	// Rendering
-
-	void BeginCommands(std::uint32_t current_image_index);
-	void RenderTriangle();
+	void BeginCommands();
 	void EndCommands();
+	// Opens and closes the rendering of the current window
+	void BeginWindowRendering();
+	void EndWindowRendering();
+	// Start and finish the draws of a pass: inline, or into its secondary command buffer when
+	// that is stale and replaying it otherwise
+	void BeginSceneCommands();
+	void EndSceneCommands();
+	void ClearWindow(std::uint32_t window);
+	void CheckFrameAllocations();
+	// Callbacks to create and destroy an object of `type` with; null without tracking
+	const VkAllocationCallbacks* GetHostAllocator(VkObjectType type) const;
+	// Leaves the swapchain image in `output_layout`
+	void RecordUpscale(VkImageLayout output_layout);
+	// Draws the overlay batch into the primary window's image, which must be a color
+	// attachment with the scene's writes visible, and leaves it in final_color_layout_
+	void RecordOverlay();
+	void ReadGpuFrameTime(FrameData& frame);
+	// The primary window's extent, scaled by the dynamic resolution
+	void ScaleRenderExtent();
+	// Ends the open pipeline statistics query, if any, and starts one for `pass` in the frame's
+	// primary command buffer; only between rendering scopes. `pixels`: render area the pass
+	// starts drawing, 0 when it resumes or for compute work.
+	void BeginStatisticsQuery(PipelineStatisticsLog::PassId pass, std::uint64_t pixels = 0);
+	void EndStatisticsQuery();
+	void ReadPipelineStatistics(FrameData& frame);
+	void RecordReadback(FrameData& frame);
+	void DeliverReadback(FrameData& frame);
+
+	// `resume` continues into attachments a previous rendering scope of this frame stored
+	void BeginDynamicRendering(bool depth_only, bool resume = false);
+	void ResumeRendering();
+	void RecordMemoryBarrier(VkPipelineStageFlags src_stage, VkAccessFlags src_access, VkPipelineStageFlags dst_stage, VkAccessFlags dst_access);
+	void BuildDepthPyramid();
+	void DispatchOcclusionCull(const FrameData& frame, const glm::mat4& view_projection, std::uint32_t object_count, bool late);
+	void DrawCulledBatches(const FrameData& frame, gsl::span<const OcclusionBatch> batches, std::uint32_t object_count, bool late);
+	void ReadOcclusionStats(FrameData& frame);
+	// Bins the pending lights into the cluster lists; recorded before rendering starts
+	void RecordLightClustering(FrameData& frame);
+	// Skips the bind when `pipeline` is bound already; triangle and mesh draws may interleave
+	void BindGraphicsPipeline(VkPipeline pipeline);
+	void BindMesh(const MeshBuffers& mesh);
+	// The buffers of `mesh` for a draw of this frame, or null while a streamable mesh is being
+	// uploaded again; starts that upload if it was evicted
+	MeshBuffers* UseMesh(MeshId mesh);
+	// Copies the vertices and indices of `mesh` into new device-local buffers and waits
+	void UploadMeshBuffers(const MeshFile& mesh, MeshBuffers& buffers);
+	// Creates the device-local buffers and returns a staging buffer with the vertices followed
+	// by the indices, which RecordMeshCopy copies into them
+	BufferHandle StageMeshBuffers(const MeshFile& mesh, MeshBuffers& buffers);
+	void RecordMeshCopy(VkCommandBuffer command_buffer, const MeshFile& mesh, VkBuffer staging, const MeshBuffers& buffers);
+	// The current frame's upload command buffer, begun on first use
+	VkCommandBuffer BeginUploadCommands();
+	// Lets the meshes whose copies ran by `completed_frame` be drawn
+	void FinishMeshUploads(std::uint64_t completed_frame);
+	void EvictMesh(MeshId mesh);
+	// Reads the heap budgets, from VK_EXT_memory_budget where enabled, then evicts the least
+	// recently used streamable meshes of heaps over memory_budget_fill of their budget
+	void UpdateMemoryBudgets();
+	void EnforceMemoryBudget();
+	void TransitionImage(const ImageTransition& transition);
+	// Records with `record` into a temporary command buffer, submits it and waits
+	void SubmitAndWait(const std::function<void(VkCommandBuffer)>& record);
 
-	std::vector<gsl::czstring> GetRequiredInstanceExtensions();
+	// Query helpers return their lists in `memory`, normally GetScratchMemory()
+	std::pmr::vector<gsl::czstring> GetRequiredInstanceExtensions(std::pmr::memory_resource* memory);
 
 
 	static gsl::span<gsl::czstring> GetSuggestedInstanceExtensions();
-	static std::vector<VkExtensionProperties> GetSupportedInstanceExtensions();
-	static bool AreAllExtensionsSupported(gsl::span<gsl::czstring> extensions);
+	static std::pmr::vector<VkExtensionProperties> GetSupportedInstanceExtensions(std::pmr::memory_resource* memory);
+	static bool AreAllExtensionsSupported(gsl::span<gsl::czstring> extensions, std::pmr::memory_resource* memory);
 
-	static std::vector<VkLayerProperties> GetSupportedValidationLayers();
-	static bool AreAllLayersSupported(gsl::span<gsl::czstring> extensions);
+	static std::pmr::vector<VkLayerProperties> GetSupportedValidationLayers(std::pmr::memory_resource* memory);
+	static bool AreAllLayersSupported(gsl::span<gsl::czstring> extensions, std::pmr::memory_resource* memory);
 
-	QueueFamilyIndices FindQueueFamilies(VkPhysicalDevice device);
-	SwapChainProperties GetSwapChainProperties(VkPhysicalDevice device);
+	QueueFamilyIndices FindQueueFamilies(VkPhysicalDevice device, std::pmr::memory_resource* memory);
+	SwapChainProperties GetSwapChainProperties(VkPhysicalDevice device, VkSurfaceKHR surface, std::pmr::memory_resource* memory);
 	bool IsDeviceSuitable(VkPhysicalDevice device);
-	std::vector<VkPhysicalDevice> GetAvailableDevices();
+	std::pmr::vector<VkPhysicalDevice> GetAvailableDevices(std::pmr::memory_resource* memory);
+	gsl::span<const gsl::czstring> GetRequiredDeviceExtensions() const;
 	bool AreAllDeviceExtensionsSupported(VkPhysicalDevice device);
-	std::vector<VkExtensionProperties> GetDeviceAvailableExtensions(VkPhysicalDevice device);
+	std::pmr::vector<VkExtensionProperties> GetDeviceAvailableExtensions(VkPhysicalDevice device, std::pmr::memory_resource* memory);
 
 	VkSurfaceFormatKHR ChooseSwapSurfaceFormat(std::span<VkSurfaceFormatKHR> formats);
 	VkPresentModeKHR ChooseSwapPresentMode(std::span<VkPresentModeKHR> modes);
-	VkExtent2D ChooseSwapExtent(const VkSurfaceCapabilitiesKHR capabilities);
+	VkExtent2D ChooseSwapExtent(const VkSurfaceCapabilitiesKHR capabilities, glm::ivec2 framebuffer_size);
 	std::uint32_t ChooseSwapImageCount(const VkSurfaceCapabilitiesKHR& capabilities);
 
-	VkShaderModule CreateShaderModule(gsl::span<std::uint8_t> buffer);
+	std::optional<std::uint32_t> FindMemoryType(std::uint32_t type_bits, VkMemoryPropertyFlags properties);
+	VkFormat FindDepthFormat();
+	VkSampleCountFlagBits ChooseSampleCount(std::uint32_t requested);
+	bool IsBlitSupported(VkFormat format);
+	// What the scene is drawn into: the current window's swapchain image, or the frame's scene
+	// target with dynamic resolution
+	VkImage GetColorTarget();
+	VkImageView GetColorTargetView();
+	// Depth and multisampled color are shared by the windows, which are drawn one after the
+	// other, so they cover the largest
+	VkExtent2D GetAttachmentExtent() const;
+	// The view covers all `mip_levels`
+	ImageHandle CreateImage(
+	    VkExtent2D extent,
+	    VkFormat format,
+	    VkImageUsageFlags usage,
+	    VkImageAspectFlags aspect,
+	    VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT,
+	    std::uint32_t mip_levels = 1);
+	BufferHandle CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties);
+
+	// Hand objects to the deletion queue, which destroys them once every frame recorded so
+	// far has retired; for replacing resources at runtime without vkDeviceWaitIdle
+	void RetireImage(ImageHandle& handle);
+	void RetireBuffer(BufferHandle& handle);
+	void RetireHeapUsage(HeapUsage& heap_usage);
+	template <typename Parent, typename T, auto Destroy>
+	void Retire(VulkanHandle<Parent, T, Destroy>& handle) { deletion_queue_.Push(std::move(handle), frame_number_); }
+
+	// The calling thread's arena of the first frame, which is only reset once startup is over
+	std::pmr::memory_resource* GetScratchMemory();
+
+	UniqueShaderModule CreateShaderModule(gsl::span<std::uint8_t> buffer);
+	// Both exit on shaders the layouts cannot be built from; `name` is for the log
+	ShaderReflection ReflectShader(gsl::span<const std::uint8_t> code, gsl::czstring name);
+	// The layout cache's pipeline layout for the resources of `shaders` together
+	PipelineLayoutHandles GetPipelineLayout(gsl::span<const ShaderReflection> shaders);
 	VkViewport GetViewport();
 	VkRect2D GetScissor();
 
 	std::array<gsl::czstring, 1> required_device_extensions_ = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+	std::vector<gsl::czstring> enabled_device_extensions_;
 
-	VkInstance instance_ = VK_NULL_HANDLE;
+	// Handles are destroyed in reverse declaration order: keep parents above their children.
+	// The allocation callbacks go first, the driver frees through them until the instance is gone.
+	std::unique_ptr<HostAllocationTracker> host_allocations_;
+	UniqueInstance instance_;
+	std::uint32_t instance_api_version_ = VK_API_VERSION_1_0;
+	ValidationMessageFilter validation_filter_;  // the messenger's user data, so it outlives it
+	UniqueDebugMessenger debug_messenger_;
 
 	//Device
 	VkPhysicalDevice physical_device_ = VK_NULL_HANDLE;
-	VkDevice logical_device_ = VK_NULL_HANDLE;
+	VkPhysicalDeviceMemoryProperties memory_properties_ = {};
+	// Bytes allocated by the engine per memory heap; above every handle, which count into it.
+	// Atomic since startup tasks allocate concurrently.
+	std::array<std::atomic<VkDeviceSize>, VK_MAX_MEMORY_HEAPS> heap_usage_ = {};
+	UniqueDevice logical_device_;
 	VkQueue graphics_queue_ = VK_NULL_HANDLE;
 	VkQueue presentation_queue_ = VK_NULL_HANDLE;
-	VkDebugUtilsMessengerEXT debug_messenger_;
+	// Cached so later startup tasks never query the surface while the swapchain is created
+	QueueFamilyIndices queue_families_;
+	DeviceFeatures device_features_;
+	// Owns every descriptor set and pipeline layout; the members below only refer to them
+	std::optional<PipelineLayoutCache> layout_cache_;
 
-	VkSurfaceKHR surface_ = VK_NULL_HANDLE;
-	VkSwapchainKHR swap_chain_ = VK_NULL_HANDLE;
+	// Resolved from either the 1.3 core entry points or VK_KHR_dynamic_rendering
+	PFN_vkCmdBeginRenderingKHR cmd_begin_rendering_ = nullptr;
+	PFN_vkCmdEndRenderingKHR cmd_end_rendering_ = nullptr;
+
+	std::vector<ImageHandle> offscreen_targets_;  // stand in for the swapchain images when offscreen
+	// The primary window first
+	std::vector<WindowSurface> surfaces_;
+	std::uint32_t current_surface_ = 0;  // the window being drawn
+	bool window_rendering_ = false;      // its rendering is open
+	// Shared by all windows; every swapchain uses the primary window's choice
 	VkSurfaceFormatKHR surface_format_;
-	VkPresentModeKHR present_mode_;
-	VkExtent2D extent_;
-	std::vector<VkImage> swap_chain_images_;
-	std::vector<VkImageView> swap_chain_image_views_;
-	std::vector<VkFramebuffer> swap_chain_framebuffers_;
+	VkExtent2D render_extent_;  // the current window's, scaled by the dynamic resolution
+	// Layout the color target is left in at the end of a frame
+	VkImageLayout final_color_layout_ = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+	VkSampleCountFlagBits msaa_samples_ = VK_SAMPLE_COUNT_1_BIT;
+	ImageHandle color_image_;  // multisampled target, resolved into the swapchain image
+
+	VkFormat depth_format_ = VK_FORMAT_UNDEFINED;
+	VkImageAspectFlags depth_aspect_ = VK_IMAGE_ASPECT_DEPTH_BIT;
+	ImageHandle depth_image_;
+
+	// Full-size per frame in flight; only the top-left render_extent_ is drawn and upscaled
+	std::vector<ImageHandle> scene_targets_;
+	bool dynamic_resolution_ = false;
+	DynamicResolutionController resolution_controller_;
+
+	UniqueQueryPool timestamp_pool_;  // kTimestampsPerFrame per frame in flight
+	std::double_t timestamp_period_ns_ = 0.0;
+	std::uint64_t timestamp_mask_ = 0;
+	std::double_t gpu_frame_ms_ = 0.0;
+	std::double_t gpu_light_clustering_ms_ = 0.0;
+	std::double_t gpu_scene_ms_ = 0.0;
 
+	UniqueQueryPool statistics_pool_;  // kMaxStatisticsQueries per frame in flight
+	PipelineStatisticsLog pipeline_statistics_;
+	bool statistics_query_open_ = false;
+
+	// Hi-Z occlusion culling. The pyramid halves the depth buffer per level, keeping the
+	// farthest depth, and stays in the GENERAL layout; the visibility flags carry over from one
+	// frame's late pass to the next frame's early pass.
+	bool occlusion_culling_ = false;
+	ImageHandle depth_pyramid_;
+	std::uint32_t depth_pyramid_levels_ = 0;
+	std::vector<UniqueImageView> depth_pyramid_mips_;
+	UniqueSampler depth_sampler_;
+	BufferHandle object_visibility_;
+	VkDescriptorSetLayout pyramid_set_layout_ = VK_NULL_HANDLE;
+	VkDescriptorSetLayout cull_set_layout_ = VK_NULL_HANDLE;
+	UniqueDescriptorPool occlusion_descriptor_pool_;
+	std::vector<VkDescriptorSet> pyramid_descriptor_sets_;  // one per level, freed with the pool
+	VkPipelineLayout pyramid_pipeline_layout_ = VK_NULL_HANDLE;
+	VkPipelineLayout cull_pipeline_layout_ = VK_NULL_HANDLE;
+	UniquePipeline depth_pyramid_pipeline_;
+	UniquePipeline occlusion_cull_pipeline_;
+	OcclusionStats occlusion_stats_;
+
+	// Clustered lighting. The cluster lists are shared by all frames in flight: each frame
+	// rebuilds them before its first draw, after the previous frame's fragments read them.
+	BufferHandle cluster_counts_;
+	BufferHandle cluster_light_indices_;  // max_lights_per_cluster slots per cluster
+	VkDescriptorSetLayout lighting_set_layout_ = VK_NULL_HANDLE;
+	UniqueDescriptorPool lighting_descriptor_pool_;
+	VkPipelineLayout light_cluster_pipeline_layout_ = VK_NULL_HANDLE;
+	UniquePipeline light_cluster_pipeline_;
+	std::vector<PointLight> pending_lights_;  // view space, reserved for max_lights
+	glm::mat4 light_projection_ = glm::mat4(1.0f);
+
+	// Overlay: the glyph atlas, sampled by a single descriptor set, and the batch writing into
+	// the current frame's vertex buffer
+	bool overlay_ = false;
+	ImageHandle glyph_atlas_;
+	glm::uvec2 glyph_atlas_extent_ = {0, 0};
+	UniqueSampler overlay_sampler_;
+	UniqueDescriptorPool overlay_descriptor_pool_;
+	VkDescriptorSet overlay_descriptor_set_ = VK_NULL_HANDLE;
+	VkPipelineLayout overlay_pipeline_layout_ = VK_NULL_HANDLE;
+	UniquePipeline overlay_pipeline_;
+	OverlayBatch overlay_batch_;
+	std::double_t gpu_overlay_ms_ = 0.0;
+
+	// Shared by the triangle and mesh pipelines, so the lighting set stays bound when draws
+	// switch between them
 	VkPipelineLayout pipeline_layout_ = VK_NULL_HANDLE;
-	VkRenderPass render_pass_ = VK_NULL_HANDLE;
+	UniqueRenderPass render_pass_;
+	// The color pipelines are the current shading variant's, owned by shader_variants_. The
+	// depth pre-pass has no fragment stage and thus no variants.
+	std::unique_ptr<ScenePipelineState> scene_pipeline_state_;
+	ShaderVariantCache shader_variants_;
+	ShaderVariantCache::ProgramId scene_program_ = 0;
+	ShaderVariantCache::ProgramId mesh_program_ = 0;
 	VkPipeline pipeline_ = VK_NULL_HANDLE;
+	UniquePipeline depth_prepass_pipeline_;
+	// Indexed meshes: per-vertex attributes from binding 1 and the dequantization bounds as
+	// push constants
+	VkPipeline mesh_pipeline_ = VK_NULL_HANDLE;
+	UniquePipeline mesh_depth_prepass_pipeline_;
+	VkPipeline bound_pipeline_ = VK_NULL_HANDLE;
+	bool in_depth_prepass_ = false;
+	// reuse_scene_commands: bumped by every change that invalidates the recorded draws
+	std::uint64_t scene_version_ = 1;
+	bool replaying_scene_ = false;  // the current pass's draws are recorded already
+
+	// Only alive during startup
+	std::vector<std::uint8_t> vertex_shader_code_;
+	std::vector<std::uint8_t> mesh_vertex_shader_code_;
+	std::vector<std::uint8_t> fragment_shader_code_;
+	std::vector<std::uint8_t> depth_pyramid_shader_code_;
+	std::vector<std::uint8_t> occlusion_cull_shader_code_;
+	std::vector<std::uint8_t> light_cluster_shader_code_;
+	std::vector<std::uint8_t> overlay_vertex_shader_code_;
+	std::vector<std::uint8_t> overlay_fragment_shader_code_;
+	// Kept for the shading variants compiled after startup
+	UniqueShaderModule vertex_shader_;
+	UniqueShaderModule mesh_vertex_shader_;
+	UniqueShaderModule fragment_shader_;
 
-	VkCommandPool command_pool_ = VK_NULL_HANDLE;
-	VkCommandBuffer command_buffer_ = VK_NULL_HANDLE;
+	UniqueCommandPool command_pool_;
+	std::vector<MeshBuffers> meshes_;
+	ResidencyManager residency_{0};
+	std::vector<MeshId> residency_meshes_;  // by ResidencyManager::ResourceId
+	std::vector<MeshId> uploading_meshes_;  // with an upload_frame
+	std::vector<MemoryHeapBudget> memory_budgets_;  // one per memory heap
+	std::vector<ReleasedMemory> released_memory_;  // oldest first
+	VkCommandBuffer command_buffer_ = VK_NULL_HANDLE;  // the current frame's
 
-	gsl::not_null<Window*> window_;
+	std::vector<FrameData> frames_;
+	std::uint32_t current_frame_ = 0;
+	std::uint32_t indirect_draw_count_ = 0;  // commands in the current frame's indirect buffer
+	// Objects released while frames in flight may still use them
+	DeletionQueue deletion_queue_;
+
+	GraphicsSettings settings_;
+	JobSystem* jobs_ = nullptr;
 	bool validation_enabled_ = false;
+
+	FrameArenas frame_arenas_;
+	// The one thread outside the job system allowed to use its frame arenas
+	std::thread::id main_thread_ = std::this_thread::get_id();
+
+	bool capture_supported_ = false;
+	bool capture_requested_ = false;
+	ReadbackHandler readback_handler_;
+	VkMemoryPropertyFlags readback_memory_properties_ = 0;
+	std::vector<std::uint8_t> readback_rgba_;  // swizzle target for BGRA formats
+
+	std::uint64_t frame_number_ = 0;
+	std::uint64_t frame_allocation_count_ = 0;
+	std::uint64_t allocating_frames_ = 0;
+	// Set by one-off work that allocates, e.g. recreating a swapchain, so that frame is not
+	// counted
+	bool frame_allocations_expected_ = false;
 };
 
 bool IsLayerSupported(const gsl::span<VkLayerProperties> properties, gsl::czstring name);
@@ -0,0 +1,399 @@
+#include <precomp.h>
+#include <host_allocation_tracker.h>
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+namespace veng {
+
+namespace {
+
+// Pool blocks up to this size; bigger ones (e.g. pipeline caches) go straight to the heap
+constexpr std::size_t kLargestPooledBlock = 64 * 1024;
+
+std::uintptr_t AlignUp(std::uintptr_t value, std::size_t alignment)
+{
+	return (value + alignment - 1) & ~(std::uintptr_t(alignment) - 1);
+}
+
+// The C heap rather than operator new, which debug builds count for the frame allocation check
+class MallocResource : public std::pmr::memory_resource {
+private:
+	void* do_allocate(std::size_t bytes, std::size_t alignment) override
+	{
+		if (alignment <= alignof(std::max_align_t)) {
+			if (void* memory = std::malloc(bytes)) {
+				return memory;
+			}
+			throw std::bad_alloc();
+		}
+
+		// Over-aligned: the pointer malloc returned is kept right before the aligned block
+		std::byte* raw = static_cast<std::byte*>(std::malloc(bytes + alignment + sizeof(void*)));
+		if (raw == nullptr) {
+			throw std::bad_alloc();
+		}
+		std::byte* aligned = reinterpret_cast<std::byte*>(AlignUp(reinterpret_cast<std::uintptr_t>(raw + sizeof(void*)), alignment));
+		std::memcpy(aligned - sizeof(void*), &raw, sizeof(void*));
+		return aligned;
+	}
+
+	void do_deallocate(void* memory, std::size_t, std::size_t alignment) override
+	{
+		if (alignment <= alignof(std::max_align_t)) {
+			std::free(memory);
+			return;
+		}
+		void* raw = nullptr;
+		std::memcpy(&raw, static_cast<std::byte*>(memory) - sizeof(void*), sizeof(void*));
+		std::free(raw);
+	}
+
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+};
+
+MallocResource malloc_resource;
+
+gsl::czstring GetScopeName(std::size_t scope)
+{
+	switch (scope) {
+		case VK_SYSTEM_ALLOCATION_SCOPE_COMMAND:
+			return "command";
+		case VK_SYSTEM_ALLOCATION_SCOPE_OBJECT:
+			return "object";
+		case VK_SYSTEM_ALLOCATION_SCOPE_CACHE:
+			return "cache";
+		case VK_SYSTEM_ALLOCATION_SCOPE_DEVICE:
+			return "device";
+		case VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE:
+			return "instance";
+		default:
+			return "unknown";
+	}
+}
+
+}  // namespace
+
+// Sits right before the memory handed to the driver
+struct HostAllocationTracker::Header {
+	std::size_t size = 0;
+	std::uint32_t offset = 0;  // from the start of the block
+	std::uint32_t block_alignment = 0;
+	std::uint8_t scope = 0;
+	std::uint8_t slot = 0;
+	bool counted = false;
+	bool pooled = false;
+};
+
+#pragma region COUNTERS
+
+void HostAllocationTracker::AtomicCounters::Add(std::size_t size)
+{
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+	live_count.fetch_add(1, std::memory_order_relaxed);
+	const std::uint64_t live = live_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+
+	std::uint64_t peak = peak_bytes.load(std::memory_order_relaxed);
+	while (live > peak && !peak_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+	}
+}
+
+void HostAllocationTracker::AtomicCounters::Remove(std::size_t size)
+{
+	frees.fetch_add(1, std::memory_order_relaxed);
+	live_count.fetch_sub(1, std::memory_order_relaxed);
+	live_bytes.fetch_sub(size, std::memory_order_relaxed);
+}
+
+HostAllocationCounters HostAllocationTracker::AtomicCounters::Load() const
+{
+	HostAllocationCounters counters;
+	counters.live_bytes = live_bytes.load(std::memory_order_relaxed);
+	counters.live_count = live_count.load(std::memory_order_relaxed);
+	counters.peak_bytes = peak_bytes.load(std::memory_order_relaxed);
+	counters.allocations = allocations.load(std::memory_order_relaxed);
+	counters.frees = frees.load(std::memory_order_relaxed);
+	counters.allocated_bytes = allocated_bytes.load(std::memory_order_relaxed);
+	return counters;
+}
+
+#pragma endregion
+
+HostAllocationTracker::HostAllocationTracker(bool pooled) : upstream_(&malloc_resource)
+{
+	if (pooled) {
+		std::pmr::pool_options options;
+		options.largest_required_pool_block = kLargestPooledBlock;
+		pool_ = std::make_unique<std::pmr::synchronized_pool_resource>(options, upstream_);
+	}
+
+	for (std::size_t i = 0; i < kSlotCount; i++) {
+		TypeSlot& slot = slots_[i];
+		slot.tracker = this;
+		slot.type = i < kCoreTypeCount ? static_cast<VkObjectType>(i) : kExtensionTypes[i - kCoreTypeCount];
+		slot.callbacks.pUserData = &slot;
+		slot.callbacks.pfnAllocation = &Allocate;
+		slot.callbacks.pfnReallocation = &Reallocate;
+		slot.callbacks.pfnFree = &Free;
+		slot.callbacks.pfnInternalAllocation = &InternalAllocation;
+		slot.callbacks.pfnInternalFree = &InternalFree;
+	}
+}
+
+HostAllocationTracker::~HostAllocationTracker()
+{
+	const std::uint64_t leaked = total_.live_count.load(std::memory_order_relaxed);
+	if (leaked > 0) {
+		SPDLOG_WARN("{} counted host allocations ({} bytes) outlived the Vulkan objects", leaked, total_.live_bytes.load(std::memory_order_relaxed));
+	}
+}
+
+std::size_t HostAllocationTracker::GetSlotIndex(VkObjectType type)
+{
+	if (static_cast<std::size_t>(type) < kCoreTypeCount) {
+		return static_cast<std::size_t>(type);
+	}
+	const auto extension = std::find(kExtensionTypes.begin(), kExtensionTypes.end(), type);
+	return extension != kExtensionTypes.end() ? kCoreTypeCount + (extension - kExtensionTypes.begin()) : 0;
+}
+
+const VkAllocationCallbacks* HostAllocationTracker::GetCallbacks(VkObjectType type) const
+{
+	return &slots_[GetSlotIndex(type)].callbacks;
+}
+
+#pragma region CALLBACKS
+
+void* VKAPI_CALL HostAllocationTracker::Allocate(void* user_data, std::size_t size, std::size_t alignment, VkSystemAllocationScope scope)
+{
+	TypeSlot& slot = *static_cast<TypeSlot*>(user_data);
+	return slot.tracker->AllocateTracked(slot, size, alignment, scope);
+}
+
+void* VKAPI_CALL HostAllocationTracker::Reallocate(void* user_data, void* original, std::size_t size, std::size_t alignment, VkSystemAllocationScope scope)
+{
+	TypeSlot& slot = *static_cast<TypeSlot*>(user_data);
+	if (original == nullptr) {
+		return slot.tracker->AllocateTracked(slot, size, alignment, scope);
+	}
+	if (size == 0) {
+		slot.tracker->FreeTracked(original);
+		return nullptr;
+	}
+
+	// On failure the original must stay valid, so it is only freed after the copy
+	void* memory = slot.tracker->AllocateTracked(slot, size, alignment, scope);
+	if (memory != nullptr) {
+		std::memcpy(memory, original, std::min(size, (static_cast<Header*>(original) - 1)->size));
+		slot.tracker->FreeTracked(original);
+	}
+	return memory;
+}
+
+void VKAPI_CALL HostAllocationTracker::Free(void* user_data, void* memory)
+{
+	static_cast<TypeSlot*>(user_data)->tracker->FreeTracked(memory);
+}
+
+// There is no header to remember whether an internal allocation was counted, so these are
+// counted whether or not tracking is enabled; otherwise toggling it would unbalance them
+void VKAPI_CALL HostAllocationTracker::InternalAllocation(void* user_data, std::size_t size, VkInternalAllocationType, VkSystemAllocationScope scope)
+{
+	HostAllocationTracker& tracker = *static_cast<TypeSlot*>(user_data)->tracker;
+	tracker.internal_bytes_[scope].fetch_add(size, std::memory_order_relaxed);
+}
+
+void VKAPI_CALL HostAllocationTracker::InternalFree(void* user_data, std::size_t size, VkInternalAllocationType, VkSystemAllocationScope scope)
+{
+	HostAllocationTracker& tracker = *static_cast<TypeSlot*>(user_data)->tracker;
+	tracker.internal_bytes_[scope].fetch_sub(size, std::memory_order_relaxed);
+}
+
+void* HostAllocationTracker::AllocateTracked(TypeSlot& slot, std::size_t size, std::size_t alignment, VkSystemAllocationScope scope)
+{
+	const std::size_t block_alignment = std::max(alignment, alignof(Header));
+	const std::size_t offset = AlignUp(sizeof(Header), block_alignment);
+	std::pmr::memory_resource* resource = pool_ != nullptr ? pool_.get() : upstream_;
+
+	// The driver expects null on failure, never an exception
+	std::byte* block = nullptr;
+	try {
+		block = static_cast<std::byte*>(resource->allocate(offset + size, block_alignment));
+	}
+	catch (const std::bad_alloc&) {
+		return nullptr;
+	}
+
+	std::byte* memory = block + offset;
+	Header* header = new (memory - sizeof(Header)) Header();
+	header->size = size;
+	header->offset = gsl::narrow_cast<std::uint32_t>(offset);
+	header->block_alignment = gsl::narrow_cast<std::uint32_t>(block_alignment);
+	header->scope = gsl::narrow_cast<std::uint8_t>(scope);
+	header->slot = gsl::narrow_cast<std::uint8_t>(&slot - slots_.data());
+	header->counted = IsEnabled();
+	header->pooled = pool_ != nullptr;
+
+	if (header->counted) {
+		total_.Add(size);
+		scopes_[scope].Add(size);
+		slot.counters.Add(size);
+	}
+	return memory;
+}
+
+void HostAllocationTracker::FreeTracked(void* memory)
+{
+	if (memory == nullptr) {
+		return;
+	}
+	const Header header = *(static_cast<Header*>(memory) - 1);
+	if (header.counted) {
+		total_.Remove(header.size);
+		scopes_[header.scope].Remove(header.size);
+		slots_[header.slot].counters.Remove(header.size);
+	}
+
+	std::pmr::memory_resource* resource = header.pooled ? pool_.get() : upstream_;
+	resource->deallocate(static_cast<std::byte*>(memory) - header.offset, header.offset + header.size, header.block_alignment);
+}
+
+#pragma endregion
+
+void HostAllocationTracker::BeginFrame()
+{
+	const HostAllocationCounters total = total_.Load();
+	last_frame_.allocations = total.allocations - frame_start_.allocations;
+	last_frame_.frees = total.frees - frame_start_.frees;
+	last_frame_.allocated_bytes = total.allocated_bytes - frame_start_.allocated_bytes;
+	frame_start_ = total;
+}
+
+HostAllocationStats HostAllocationTracker::GetStats() const
+{
+	HostAllocationStats stats;
+	stats.total = total_.Load();
+	for (std::size_t scope = 0; scope < HostAllocationStats::kScopeCount; scope++) {
+		stats.scopes[scope] = scopes_[scope].Load();
+		stats.internal_bytes[scope] = internal_bytes_[scope].load(std::memory_order_relaxed);
+	}
+	for (const TypeSlot& slot : slots_) {
+		const HostAllocationCounters counters = slot.counters.Load();
+		if (counters.allocations > 0) {
+			stats.object_types.emplace_back(slot.type, counters);
+		}
+	}
+	stats.last_frame = last_frame_;
+	return stats;
+}
+
+void HostAllocationTracker::LogStats() const
+{
+	HostAllocationStats stats = GetStats();
+	SPDLOG_INFO(
+	    "Host allocations: {} bytes live in {} blocks, {} bytes peak, {} allocations and {} frees in total; last frame {} allocations, {} frees, {} bytes",
+	    stats.total.live_bytes,
+	    stats.total.live_count,
+	    stats.total.peak_bytes,
+	    stats.total.allocations,
+	    stats.total.frees,
+	    stats.last_frame.allocations,
+	    stats.last_frame.frees,
+	    stats.last_frame.allocated_bytes);
+
+	for (std::size_t scope = 0; scope < HostAllocationStats::kScopeCount; scope++) {
+		const HostAllocationCounters& counters = stats.scopes[scope];
+		if (counters.allocations == 0 && stats.internal_bytes[scope] == 0) {
+			continue;
+		}
+		SPDLOG_INFO(
+		    "  {:<8} scope: {:>9} bytes live, {:>9} peak, {:>8} allocations, {:>9} bytes internal",
+		    GetScopeName(scope),
+		    counters.live_bytes,
+		    counters.peak_bytes,
+		    counters.allocations,
+		    stats.internal_bytes[scope]);
+	}
+
+	// Busiest types first, which is where the driver hot spots are
+	std::sort(stats.object_types.begin(), stats.object_types.end(), [](const auto& left, const auto& right) {
+		return left.second.allocations > right.second.allocations;
+	});
+	for (const auto& [type, counters] : stats.object_types) {
+		SPDLOG_INFO(
+		    "  {:<22} {:>9} bytes live, {:>9} peak, {:>8} allocations, {:>8} frees",
+		    GetObjectTypeName(type),
+		    counters.live_bytes,
+		    counters.peak_bytes,
+		    counters.allocations,
+		    counters.frees);
+	}
+}
+
+gsl::czstring GetObjectTypeName(VkObjectType type)
+{
+	switch (type) {
+		case VK_OBJECT_TYPE_INSTANCE:
+			return "instance";
+		case VK_OBJECT_TYPE_PHYSICAL_DEVICE:
+			return "physical device";
+		case VK_OBJECT_TYPE_DEVICE:
+			return "device";
+		case VK_OBJECT_TYPE_QUEUE:
+			return "queue";
+		case VK_OBJECT_TYPE_SEMAPHORE:
+			return "semaphore";
+		case VK_OBJECT_TYPE_COMMAND_BUFFER:
+			return "command buffer";
+		case VK_OBJECT_TYPE_FENCE:
+			return "fence";
+		case VK_OBJECT_TYPE_DEVICE_MEMORY:
+			return "device memory";
+		case VK_OBJECT_TYPE_BUFFER:
+			return "buffer";
+		case VK_OBJECT_TYPE_IMAGE:
+			return "image";
+		case VK_OBJECT_TYPE_EVENT:
+			return "event";
+		case VK_OBJECT_TYPE_QUERY_POOL:
+			return "query pool";
+		case VK_OBJECT_TYPE_BUFFER_VIEW:
+			return "buffer view";
+		case VK_OBJECT_TYPE_IMAGE_VIEW:
+			return "image view";
+		case VK_OBJECT_TYPE_SHADER_MODULE:
+			return "shader module";
+		case VK_OBJECT_TYPE_PIPELINE_CACHE:
+			return "pipeline cache";
+		case VK_OBJECT_TYPE_PIPELINE_LAYOUT:
+			return "pipeline layout";
+		case VK_OBJECT_TYPE_RENDER_PASS:
+			return "render pass";
+		case VK_OBJECT_TYPE_PIPELINE:
+			return "pipeline";
+		case VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT:
+			return "descriptor set layout";
+		case VK_OBJECT_TYPE_SAMPLER:
+			return "sampler";
+		case VK_OBJECT_TYPE_DESCRIPTOR_POOL:
+			return "descriptor pool";
+		case VK_OBJECT_TYPE_DESCRIPTOR_SET:
+			return "descriptor set";
+		case VK_OBJECT_TYPE_FRAMEBUFFER:
+			return "framebuffer";
+		case VK_OBJECT_TYPE_COMMAND_POOL:
+			return "command pool";
+		case VK_OBJECT_TYPE_SURFACE_KHR:
+			return "surface";
+		case VK_OBJECT_TYPE_SWAPCHAIN_KHR:
+			return "swapchain";
+		case VK_OBJECT_TYPE_DEBUG_UTILS_MESSENGER_EXT:
+			return "debug messenger";
+		default:
+			return "unknown";
+	}
+}
+
+}  // namespace veng
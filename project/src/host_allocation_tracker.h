@@ -0,0 +1,135 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <memory_resource>
+#include <utility>
+#include <vector>
+
+namespace veng {
+
+struct HostAllocationCounters {
+	std::uint64_t live_bytes = 0;
+	std::uint64_t live_count = 0;
+	std::uint64_t peak_bytes = 0;
+	std::uint64_t allocations = 0;  // since creation, reallocations count as one each
+	std::uint64_t frees = 0;
+	std::uint64_t allocated_bytes = 0;
+};
+
+// Allocations, frees and bytes allocated between two BeginFrame calls
+struct HostAllocationChurn {
+	std::uint64_t allocations = 0;
+	std::uint64_t frees = 0;
+	std::uint64_t allocated_bytes = 0;
+};
+
+struct HostAllocationStats {
+	static constexpr std::size_t kScopeCount = VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1;
+
+	HostAllocationCounters total;
+	// Indexed by VkSystemAllocationScope
+	std::array<HostAllocationCounters, kScopeCount> scopes = {};
+	// Object types that allocated anything, with their counters
+	std::vector<std::pair<VkObjectType, HostAllocationCounters>> object_types;
+	// Memory the driver allocated itself and only reported, per scope
+	std::array<std::uint64_t, kScopeCount> internal_bytes = {};
+	HostAllocationChurn last_frame;
+};
+
+// VkAllocationCallbacks that count the driver's host allocations per allocation scope and
+// per object type. Vulkan does not tell the callbacks which object an allocation is for, so
+// every object type gets its own callbacks, and the objects must be destroyed with the ones
+// they were created with (VulkanHandle keeps them).
+//
+// Each allocation carries a small header with its size and where it came from, so counting
+// can be switched on and off at any time without the frees of earlier allocations throwing
+// the numbers off. With `pooled` small allocations come from size-class pools instead of the
+// C heap, which takes the steady per-frame command scope allocations off malloc.
+//
+// The callbacks may be called from any thread; counters are relaxed atomics.
+class HostAllocationTracker {
+public:
+	explicit HostAllocationTracker(bool pooled);
+	~HostAllocationTracker();
+
+	HostAllocationTracker(const HostAllocationTracker&) = delete;
+	HostAllocationTracker& operator=(const HostAllocationTracker&) = delete;
+
+	// Callbacks to create (and later destroy) an object of `type` with. Types without a slot of
+	// their own are counted as VK_OBJECT_TYPE_UNKNOWN.
+	const VkAllocationCallbacks* GetCallbacks(VkObjectType type) const;
+
+	// Allocations made while disabled are neither counted nor, when freed, subtracted. The
+	// driver's internal allocations are always counted.
+	void SetEnabled(bool enabled) { enabled_.store(enabled, std::memory_order_relaxed); }
+	bool IsEnabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+	// Closes the churn window of the previous frame. Main thread only.
+	void BeginFrame();
+
+	HostAllocationStats GetStats() const;
+	void LogStats() const;
+
+private:
+	struct AtomicCounters {
+		std::atomic<std::uint64_t> live_bytes = 0;
+		std::atomic<std::uint64_t> live_count = 0;
+		std::atomic<std::uint64_t> peak_bytes = 0;
+		std::atomic<std::uint64_t> allocations = 0;
+		std::atomic<std::uint64_t> frees = 0;
+		std::atomic<std::uint64_t> allocated_bytes = 0;
+
+		void Add(std::size_t size);
+		void Remove(std::size_t size);
+		HostAllocationCounters Load() const;
+	};
+
+	// One per tracked object type; the callbacks' user data points back here
+	struct TypeSlot {
+		HostAllocationTracker* tracker = nullptr;
+		VkObjectType type = VK_OBJECT_TYPE_UNKNOWN;
+		AtomicCounters counters;
+		VkAllocationCallbacks callbacks = {};
+	};
+
+	struct Header;
+
+	// The core object types, then the few extension types Graphics creates
+	static constexpr std::size_t kCoreTypeCount = VK_OBJECT_TYPE_COMMAND_POOL + 1;
+	static constexpr std::array<VkObjectType, 3> kExtensionTypes = {
+	    VK_OBJECT_TYPE_SURFACE_KHR,
+	    VK_OBJECT_TYPE_SWAPCHAIN_KHR,
+	    VK_OBJECT_TYPE_DEBUG_UTILS_MESSENGER_EXT,
+	};
+	static constexpr std::size_t kSlotCount = kCoreTypeCount + kExtensionTypes.size();
+
+	static std::size_t GetSlotIndex(VkObjectType type);
+
+	static void* VKAPI_CALL Allocate(void* user_data, std::size_t size, std::size_t alignment, VkSystemAllocationScope scope);
+	static void* VKAPI_CALL Reallocate(void* user_data, void* original, std::size_t size, std::size_t alignment, VkSystemAllocationScope scope);
+	static void VKAPI_CALL Free(void* user_data, void* memory);
+	static void VKAPI_CALL InternalAllocation(void* user_data, std::size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope);
+	static void VKAPI_CALL InternalFree(void* user_data, std::size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope);
+
+	void* AllocateTracked(TypeSlot& slot, std::size_t size, std::size_t alignment, VkSystemAllocationScope scope);
+	void FreeTracked(void* memory);
+
+	std::atomic<bool> enabled_ = true;
+	std::unique_ptr<std::pmr::memory_resource> pool_;  // null when not pooled
+	std::pmr::memory_resource* upstream_;
+
+	AtomicCounters total_;
+	std::array<AtomicCounters, HostAllocationStats::kScopeCount> scopes_;
+	std::array<std::atomic<std::uint64_t>, HostAllocationStats::kScopeCount> internal_bytes_ = {};
+	std::array<TypeSlot, kSlotCount> slots_;
+
+	HostAllocationCounters frame_start_;
+	HostAllocationChurn last_frame_;
+};
+
+gsl::czstring GetObjectTypeName(VkObjectType type);
+
+}  // namespace veng
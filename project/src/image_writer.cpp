@@ -0,0 +1,270 @@
+#include <precomp.h>
+#include <image_writer.h>
+#include <array>
+#include <fstream>
+#include <spdlog/spdlog.h>
+
+namespace veng {
+
+#pragma region PNG_ENCODING
+
+static std::uint32_t UpdateCrc32(std::uint32_t crc, gsl::span<const std::uint8_t> bytes)
+{
+	static const std::array<std::uint32_t, 256> table = []() {
+		std::array<std::uint32_t, 256> entries = {};
+		for (std::uint32_t i = 0; i < entries.size(); i++) {
+			std::uint32_t value = i;
+			for (std::uint32_t bit = 0; bit < 8; bit++) {
+				value = (value & 1) ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+			}
+			entries[i] = value;
+		}
+		return entries;
+	}();
+
+	crc = ~crc;
+	for (std::uint8_t byte : bytes) {
+		crc = table[(crc ^ byte) & 0xFF] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+static void WriteBigEndian(std::ofstream& file, std::uint32_t value)
+{
+	const std::array<char, 4> bytes = {
+	    static_cast<char>(value >> 24), static_cast<char>(value >> 16), static_cast<char>(value >> 8), static_cast<char>(value)};
+	file.write(bytes.data(), bytes.size());
+}
+
+static void WriteChunk(std::ofstream& file, gsl::czstring type, gsl::span<const std::uint8_t> data)
+{
+	const gsl::span<const std::uint8_t> type_bytes(reinterpret_cast<const std::uint8_t*>(type), 4);
+
+	WriteBigEndian(file, gsl::narrow_cast<std::uint32_t>(data.size()));
+	file.write(type, 4);
+	file.write(reinterpret_cast<const char*>(data.data()), data.size());
+	WriteBigEndian(file, UpdateCrc32(UpdateCrc32(0, type_bytes), data));
+}
+
+// Scanlines use filter 0 and the zlib stream uses stored deflate blocks, which costs file
+// size but makes encoding a copy. Streamed straight to the file, so nothing is allocated.
+static bool WritePng(const std::filesystem::path& path, std::uint32_t width, std::uint32_t height, gsl::span<const std::uint8_t> rgba)
+{
+	std::ofstream file(path, std::ios::binary);
+	if (!file) {
+		return false;
+	}
+
+	constexpr std::array<std::uint8_t, 8> kSignature = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+	file.write(reinterpret_cast<const char*>(kSignature.data()), kSignature.size());
+
+	std::array<std::uint8_t, 13> header = {};
+	for (std::uint32_t i = 0; i < 4; i++) {
+		header[i] = static_cast<std::uint8_t>(width >> (24 - i * 8));
+		header[4 + i] = static_cast<std::uint8_t>(height >> (24 - i * 8));
+	}
+	header[8] = 8;  // bits per channel
+	header[9] = 6;  // RGBA
+	WriteChunk(file, "IHDR", header);
+
+	// The filtered image is every row prefixed with its filter byte
+	const std::size_t row_size = std::size_t(width) * 4;
+	const std::size_t raw_size = (row_size + 1) * height;
+	constexpr std::size_t kMaxStoredBlock = 65535;
+	const std::size_t block_count = std::max<std::size_t>(1, (raw_size + kMaxStoredBlock - 1) / kMaxStoredBlock);
+	const std::size_t stream_size = 2 + block_count * 5 + raw_size + 4;
+
+	WriteBigEndian(file, gsl::narrow_cast<std::uint32_t>(stream_size));
+	file.write("IDAT", 4);
+	std::uint32_t crc = UpdateCrc32(0, gsl::span<const std::uint8_t>(reinterpret_cast<const std::uint8_t*>("IDAT"), 4));
+	const auto emit = [&file, &crc](gsl::span<const std::uint8_t> bytes) {
+		crc = UpdateCrc32(crc, bytes);
+		file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+	};
+
+	constexpr std::array<std::uint8_t, 2> kZlibHeader = {0x78, 0x01};  // deflate with a 32K window, header % 31 == 0
+	emit(kZlibHeader);
+
+	std::uint32_t adler_a = 1;
+	std::uint32_t adler_b = 0;
+	const auto emit_data = [&emit, &adler_a, &adler_b](gsl::span<const std::uint8_t> bytes) {
+		for (std::uint8_t byte : bytes) {
+			adler_a += byte;
+			adler_a = adler_a >= 65521 ? adler_a - 65521 : adler_a;
+			adler_b += adler_a;
+			adler_b = adler_b >= 65521 ? adler_b - 65521 : adler_b;
+		}
+		emit(bytes);
+	};
+
+	// Stored blocks split rows anywhere, so each block is copied in row segments
+	constexpr std::array<std::uint8_t, 1> kFilterNone = {0};
+	std::size_t raw_offset = 0;
+	do {
+		const std::size_t block_size = std::min(kMaxStoredBlock, raw_size - raw_offset);
+		const std::size_t block_end = raw_offset + block_size;
+		const std::array<std::uint8_t, 5> block_header = {
+		    static_cast<std::uint8_t>(block_end == raw_size ? 1 : 0),
+		    static_cast<std::uint8_t>(block_size),
+		    static_cast<std::uint8_t>(block_size >> 8),
+		    static_cast<std::uint8_t>(~block_size),
+		    static_cast<std::uint8_t>(~block_size >> 8),
+		};
+		emit(block_header);
+
+		while (raw_offset < block_end) {
+			const std::size_t row = raw_offset / (row_size + 1);
+			const std::size_t column = raw_offset % (row_size + 1);  // 0 is the filter byte
+			const std::size_t count = std::min(block_end - raw_offset, row_size + 1 - column);
+			if (column == 0) {
+				emit_data(kFilterNone);
+				emit_data(rgba.subspan(row * row_size, count - 1));
+			}
+			else {
+				emit_data(rgba.subspan(row * row_size + column - 1, count));
+			}
+			raw_offset += count;
+		}
+	} while (raw_offset < raw_size);
+
+	const std::uint32_t adler = (adler_b << 16) | adler_a;
+	const std::array<std::uint8_t, 4> adler_bytes = {
+	    static_cast<std::uint8_t>(adler >> 24), static_cast<std::uint8_t>(adler >> 16), static_cast<std::uint8_t>(adler >> 8), static_cast<std::uint8_t>(adler)};
+	emit(adler_bytes);
+	WriteBigEndian(file, crc);
+
+	WriteChunk(file, "IEND", {});
+	return static_cast<bool>(file);
+}
+
+#pragma endregion
+
+gsl::czstring GetImageFileExtension(ImageFileFormat format)
+{
+	switch (format) {
+		case ImageFileFormat::kPng:
+			return "png";
+		case ImageFileFormat::kRaw:
+			return "rgba";
+	}
+	return "bin";
+}
+
+bool WriteImageFile(const std::filesystem::path& path, ImageFileFormat format, std::uint32_t width, std::uint32_t height, gsl::span<const std::uint8_t> rgba)
+{
+	Expects(rgba.size() == std::size_t(width) * height * 4);
+
+	if (format == ImageFileFormat::kPng) {
+		return WritePng(path, width, height, rgba);
+	}
+
+	std::ofstream file(path, std::ios::binary);
+	file.write(reinterpret_cast<const char*>(rgba.data()), rgba.size());
+	return static_cast<bool>(file);
+}
+
+#pragma region IMAGE_WRITER
+
+ImageWriter::ImageWriter(ImageWriterSettings settings) : settings_(settings)
+{
+	Expects(settings_.max_queued_images > 0);
+	worker_ = std::thread(&ImageWriter::WorkerLoop, this);
+}
+
+ImageWriter::~ImageWriter()
+{
+	{
+		std::lock_guard lock(mutex_);
+		stopping_ = true;
+	}
+	wake_condition_.notify_one();
+	worker_.join();
+
+	const std::uint64_t total_count = written_count_ + failed_count_ + dropped_count_;
+	if (dropped_count_ > 0) {
+		SPDLOG_WARN("Image writer dropped {} of {} images, the disk could not keep up", dropped_count_, total_count);
+	}
+	if (failed_count_ > 0) {
+		SPDLOG_WARN("Image writer could not write {} of {} images", failed_count_, total_count);
+	}
+}
+
+bool ImageWriter::Write(std::filesystem::path path, ImageFileFormat format, std::uint32_t width, std::uint32_t height, gsl::span<const std::uint8_t> rgba)
+{
+	std::vector<std::uint8_t> pixels;
+	{
+		std::lock_guard lock(mutex_);
+		if (queue_.size() + reserved_count_ >= settings_.max_queued_images) {
+			dropped_count_++;
+			return false;
+		}
+		reserved_count_++;
+		if (!free_buffers_.empty()) {
+			pixels = std::move(free_buffers_.back());
+			free_buffers_.pop_back();
+		}
+	}
+
+	// Copy outside the lock; the worker may be writing meanwhile
+	pixels.assign(rgba.begin(), rgba.end());
+
+	{
+		std::lock_guard lock(mutex_);
+		reserved_count_--;
+		queue_.push_back({std::move(path), format, width, height, std::move(pixels)});
+	}
+	wake_condition_.notify_one();
+	return true;
+}
+
+std::uint64_t ImageWriter::GetWrittenCount() const
+{
+	std::lock_guard lock(mutex_);
+	return written_count_;
+}
+
+std::uint64_t ImageWriter::GetFailedCount() const
+{
+	std::lock_guard lock(mutex_);
+	return failed_count_;
+}
+
+std::uint64_t ImageWriter::GetDroppedCount() const
+{
+	std::lock_guard lock(mutex_);
+	return dropped_count_;
+}
+
+void ImageWriter::WorkerLoop()
+{
+	std::unique_lock lock(mutex_);
+	for (;;) {
+		// A reserved slot is still to be pushed, so stopping waits for it too
+		wake_condition_.wait(lock, [this]() { return !queue_.empty() || (stopping_ && reserved_count_ == 0); });
+		if (queue_.empty()) {
+			return;  // stopping, and everything has been written
+		}
+
+		Request request = std::move(queue_.front());
+		queue_.pop_front();
+
+		lock.unlock();
+		const bool written = WriteImageFile(request.path, request.format, request.width, request.height, request.pixels);
+		if (!written) {
+			SPDLOG_ERROR("Could not write image {}", request.path.string());
+		}
+		lock.lock();
+
+		if (written) {
+			written_count_++;
+		}
+		else {
+			failed_count_++;
+		}
+		free_buffers_.push_back(std::move(request.pixels));
+	}
+}
+
+#pragma endregion
+
+}  // namespace veng
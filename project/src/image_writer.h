@@ -0,0 +1,74 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace veng {
+
+enum class ImageFileFormat {
+	kPng,  // 8-bit RGBA, stored without compression so encoding keeps up with the frame rate
+	kRaw,  // the tightly packed RGBA bytes, e.g. for `ffmpeg -f rawvideo -pixel_format rgba`
+};
+
+gsl::czstring GetImageFileExtension(ImageFileFormat format);
+
+// Writes `rgba` (width * height * 4 bytes, rows top to bottom) to `path`
+bool WriteImageFile(const std::filesystem::path& path, ImageFileFormat format, std::uint32_t width, std::uint32_t height, gsl::span<const std::uint8_t> rgba);
+
+struct ImageWriterSettings {
+	// Images waiting for the writer thread; further ones are dropped rather than stalling
+	// the caller
+	std::size_t max_queued_images = 8;
+};
+
+// Encodes and writes images on a background thread. Pixel buffers are recycled, so a
+// steady stream of same-sized images stops allocating after the queue has filled once.
+class ImageWriter {
+public:
+	explicit ImageWriter(ImageWriterSettings settings = {});
+	// Writes whatever is still queued
+	~ImageWriter();
+
+	ImageWriter(const ImageWriter&) = delete;
+	ImageWriter& operator=(const ImageWriter&) = delete;
+
+	// Copies `rgba` and queues it. Returns false, dropping the image, if the queue is full.
+	bool Write(std::filesystem::path path, ImageFileFormat format, std::uint32_t width, std::uint32_t height, gsl::span<const std::uint8_t> rgba);
+
+	// Images on disk; ones that could not be written are counted as failed instead
+	std::uint64_t GetWrittenCount() const;
+	std::uint64_t GetFailedCount() const;
+	std::uint64_t GetDroppedCount() const;
+
+private:
+	struct Request {
+		std::filesystem::path path;
+		ImageFileFormat format = ImageFileFormat::kPng;
+		std::uint32_t width = 0;
+		std::uint32_t height = 0;
+		std::vector<std::uint8_t> pixels;
+	};
+
+	void WorkerLoop();
+
+	ImageWriterSettings settings_;
+
+	mutable std::mutex mutex_;
+	std::condition_variable wake_condition_;
+	std::deque<Request> queue_;
+	// Queue slots taken by Write() calls still copying their pixels
+	std::size_t reserved_count_ = 0;
+	std::vector<std::vector<std::uint8_t>> free_buffers_;
+	std::uint64_t written_count_ = 0;
+	std::uint64_t failed_count_ = 0;
+	std::uint64_t dropped_count_ = 0;
+	bool stopping_ = false;
+
+	std::thread worker_;
+};
+
+}  // namespace veng
@@ -0,0 +1,248 @@
+#include <precomp.h>
+#include <job_system.h>
+#include <spdlog/spdlog.h>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace veng {
+
+static thread_local std::int32_t tls_worker_index = -1;
+
+#pragma region WORK_QUEUE
+
+bool JobSystem::WorkQueue::PushBack(const Job& job)
+{
+	std::lock_guard lock(mutex);
+	if (size == kQueueCapacity) {
+		return false;
+	}
+	jobs[(head + size) % kQueueCapacity] = job;
+	size++;
+	return true;
+}
+
+bool JobSystem::WorkQueue::PopBack(Job& job)
+{
+	std::lock_guard lock(mutex);
+	if (size == 0) {
+		return false;
+	}
+	size--;
+	job = jobs[(head + size) % kQueueCapacity];
+	return true;
+}
+
+bool JobSystem::WorkQueue::StealFront(Job& job)
+{
+	std::lock_guard lock(mutex);
+	if (size == 0) {
+		return false;
+	}
+	job = jobs[head];
+	head = (head + 1) % kQueueCapacity;
+	size--;
+	return true;
+}
+
+#pragma endregion
+
+JobSystem::JobSystem(JobSystemSettings settings) : settings_(settings)
+{
+	std::uint32_t worker_count = settings_.worker_count;
+	if (worker_count == 0) {
+		worker_count = std::max(1u, std::thread::hardware_concurrency()) - 1;
+	}
+
+	// One queue per worker plus a shared one for every other thread
+	for (std::uint32_t i = 0; i < worker_count + 1; i++) {
+		queues_.push_back(std::make_unique<WorkQueue>());
+	}
+
+	workers_.reserve(worker_count);
+	for (std::uint32_t i = 0; i < worker_count; i++) {
+		workers_.emplace_back(&JobSystem::WorkerLoop, this, i);
+	}
+
+	SPDLOG_INFO("Job system started with {} workers", worker_count);
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard lock(sleep_mutex_);
+		stopping_ = true;
+	}
+	wake_condition_.notify_all();
+
+	for (std::thread& worker : workers_) {
+		worker.join();
+	}
+}
+
+std::uint32_t JobSystem::GetCurrentThreadIndex() const
+{
+	return tls_worker_index >= 0 ? static_cast<std::uint32_t>(tls_worker_index) : GetWorkerCount();
+}
+
+void JobSystem::Run(const Job& job, JobCounter* counter, JobCounter* dependency)
+{
+	Job scheduled = job;
+	scheduled.counter = counter;
+
+	if (counter != nullptr) {
+		counter->count_.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	if (dependency != nullptr) {
+		std::lock_guard lock(dependency->continuations_mutex_);
+		// Checked under the lock so Finish() cannot flush the list in between
+		if (!dependency->IsDone()) {
+			Expects(dependency->continuation_count_ < JobCounter::kMaxContinuations);
+			dependency->continuations_[dependency->continuation_count_++] = scheduled;
+			return;
+		}
+	}
+
+	Enqueue(scheduled);
+}
+
+void JobSystem::Run(std::function<void()> task, JobCounter* counter, JobCounter* dependency)
+{
+	Job job;
+	job.function = [](void* data, std::size_t, std::size_t) {
+		std::unique_ptr<std::function<void()>> task(static_cast<std::function<void()>*>(data));
+		(*task)();
+	};
+	job.data = new std::function<void()>(std::move(task));
+	Run(job, counter, dependency);
+}
+
+void JobSystem::Enqueue(const Job& job)
+{
+	if (!queues_[GetCurrentThreadIndex()]->PushBack(job)) {
+		// Queue full: running it right away keeps forward progress without allocating
+		Execute(job);
+		return;
+	}
+
+	queued_jobs_.fetch_add(1, std::memory_order_release);
+	{
+		// Pairs with the predicate check in WorkerLoop so a worker about to sleep cannot miss this
+		std::lock_guard lock(sleep_mutex_);
+	}
+	wake_condition_.notify_one();
+}
+
+bool JobSystem::TryRunOne(std::uint32_t thread_index)
+{
+	Job job;
+	bool found = queues_[thread_index]->PopBack(job);
+
+	for (std::size_t offset = 1; !found && offset < queues_.size(); offset++) {
+		found = queues_[(thread_index + offset) % queues_.size()]->StealFront(job);
+	}
+
+	if (!found) {
+		return false;
+	}
+
+	queued_jobs_.fetch_sub(1, std::memory_order_relaxed);
+	Execute(job);
+	return true;
+}
+
+void JobSystem::Execute(const Job& job)
+{
+	job.function(job.data, job.begin, job.end);
+
+	if (job.counter != nullptr) {
+		Finish(*job.counter);
+	}
+}
+
+void JobSystem::Finish(JobCounter& counter)
+{
+	// The decrement happens under the lock so Run() sees a consistent count when deciding
+	// whether to park a continuation, and Wait() can use the lock to know we are done here.
+	// Copied out, since the counter may be reused or destroyed once the lock is released
+	std::array<Job, JobCounter::kMaxContinuations> continuations;
+	std::size_t continuation_count = 0;
+	{
+		std::lock_guard lock(counter.continuations_mutex_);
+		if (counter.count_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			continuation_count = std::exchange(counter.continuation_count_, 0);
+			std::copy_n(counter.continuations_.begin(), continuation_count, continuations.begin());
+		}
+	}
+
+	for (std::size_t i = 0; i < continuation_count; i++) {
+		Enqueue(continuations[i]);
+	}
+}
+
+void JobSystem::Wait(JobCounter& counter)
+{
+	const std::uint32_t thread_index = GetCurrentThreadIndex();
+	while (!counter.IsDone()) {
+		if (!TryRunOne(thread_index)) {
+			std::this_thread::yield();
+		}
+	}
+
+	// The last Finish() may still be leaving its critical section; the counter must not be
+	// destroyed before it has.
+	std::lock_guard lock(counter.continuations_mutex_);
+}
+
+void JobSystem::WorkerLoop(std::uint32_t worker_index)
+{
+	tls_worker_index = gsl::narrow_cast<std::int32_t>(worker_index);
+
+	if (settings_.pin_workers) {
+		PinCurrentThread(settings_.first_core + worker_index);
+	}
+
+	while (true) {
+		if (TryRunOne(worker_index)) {
+			continue;
+		}
+
+		std::unique_lock lock(sleep_mutex_);
+		wake_condition_.wait(lock, [this]() {
+			return stopping_ || queued_jobs_.load(std::memory_order_acquire) > 0;
+		});
+		if (stopping_) {
+			return;
+		}
+	}
+}
+
+void JobSystem::PinCurrentThread(std::uint32_t core)
+{
+	const std::uint32_t core_count = std::max(1u, std::thread::hardware_concurrency());
+	core %= core_count;
+
+#if defined(_WIN32)
+	if (SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << core) == 0) {
+		SPDLOG_WARN("Could not pin job worker to core {}", core);
+	}
+#elif defined(__linux__)
+	cpu_set_t cpu_set;
+	CPU_ZERO(&cpu_set);
+	CPU_SET(core, &cpu_set);
+	if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) != 0) {
+		SPDLOG_WARN("Could not pin job worker to core {}", core);
+	}
+#else
+	SPDLOG_WARN("Thread affinity is not supported on this platform");
+#endif
+}
+
+}  // namespace veng
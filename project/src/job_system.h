@@ -0,0 +1,158 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace veng {
+
+class JobSystem;
+class JobCounter;
+
+// A unit of work: a plain function pointer over an index range, so scheduling never
+// allocates. `counter` (optional) is decremented once the job has run.
+struct Job {
+	void (*function)(void* data, std::size_t begin, std::size_t end) = nullptr;
+	void* data = nullptr;
+	std::size_t begin = 0;
+	std::size_t end = 0;
+	JobCounter* counter = nullptr;
+};
+
+// Counts outstanding jobs. Jobs can be scheduled to start only once a counter reaches
+// zero, which is how dependencies between jobs are expressed. The jobs held back are kept
+// in the counter itself, up to kMaxContinuations of them; more can wait on a job that
+// depends on this counter and schedules the rest.
+class JobCounter {
+public:
+	static constexpr std::size_t kMaxContinuations = 8;
+
+	JobCounter() = default;
+	JobCounter(const JobCounter&) = delete;
+	JobCounter& operator=(const JobCounter&) = delete;
+
+	bool IsDone() const { return count_.load(std::memory_order_acquire) == 0; }
+
+private:
+	friend class JobSystem;
+
+	std::atomic<std::int32_t> count_ = 0;
+	std::mutex continuations_mutex_;
+	std::array<Job, kMaxContinuations> continuations_;
+	std::size_t continuation_count_ = 0;
+};
+
+struct JobSystemSettings {
+	// 0 picks one worker per hardware thread, minus the main thread
+	std::uint32_t worker_count = 0;
+	// Pins worker i to core (first_core + i); the main thread is left unpinned
+	bool pin_workers = false;
+	std::uint32_t first_core = 1;
+};
+
+// Fixed pool of workers with one deque each. Owners push and pop at the back, idle
+// workers steal from the front of the others. The thread calling Wait() helps by
+// running jobs itself, so waiting never blocks a core.
+class JobSystem {
+public:
+	explicit JobSystem(JobSystemSettings settings = {});
+	~JobSystem();
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	// `counter` is incremented now and decremented when the job finishes. If `dependency`
+	// is given the job is held back until that counter reaches zero; at most
+	// JobCounter::kMaxContinuations jobs may be held back by one counter.
+	void Run(const Job& job, JobCounter* counter = nullptr, JobCounter* dependency = nullptr);
+
+	// Convenience for coarse tasks (startup, asset loads); allocates the closure.
+	void Run(std::function<void()> task, JobCounter* counter = nullptr, JobCounter* dependency = nullptr);
+
+	// Runs jobs until `counter` reaches zero
+	void Wait(JobCounter& counter);
+
+	// Splits [0, count) into ranges of at least `grain` items and calls body(begin, end)
+	// for each, returning once all have run. Does not allocate.
+	template <typename Body>
+	void ParallelFor(std::size_t count, std::size_t grain, Body&& body);
+
+	std::uint32_t GetWorkerCount() const { return gsl::narrow_cast<std::uint32_t>(workers_.size()); }
+	// Number of threads that execute jobs: the workers plus the calling (main) thread
+	std::uint32_t GetConcurrency() const { return GetWorkerCount() + 1; }
+	// Index of the current thread's queue: workers are [0, worker count), any other thread
+	// shares the last one.
+	std::uint32_t GetCurrentThreadIndex() const;
+
+private:
+	static constexpr std::size_t kQueueCapacity = 4096;
+
+	// Bounded ring buffer; a mutex is cheap here as contention is limited to steals.
+	struct WorkQueue {
+		std::mutex mutex;
+		std::array<Job, kQueueCapacity> jobs;
+		std::size_t head = 0;
+		std::size_t size = 0;
+
+		bool PushBack(const Job& job);
+		bool PopBack(Job& job);
+		bool StealFront(Job& job);
+	};
+
+	void Enqueue(const Job& job);
+	bool TryRunOne(std::uint32_t thread_index);
+	void Execute(const Job& job);
+	void Finish(JobCounter& counter);
+	void WorkerLoop(std::uint32_t worker_index);
+	void PinCurrentThread(std::uint32_t core);
+
+	JobSystemSettings settings_;
+	std::vector<std::unique_ptr<WorkQueue>> queues_;
+	std::vector<std::thread> workers_;
+
+	std::atomic<std::int64_t> queued_jobs_ = 0;
+	std::mutex sleep_mutex_;
+	std::condition_variable wake_condition_;
+	std::atomic<bool> stopping_ = false;
+};
+
+template <typename Body>
+void JobSystem::ParallelFor(std::size_t count, std::size_t grain, Body&& body)
+{
+	if (count == 0) {
+		return;
+	}
+
+	// A few ranges per thread leaves room for stealing to even out the load
+	const std::size_t target_ranges = GetConcurrency() * 4;
+	const std::size_t range_size = std::max<std::size_t>(std::max<std::size_t>(grain, 1), (count + target_ranges - 1) / target_ranges);
+
+	if (range_size >= count) {
+		body(std::size_t(0), count);
+		return;
+	}
+
+	using BodyType = std::remove_reference_t<Body>;
+	Job job;
+	job.function = [](void* data, std::size_t begin, std::size_t end) {
+		(*static_cast<BodyType*>(data))(begin, end);
+	};
+	job.data = const_cast<void*>(static_cast<const void*>(&body));
+
+	JobCounter counter;
+	for (std::size_t begin = range_size; begin < count; begin += range_size) {
+		job.begin = begin;
+		job.end = std::min(begin + range_size, count);
+		Run(job, &counter);
+	}
+
+	body(std::size_t(0), range_size);
+	Wait(counter);
+}
+
+}  // namespace veng
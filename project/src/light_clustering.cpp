@@ -0,0 +1,191 @@
+#include <precomp.h>
+#include <light_clustering.h>
+#include <algorithm>
+
+namespace veng {
+
+namespace {
+
+// Direction through an NDC point, scaled to unit distance along -z. Any depth inside the
+// frustum lies on the ray, so the projection's depth convention does not matter.
+glm::vec3 GetViewRay(const glm::mat4& inverse_projection, glm::vec2 ndc)
+{
+	const glm::vec4 point = inverse_projection * glm::vec4(ndc, 0.5f, 1.0f);
+	const glm::vec3 position = glm::vec3(point) / point.w;
+	return position / -position.z;
+}
+
+// Where `slice` starts; the first slice reaches back to the camera
+std::float_t GetSliceDepth(const ClusterSettings& settings, std::uint32_t slice)
+{
+	return slice == 0 ? 0.0f : settings.near * std::pow(settings.far / settings.near, static_cast<std::float_t>(slice) / settings.slices);
+}
+
+bool SphereTouchesBox(const glm::vec3& center, std::float_t radius, const glm::vec3& box_min, const glm::vec3& box_max)
+{
+	const glm::vec3 offset = glm::clamp(center, box_min, box_max) - center;
+	return glm::dot(offset, offset) <= radius * radius;
+}
+
+}  // namespace
+
+std::uint32_t GetClusterCount(const ClusterSettings& settings)
+{
+	return settings.tiles_x * settings.tiles_y * settings.slices;
+}
+
+std::uint32_t GetClusterSlice(const ClusterSettings& settings, std::float_t depth)
+{
+	if (depth <= settings.near) {
+		return 0;
+	}
+	const std::float_t slice = std::log(depth / settings.near) * settings.slices / std::log(settings.far / settings.near);
+	return std::min(static_cast<std::uint32_t>(slice), settings.slices - 1);
+}
+
+ClusterUniforms MakeClusterUniforms(const ClusterSettings& settings, const glm::mat4& projection, glm::uvec2 viewport, std::uint32_t light_count)
+{
+	const std::float_t scale = settings.slices / std::log(settings.far / settings.near);
+
+	ClusterUniforms uniforms;
+	uniforms.inverse_projection = glm::inverse(projection);
+	uniforms.grid = glm::uvec4(settings.tiles_x, settings.tiles_y, settings.slices, light_count);
+	uniforms.viewport = glm::vec4(viewport.x, viewport.y, 1.0f / viewport.x, 1.0f / viewport.y);
+	uniforms.slicing = glm::vec4(settings.near, settings.far, scale, scale * std::log(settings.near));
+	uniforms.limits = glm::uvec4(settings.max_lights_per_cluster, 0, 0, 0);
+	return uniforms;
+}
+
+PointLight TransformLight(const PointLight& light, const glm::mat4& view)
+{
+	PointLight transformed = light;
+	transformed.position = glm::vec3(view * glm::vec4(light.position, 1.0f));
+	return transformed;
+}
+
+LightClusterer::LightClusterer(ClusterSettings settings)
+    : settings_(settings), bounds_min_(GetClusterCount(settings)), bounds_max_(GetClusterCount(settings)), counts_(GetClusterCount(settings), 0),
+      light_indices_(std::size_t(GetClusterCount(settings)) * settings.max_lights_per_cluster), column_extents_(settings.slices * settings.tiles_x),
+      row_extents_(settings.slices * settings.tiles_y)
+{
+	Expects(settings_.tiles_x > 0 && settings_.tiles_y > 0 && settings_.slices > 0);
+	Expects(settings_.near > 0.0f && settings_.far > settings_.near);
+}
+
+void LightClusterer::SetProjection(const glm::mat4& projection)
+{
+	const glm::mat4 inverse_projection = glm::inverse(projection);
+	const glm::vec2 empty(std::numeric_limits<std::float_t>::max(), std::numeric_limits<std::float_t>::lowest());
+	std::fill(column_extents_.begin(), column_extents_.end(), empty);
+	std::fill(row_extents_.begin(), row_extents_.end(), empty);
+
+	// Box around the frustum piece between the tile's corner rays at the slice's two depths
+	for (std::uint32_t slice = 0; slice < settings_.slices; slice++) {
+		const std::float_t near_depth = GetSliceDepth(settings_, slice);
+		const std::float_t far_depth = GetSliceDepth(settings_, slice + 1);
+		for (std::uint32_t tile_y = 0; tile_y < settings_.tiles_y; tile_y++) {
+			for (std::uint32_t tile_x = 0; tile_x < settings_.tiles_x; tile_x++) {
+				glm::vec3 box_min(std::numeric_limits<std::float_t>::max());
+				glm::vec3 box_max(std::numeric_limits<std::float_t>::lowest());
+				for (std::uint32_t corner = 0; corner < 4; corner++) {
+					const glm::vec2 ndc(
+					    -1.0f + 2.0f * static_cast<std::float_t>(tile_x + (corner & 1)) / settings_.tiles_x,
+					    -1.0f + 2.0f * static_cast<std::float_t>(tile_y + (corner >> 1)) / settings_.tiles_y);
+					const glm::vec3 ray = GetViewRay(inverse_projection, ndc);
+					for (std::float_t depth : {near_depth, far_depth}) {
+						box_min = glm::min(box_min, ray * depth);
+						box_max = glm::max(box_max, ray * depth);
+					}
+				}
+				const std::uint32_t cluster = GetClusterIndex(tile_x, tile_y, slice);
+				bounds_min_[cluster] = box_min;
+				bounds_max_[cluster] = box_max;
+
+				glm::vec2& column = column_extents_[slice * settings_.tiles_x + tile_x];
+				column = glm::vec2(std::min(column.x, box_min.x), std::max(column.y, box_max.x));
+				glm::vec2& row = row_extents_[slice * settings_.tiles_y + tile_y];
+				row = glm::vec2(std::min(row.x, box_min.y), std::max(row.y, box_max.y));
+			}
+		}
+	}
+}
+
+void LightClusterer::Reset()
+{
+	std::fill(counts_.begin(), counts_.end(), 0);
+	overflow_count_ = 0;
+}
+
+void LightClusterer::Append(std::uint32_t cluster, std::uint32_t light)
+{
+	std::uint32_t& count = counts_[cluster];
+	if (count == settings_.max_lights_per_cluster) {
+		overflow_count_++;
+		return;
+	}
+	light_indices_[std::size_t(cluster) * settings_.max_lights_per_cluster + count++] = light;
+}
+
+void LightClusterer::Build(gsl::span<const PointLight> lights)
+{
+	Reset();
+
+	for (std::uint32_t light = 0; light < lights.size(); light++) {
+		const glm::vec3& center = lights[light].position;
+		const std::float_t radius = lights[light].radius;
+		const std::float_t depth_min = -center.z - radius;
+		const std::float_t depth_max = -center.z + radius;
+		if (depth_max < 0.0f || depth_min > settings_.far) {
+			continue;
+		}
+
+		// One slice of slack either side: the log mapping and the box depths may round apart
+		const std::uint32_t first_slice = std::max(GetClusterSlice(settings_, depth_min), 1u) - 1;
+		const std::uint32_t last_slice = std::min(GetClusterSlice(settings_, depth_max) + 1, settings_.slices - 1);
+		for (std::uint32_t slice = first_slice; slice <= last_slice; slice++) {
+			// Columns and rows whose boxes overlap the sphere's extent, then the exact test
+			std::uint32_t first_x = settings_.tiles_x;
+			std::uint32_t last_x = 0;
+			for (std::uint32_t tile_x = 0; tile_x < settings_.tiles_x; tile_x++) {
+				const glm::vec2& extent = column_extents_[slice * settings_.tiles_x + tile_x];
+				if (extent.y >= center.x - radius && extent.x <= center.x + radius) {
+					first_x = std::min(first_x, tile_x);
+					last_x = tile_x;
+				}
+			}
+			std::uint32_t first_y = settings_.tiles_y;
+			std::uint32_t last_y = 0;
+			for (std::uint32_t tile_y = 0; tile_y < settings_.tiles_y; tile_y++) {
+				const glm::vec2& extent = row_extents_[slice * settings_.tiles_y + tile_y];
+				if (extent.y >= center.y - radius && extent.x <= center.y + radius) {
+					first_y = std::min(first_y, tile_y);
+					last_y = tile_y;
+				}
+			}
+
+			for (std::uint32_t tile_y = first_y; tile_y <= last_y && first_y < settings_.tiles_y; tile_y++) {
+				for (std::uint32_t tile_x = first_x; tile_x <= last_x && first_x < settings_.tiles_x; tile_x++) {
+					const std::uint32_t cluster = GetClusterIndex(tile_x, tile_y, slice);
+					if (SphereTouchesBox(center, radius, bounds_min_[cluster], bounds_max_[cluster])) {
+						Append(cluster, light);
+					}
+				}
+			}
+		}
+	}
+}
+
+void LightClusterer::BuildBruteForce(gsl::span<const PointLight> lights)
+{
+	Reset();
+
+	for (std::uint32_t cluster = 0; cluster < counts_.size(); cluster++) {
+		for (std::uint32_t light = 0; light < lights.size(); light++) {
+			if (SphereTouchesBox(lights[light].position, lights[light].radius, bounds_min_[cluster], bounds_max_[cluster])) {
+				Append(cluster, light);
+			}
+		}
+	}
+}
+
+}  // namespace veng
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <vector>
+
+namespace veng {
+
+// Clustered forward shading: the view frustum is cut into a grid of screen tiles and
+// exponential depth slices, every light is listed in the clusters its sphere touches, and the
+// fragment shader only walks the list of its own cluster. Shading cost then follows the light
+// density around a pixel rather than the total light count.
+//
+// Graphics bins on the GPU (light_cluster.comp); the CPU binning here produces the same lists
+// and serves as reference and benchmark.
+
+struct ClusterSettings {
+	std::uint32_t tiles_x = 16;
+	std::uint32_t tiles_y = 9;
+	std::uint32_t slices = 32;
+	// View-space depth range the exponential slices cover. The first slice also reaches from
+	// `near` back to the camera, so no slices go to the few units in front of it; fragments
+	// past `far` use the last slice and miss lights beyond it.
+	std::float_t near = 1.0f;
+	std::float_t far = 500.0f;
+	// Lights past this many in a cluster are dropped, lowest light indices first kept
+	std::uint32_t max_lights_per_cluster = 256;
+};
+
+// std430 layout of the light buffer
+struct PointLight {
+	glm::vec3 position = glm::vec3(0.0f);
+	std::float_t radius = 1.0f;  // no contribution past it
+	glm::vec3 color = glm::vec3(1.0f);
+	std::float_t intensity = 1.0f;
+};
+
+// std140 uniform block shared by light_cluster.comp and clustered.frag
+struct ClusterUniforms {
+	glm::mat4 inverse_projection;
+	glm::uvec4 grid;      // tiles x, tiles y, slices, light count
+	glm::vec4 viewport;   // width, height, 1 / width, 1 / height in pixels
+	glm::vec4 slicing;    // near, far, scale, bias: slice = floor(log(depth) * scale - bias)
+	glm::uvec4 limits;    // max lights per cluster
+};
+
+static_assert(sizeof(ClusterUniforms) == 128, "ClusterUniforms mirrors a std140 block");
+
+std::uint32_t GetClusterCount(const ClusterSettings& settings);
+// Slice containing view-space `depth` (distance in front of the camera), clamped to the grid
+std::uint32_t GetClusterSlice(const ClusterSettings& settings, std::float_t depth);
+ClusterUniforms MakeClusterUniforms(const ClusterSettings& settings, const glm::mat4& projection, glm::uvec2 viewport, std::uint32_t light_count);
+// Moves a world-space light into view space, which is where the clusters live
+PointLight TransformLight(const PointLight& light, const glm::mat4& view);
+
+class LightClusterer {
+public:
+	explicit LightClusterer(ClusterSettings settings = {});
+
+	// Cluster bounds depend on the projection only
+	void SetProjection(const glm::mat4& projection);
+
+	// Bins view-space `lights`. Each light only visits the clusters under its projected bounds.
+	void Build(gsl::span<const PointLight> lights);
+	// Every cluster tests every light, the way light_cluster.comp does; same result
+	void BuildBruteForce(gsl::span<const PointLight> lights);
+
+	const ClusterSettings& GetSettings() const { return settings_; }
+	std::uint32_t GetClusterIndex(std::uint32_t tile_x, std::uint32_t tile_y, std::uint32_t slice) const
+	{
+		return (slice * settings_.tiles_y + tile_y) * settings_.tiles_x + tile_x;
+	}
+	gsl::span<const std::uint32_t> GetClusterLights(std::uint32_t cluster) const
+	{
+		return gsl::span<const std::uint32_t>(light_indices_).subspan(std::size_t(cluster) * settings_.max_lights_per_cluster, counts_[cluster]);
+	}
+	// Light references dropped by full clusters in the last build
+	std::uint32_t GetOverflowCount() const { return overflow_count_; }
+
+private:
+	void Reset();
+	void Append(std::uint32_t cluster, std::uint32_t light);
+
+	ClusterSettings settings_;
+	// View-space bounds of every cluster
+	std::vector<glm::vec3> bounds_min_;
+	std::vector<glm::vec3> bounds_max_;
+	std::vector<std::uint32_t> counts_;
+	std::vector<std::uint32_t> light_indices_;  // max_lights_per_cluster slots per cluster
+	std::uint32_t overflow_count_ = 0;
+	// Per slice, the x range of each tile column and the y range of each tile row
+	std::vector<glm::vec2> column_extents_;
+	std::vector<glm::vec2> row_extents_;
+};
+
+}  // namespace veng
@@ -0,0 +1,74 @@
+#include <precomp.h>
+#include <lod_selection.h>
+
+namespace veng {
+
+LodProjection LodProjection::FromPerspective(const glm::vec3& camera_position, std::float_t fov_y, std::float_t viewport_height)
+{
+	LodProjection projection;
+	projection.camera_position = camera_position;
+	projection.pixels_per_unit = viewport_height / (2.0f * std::tan(fov_y * 0.5f));
+	return projection;
+}
+
+void LodSelector::Select(
+    gsl::span<const std::uint32_t> instances, gsl::span<const glm::vec4> spheres, gsl::span<const MeshLod> lods, std::float_t mesh_radius, const LodProjection& projection)
+{
+	Expects(!lods.empty() && mesh_radius > 0.0f);
+	const std::uint32_t coarsest = gsl::narrow_cast<std::uint32_t>(lods.size() - 1);
+	const std::float_t refine_threshold = settings_.error_threshold;
+	const std::float_t coarsen_threshold = settings_.error_threshold * (1.0f - settings_.hysteresis);
+
+	for (std::uint32_t instance : instances) {
+		const glm::vec4& sphere = spheres[instance];
+		// Nearest point of the bounding sphere, so errors are never underestimated
+		const std::float_t distance = glm::length(glm::vec3(sphere) - projection.camera_position) - sphere.w;
+		if (distance <= 0.0f) {
+			current_[instance] = 0;
+			continue;
+		}
+		const std::float_t error_to_pixels = (sphere.w / mesh_radius) * projection.pixels_per_unit / distance;
+
+		// Errors grow along the chain, so refining and coarsening are both a walk from the
+		// current LOD; between the two thresholds it stays put
+		std::uint32_t lod = std::min<std::uint32_t>(current_[instance], coarsest);
+		while (lod > 0 && lods[lod].error * error_to_pixels > refine_threshold) {
+			lod--;
+		}
+		while (lod < coarsest && lods[lod + 1].error * error_to_pixels <= coarsen_threshold) {
+			lod++;
+		}
+		current_[instance] = gsl::narrow_cast<std::uint8_t>(lod);
+	}
+}
+
+std::size_t LodSelector::BuildDraws(gsl::span<const std::uint32_t> instances, gsl::span<const MeshLod> lods, gsl::span<DrawIndexedCommand> draws) const
+{
+	Expects(draws.size() >= instances.size());
+	std::size_t draw_count = 0;
+	std::size_t run_start = 0;
+	for (std::size_t i = 1; i <= instances.size(); i++) {
+		if (i == instances.size() || instances[i] != instances[i - 1] + 1 || current_[instances[i]] != current_[instances[run_start]]) {
+			const MeshLod& lod = lods[std::min<std::size_t>(current_[instances[run_start]], lods.size() - 1)];
+			DrawIndexedCommand& draw = draws[draw_count++];
+			draw.index_count = lod.index_count;
+			draw.instance_count = gsl::narrow_cast<std::uint32_t>(i - run_start);
+			draw.first_index = lod.first_index;
+			draw.vertex_offset = 0;
+			draw.first_instance = instances[run_start];
+			run_start = i;
+		}
+	}
+	return draw_count;
+}
+
+std::uint64_t CountTriangles(gsl::span<const DrawIndexedCommand> draws)
+{
+	std::uint64_t triangles = 0;
+	for (const DrawIndexedCommand& draw : draws) {
+		triangles += std::uint64_t(draw.index_count / 3) * draw.instance_count;
+	}
+	return triangles;
+}
+
+}  // namespace veng
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <mesh_format.h>
+#include <vector>
+
+namespace veng {
+
+// Same layout as VkDrawIndexedIndirectCommand, so arrays of it go into indirect draw
+// buffers unchanged; declared here so LOD and culling code stays free of Vulkan.
+struct DrawIndexedCommand {
+	std::uint32_t index_count = 0;
+	std::uint32_t instance_count = 0;
+	std::uint32_t first_index = 0;
+	std::int32_t vertex_offset = 0;
+	std::uint32_t first_instance = 0;
+};
+
+// Converts world-space errors at a distance into pixels for a perspective camera
+struct LodProjection {
+	glm::vec3 camera_position = glm::vec3(0.0f);
+	// Pixels one world unit covers at distance 1: viewport_height / (2 tan(fov_y / 2))
+	std::float_t pixels_per_unit = 1.0f;
+
+	static LodProjection FromPerspective(const glm::vec3& camera_position, std::float_t fov_y, std::float_t viewport_height);
+};
+
+struct LodSettings {
+	// Pixels a LOD's projected error may reach. MeshLod::error is an RMS deviation, so the
+	// worst visible shift can be somewhat larger.
+	std::float_t error_threshold = 1.0f;
+	// An instance only moves to a coarser LOD once that LOD's error is this fraction below
+	// the threshold, so objects resting near a switch distance do not flip every frame
+	std::float_t hysteresis = 0.2f;
+};
+
+// Chooses per instance the coarsest LOD whose error projects below the pixel threshold. The
+// LOD of every instance is remembered for the hysteresis, so instances are identified by
+// their index in the instance buffer; meshes drawn with disjoint instances can share one
+// selector.
+class LodSelector {
+public:
+	explicit LodSelector(LodSettings settings = {}) : settings_(settings) {}
+
+	// New instances start at LOD 0
+	void Resize(std::size_t instance_count) { current_.resize(instance_count, 0); }
+
+	// Updates the LOD of each of `instances`. `spheres` holds the world-space bounding sphere
+	// of every instance (xyz center, w radius); its ratio to `mesh_radius`, the mesh's own
+	// bounding radius, scales the object-space LOD errors into world units.
+	void Select(
+	    gsl::span<const std::uint32_t> instances,
+	    gsl::span<const glm::vec4> spheres,
+	    gsl::span<const MeshLod> lods,
+	    std::float_t mesh_radius,
+	    const LodProjection& projection);
+
+	std::uint32_t GetLod(std::uint32_t instance) const { return current_[instance]; }
+
+	// Writes one instanced draw per run of consecutive instances at the same LOD, as
+	// Graphics::RenderTriangleInstances merges runs, and returns how many were written.
+	// `draws` must hold instances.size() entries; the result feeds Graphics::DrawMesh or an
+	// indirect draw buffer alike.
+	std::size_t BuildDraws(gsl::span<const std::uint32_t> instances, gsl::span<const MeshLod> lods, gsl::span<DrawIndexedCommand> draws) const;
+
+private:
+	LodSettings settings_;
+	std::vector<std::uint8_t> current_;
+};
+
+std::uint64_t CountTriangles(gsl::span<const DrawIndexedCommand> draws);
+
+}  // namespace veng
@@ -0,0 +1,101 @@
+#include <precomp.h>
+#include <logging.h>
+#include <spdlog/spdlog.h>
+#include <spdlog/async.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+
+namespace veng {
+
+#pragma region LOGGING_INITIALIZATION
+
+LoggingInitialization::LoggingInitialization(LoggingSettings settings)
+{
+	// A single worker keeps messages in order
+	spdlog::init_thread_pool(settings.queue_size, 1);
+
+	std::shared_ptr<spdlog::logger> logger = spdlog::create_async_nb<spdlog::sinks::stdout_color_sink_mt>("veng");
+	logger->set_level(static_cast<spdlog::level::level_enum>(SPDLOG_ACTIVE_LEVEL));
+	logger->flush_on(spdlog::level::err);
+	spdlog::set_default_logger(logger);
+
+	// Error paths leave through std::exit(), which skips our destructor
+	std::atexit([]() {
+		spdlog::shutdown();
+	});
+}
+
+LoggingInitialization::~LoggingInitialization()
+{
+	spdlog::shutdown();
+}
+
+#pragma endregion
+
+#pragma region VALIDATION_MESSAGE_FILTER
+
+ValidationMessageFilter::ValidationMessageFilter(std::uint32_t max_per_interval, std::chrono::steady_clock::duration interval)
+    : max_per_interval_(max_per_interval), interval_(interval), interval_begin_(std::chrono::steady_clock::now())
+{
+}
+
+ValidationMessageFilter::~ValidationMessageFilter()
+{
+	std::lock_guard lock(mutex_);
+	LogSummary();
+}
+
+bool ValidationMessageFilter::ShouldLog(std::int32_t message_id, gsl::czstring name)
+{
+	std::lock_guard lock(mutex_);
+	FlushIfIntervalPassed();
+
+	auto [it, inserted] = stats_.try_emplace(message_id);
+	MessageStats& stats = it->second;
+	if (inserted && name != nullptr) {
+		stats.name = name;
+	}
+
+	stats.total++;
+	if (stats.logged_in_interval < max_per_interval_) {
+		stats.logged_in_interval++;
+		return true;
+	}
+
+	stats.suppressed_in_interval++;
+	return false;
+}
+
+void ValidationMessageFilter::Flush()
+{
+	std::lock_guard lock(mutex_);
+	FlushIfIntervalPassed();
+}
+
+void ValidationMessageFilter::FlushIfIntervalPassed()
+{
+	const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (now - interval_begin_ >= interval_) {
+		LogSummary();
+		interval_begin_ = now;
+	}
+}
+
+void ValidationMessageFilter::LogSummary()
+{
+	for (auto& [message_id, stats] : stats_) {
+		if (stats.suppressed_in_interval > 0) {
+			SPDLOG_WARN(
+			    "Vulkan Validation: {} (0x{:08x}) repeated {} more times, {} in total",
+			    stats.name.empty() ? "message" : stats.name,
+			    static_cast<std::uint32_t>(message_id),
+			    stats.suppressed_in_interval,
+			    stats.total);
+		}
+		stats.logged_in_interval = 0;
+		stats.suppressed_in_interval = 0;
+	}
+}
+
+#pragma endregion
+
+}  // namespace veng
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <unordered_map>
+
+namespace veng {
+
+struct LoggingSettings {
+	// Messages waiting for the logging thread. When full the oldest are dropped, so a burst
+	// never blocks the thread that logs (e.g. a driver thread in a validation callback).
+	std::size_t queue_size = 8192;
+};
+
+// Routes the default spdlog logger through a background thread. Levels below
+// SPDLOG_ACTIVE_LEVEL are compiled out of the SPDLOG_* macros, and the runtime level starts
+// there too. Pending messages are flushed on destruction and on std::exit().
+struct LoggingInitialization {
+public:
+	explicit LoggingInitialization(LoggingSettings settings = {});
+	~LoggingInitialization();
+
+	LoggingInitialization(const LoggingInitialization&) = delete;
+	LoggingInitialization& operator=(const LoggingInitialization&) = delete;
+};
+
+// Deduplicates and rate-limits validation messages by their messageIdNumber: each id is
+// logged at most `max_per_interval` times per interval and the rest are counted. Once an
+// interval has passed, a summary of what was suppressed is logged, by the next message or
+// by Flush(), and on destruction. Thread-safe.
+class ValidationMessageFilter {
+public:
+	explicit ValidationMessageFilter(std::uint32_t max_per_interval = 3, std::chrono::steady_clock::duration interval = std::chrono::seconds(5));
+	~ValidationMessageFilter();
+
+	ValidationMessageFilter(const ValidationMessageFilter&) = delete;
+	ValidationMessageFilter& operator=(const ValidationMessageFilter&) = delete;
+
+	// `name` (pMessageIdName, may be null) is only used in summaries
+	bool ShouldLog(std::int32_t message_id, gsl::czstring name);
+
+	// Logs the summary if the interval has passed, so repeats are reported even when no
+	// further message comes. Meant to be called regularly, e.g. once per frame.
+	void Flush();
+
+private:
+	struct MessageStats {
+		std::string name;
+		std::uint32_t logged_in_interval = 0;
+		std::uint32_t suppressed_in_interval = 0;
+		std::uint64_t total = 0;
+	};
+
+	// Expect mutex_ to be held
+	void FlushIfIntervalPassed();
+	void LogSummary();
+
+	std::uint32_t max_per_interval_;
+	std::chrono::steady_clock::duration interval_;
+
+	std::mutex mutex_;
+	std::unordered_map<std::int32_t, MessageStats> stats_;
+	std::chrono::steady_clock::time_point interval_begin_;
+};
+
+}  // namespace veng
@@ -1,22 +1,712 @@
 #include <precomp.h>
+#include <array>
+#include <chrono>
+#include <memory>
+#include <numeric>
+#include <random>
 #include <GLFW/glfw3.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <frustum_culling.h>
 #include <glfw_monitor.h>
 #include <glfw_initialization.h>
 #include <glfw_window.h>
 #include <graphics.h>
+#include <image_writer.h>
+#include <job_system.h>
+#include <lod_selection.h>
+#include <logging.h>
+#include <main_loop.h>
+#include <mesh_file.h>
+#include <spdlog/spdlog.h>
+#include <transform_hierarchy.h>
+
+namespace {
+
+constexpr std::size_t kHudFrames = 120;  // frame times in the HUD graph
+constexpr std::float_t kHudTargetMs = 1000.0f / 60.0f;
+
+// fmt::format_to_n into `buffer`, cut off at its end
+template <typename... Args>
+std::string_view FormatLine(gsl::span<char> buffer, fmt::format_string<Args...> format, Args&&... args)
+{
+	const auto result = fmt::format_to_n(buffer.data(), buffer.size(), format, std::forward<Args>(args)...);
+	return {buffer.data(), std::min(result.size, buffer.size())};
+}
+
+// Frame times with a graph of the recent ones, instance and memory counters in the top left
+// corner. Formats into a stack buffer and writes straight into the overlay, so it never
+// allocates.
+void DrawHud(veng::Graphics& graphics, gsl::span<const std::float_t, kHudFrames> frame_times, std::size_t visible, std::size_t instances)
+{
+	constexpr std::float_t kScale = 2.0f;
+	constexpr std::float_t kLineHeight = veng::GlyphAtlas::kCellHeight * kScale;
+	const glm::vec2 origin = {8.0f, 8.0f};
+	const glm::vec2 graph_size = {kHudFrames * 3.0f, 64.0f};
+	constexpr std::float_t kPadding = 6.0f;
+	const std::uint32_t text = veng::PackOverlayColor(glm::vec4(1.0f));
+	const std::uint32_t dim = veng::PackOverlayColor(glm::vec4(0.7f, 0.7f, 0.7f, 1.0f));
+
+	std::size_t device_heaps = 0;
+	for (const veng::MemoryHeapBudget& heap : graphics.GetMemoryBudgets()) {
+		device_heaps += heap.device_local ? 1 : 0;
+	}
+
+	veng::OverlayBatch& overlay = graphics.GetOverlay();
+	const std::float_t lines = static_cast<std::float_t>(4 + device_heaps);
+	const glm::vec2 panel_size = {std::max(graph_size.x, 36 * veng::GlyphAtlas::kCellWidth * kScale), lines * kLineHeight + graph_size.y + kPadding};
+	overlay.Rect(origin, panel_size + 2.0f * glm::vec2(kPadding), veng::PackOverlayColor(glm::vec4(0.0f, 0.0f, 0.0f, 0.6f)));
+
+	std::array<char, 96> line;
+	glm::vec2 cursor = origin + glm::vec2(kPadding);
+	const std::float_t cpu_ms = frame_times.back();
+	overlay.Text(cursor, FormatLine(line, "Frame {:6.2f} ms {:5.0f} FPS", cpu_ms, cpu_ms > 0.0f ? 1000.0f / cpu_ms : 0.0f), text, kScale);
+	cursor.y += kLineHeight;
+	overlay.Text(
+	    cursor,
+	    FormatLine(line, "GPU   {:6.2f} ms  HUD {:.3f} ms  {:3.0f}%", graphics.GetGpuFrameTime(), graphics.GetGpuOverlayTime(), graphics.GetRenderScale() * 100.0f),
+	    text,
+	    kScale);
+	cursor.y += kLineHeight + kPadding * 0.5f;
+
+	// Bars up to twice the target, with the target as a line across
+	const std::float_t graph_max = kHudTargetMs * 2.0f;
+	overlay.Rect(cursor, graph_size, veng::PackOverlayColor(glm::vec4(1.0f, 1.0f, 1.0f, 0.1f)));
+	overlay.Graph(cursor, graph_size, frame_times, graph_max, veng::PackOverlayColor(glm::vec4(0.3f, 0.9f, 0.4f, 0.9f)));
+	overlay.Rect({cursor.x, cursor.y + graph_size.y * (1.0f - kHudTargetMs / graph_max)}, {graph_size.x, 1.0f}, veng::PackOverlayColor(glm::vec4(1.0f, 0.3f, 0.2f, 1.0f)));
+	cursor.y += graph_size.y + kPadding * 0.5f;
+
+	overlay.Text(cursor, FormatLine(line, "{}/{} instances visible", visible, instances), dim, kScale);
+	cursor.y += kLineHeight;
+	const gsl::span<const veng::MemoryHeapBudget> heaps = graphics.GetMemoryBudgets();
+	for (std::size_t i = 0; i < heaps.size(); i++) {
+		if (!heaps[i].device_local) {
+			continue;
+		}
+		constexpr std::double_t kMegabyte = 1024.0 * 1024.0;
+		overlay.Text(
+		    cursor,
+		    FormatLine(line, "Heap {} {:.0f}/{:.0f} MB", i, static_cast<std::double_t>(heaps[i].usage) / kMegabyte, static_cast<std::double_t>(heaps[i].budget) / kMegabyte),
+		    dim,
+		    kScale);
+		cursor.y += kLineHeight;
+	}
+	// Written so far, without this line's own glyphs
+	overlay.Text(cursor, FormatLine(line, "{} overlay vertices", overlay.GetVertexCount()), dim, kScale);
+}
+
+// --mesh: copies of one cooked mesh on a square grid in the XZ plane, seen by a camera
+// circling above it
+constexpr std::uint32_t kMeshGridSize = 16;
+// Rows and columns of copies between two occluder walls
+constexpr std::uint32_t kMeshWallInterval = 4;
+
+struct MeshGrid {
+	veng::MeshId mesh = 0;
+	std::float_t spacing = 0.0f;
+	// Per instance: object to world and the world-space bounding sphere
+	std::vector<glm::mat4> models;
+	std::vector<glm::vec4> spheres;
+	veng::LodSelector lods;
+	// Object to world of the occluders, stretched copies at the instances after the grid's
+	std::vector<glm::mat4> walls;
+};
+
+struct MeshCamera {
+	glm::vec3 position = glm::vec3(0.0f);
+	std::float_t fov_y = 0.0f;
+	glm::mat4 view = glm::mat4(1.0f);
+	glm::mat4 projection = glm::mat4(1.0f);
+	glm::mat4 view_projection = glm::mat4(1.0f);
+};
+
+// What Graphics::GetMeshRadius reports once the mesh is uploaded
+std::float_t GetMeshRadius(const veng::MeshFileHeader& header)
+{
+	return glm::length(header.bounds_max - header.bounds_min) * 0.5f;
+}
+
+// Centers a copy of the mesh on every grid cell and adds its bounds to `volumes`
+MeshGrid PlaceMeshGrid(const veng::Graphics& graphics, veng::MeshId mesh, const veng::MeshFileHeader& header, veng::BoundingVolumes& volumes)
+{
+	MeshGrid grid;
+	grid.mesh = mesh;
+	const std::float_t radius = graphics.GetMeshRadius(mesh);
+	const glm::vec3 mesh_center = (header.bounds_min + header.bounds_max) * 0.5f;
+	grid.spacing = radius * 3.0f;
+	const std::float_t first = -0.5f * static_cast<std::float_t>(kMeshGridSize - 1) * grid.spacing;
+	for (std::uint32_t z = 0; z < kMeshGridSize; z++) {
+		for (std::uint32_t x = 0; x < kMeshGridSize; x++) {
+			const glm::vec3 center(first + static_cast<std::float_t>(x) * grid.spacing, 0.0f, first + static_cast<std::float_t>(z) * grid.spacing);
+			grid.models.push_back(glm::translate(glm::mat4(1.0f), center - mesh_center));
+			grid.spheres.emplace_back(center, radius);
+			volumes.Add(center, radius, center - glm::vec3(radius), center + glm::vec3(radius));
+		}
+	}
+	grid.lods.Resize(grid.models.size());
+	return grid;
+}
+
+// Walls across the grid between every few rows and columns, as high as two copies are wide:
+// from the orbiting camera they hide most copies beyond the nearest one
+void PlaceMeshWalls(const veng::Graphics& graphics, MeshGrid& grid, const veng::MeshFileHeader& header)
+{
+	const glm::vec3 mesh_center = (header.bounds_min + header.bounds_max) * 0.5f;
+	const glm::vec3 mesh_size = glm::max(header.bounds_max - header.bounds_min, glm::vec3(1e-6f));
+	const std::float_t length = static_cast<std::float_t>(kMeshGridSize) * grid.spacing;
+	const std::float_t height = grid.spacing * 2.0f;
+	const std::float_t thickness = grid.spacing * 0.3f;
+	// Standing on the plane the copies rest on
+	const std::float_t center_y = height * 0.5f - graphics.GetMeshRadius(grid.mesh);
+	const std::float_t first = -0.5f * static_cast<std::float_t>(kMeshGridSize - 1) * grid.spacing;
+	for (std::uint32_t row = kMeshWallInterval; row < kMeshGridSize; row += kMeshWallInterval) {
+		const std::float_t offset = first + (static_cast<std::float_t>(row) - 0.5f) * grid.spacing;
+		const auto place = [&](const glm::vec3& center, const glm::vec3& size) {
+			grid.walls.push_back(glm::scale(glm::translate(glm::mat4(1.0f), center), size / mesh_size) * glm::translate(glm::mat4(1.0f), -mesh_center));
+		};
+		place(glm::vec3(0.0f, center_y, offset), glm::vec3(length, height, thickness));
+		place(glm::vec3(offset, center_y, 0.0f), glm::vec3(thickness, height, length));
+	}
+}
+
+// Lights of random colors scattered over the grid from the copies' centers to a copy above,
+// each reaching its neighbouring copies
+std::vector<veng::PointLight> ScatterMeshLights(const MeshGrid& grid, std::uint32_t count)
+{
+	const std::float_t half_extent = 0.5f * static_cast<std::float_t>(kMeshGridSize) * grid.spacing;
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<std::float_t> horizontal(-half_extent, half_extent);
+	std::uniform_real_distribution<std::float_t> height(0.0f, grid.spacing);
+	std::uniform_real_distribution<std::float_t> radius(grid.spacing * 0.5f, grid.spacing * 1.5f);
+	std::uniform_real_distribution<std::float_t> channel(0.2f, 1.0f);
+	std::vector<veng::PointLight> lights(count);
+	for (veng::PointLight& light : lights) {
+		light.position = glm::vec3(horizontal(random), height(random), horizontal(random));
+		light.radius = radius(random);
+		light.color = glm::vec3(channel(random), channel(random), channel(random));
+	}
+	return lights;
+}
+
+// One turn a minute at a slant from just outside the grid, so the near copies fill the view
+// and the far ones shrink to a few pixels
+MeshCamera OrbitMeshGrid(const MeshGrid& grid, std::float_t time, glm::ivec2 framebuffer_size)
+{
+	const std::float_t half_extent = 0.5f * static_cast<std::float_t>(kMeshGridSize) * grid.spacing;
+	const std::float_t angle = time * glm::radians(6.0f);
+
+	MeshCamera camera;
+	camera.position = glm::vec3(std::cos(angle) * half_extent * 1.2f, half_extent * 0.4f, std::sin(angle) * half_extent * 1.2f);
+	camera.fov_y = glm::radians(60.0f);
+	camera.view = glm::lookAt(camera.position, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	const std::float_t aspect = static_cast<std::float_t>(std::max(framebuffer_size.x, 1)) / static_cast<std::float_t>(std::max(framebuffer_size.y, 1));
+	camera.projection = veng::PerspectiveReverseZ(camera.fov_y, aspect, grid.spacing * 0.05f);
+	camera.view_projection = camera.projection * camera.view;
+	return camera;
+}
+
+// Picks the LOD of every visible copy from its projected error at the current resolution
+void SelectMeshLods(const veng::Graphics& graphics, MeshGrid& grid, const MeshCamera& camera, std::float_t viewport_height, gsl::span<const std::uint32_t> visible)
+{
+	const veng::LodProjection projection = veng::LodProjection::FromPerspective(camera.position, camera.fov_y, viewport_height);
+	grid.lods.Select(visible, grid.spheres, graphics.GetMeshLods(grid.mesh), graphics.GetMeshRadius(grid.mesh), projection);
+}
+
+// One indirect draw per run of consecutive visible copies at the same LOD
+void DrawMeshGrid(veng::Graphics& graphics, const MeshGrid& grid, gsl::span<const std::uint32_t> visible, std::pmr::memory_resource* memory)
+{
+	std::pmr::vector<veng::DrawIndexedCommand> draws(visible.size(), memory);
+	draws.resize(grid.lods.BuildDraws(visible, graphics.GetMeshLods(grid.mesh), draws));
+	graphics.DrawMeshIndirect(grid.mesh, draws);
+}
+
+// All walls in one instanced draw at the finest LOD, which occludes best
+void DrawMeshWalls(veng::Graphics& graphics, const MeshGrid& grid)
+{
+	if (grid.walls.empty()) {
+		return;
+	}
+	const veng::MeshLod& lod = graphics.GetMeshLods(grid.mesh).front();
+	veng::DrawIndexedCommand draw;
+	draw.index_count = lod.index_count;
+	draw.instance_count = gsl::narrow_cast<std::uint32_t>(grid.walls.size());
+	draw.first_index = lod.first_index;
+	draw.first_instance = gsl::narrow_cast<std::uint32_t>(grid.models.size());
+	graphics.DrawMeshIndirect(grid.mesh, gsl::span(&draw, 1));
+}
+
+// Every copy goes to the GPU culling pass at its selected LOD; the pass tests it against the
+// frustum and the depth the walls and the copies drawn first leave behind
+void DrawMeshGridOcclusionCulled(veng::Graphics& graphics, const MeshGrid& grid, const MeshCamera& camera, std::pmr::memory_resource* memory)
+{
+	const gsl::span<const veng::MeshLod> lods = graphics.GetMeshLods(grid.mesh);
+	std::pmr::vector<veng::CulledObject> objects(grid.models.size(), memory);
+	for (std::uint32_t i = 0; i < objects.size(); i++) {
+		const veng::MeshLod& lod = lods[grid.lods.GetLod(i)];
+		objects[i].sphere = grid.spheres[i];
+		objects[i].instance = i;
+		objects[i].first_index = lod.first_index;
+		objects[i].index_count = lod.index_count;
+	}
+	veng::OcclusionBatch batch;
+	batch.mesh = grid.mesh;
+	batch.objects = objects;
+	graphics.DrawOcclusionCulled(gsl::span(&batch, 1), camera.view_projection);
+}
+
+}  // namespace
 
 int main(std::size_t argc, gsl::zstring* argv)
 {
+	const std::chrono::steady_clock::time_point startup_begin = std::chrono::steady_clock::now();
+	const veng::LoggingInitialization _logging;  // first in, last out: everything below may log
 	const veng::GlfwInitialization _glfw;  // resource acquisition in initialization
 
-	veng::Window window("VulkanEngine", {800, 600});
+	// Shared by every CPU-side system so they never oversubscribe the cores
+	veng::JobSystem jobs;
 
-	window.TryMoveToMonitor(0);
+	// --loop=continuous|capped|on-demand and --fps=<n> for the capped mode.
+	// --capture=<directory> writes every frame (--capture-format=png|raw), --offscreen renders
+	// without presenting and --frames=<n> stops after n frames; such a run fails when a frame
+	// past the warm-up allocates from the heap (debug builds).
+	// --dynamic-resolution=<GPU ms> scales the render resolution to meet that frame time.
+	// --windows=<n> shows the scene in n windows, one per monitor, driven by one device.
+	// --host-allocations counts the driver's host allocations and logs them at exit,
+	// --pool-host-allocations also serves them from pools.
+	// --cycle-shading switches between precompiled shading variants once per second.
+	// --reuse-commands records the draws once per frame in flight and replays them.
+	// --memory-budget logs the budget and usage of every memory heap at exit.
+	// --pipeline-statistics counts vertices and shader invocations per pass and logs them at exit.
+	// --hud draws frame times, a frame-time graph and memory usage over the primary window.
+	// --depth-prepass lays down depth before shading, --msaa=<n> renders with n samples.
+	// --mesh=<path.vmsh> draws a grid of a cooked mesh (veng_meshcook) instead of the triangles,
+	// each copy at the coarsest LOD whose error stays below a pixel. --stream-meshes=<n> uploads
+	// n streamable copies of it and draws them in turn, one per second; --memory-budget-fill=<f>
+	// evicts streamable meshes above that fraction of a heap's budget, 0 all not drawn lately.
+	// --occlusion-culling adds walls to the --mesh grid and culls the copies they hide on the
+	// GPU; it logs the copies drawn against those in the frustum, and a --frames run fails
+	// unless fewer are drawn.
+	// --lights=<n> lights the --mesh grid with n point lights through clustered shading and logs
+	// the GPU times of light clustering and the scene at exit.
+	veng::MainLoopSettings loop_settings;
+	veng::GraphicsSettings settings;
+	std::optional<std::filesystem::path> capture_directory;
+	veng::ImageFileFormat capture_format = veng::ImageFileFormat::kPng;
+	std::uint64_t frame_limit = 0;
+	std::uint32_t window_count = 1;
+	bool cycle_shading = false;
+	bool log_memory_budget = false;
+	bool hud = false;
+	std::optional<std::filesystem::path> mesh_path;
+	std::uint32_t stream_mesh_count = 0;
+	bool occlusion_culling = false;
+	std::uint32_t light_count = 0;
+	for (std::size_t i = 1; i < argc; i++) {
+		const std::string_view argument = argv[i];
+		if (argument.starts_with("--loop=")) {
+			const std::optional<veng::LoopMode> mode = veng::ParseLoopMode(argument.substr(7));
+			if (!mode.has_value()) {
+				SPDLOG_ERROR("Unknown loop mode: {}", argument.substr(7));
+				return EXIT_FAILURE;
+			}
+			loop_settings.mode = mode.value();
+		}
+		else if (argument.starts_with("--fps=")) {
+			loop_settings.target_fps = std::max(1.0, std::atof(argv[i] + 6));
+		}
+		else if (argument.starts_with("--capture=")) {
+			capture_directory = std::filesystem::path(argument.substr(10));
+		}
+		else if (argument == "--capture-format=raw") {
+			capture_format = veng::ImageFileFormat::kRaw;
+		}
+		else if (argument == "--offscreen") {
+			settings.offscreen = true;
+		}
+		else if (argument.starts_with("--frames=")) {
+			frame_limit = std::strtoull(argv[i] + 9, nullptr, 10);
+		}
+		else if (argument.starts_with("--dynamic-resolution=")) {
+			settings.dynamic_resolution.enabled = true;
+			settings.dynamic_resolution.target_gpu_ms = std::max(0.1, std::atof(argv[i] + 21));
+		}
+		else if (argument.starts_with("--windows=")) {
+			window_count = std::max(1u, static_cast<std::uint32_t>(std::strtoul(argv[i] + 10, nullptr, 10)));
+		}
+		else if (argument == "--host-allocations") {
+			settings.track_host_allocations = true;
+		}
+		else if (argument == "--pool-host-allocations") {
+			settings.track_host_allocations = true;
+			settings.pool_host_allocations = true;
+		}
+		else if (argument == "--cycle-shading") {
+			cycle_shading = true;
+		}
+		else if (argument == "--reuse-commands") {
+			settings.reuse_scene_commands = true;
+		}
+		else if (argument == "--memory-budget") {
+			log_memory_budget = true;
+		}
+		else if (argument == "--pipeline-statistics") {
+			settings.pipeline_statistics = true;
+		}
+		else if (argument == "--hud") {
+			settings.overlay = true;
+			hud = true;
+		}
+		else if (argument == "--depth-prepass") {
+			settings.depth_prepass = true;
+		}
+		else if (argument.starts_with("--msaa=")) {
+			settings.msaa_samples = std::max(1u, static_cast<std::uint32_t>(std::strtoul(argv[i] + 7, nullptr, 10)));
+		}
+		else if (argument.starts_with("--mesh=")) {
+			mesh_path = std::filesystem::path(argument.substr(7));
+		}
+		else if (argument.starts_with("--stream-meshes=")) {
+			stream_mesh_count = static_cast<std::uint32_t>(std::strtoul(argv[i] + 16, nullptr, 10));
+		}
+		else if (argument.starts_with("--memory-budget-fill=")) {
+			settings.memory_budget_fill = static_cast<std::float_t>(std::clamp(std::atof(argv[i] + 21), 0.0, 1.0));
+		}
+		else if (argument == "--occlusion-culling") {
+			occlusion_culling = true;
+		}
+		else if (argument.starts_with("--lights=")) {
+			light_count = static_cast<std::uint32_t>(std::strtoul(argv[i] + 9, nullptr, 10));
+		}
+	}
+	// Nothing would ever close a hidden window
+	if (settings.offscreen && frame_limit == 0) {
+		frame_limit = 120;
+	}
+	if (settings.offscreen && window_count > 1) {
+		SPDLOG_WARN("Offscreen rendering uses a single window");
+		window_count = 1;
+	}
+	if (occlusion_culling && !mesh_path.has_value()) {
+		SPDLOG_WARN("Occlusion culling needs a --mesh scene");
+		occlusion_culling = false;
+	}
+	if (occlusion_culling && settings.reuse_scene_commands) {
+		SPDLOG_WARN("Occlusion-culled draws change every frame and are not reused");
+		settings.reuse_scene_commands = false;
+	}
+	settings.occlusion_culling = occlusion_culling;
+	if (light_count > 0 && !mesh_path.has_value()) {
+		SPDLOG_WARN("Lights need a --mesh scene");
+		light_count = 0;
+	}
+
+	// Opened ahead of the graphics, which size the light clusters to it
+	std::optional<veng::MeshFile> mesh_file;
+	if (mesh_path.has_value()) {
+		mesh_file = veng::MeshFile::Open(mesh_path.value());
+		if (!mesh_file.has_value()) {
+			return EXIT_FAILURE;
+		}
+	}
+	if (light_count > 0) {
+		// Slices from just in front of the camera to past the far side of the grid
+		const std::float_t radius = GetMeshRadius(mesh_file->GetHeader());
+		settings.clustered_lighting = true;
+		settings.max_lights = std::max(settings.max_lights, light_count);
+		settings.light_clusters.near = radius;
+		settings.light_clusters.far = radius * 3.0f * static_cast<std::float_t>(kMeshGridSize) * 2.0f;
+	}
+	if (settings.reuse_scene_commands && window_count > 1) {
+		SPDLOG_WARN("Reused scene commands need a single window");
+		window_count = 1;
+	}
+
+	if (cycle_shading) {
+		// Each quality level in its own color, so the switch shows without clustered lighting
+		veng::ShadingVariant attenuation;
+		attenuation.albedo = glm::vec3(0.0f, 0.5f, 1.0f);
+		attenuation.quality = veng::ShadingQuality::kAttenuation;
+		veng::ShadingVariant ambient;
+		ambient.albedo = glm::vec3(0.5f, 1.0f, 0.0f);
+		ambient.quality = veng::ShadingQuality::kAmbient;
+		settings.shading_variants = {veng::ShadingVariant(), attenuation, ambient};
+	}
+
+	// GLFW only allows window and monitor calls on the main thread, so this stays ahead of
+	// the (parallel) graphics startup
+	veng::Window window("VulkanEngine", {800, 600}, !settings.offscreen);
+
+	if (!settings.offscreen) {
+		window.TryMoveToMonitor(0);
+	}
+
+	// Closing the first window ends the program; the others only mirror it
+	std::vector<std::unique_ptr<veng::Window>> extra_windows;
+	std::vector<gsl::not_null<veng::Window*>> windows = {&window};
+	for (std::uint32_t i = 1; i < window_count; i++) {
+		const std::string name = fmt::format("VulkanEngine {}", i + 1);
+		extra_windows.push_back(std::make_unique<veng::Window>(name.c_str(), glm::ivec2(800, 600)));
+		if (!extra_windows.back()->TryMoveToMonitor(gsl::narrow_cast<std::uint16_t>(i))) {
+			SPDLOG_WARN("No monitor {} for window {}", i, i + 1);
+		}
+		windows.push_back(extra_windows.back().get());
+	}
 
-	veng::Graphics graphics(&window);
+	using Milliseconds = std::chrono::duration<double, std::milli>;
+	SPDLOG_INFO("Window setup done at {:.2f} ms", Milliseconds(std::chrono::steady_clock::now() - startup_begin).count());
 
-	while (!window.ShouldClose()) {
-		glfwPollEvents();
+	settings.arena_thread_count = jobs.GetConcurrency();
+	veng::Graphics graphics(windows, settings, &jobs);
+
+	// Frames arrive a few frames late from the readback ring and are written in the background
+	std::optional<veng::ImageWriter> capture_writer;
+	if (capture_directory.has_value()) {
+		if (!graphics.IsCaptureSupported()) {
+			SPDLOG_ERROR("Frame capture is not supported by this swapchain");
+			return EXIT_FAILURE;
+		}
+		std::filesystem::create_directories(capture_directory.value());
+		capture_writer.emplace();
+		graphics.SetReadbackHandler([&](const veng::FrameReadback& readback) {
+			const std::filesystem::path path =
+			    capture_directory.value() / fmt::format("frame_{:06}.{}", readback.frame_number, veng::GetImageFileExtension(capture_format));
+			capture_writer->Write(path, capture_format, readback.width, readback.height, readback.rgba);
+		});
+	}
+
+	// A ring of small triangles orbiting the center one; the shader has no camera, so world
+	// space is clip space and triangles leaving the screen are culled.
+	constexpr std::uint32_t kRingSize = 64;
+	constexpr std::float_t kTriangleRadius = 0.71f;  // bounds the hard-coded triangle
+	constexpr std::float_t kRootScale = 0.5f;
+	constexpr std::float_t kChildScale = 0.1f;
+
+	veng::TransformHierarchy scene(settings.frames_in_flight);
+	veng::BoundingVolumes volumes;
+	const veng::TransformHierarchy::Handle root = scene.Add(std::nullopt, glm::vec3(0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(kRootScale));
+	// Or the mesh grid instead, placed once
+	std::optional<MeshGrid> mesh_grid;
+	std::vector<veng::MeshId> streamed_meshes;
+	std::vector<veng::PointLight> lights;
+	if (mesh_file.has_value()) {
+		const veng::MeshFileHeader header = mesh_file->GetHeader();
+		veng::MeshId mesh = 0;
+		if (stream_mesh_count > 0) {
+			// The copies are restored from the shared mapping after an eviction
+			const std::shared_ptr<const veng::MeshFile> source = std::make_shared<const veng::MeshFile>(std::move(mesh_file.value()));
+			for (std::uint32_t i = 0; i < stream_mesh_count; i++) {
+				streamed_meshes.push_back(graphics.UploadStreamableMesh(source));
+			}
+			mesh = streamed_meshes.front();
+		}
+		else {
+			// Uploaded through its mapping, which can go once the copy is done
+			mesh = graphics.UploadMesh(mesh_file.value());
+		}
+		mesh_file.reset();
+		mesh_grid = PlaceMeshGrid(graphics, mesh, header, volumes);
+		if (graphics.IsOcclusionCullingEnabled()) {
+			PlaceMeshWalls(graphics, mesh_grid.value(), header);
+		}
+		lights = ScatterMeshLights(mesh_grid.value(), light_count);
+		SPDLOG_INFO("{} copies of {} with {} LODs", mesh_grid->models.size(), mesh_path->string(), graphics.GetMeshLods(mesh).size());
+	}
+	else {
+		for (std::uint32_t i = 0; i < kRingSize; i++) {
+			const std::float_t angle = glm::radians(360.0f) * static_cast<std::float_t>(i) / kRingSize;
+			scene.Add(root, glm::vec3(std::cos(angle) * 2.2f, std::sin(angle) * 1.4f, 0.5f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(kChildScale / kRootScale));
+		}
+		for (std::uint32_t i = 0; i < scene.Size(); i++) {
+			volumes.Add(glm::vec3(0.0f), 0.0f, glm::vec3(0.0f), glm::vec3(0.0f));
+		}
+	}
+	const std::size_t instance_count = volumes.Size();
+
+	const veng::Frustum clip_space = veng::Frustum::FromViewProjection(glm::mat4(1.0f));
+	const veng::CullingKernel kernel = veng::DetectCullingKernel();
+	bool first_frame_presented = false;
+	std::size_t shading_variant = 0;
+	// Oldest first, shifted by one every frame
+	std::array<std::float_t, kHudFrames> frame_times = {};
+	std::chrono::steady_clock::time_point last_frame_begin = std::chrono::steady_clock::now();
+	// Copies drawn after occlusion culling and copies in the frustum, summed over the frames
+	// that report them
+	std::uint64_t occlusion_frames = 0;
+	std::uint64_t occlusion_drawn = 0;
+	std::uint64_t frustum_frames = 0;
+	std::uint64_t frustum_visible = 0;
+
+	// Limited runs are the unattended ones
+	const bool frame_limited = frame_limit > 0;
+	veng::MainLoop loop(&window, loop_settings);
+	while (loop.WaitForNextFrame()) {
+		if (!streamed_meshes.empty()) {
+			// The copy not drawn for longest is the first to go, so under a low budget fill each
+			// comes back through an upload when its turn comes
+			const veng::MeshId mesh = streamed_meshes[static_cast<std::size_t>(glfwGetTime()) % streamed_meshes.size()];
+			if (mesh != mesh_grid->mesh) {
+				mesh_grid->mesh = mesh;
+				graphics.MarkSceneDirty();
+			}
+		}
+		if (cycle_shading) {
+			const std::size_t variant = static_cast<std::size_t>(glfwGetTime()) % settings.shading_variants.size();
+			if (variant != shading_variant) {
+				graphics.SetShadingVariant(settings.shading_variants[variant]);
+				shading_variant = variant;
+			}
+		}
+		const std::float_t time = static_cast<std::float_t>(glfwGetTime());
+		MeshCamera camera;
+		if (mesh_grid.has_value()) {
+			camera = OrbitMeshGrid(mesh_grid.value(), time, window.GetFramebufferSize());
+			if (!lights.empty()) {
+				// Into view space for the frame about to begin
+				graphics.SetLights(lights, camera.view, camera.projection);
+			}
+		}
+		if (!graphics.BeginFrame()) {
+			// The swapchain was recreated, or waits for the window to be restored, which
+			// WaitForNextFrame blocks on: draw again once it can
+			loop.RequestRedraw();
+			continue;
+		}
+		if (capture_writer.has_value()) {
+			graphics.CaptureFrame();
+		}
+		if (graphics.IsOcclusionCullingEnabled() && graphics.GetOcclusionStats().objects > 0) {
+			occlusion_frames++;
+			occlusion_drawn += graphics.GetOcclusionStats().drawn_early + graphics.GetOcclusionStats().drawn_late;
+		}
+
+		if (mesh_grid.has_value()) {
+			// The shaders take clip-space matrices
+			const gsl::span<glm::mat4> instances = graphics.GetInstanceBuffer();
+			for (std::size_t i = 0; i < mesh_grid->models.size(); i++) {
+				instances[i] = camera.view_projection * mesh_grid->models[i];
+			}
+			for (std::size_t i = 0; i < mesh_grid->walls.size(); i++) {
+				instances[mesh_grid->models.size() + i] = camera.view_projection * mesh_grid->walls[i];
+			}
+		}
+		else {
+			scene.SetRotation(root, glm::angleAxis(time * 0.5f, glm::vec3(0.0f, 0.0f, 1.0f)));
+			scene.Update(graphics.GetInstanceBuffer(), &jobs);
+		}
+
+		// Transient per-frame list: lives in the frame arena, no heap allocation
+		std::pmr::memory_resource* frame_memory = graphics.GetFrameMemory(jobs.GetCurrentThreadIndex());
+		std::pmr::vector<std::uint32_t> visible(volumes.Size(), frame_memory);
+		if (settings.reuse_scene_commands) {
+			// A culled list changes as the ring turns and would dirty the recordings every
+			// frame: draw every instance, the moving matrices are read at replay, and let the
+			// GPU clip. Nothing to prepare at all while replaying.
+			if (graphics.NeedsSceneDraws()) {
+				std::iota(visible.begin(), visible.end(), 0u);
+			}
+			else {
+				visible.clear();
+			}
+		}
+		else if (mesh_grid.has_value()) {
+			visible.resize(veng::CullFrustum(volumes, veng::Frustum::FromViewProjection(camera.view_projection), visible, kernel, jobs));
+		}
+		if (mesh_grid.has_value()) {
+			// Once for all passes and windows. Recorded draws keep the LODs they were recorded
+			// with until the scene is marked dirty.
+			const std::float_t viewport_height = static_cast<std::float_t>(window.GetFramebufferSize().y) * graphics.GetRenderScale();
+			SelectMeshLods(graphics, mesh_grid.value(), camera, viewport_height, visible);
+			if (graphics.IsOcclusionCullingEnabled()) {
+				frustum_frames++;
+				frustum_visible += visible.size();
+			}
+		}
+		else {
+			for (veng::TransformHierarchy::Handle node = 0; node < scene.Size(); node++) {
+				const glm::mat4& world = scene.GetWorldMatrix(node);
+				const glm::vec3 center(world[3]);
+				const std::float_t radius = kTriangleRadius * glm::length(glm::vec3(world[0]));
+				volumes.Set(node, center, radius, center - glm::vec3(radius), center + glm::vec3(radius));
+			}
+			visible.resize(veng::CullFrustum(volumes, clip_space, visible, kernel, jobs));
+		}
+
+		if (hud && graphics.IsOverlayEnabled()) {
+			const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			std::copy(frame_times.begin() + 1, frame_times.end(), frame_times.begin());
+			frame_times.back() = static_cast<std::float_t>(Milliseconds(now - last_frame_begin).count());
+			last_frame_begin = now;
+			// Recorded draws cover every instance
+			DrawHud(graphics, frame_times, settings.reuse_scene_commands ? instance_count : visible.size(), instance_count);
+		}
+
+		for (std::uint32_t i = 0; i < graphics.GetWindowCount(); i++) {
+			if (i > 0 && !graphics.BeginWindow(i)) {
+				continue;
+			}
+			const auto draw_scene = [&] {
+				if (mesh_grid.has_value()) {
+					// The culling pass covers the primary window only
+					DrawMeshWalls(graphics, mesh_grid.value());
+					if (graphics.IsOcclusionCullingEnabled() && i == 0) {
+						DrawMeshGridOcclusionCulled(graphics, mesh_grid.value(), camera, frame_memory);
+					}
+					else {
+						DrawMeshGrid(graphics, mesh_grid.value(), visible, frame_memory);
+					}
+				}
+				else {
+					graphics.RenderTriangleInstances(visible);
+				}
+			};
+			if (settings.depth_prepass) {
+				draw_scene();
+				graphics.BeginMainPass();
+			}
+			draw_scene();
+		}
+
+		graphics.EndFrame();
+
+		if (!first_frame_presented) {
+			SPDLOG_INFO("Time to first frame: {:.2f} ms", Milliseconds(std::chrono::steady_clock::now() - startup_begin).count());
+			first_frame_presented = true;
+		}
+		if (frame_limit > 0 && --frame_limit == 0) {
+			break;
+		}
+	}
+
+	// The last frames_in_flight captures are still on their way
+	graphics.FlushReadbacks();
+	if (settings.track_host_allocations) {
+		graphics.LogHostAllocationStats();
+	}
+	if (cycle_shading) {
+		const veng::ShaderVariantStats variants = graphics.GetShaderVariantStats();
+		SPDLOG_INFO("Shading variants: {} cache hits, {} compiled on demand", variants.hits, variants.compiled_on_demand);
+	}
+	if (log_memory_budget || !streamed_meshes.empty()) {
+		graphics.LogMemoryBudgets();
+	}
+	if (settings.pipeline_statistics) {
+		graphics.LogPipelineStatistics();
+	}
+	if (!lights.empty()) {
+		SPDLOG_INFO("{} lights: {:.3f} ms light clustering, {:.3f} ms scene on the GPU", lights.size(), graphics.GetGpuLightClusteringTime(), graphics.GetGpuSceneTime());
+	}
+	if (occlusion_frames > 0 && frustum_frames > 0) {
+		const std::double_t drawn = static_cast<std::double_t>(occlusion_drawn) / static_cast<std::double_t>(occlusion_frames);
+		const std::double_t in_frustum = static_cast<std::double_t>(frustum_visible) / static_cast<std::double_t>(frustum_frames);
+		SPDLOG_INFO("Occlusion culling: {:.1f} copies drawn per frame, {:.1f} in the frustum", drawn, in_frustum);
+		if (frame_limited && drawn >= in_frustum) {
+			SPDLOG_ERROR("Occlusion culling drew no fewer copies than frustum culling");
+			return EXIT_FAILURE;
+		}
+	}
+	if (frame_limited && graphics.GetAllocatingFrameCount() > 0) {
+		SPDLOG_ERROR("{} frames allocated from the heap", graphics.GetAllocatingFrameCount());
+		return EXIT_FAILURE;
 	}
 
 	return EXIT_SUCCESS;
@@ -0,0 +1,279 @@
+#include <precomp.h>
+#include <main_loop.h>
+#include <GLFW/glfw3.h>
+#include <spdlog/spdlog.h>
+#include <thread>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+namespace veng {
+
+// CPU time of all threads of the process, in seconds
+static std::double_t GetProcessCpuSeconds()
+{
+#if defined(_WIN32)
+	FILETIME creation, exit, kernel, user;
+	if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) {
+		return 0.0;
+	}
+	const auto to_ticks = [](const FILETIME& time) { return (std::uint64_t(time.dwHighDateTime) << 32) | time.dwLowDateTime; };
+	return static_cast<std::double_t>(to_ticks(kernel) + to_ticks(user)) * 100e-9;
+#else
+	timespec time;
+	if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time) != 0) {
+		return 0.0;
+	}
+	return static_cast<std::double_t>(time.tv_sec) + static_cast<std::double_t>(time.tv_nsec) * 1e-9;
+#endif
+}
+
+gsl::czstring GetLoopModeName(LoopMode mode)
+{
+	switch (mode) {
+		case LoopMode::kContinuous:
+			return "continuous";
+		case LoopMode::kCapped:
+			return "capped";
+		case LoopMode::kOnDemand:
+			return "on-demand";
+	}
+	return "unknown";
+}
+
+std::optional<LoopMode> ParseLoopMode(std::string_view name)
+{
+	for (LoopMode mode : {LoopMode::kContinuous, LoopMode::kCapped, LoopMode::kOnDemand}) {
+		if (name == GetLoopModeName(mode)) {
+			return mode;
+		}
+	}
+	return std::nullopt;
+}
+
+MainLoop::MainLoop(gsl::not_null<Window*> window, MainLoopSettings settings) : window_(window), settings_(settings)
+{
+	Expects(settings_.target_fps > 0.0);
+
+	// Any of these means the picture may have changed; wake up and redraw
+	GLFWwindow* handle = window_->GetHandle();
+	glfwSetWindowUserPointer(handle, this);
+	glfwSetWindowRefreshCallback(handle, [](GLFWwindow* window) { OnWindowEvent(window); });
+	glfwSetFramebufferSizeCallback(handle, [](GLFWwindow* window, int, int) { OnWindowEvent(window); });
+	glfwSetWindowFocusCallback(handle, [](GLFWwindow* window, int) { OnWindowEvent(window); });
+	glfwSetKeyCallback(handle, [](GLFWwindow* window, int, int, int, int) { OnWindowEvent(window); });
+	glfwSetMouseButtonCallback(handle, [](GLFWwindow* window, int, int, int) { OnWindowEvent(window); });
+	glfwSetCursorPosCallback(handle, [](GLFWwindow* window, double, double) { OnWindowEvent(window); });
+	glfwSetScrollCallback(handle, [](GLFWwindow* window, double, double) { OnWindowEvent(window); });
+
+	const Clock::time_point now = Clock::now();
+	next_frame_ = now;
+	last_account_wall_ = now;
+	last_account_cpu_ = GetProcessCpuSeconds();
+	interval_begin_ = now;
+
+	SPDLOG_INFO("Main loop mode: {}", GetLoopModeName(settings_.mode));
+}
+
+MainLoop::~MainLoop()
+{
+	Account();
+	for (std::size_t mode = 0; mode < kModeCount; mode++) {
+		if (totals_[mode].wall_time > Clock::duration::zero()) {
+			LogStats("total", static_cast<LoopMode>(mode), totals_[mode]);
+		}
+	}
+
+	GLFWwindow* handle = window_->GetHandle();
+	glfwSetWindowRefreshCallback(handle, nullptr);
+	glfwSetFramebufferSizeCallback(handle, nullptr);
+	glfwSetWindowFocusCallback(handle, nullptr);
+	glfwSetKeyCallback(handle, nullptr);
+	glfwSetMouseButtonCallback(handle, nullptr);
+	glfwSetCursorPosCallback(handle, nullptr);
+	glfwSetScrollCallback(handle, nullptr);
+	glfwSetWindowUserPointer(handle, nullptr);
+}
+
+bool MainLoop::WaitForNextFrame()
+{
+	WaitWhileMinimized();
+	switch (settings_.mode) {
+		case LoopMode::kContinuous:
+			glfwPollEvents();
+			break;
+		case LoopMode::kCapped: {
+			const Clock::duration period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<std::double_t>(1.0 / settings_.target_fps));
+			next_frame_ += period;
+			const Clock::time_point now = Clock::now();
+			// Fell behind by more than a frame: start over instead of rendering a burst to catch up
+			if (next_frame_ + period < now) {
+				next_frame_ = now;
+			}
+			SleepUntil(next_frame_);
+			glfwPollEvents();
+			break;
+		}
+		case LoopMode::kOnDemand:
+			glfwPollEvents();
+			WaitUntilDirty();
+			break;
+	}
+
+	Account();
+	interval_.frames++;
+	totals_[static_cast<std::size_t>(settings_.mode)].frames++;
+
+	if (last_account_wall_ - interval_begin_ >= settings_.report_interval) {
+		LogStats("last interval", settings_.mode, interval_);
+		interval_ = {};
+		interval_begin_ = last_account_wall_;
+	}
+
+	return !window_->ShouldClose();
+}
+
+void MainLoop::RequestRedraw()
+{
+	dirty_ = true;
+	// Wakes glfwWaitEventsTimeout; safe from any thread
+	glfwPostEmptyEvent();
+}
+
+void MainLoop::ScheduleRedraw(Clock::duration delay)
+{
+	const Clock::time_point deadline = Clock::now() + delay;
+	if (!scheduled_redraw_.has_value() || deadline < scheduled_redraw_.value()) {
+		scheduled_redraw_ = deadline;
+	}
+}
+
+void MainLoop::SetMode(LoopMode mode)
+{
+	if (mode == settings_.mode) {
+		return;
+	}
+
+	Account();
+	if (interval_.frames > 0) {
+		LogStats("last interval", settings_.mode, interval_);
+	}
+	interval_ = {};
+	interval_begin_ = last_account_wall_;
+
+	settings_.mode = mode;
+	next_frame_ = Clock::now();
+	dirty_ = true;
+	SPDLOG_INFO("Main loop mode: {}", GetLoopModeName(mode));
+}
+
+void MainLoop::SetTargetFps(std::double_t fps)
+{
+	Expects(fps > 0.0);
+	settings_.target_fps = fps;
+}
+
+void MainLoop::OnWindowEvent(GLFWwindow* window)
+{
+	static_cast<MainLoop*>(glfwGetWindowUserPointer(window))->dirty_ = true;
+}
+
+void MainLoop::WaitUntilDirty()
+{
+	while (!window_->ShouldClose()) {
+		const Clock::time_point now = Clock::now();
+		if (scheduled_redraw_.has_value() && scheduled_redraw_.value() <= now) {
+			scheduled_redraw_.reset();
+			dirty_ = true;
+		}
+		if (dirty_.exchange(false)) {
+			return;
+		}
+
+		Clock::duration timeout = settings_.max_idle_wait;
+		if (scheduled_redraw_.has_value()) {
+			timeout = std::min(timeout, scheduled_redraw_.value() - now);
+		}
+		glfwWaitEventsTimeout(std::chrono::duration<std::double_t>(timeout).count());
+	}
+}
+
+void MainLoop::WaitWhileMinimized()
+{
+	// Restoring the window resizes its framebuffer, whose callback marks it dirty
+	for (;;) {
+		const glm::ivec2 size = window_->GetFramebufferSize();
+		if ((size.x > 0 && size.y > 0) || window_->ShouldClose()) {
+			return;
+		}
+		glfwWaitEvents();
+	}
+}
+
+void MainLoop::SleepUntil(Clock::time_point deadline)
+{
+	// OS sleeps overshoot by a scheduler tick or more: sleep in 1 ms steps while the expected
+	// cost of one more step still fits, then spin for the last stretch
+	for (;;) {
+		const std::double_t remaining = std::chrono::duration<std::double_t>(deadline - Clock::now()).count();
+		if (remaining <= sleep_estimate_) {
+			break;
+		}
+
+		const Clock::time_point begin = Clock::now();
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		const std::double_t observed = std::chrono::duration<std::double_t>(Clock::now() - begin).count();
+
+		// Welford's update; the estimate is one standard deviation above the mean
+		sleep_samples_++;
+		const std::double_t delta = observed - sleep_mean_;
+		sleep_mean_ += delta / static_cast<std::double_t>(sleep_samples_);
+		sleep_m2_ += delta * (observed - sleep_mean_);
+		sleep_estimate_ = sleep_mean_ + std::sqrt(sleep_m2_ / static_cast<std::double_t>(sleep_samples_ - 1));
+	}
+
+	while (Clock::now() < deadline) {
+		std::this_thread::yield();
+	}
+}
+
+void MainLoop::Account()
+{
+	const Clock::time_point wall = Clock::now();
+	const std::double_t cpu = GetProcessCpuSeconds();
+
+	ModeStats& total = totals_[static_cast<std::size_t>(settings_.mode)];
+	interval_.wall_time += wall - last_account_wall_;
+	interval_.cpu_seconds += cpu - last_account_cpu_;
+	total.wall_time += wall - last_account_wall_;
+	total.cpu_seconds += cpu - last_account_cpu_;
+
+	last_account_wall_ = wall;
+	last_account_cpu_ = cpu;
+}
+
+void MainLoop::LogStats(gsl::czstring label, LoopMode mode, const ModeStats& stats) const
+{
+	const std::double_t wall_seconds = std::chrono::duration<std::double_t>(stats.wall_time).count();
+	if (wall_seconds <= 0.0) {
+		return;
+	}
+
+	// 100% is one fully busy core; the process total may exceed it with worker threads
+	const std::double_t cpu_percent = 100.0 * stats.cpu_seconds / wall_seconds;
+	const std::double_t core_count = static_cast<std::double_t>(std::max(1u, std::thread::hardware_concurrency()));
+	SPDLOG_INFO("Main loop [{}, {}]: {:.1f} fps over {:.1f} s, CPU {:.1f}% of one core ({:.1f}% of the machine)",
+	    GetLoopModeName(mode),
+	    label,
+	    static_cast<std::double_t>(stats.frames) / wall_seconds,
+	    wall_seconds,
+	    cpu_percent,
+	    cpu_percent / core_count);
+}
+
+}  // namespace veng
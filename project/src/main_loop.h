@@ -0,0 +1,97 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <glfw_window.h>
+#include <optional>
+
+namespace veng {
+
+enum class LoopMode {
+	kContinuous,  // poll events and render as fast as presentation allows
+	kCapped,      // render at most target_fps, sleeping in between
+	kOnDemand,    // block in glfwWaitEventsTimeout until input or RequestRedraw()
+};
+
+gsl::czstring GetLoopModeName(LoopMode mode);
+// Accepts the names above: "continuous", "capped" and "on-demand"
+std::optional<LoopMode> ParseLoopMode(std::string_view name);
+
+struct MainLoopSettings {
+	LoopMode mode = LoopMode::kContinuous;
+	std::double_t target_fps = 60.0;
+	// Longest single wait in on-demand mode, so ShouldClose() and scheduled redraws are seen
+	// even without events
+	std::chrono::steady_clock::duration max_idle_wait = std::chrono::milliseconds(500);
+	// How often frame rate and CPU utilization of the current mode are logged
+	std::chrono::steady_clock::duration report_interval = std::chrono::seconds(10);
+};
+
+// Decides when the next frame starts: handles window events and idles according to the mode,
+// and tracks frame rate and process CPU time per mode. Installs the window's refresh, resize,
+// focus and input callbacks to mark it dirty. Main thread only, except RequestRedraw().
+class MainLoop {
+public:
+	using Clock = std::chrono::steady_clock;
+
+	MainLoop(gsl::not_null<Window*> window, MainLoopSettings settings = {});
+	// Logs the totals of every mode that was used
+	~MainLoop();
+
+	MainLoop(const MainLoop&) = delete;
+	MainLoop& operator=(const MainLoop&) = delete;
+
+	// Processes pending events and waits until a frame is due; blocks on events while the
+	// window is minimized, in every mode. Returns false once the window should close.
+	bool WaitForNextFrame();
+
+	// Marks the window dirty so on-demand mode renders another frame. Thread-safe.
+	void RequestRedraw();
+	// Redraw no later than `delay` from now, e.g. for a blinking cursor or a clock
+	void ScheduleRedraw(Clock::duration delay);
+
+	void SetMode(LoopMode mode);
+	LoopMode GetMode() const { return settings_.mode; }
+	void SetTargetFps(std::double_t fps);
+
+private:
+	struct ModeStats {
+		Clock::duration wall_time = Clock::duration::zero();
+		std::double_t cpu_seconds = 0.0;
+		std::uint64_t frames = 0;
+	};
+
+	static constexpr std::size_t kModeCount = 3;
+
+	static void OnWindowEvent(GLFWwindow* window);
+	// A 0x0 framebuffer has no swapchain to draw into
+	void WaitWhileMinimized();
+	void WaitUntilDirty();
+	void SleepUntil(Clock::time_point deadline);
+	// Charges the time since the last call to the current mode
+	void Account();
+	void LogStats(gsl::czstring label, LoopMode mode, const ModeStats& stats) const;
+
+	gsl::not_null<Window*> window_;
+	MainLoopSettings settings_;
+
+	std::atomic<bool> dirty_ = true;
+	std::optional<Clock::time_point> scheduled_redraw_;
+	Clock::time_point next_frame_;
+
+	// Running mean and variance of how long a 1 ms sleep really takes, so SleepUntil knows
+	// when to stop sleeping and spin for the remainder
+	std::double_t sleep_estimate_ = 0.005;
+	std::double_t sleep_mean_ = 0.005;
+	std::double_t sleep_m2_ = 0.0;
+	std::uint64_t sleep_samples_ = 1;
+
+	Clock::time_point last_account_wall_;
+	std::double_t last_account_cpu_ = 0.0;
+	Clock::time_point interval_begin_;
+	ModeStats interval_;
+	std::array<ModeStats, kModeCount> totals_ = {};
+};
+
+}  // namespace veng
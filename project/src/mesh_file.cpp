@@ -0,0 +1,189 @@
+#include <precomp.h>
+#include <mesh_file.h>
+#include <algorithm>
+#include <spdlog/spdlog.h>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace veng {
+
+#pragma region MAPPED_FILE
+
+std::optional<MappedFile> MappedFile::Open(const std::filesystem::path& path)
+{
+	MappedFile mapped;
+
+#if defined(_WIN32)
+	HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		return std::nullopt;
+	}
+	const auto close_file = gsl::finally([file]() { CloseHandle(file); });
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+		return std::nullopt;
+	}
+	// The view keeps the mapping object alive, so neither handle is needed afterwards
+	HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr) {
+		return std::nullopt;
+	}
+	const auto close_mapping = gsl::finally([mapping]() { CloseHandle(mapping); });
+
+	mapped.data_ = static_cast<const std::uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	mapped.size_ = static_cast<std::size_t>(size.QuadPart);
+#else
+	const int file = open(path.c_str(), O_RDONLY);
+	if (file < 0) {
+		return std::nullopt;
+	}
+	const auto close_file = gsl::finally([file]() { close(file); });
+
+	struct stat status;
+	if (fstat(file, &status) != 0 || status.st_size == 0) {
+		return std::nullopt;
+	}
+	void* data = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+	if (data == MAP_FAILED) {
+		return std::nullopt;
+	}
+	mapped.data_ = static_cast<const std::uint8_t*>(data);
+	mapped.size_ = static_cast<std::size_t>(status.st_size);
+#endif
+
+	if (mapped.data_ == nullptr) {
+		return std::nullopt;
+	}
+	return mapped;
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept : data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)) {}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+	if (this != &other) {
+		Unmap();
+		data_ = std::exchange(other.data_, nullptr);
+		size_ = std::exchange(other.size_, 0);
+	}
+	return *this;
+}
+
+MappedFile::~MappedFile()
+{
+	Unmap();
+}
+
+void MappedFile::Unmap()
+{
+	if (data_ == nullptr) {
+		return;
+	}
+#if defined(_WIN32)
+	UnmapViewOfFile(data_);
+#else
+	munmap(const_cast<std::uint8_t*>(data_), size_);
+#endif
+	data_ = nullptr;
+	size_ = 0;
+}
+
+#pragma endregion
+
+#pragma region MESH_FILE
+
+// Written so that nothing can wrap around, whatever the header holds
+static bool IsRangeInBounds(std::uint64_t offset, std::uint64_t byte_count, std::uint64_t size)
+{
+	return offset <= size && byte_count <= size - offset;
+}
+
+// An out-of-range index would have the GPU read past the vertex buffer
+template <typename Index>
+static bool AreIndicesInRange(gsl::span<const std::uint8_t> bytes, std::uint32_t vertex_count)
+{
+	const gsl::span<const Index> indices(reinterpret_cast<const Index*>(bytes.data()), bytes.size() / sizeof(Index));
+	return std::all_of(indices.begin(), indices.end(), [vertex_count](Index index) { return index < vertex_count; });
+}
+
+std::optional<MeshFile> MeshFile::Open(const std::filesystem::path& path)
+{
+	std::optional<MappedFile> file = MappedFile::Open(path);
+	if (!file.has_value()) {
+		SPDLOG_ERROR("Could not map mesh {}", path.string());
+		return std::nullopt;
+	}
+
+	// The header, the LOD table and the indices are validated; the vertex data is trusted
+	const gsl::span<const std::uint8_t> bytes = file->GetBytes();
+	if (bytes.size() < sizeof(MeshFileHeader)) {
+		SPDLOG_ERROR("Mesh {} is too small for its header", path.string());
+		return std::nullopt;
+	}
+	const MeshFileHeader& header = *reinterpret_cast<const MeshFileHeader*>(bytes.data());
+	if (header.magic != kMeshFileMagic || header.version != kMeshFileVersion) {
+		SPDLOG_ERROR("Mesh {} is not a version {} cooked mesh", path.string(), kMeshFileVersion);
+		return std::nullopt;
+	}
+
+	const std::uint64_t vertex_bytes = std::uint64_t(header.vertex_count) * header.vertex_stride;
+	const std::uint64_t index_bytes = std::uint64_t(header.index_count) * header.index_size;
+	const std::uint64_t lod_bytes = std::uint64_t(header.lod_count) * sizeof(MeshLod);
+	const bool aligned = header.vertex_offset % kMeshDataAlignment == 0 && header.index_offset % kMeshDataAlignment == 0 && header.lod_offset % kMeshDataAlignment == 0;
+	const bool in_bounds = IsRangeInBounds(header.vertex_offset, vertex_bytes, bytes.size()) && IsRangeInBounds(header.index_offset, index_bytes, bytes.size()) &&
+	                       IsRangeInBounds(header.lod_offset, lod_bytes, bytes.size());
+	const bool lods_valid = header.lod_count >= 1 && header.lod_count <= kMaxMeshLods;
+	if (header.vertex_stride != sizeof(PackedVertex) || (header.index_size != 2 && header.index_size != 4) || !aligned || !in_bounds || !lods_valid) {
+		SPDLOG_ERROR("Mesh {} is truncated or has an invalid layout", path.string());
+		return std::nullopt;
+	}
+
+	// The mapping does not move with the MeshFile, so `header` stays valid
+	MeshFile mesh(std::move(file.value()));
+	for (const MeshLod& lod : mesh.GetLods()) {
+		if (std::uint64_t(lod.first_index) + lod.index_count > header.index_count || lod.index_count == 0 || lod.index_count % 3 != 0) {
+			SPDLOG_ERROR("Mesh {} has an LOD outside its index buffer", path.string());
+			return std::nullopt;
+		}
+	}
+	// Touches every index page, which the upload does right after anyway
+	const bool indices_valid = header.index_size == 2 ? AreIndicesInRange<std::uint16_t>(mesh.GetIndexBytes(), header.vertex_count)
+	                                                  : AreIndicesInRange<std::uint32_t>(mesh.GetIndexBytes(), header.vertex_count);
+	if (!indices_valid) {
+		SPDLOG_ERROR("Mesh {} has an index past its last vertex", path.string());
+		return std::nullopt;
+	}
+	return mesh;
+}
+
+gsl::span<const std::uint8_t> MeshFile::GetVertexBytes() const
+{
+	const MeshFileHeader& header = GetHeader();
+	return file_.GetBytes().subspan(header.vertex_offset, std::size_t(header.vertex_count) * header.vertex_stride);
+}
+
+gsl::span<const std::uint8_t> MeshFile::GetIndexBytes() const
+{
+	const MeshFileHeader& header = GetHeader();
+	return file_.GetBytes().subspan(header.index_offset, std::size_t(header.index_count) * header.index_size);
+}
+
+gsl::span<const MeshLod> MeshFile::GetLods() const
+{
+	const MeshFileHeader& header = GetHeader();
+	return {reinterpret_cast<const MeshLod*>(file_.GetBytes().data() + header.lod_offset), header.lod_count};
+}
+
+#pragma endregion
+
+}  // namespace veng
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <filesystem>
+#include <mesh_format.h>
+#include <optional>
+
+namespace veng {
+
+// Read-only memory mapping of a whole file. Pages are only read when touched, so mapping a
+// large file is cheap until its contents are used.
+class MappedFile {
+public:
+	static std::optional<MappedFile> Open(const std::filesystem::path& path);
+
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator=(MappedFile&& other) noexcept;
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	gsl::span<const std::uint8_t> GetBytes() const { return {data_, size_}; }
+
+private:
+	MappedFile() = default;
+	void Unmap();
+
+	const std::uint8_t* data_ = nullptr;
+	std::size_t size_ = 0;
+};
+
+// A cooked mesh (mesh_format.h) viewed in place: the vertex and index spans point into the
+// mapping and can be copied to GPU buffers without any parsing.
+class MeshFile {
+public:
+	// Logs and returns nothing if the file is missing, from another version, or truncated
+	static std::optional<MeshFile> Open(const std::filesystem::path& path);
+
+	const MeshFileHeader& GetHeader() const { return *reinterpret_cast<const MeshFileHeader*>(file_.GetBytes().data()); }
+	gsl::span<const std::uint8_t> GetVertexBytes() const;
+	gsl::span<const std::uint8_t> GetIndexBytes() const;
+	gsl::span<const MeshLod> GetLods() const;
+
+private:
+	explicit MeshFile(MappedFile file) : file_(std::move(file)) {}
+
+	MappedFile file_;
+};
+
+}  // namespace veng
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <array>
+
+namespace veng {
+
+// Layout of the cooked meshes written by veng_meshcook (tools/meshcook). The file is the
+// header followed by the LOD table, vertex and index data at aligned offsets, so a memory
+// mapping can be handed to the GPU upload as is. Little-endian throughout.
+
+constexpr std::uint32_t kMeshFileMagic = 0x48534D56;  // "VMSH"
+constexpr std::uint32_t kMeshFileVersion = 2;
+// Alignment of every data block, enough for any vertex attribute and for copy offsets
+constexpr std::uint64_t kMeshDataAlignment = 16;
+constexpr std::uint32_t kMaxMeshLods = 8;
+
+struct MeshFileHeader {
+	std::uint32_t magic = kMeshFileMagic;
+	std::uint32_t version = kMeshFileVersion;
+	std::uint32_t vertex_count = 0;
+	std::uint32_t index_count = 0;
+	std::uint32_t vertex_stride = 0;
+	std::uint32_t index_size = 0;  // 2 or 4 bytes, matching VK_INDEX_TYPE_UINT16/UINT32
+	std::uint64_t vertex_offset = 0;
+	std::uint64_t index_offset = 0;
+	// Quantized positions are relative to these bounds
+	glm::vec3 bounds_min = glm::vec3(0.0f);
+	glm::vec3 bounds_max = glm::vec3(0.0f);
+	std::uint64_t lod_offset = 0;
+	std::uint32_t lod_count = 0;  // 1 to kMaxMeshLods
+	std::uint32_t reserved = 0;
+};
+
+static_assert(sizeof(MeshFileHeader) == 80, "MeshFileHeader is a file format");
+
+// One level of detail: a range of the shared index buffer, finest first. Every LOD indexes
+// the same vertices, so switching LODs only changes the draw's index range.
+struct MeshLod {
+	std::uint32_t first_index = 0;
+	std::uint32_t index_count = 0;
+	// Estimated deviation from the full surface, in the units of the source positions; 0 for
+	// LOD 0. The largest, over all collapses, of the moved vertex's area-weighted RMS distance
+	// to the original triangle planes it absorbed. Not a bound: single points may stray further.
+	std::float_t error = 0.0f;
+};
+
+static_assert(sizeof(MeshLod) == 12, "MeshLod is a file format");
+
+// 16 bytes per vertex instead of 32 for the float attributes. Vertex input formats:
+//   position  VK_FORMAT_R16G16B16A16_UNORM, w is 0; world = mix(bounds_min, bounds_max, xyz)
+//   normal    VK_FORMAT_A2B10G10R10_SNORM_PACK32, w is 0
+//   uv        VK_FORMAT_R16G16_SFLOAT
+struct PackedVertex {
+	std::array<std::uint16_t, 4> position = {};
+	std::uint32_t normal = 0;
+	std::array<std::uint16_t, 2> uv = {};
+};
+
+static_assert(sizeof(PackedVertex) == 16, "PackedVertex is a file format");
+
+constexpr std::uint64_t AlignMeshOffset(std::uint64_t offset)
+{
+	return (offset + kMeshDataAlignment - 1) & ~(kMeshDataAlignment - 1);
+}
+
+}  // namespace veng
@@ -0,0 +1,236 @@
+#include <precomp.h>
+#include <overlay.h>
+#include <algorithm>
+#include <array>
+
+namespace veng {
+
+namespace {
+
+// Rows top to bottom, the leftmost pixel in bit 4
+using Glyph = std::array<std::uint8_t, GlyphAtlas::kGlyphHeight>;
+
+constexpr std::array<Glyph, GlyphAtlas::kCharacterCount> kFont = {{
+	{{0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}},  //  
+	{{0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04}},  // !
+	{{0x0A, 0x0A, 0x0A, 0x00, 0x00, 0x00, 0x00}},  // "
+	{{0x0A, 0x0A, 0x1F, 0x0A, 0x1F, 0x0A, 0x0A}},  // #
+	{{0x04, 0x0F, 0x14, 0x0E, 0x05, 0x1E, 0x04}},  // $
+	{{0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03}},  // %
+	{{0x0C, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0D}},  // &
+	{{0x04, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00}},  // '
+	{{0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02}},  // (
+	{{0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08}},  // )
+	{{0x00, 0x04, 0x15, 0x0E, 0x15, 0x04, 0x00}},  // *
+	{{0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00}},  // +
+	{{0x00, 0x00, 0x00, 0x00, 0x0C, 0x04, 0x08}},  // ,
+	{{0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00}},  // -
+	{{0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C}},  // .
+	{{0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00}},  // /
+	{{0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E}},  // 0
+	{{0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E}},  // 1
+	{{0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F}},  // 2
+	{{0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E}},  // 3
+	{{0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02}},  // 4
+	{{0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E}},  // 5
+	{{0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E}},  // 6
+	{{0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08}},  // 7
+	{{0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E}},  // 8
+	{{0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C}},  // 9
+	{{0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00}},  // :
+	{{0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x04, 0x08}},  // ;
+	{{0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02}},  // <
+	{{0x00, 0x00, 0x1F, 0x00, 0x1F, 0x00, 0x00}},  // =
+	{{0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08}},  // >
+	{{0x0E, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04}},  // ?
+	{{0x0E, 0x11, 0x01, 0x0D, 0x15, 0x15, 0x0E}},  // @
+	{{0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11}},  // A
+	{{0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E}},  // B
+	{{0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E}},  // C
+	{{0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C}},  // D
+	{{0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F}},  // E
+	{{0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10}},  // F
+	{{0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F}},  // G
+	{{0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11}},  // H
+	{{0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E}},  // I
+	{{0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C}},  // J
+	{{0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11}},  // K
+	{{0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F}},  // L
+	{{0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11}},  // M
+	{{0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11}},  // N
+	{{0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E}},  // O
+	{{0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10}},  // P
+	{{0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D}},  // Q
+	{{0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11}},  // R
+	{{0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E}},  // S
+	{{0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04}},  // T
+	{{0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E}},  // U
+	{{0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04}},  // V
+	{{0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A}},  // W
+	{{0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11}},  // X
+	{{0x11, 0x11, 0x0A, 0x04, 0x04, 0x04, 0x04}},  // Y
+	{{0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F}},  // Z
+	{{0x0E, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0E}},  // [
+	{{0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00}},  // backslash
+	{{0x0E, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0E}},  // ]
+	{{0x04, 0x0A, 0x11, 0x00, 0x00, 0x00, 0x00}},  // ^
+	{{0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F}},  // _
+	{{0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00}},  // `
+	{{0x00, 0x00, 0x0E, 0x01, 0x0F, 0x11, 0x0F}},  // a
+	{{0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x1E}},  // b
+	{{0x00, 0x00, 0x0E, 0x10, 0x10, 0x11, 0x0E}},  // c
+	{{0x01, 0x01, 0x0D, 0x13, 0x11, 0x11, 0x0F}},  // d
+	{{0x00, 0x00, 0x0E, 0x11, 0x1F, 0x10, 0x0E}},  // e
+	{{0x06, 0x09, 0x08, 0x1C, 0x08, 0x08, 0x08}},  // f
+	{{0x00, 0x0F, 0x11, 0x11, 0x0F, 0x01, 0x0E}},  // g
+	{{0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x11}},  // h
+	{{0x04, 0x00, 0x0C, 0x04, 0x04, 0x04, 0x0E}},  // i
+	{{0x02, 0x00, 0x06, 0x02, 0x02, 0x12, 0x0C}},  // j
+	{{0x10, 0x10, 0x12, 0x14, 0x18, 0x14, 0x12}},  // k
+	{{0x0C, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E}},  // l
+	{{0x00, 0x00, 0x1A, 0x15, 0x15, 0x11, 0x11}},  // m
+	{{0x00, 0x00, 0x16, 0x19, 0x11, 0x11, 0x11}},  // n
+	{{0x00, 0x00, 0x0E, 0x11, 0x11, 0x11, 0x0E}},  // o
+	{{0x00, 0x00, 0x1E, 0x11, 0x1E, 0x10, 0x10}},  // p
+	{{0x00, 0x00, 0x0D, 0x13, 0x0F, 0x01, 0x01}},  // q
+	{{0x00, 0x00, 0x16, 0x19, 0x10, 0x10, 0x10}},  // r
+	{{0x00, 0x00, 0x0E, 0x10, 0x0E, 0x01, 0x1E}},  // s
+	{{0x08, 0x08, 0x1C, 0x08, 0x08, 0x09, 0x06}},  // t
+	{{0x00, 0x00, 0x11, 0x11, 0x11, 0x13, 0x0D}},  // u
+	{{0x00, 0x00, 0x11, 0x11, 0x11, 0x0A, 0x04}},  // v
+	{{0x00, 0x00, 0x11, 0x11, 0x15, 0x15, 0x0A}},  // w
+	{{0x00, 0x00, 0x11, 0x0A, 0x04, 0x0A, 0x11}},  // x
+	{{0x00, 0x00, 0x11, 0x11, 0x0F, 0x01, 0x0E}},  // y
+	{{0x00, 0x00, 0x1F, 0x02, 0x04, 0x08, 0x1F}},  // z
+	{{0x02, 0x04, 0x04, 0x08, 0x04, 0x04, 0x02}},  // {
+	{{0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04}},  // |
+	{{0x08, 0x04, 0x04, 0x02, 0x04, 0x04, 0x08}},  // }
+	{{0x00, 0x00, 0x08, 0x15, 0x02, 0x00, 0x00}},  // ~
+}};
+
+// The cell after the last glyph is solid
+constexpr std::uint32_t kSolidCell = GlyphAtlas::kCharacterCount;
+
+glm::uvec2 GetCellOrigin(std::uint32_t cell)
+{
+	return {(cell % GlyphAtlas::kColumns) * GlyphAtlas::kCellWidth, (cell / GlyphAtlas::kColumns) * GlyphAtlas::kCellHeight};
+}
+
+std::uint32_t GetCell(char character)
+{
+	const std::uint32_t index = static_cast<std::uint32_t>(static_cast<unsigned char>(character)) - static_cast<std::uint32_t>(GlyphAtlas::kFirstCharacter);
+	return index < GlyphAtlas::kCharacterCount ? index : static_cast<std::uint32_t>('?' - GlyphAtlas::kFirstCharacter);
+}
+
+}  // namespace
+
+std::uint32_t PackOverlayColor(const glm::vec4& color)
+{
+	const glm::uvec4 bytes = glm::uvec4(glm::clamp(color, 0.0f, 1.0f) * 255.0f + 0.5f);
+	return bytes.x | (bytes.y << 8) | (bytes.z << 16) | (bytes.w << 24);
+}
+
+GlyphAtlas BakeGlyphAtlas()
+{
+	constexpr std::uint32_t kCells = GlyphAtlas::kCharacterCount + 1;
+	GlyphAtlas atlas;
+	atlas.extent = {GlyphAtlas::kColumns * GlyphAtlas::kCellWidth, (kCells + GlyphAtlas::kColumns - 1) / GlyphAtlas::kColumns * GlyphAtlas::kCellHeight};
+	atlas.pixels.resize(static_cast<std::size_t>(atlas.extent.x) * atlas.extent.y, 0);
+	for (std::uint32_t cell = 0; cell < kCells; cell++) {
+		const glm::uvec2 origin = GetCellOrigin(cell);
+		for (std::uint32_t y = 0; y < GlyphAtlas::kGlyphHeight; y++) {
+			for (std::uint32_t x = 0; x < GlyphAtlas::kGlyphWidth; x++) {
+				const bool set = cell == kSolidCell || (kFont[cell][y] >> (GlyphAtlas::kGlyphWidth - 1 - x) & 1) != 0;
+				atlas.pixels[static_cast<std::size_t>(origin.y + y) * atlas.extent.x + origin.x + x] = set ? 255 : 0;
+			}
+		}
+	}
+	return atlas;
+}
+
+OverlayBatch::OverlayBatch(gsl::span<OverlayVertex> vertices, glm::uvec2 atlas_extent)
+    : vertices_(vertices), texel_size_(1.0f / glm::vec2(atlas_extent))
+{
+}
+
+void OverlayBatch::Reset()
+{
+	vertex_count_ = 0;
+	dropped_quads_ = 0;
+}
+
+void OverlayBatch::Rect(glm::vec2 position, glm::vec2 size, std::uint32_t color)
+{
+	// Every corner samples the middle of the solid cell
+	const glm::vec2 uv = (glm::vec2(GetCellOrigin(kSolidCell)) + glm::vec2(GlyphAtlas::kGlyphWidth, GlyphAtlas::kGlyphHeight) * 0.5f) * texel_size_;
+	Quad(position, position + size, uv, uv, color);
+}
+
+glm::vec2 OverlayBatch::Text(glm::vec2 position, std::string_view text, std::uint32_t color, std::float_t scale)
+{
+	const glm::vec2 glyph_size = glm::vec2(GlyphAtlas::kGlyphWidth, GlyphAtlas::kGlyphHeight) * scale;
+	glm::vec2 cursor = position;
+	for (char character : text) {
+		if (character == '\n') {
+			cursor = {position.x, cursor.y + GlyphAtlas::kCellHeight * scale};
+			continue;
+		}
+		if (character != ' ') {
+			const glm::vec2 uv_min = glm::vec2(GetCellOrigin(GetCell(character))) * texel_size_;
+			Quad(cursor, cursor + glyph_size, uv_min, uv_min + glm::vec2(GlyphAtlas::kGlyphWidth, GlyphAtlas::kGlyphHeight) * texel_size_, color);
+		}
+		cursor.x += GlyphAtlas::kCellWidth * scale;
+	}
+	return cursor;
+}
+
+void OverlayBatch::Graph(glm::vec2 position, glm::vec2 size, gsl::span<const std::float_t> values, std::float_t max_value, std::uint32_t color)
+{
+	if (values.empty() || max_value <= 0.0f) {
+		return;
+	}
+	const std::float_t bar_width = size.x / static_cast<std::float_t>(values.size());
+	for (std::size_t i = 0; i < values.size(); i++) {
+		const std::float_t height = std::clamp(values[i] / max_value, 0.0f, 1.0f) * size.y;
+		if (height > 0.0f) {
+			Rect({position.x + bar_width * static_cast<std::float_t>(i), position.y + size.y - height}, {bar_width, height}, color);
+		}
+	}
+}
+
+glm::vec2 OverlayBatch::MeasureText(std::string_view text, std::float_t scale)
+{
+	std::uint32_t columns = 0;
+	std::uint32_t line_columns = 0;
+	std::uint32_t lines = 1;
+	for (char character : text) {
+		if (character == '\n') {
+			lines++;
+			line_columns = 0;
+			continue;
+		}
+		columns = std::max(columns, ++line_columns);
+	}
+	// Without the padding after the last column and below the last line
+	const std::float_t width = columns > 0 ? static_cast<std::float_t>(columns * GlyphAtlas::kCellWidth - 1) : 0.0f;
+	return glm::vec2(width, static_cast<std::float_t>(lines * GlyphAtlas::kCellHeight - 1)) * scale;
+}
+
+void OverlayBatch::Quad(glm::vec2 min, glm::vec2 max, glm::vec2 uv_min, glm::vec2 uv_max, std::uint32_t color)
+{
+	if (vertex_count_ + kOverlayVerticesPerQuad > vertices_.size()) {
+		dropped_quads_++;
+		return;
+	}
+	const std::array<OverlayVertex, 4> corners = {{
+	    {min, uv_min, color},
+	    {{max.x, min.y}, {uv_max.x, uv_min.y}, color},
+	    {max, uv_max, color},
+	    {{min.x, max.y}, {uv_min.x, uv_max.y}, color},
+	}};
+	for (std::uint32_t corner : {0, 1, 2, 0, 2, 3}) {
+		vertices_[vertex_count_++] = corners[corner];
+	}
+}
+
+}  // namespace veng
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vector>
+
+namespace veng {
+
+// One corner of an overlay quad, in window pixels with the origin at the top left. The color
+// is RGBA8 with red in the lowest byte.
+struct OverlayVertex {
+	glm::vec2 position;
+	glm::vec2 uv;
+	std::uint32_t color = 0;
+};
+
+inline constexpr std::uint32_t kOverlayVerticesPerQuad = 6;
+
+// Packs 0-1 channels into an overlay vertex color
+std::uint32_t PackOverlayColor(const glm::vec4& color);
+
+// The built-in font baked into an 8-bit coverage image: printable ASCII in 5x7 pixel glyphs,
+// one per cell of a 16 column grid, plus a solid cell that rectangles sample
+struct GlyphAtlas {
+	static constexpr std::uint32_t kGlyphWidth = 5;
+	static constexpr std::uint32_t kGlyphHeight = 7;
+	static constexpr std::uint32_t kCellWidth = kGlyphWidth + 1;
+	static constexpr std::uint32_t kCellHeight = kGlyphHeight + 1;
+	static constexpr char kFirstCharacter = ' ';
+	static constexpr std::uint32_t kCharacterCount = 95;
+	static constexpr std::uint32_t kColumns = 16;
+
+	glm::uvec2 extent = {0, 0};
+	std::vector<std::uint8_t> pixels;  // row after row
+};
+
+GlyphAtlas BakeGlyphAtlas();
+
+// Builds one frame's overlay quads straight into a mapped vertex buffer: solid rectangles,
+// text in the built-in font and bar graphs. Nothing allocates, so the whole overlay can be
+// rebuilt every frame; quads past the end of the buffer are dropped and counted.
+class OverlayBatch {
+public:
+	OverlayBatch() = default;
+	OverlayBatch(gsl::span<OverlayVertex> vertices, glm::uvec2 atlas_extent);
+
+	void Reset();
+
+	void Rect(glm::vec2 position, glm::vec2 size, std::uint32_t color);
+	// Glyphs are `scale` times their atlas size; integer scales keep them sharp. Characters
+	// the font lacks draw as '?' and '\n' starts a new line. Returns where the next
+	// character would go.
+	glm::vec2 Text(glm::vec2 position, std::string_view text, std::uint32_t color, std::float_t scale = 1.0f);
+	// One bar per value, oldest on the left, scaled so that `max_value` fills the height
+	void Graph(glm::vec2 position, glm::vec2 size, gsl::span<const std::float_t> values, std::float_t max_value, std::uint32_t color);
+
+	std::uint32_t GetVertexCount() const { return vertex_count_; }
+	std::uint32_t GetDroppedQuads() const { return dropped_quads_; }
+
+	// Size of text drawn by Text() at `scale`
+	static glm::vec2 MeasureText(std::string_view text, std::float_t scale = 1.0f);
+
+private:
+	void Quad(glm::vec2 min, glm::vec2 max, glm::vec2 uv_min, glm::vec2 uv_max, std::uint32_t color);
+
+	gsl::span<OverlayVertex> vertices_;
+	glm::vec2 texel_size_ = {0.0f, 0.0f};
+	std::uint32_t vertex_count_ = 0;
+	std::uint32_t dropped_quads_ = 0;
+};
+
+}  // namespace veng
@@ -0,0 +1,136 @@
+#include <precomp.h>
+#include <pipeline_layout_cache.h>
+#include <algorithm>
+
+namespace veng {
+
+namespace {
+
+void HashCombine(std::size_t& seed, std::uint64_t value)
+{
+	seed ^= std::hash<std::uint64_t>()(value) + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2);
+}
+
+}  // namespace
+
+bool PipelineLayoutCache::SetLayoutKey::operator==(const SetLayoutKey& other) const
+{
+	return std::equal(
+	    bindings.begin(), bindings.end(), other.bindings.begin(), other.bindings.end(), [](const VkDescriptorSetLayoutBinding& left, const VkDescriptorSetLayoutBinding& right) {
+		    return left.binding == right.binding && left.descriptorType == right.descriptorType && left.descriptorCount == right.descriptorCount &&
+		           left.stageFlags == right.stageFlags && left.pImmutableSamplers == right.pImmutableSamplers;
+	    });
+}
+
+bool PipelineLayoutCache::PipelineLayoutKey::operator==(const PipelineLayoutKey& other) const
+{
+	const auto same_range = [](const VkPushConstantRange& left, const VkPushConstantRange& right) {
+		return left.stageFlags == right.stageFlags && left.offset == right.offset && left.size == right.size;
+	};
+	return set_layouts == other.set_layouts &&
+	       std::equal(push_constant_ranges.begin(), push_constant_ranges.end(), other.push_constant_ranges.begin(), other.push_constant_ranges.end(), same_range);
+}
+
+std::size_t PipelineLayoutCache::KeyHash::operator()(const SetLayoutKey& key) const
+{
+	std::size_t seed = key.bindings.size();
+	for (const VkDescriptorSetLayoutBinding& binding : key.bindings) {
+		HashCombine(seed, std::uint64_t(binding.binding) << 32 | binding.descriptorType);
+		HashCombine(seed, std::uint64_t(binding.descriptorCount) << 32 | binding.stageFlags);
+	}
+	return seed;
+}
+
+std::size_t PipelineLayoutCache::KeyHash::operator()(const PipelineLayoutKey& key) const
+{
+	std::size_t seed = key.set_layouts.size();
+	for (VkDescriptorSetLayout set_layout : key.set_layouts) {
+		HashCombine(seed, reinterpret_cast<std::uint64_t>(set_layout));
+	}
+	for (const VkPushConstantRange& range : key.push_constant_ranges) {
+		HashCombine(seed, std::uint64_t(range.offset) << 32 | range.size);
+		HashCombine(seed, range.stageFlags);
+	}
+	return seed;
+}
+
+PipelineLayoutCache::PipelineLayoutCache(
+    VkDevice device, const VkAllocationCallbacks* set_layout_allocator, const VkAllocationCallbacks* pipeline_layout_allocator)
+    : device_(device), set_layout_allocator_(set_layout_allocator), pipeline_layout_allocator_(pipeline_layout_allocator)
+{
+}
+
+VkDescriptorSetLayout PipelineLayoutCache::GetSetLayout(gsl::span<const VkDescriptorSetLayoutBinding> bindings)
+{
+	std::scoped_lock lock(mutex_);
+	requests_++;
+	return GetSetLayoutLocked(bindings);
+}
+
+VkDescriptorSetLayout PipelineLayoutCache::GetSetLayoutLocked(gsl::span<const VkDescriptorSetLayoutBinding> bindings)
+{
+	SetLayoutKey key = {std::vector<VkDescriptorSetLayoutBinding>(bindings.begin(), bindings.end())};
+	if (const auto cached = set_layouts_.find(key); cached != set_layouts_.end()) {
+		return cached->second;
+	}
+
+	VkDescriptorSetLayoutCreateInfo info = {};
+	info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	info.bindingCount = gsl::narrow_cast<std::uint32_t>(bindings.size());
+	info.pBindings = bindings.data();
+
+	UniqueDescriptorSetLayout set_layout;
+	if (vkCreateDescriptorSetLayout(device_, &info, set_layout_allocator_, set_layout.Put(device_, set_layout_allocator_)) != VK_SUCCESS) {
+		set_layout.Release();
+		return VK_NULL_HANDLE;
+	}
+	return set_layouts_.emplace(std::move(key), std::move(set_layout)).first->second;
+}
+
+PipelineLayoutHandles PipelineLayoutCache::GetPipelineLayout(const PipelineLayoutDescription& description)
+{
+	std::scoped_lock lock(mutex_);
+	requests_++;
+
+	PipelineLayoutHandles handles;
+	for (const std::vector<VkDescriptorSetLayoutBinding>& bindings : description.sets) {
+		const VkDescriptorSetLayout set_layout = GetSetLayoutLocked(bindings);
+		if (set_layout == VK_NULL_HANDLE) {
+			return {};
+		}
+		handles.set_layouts.push_back(set_layout);
+	}
+
+	PipelineLayoutKey key = {handles.set_layouts, description.push_constant_ranges};
+	if (const auto cached = pipeline_layouts_.find(key); cached != pipeline_layouts_.end()) {
+		handles.layout = cached->second;
+		return handles;
+	}
+
+	VkPipelineLayoutCreateInfo info = {};
+	info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	info.setLayoutCount = gsl::narrow_cast<std::uint32_t>(handles.set_layouts.size());
+	info.pSetLayouts = handles.set_layouts.data();
+	info.pushConstantRangeCount = gsl::narrow_cast<std::uint32_t>(description.push_constant_ranges.size());
+	info.pPushConstantRanges = description.push_constant_ranges.data();
+
+	UniquePipelineLayout layout;
+	if (vkCreatePipelineLayout(device_, &info, pipeline_layout_allocator_, layout.Put(device_, pipeline_layout_allocator_)) != VK_SUCCESS) {
+		layout.Release();
+		return {};
+	}
+	handles.layout = pipeline_layouts_.emplace(std::move(key), std::move(layout)).first->second;
+	return handles;
+}
+
+PipelineLayoutCacheStats PipelineLayoutCache::GetStats() const
+{
+	std::scoped_lock lock(mutex_);
+	PipelineLayoutCacheStats stats;
+	stats.requests = requests_;
+	stats.pipeline_layouts = gsl::narrow_cast<std::uint32_t>(pipeline_layouts_.size());
+	stats.set_layouts = gsl::narrow_cast<std::uint32_t>(set_layouts_.size());
+	return stats;
+}
+
+}  // namespace veng
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <spirv_reflection.h>
+#include <vulkan_handle.h>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace veng {
+
+struct PipelineLayoutHandles {
+	VkPipelineLayout layout = VK_NULL_HANDLE;
+	std::vector<VkDescriptorSetLayout> set_layouts;  // by set number
+};
+
+struct PipelineLayoutCacheStats {
+	std::uint32_t requests = 0;
+	std::uint32_t pipeline_layouts = 0;
+	std::uint32_t set_layouts = 0;
+};
+
+// Descriptor set and pipeline layouts interned by content: asking twice for the same bindings
+// or the same sets and push constant ranges gives the same object, so pipelines built from
+// the same shader interface share one layout and layout-compatible binds come for free. The
+// cache owns everything it hands out until it is destroyed.
+//
+// Thread-safe, pipelines are created by concurrent startup tasks.
+class PipelineLayoutCache {
+public:
+	PipelineLayoutCache(VkDevice device, const VkAllocationCallbacks* set_layout_allocator, const VkAllocationCallbacks* pipeline_layout_allocator);
+
+	PipelineLayoutCache(const PipelineLayoutCache&) = delete;
+	PipelineLayoutCache& operator=(const PipelineLayoutCache&) = delete;
+
+	// `bindings` in binding order; null if creation failed
+	VkDescriptorSetLayout GetSetLayout(gsl::span<const VkDescriptorSetLayoutBinding> bindings);
+	// Null layout if any creation failed
+	PipelineLayoutHandles GetPipelineLayout(const PipelineLayoutDescription& description);
+
+	PipelineLayoutCacheStats GetStats() const;
+
+private:
+	struct SetLayoutKey {
+		std::vector<VkDescriptorSetLayoutBinding> bindings;
+		bool operator==(const SetLayoutKey& other) const;
+	};
+
+	struct PipelineLayoutKey {
+		std::vector<VkDescriptorSetLayout> set_layouts;
+		std::vector<VkPushConstantRange> push_constant_ranges;
+		bool operator==(const PipelineLayoutKey& other) const;
+	};
+
+	struct KeyHash {
+		std::size_t operator()(const SetLayoutKey& key) const;
+		std::size_t operator()(const PipelineLayoutKey& key) const;
+	};
+
+	VkDescriptorSetLayout GetSetLayoutLocked(gsl::span<const VkDescriptorSetLayoutBinding> bindings);
+
+	VkDevice device_ = VK_NULL_HANDLE;
+	const VkAllocationCallbacks* set_layout_allocator_ = nullptr;
+	const VkAllocationCallbacks* pipeline_layout_allocator_ = nullptr;
+
+	mutable std::mutex mutex_;
+	// Set layouts first so they outlive the pipeline layouts made from them
+	std::unordered_map<SetLayoutKey, UniqueDescriptorSetLayout, KeyHash> set_layouts_;
+	std::unordered_map<PipelineLayoutKey, UniquePipelineLayout, KeyHash> pipeline_layouts_;
+	std::uint32_t requests_ = 0;
+};
+
+}  // namespace veng
@@ -0,0 +1,90 @@
+#include <precomp.h>
+#include <pipeline_statistics.h>
+#include <spdlog/spdlog.h>
+
+namespace veng {
+
+namespace {
+
+std::double_t Ratio(std::uint64_t numerator, std::uint64_t denominator)
+{
+	return denominator > 0 ? static_cast<std::double_t>(numerator) / static_cast<std::double_t>(denominator) : 0.0;
+}
+
+}  // namespace
+
+PipelineStatistics& PipelineStatistics::operator+=(const PipelineStatistics& other)
+{
+	input_assembly_vertices += other.input_assembly_vertices;
+	input_assembly_primitives += other.input_assembly_primitives;
+	vertex_shader_invocations += other.vertex_shader_invocations;
+	clipping_invocations += other.clipping_invocations;
+	clipping_primitives += other.clipping_primitives;
+	fragment_shader_invocations += other.fragment_shader_invocations;
+	compute_shader_invocations += other.compute_shader_invocations;
+	pixels += other.pixels;
+	return *this;
+}
+
+PipelineStatistics UnpackPipelineStatistics(gsl::span<const std::uint64_t, kPipelineStatisticsCount> results, std::uint64_t pixels)
+{
+	PipelineStatistics statistics;
+	statistics.input_assembly_vertices = results[0];
+	statistics.input_assembly_primitives = results[1];
+	statistics.vertex_shader_invocations = results[2];
+	statistics.clipping_invocations = results[3];
+	statistics.clipping_primitives = results[4];
+	statistics.fragment_shader_invocations = results[5];
+	statistics.compute_shader_invocations = results[6];
+	statistics.pixels = pixels;
+	return statistics;
+}
+
+PipelineStatisticsLog::PassId PipelineStatisticsLog::AddPass(std::string name)
+{
+	passes_.push_back({std::move(name)});
+	return gsl::narrow_cast<PassId>(passes_.size() - 1);
+}
+
+void PipelineStatisticsLog::Add(PassId pass, std::uint64_t frame, const PipelineStatistics& statistics)
+{
+	PassStatistics& entry = passes_[pass];
+	Expects(entry.frames == 0 || entry.last_frame_number <= frame);
+	if (entry.frames == 0 || entry.last_frame_number != frame) {
+		entry.frames++;
+		entry.last_frame = {};
+		entry.last_frame_number = frame;
+	}
+	entry.last_frame += statistics;
+	entry.total += statistics;
+}
+
+void PipelineStatisticsLog::LogSummary() const
+{
+	for (const PassStatistics& pass : passes_) {
+		if (pass.frames == 0) {
+			continue;
+		}
+		const PipelineStatistics& total = pass.total;
+		if (total.pixels == 0) {
+			SPDLOG_INFO("{} over {} frames, per frame: {:.0f} compute shader runs", pass.name, pass.frames, Ratio(total.compute_shader_invocations, pass.frames));
+			continue;
+		}
+		// Vertex shader runs per assembled vertex fall below 1 as indexed draws hit the
+		// post-transform cache; fragment shader runs per pixel above 1 are overdraw
+		SPDLOG_INFO(
+		    "{} over {} frames, per frame: {:.0f} vertices, {:.0f} primitives ({:.0f}% after clipping), {:.0f} vertex shader runs ({:.2f} per vertex), "
+		    "{:.0f} fragment shader runs ({:.2f} per pixel)",
+		    pass.name,
+		    pass.frames,
+		    Ratio(total.input_assembly_vertices, pass.frames),
+		    Ratio(total.input_assembly_primitives, pass.frames),
+		    Ratio(total.clipping_primitives, total.clipping_invocations) * 100.0,
+		    Ratio(total.vertex_shader_invocations, pass.frames),
+		    Ratio(total.vertex_shader_invocations, total.input_assembly_vertices),
+		    Ratio(total.fragment_shader_invocations, pass.frames),
+		    Ratio(total.fragment_shader_invocations, total.pixels));
+	}
+}
+
+}  // namespace veng
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <string>
+#include <vector>
+
+namespace veng {
+
+// What the pipeline statistics query pools count. Each query returns one 64-bit value per
+// flag, in the order of the flag bits.
+inline constexpr VkQueryPipelineStatisticFlags kPipelineStatisticsFlags =
+    VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT | VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT | VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT | VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+inline constexpr std::uint32_t kPipelineStatisticsCount = 7;
+
+struct PipelineStatistics {
+	std::uint64_t input_assembly_vertices = 0;
+	std::uint64_t input_assembly_primitives = 0;
+	std::uint64_t vertex_shader_invocations = 0;
+	// Primitives that reached clipping, and those that came out of it
+	std::uint64_t clipping_invocations = 0;
+	std::uint64_t clipping_primitives = 0;
+	std::uint64_t fragment_shader_invocations = 0;
+	std::uint64_t compute_shader_invocations = 0;
+	// Render area of the pass, to relate fragment invocations to; 0 for compute work
+	std::uint64_t pixels = 0;
+
+	PipelineStatistics& operator+=(const PipelineStatistics& other);
+};
+
+// One query's results as laid out by kPipelineStatisticsFlags
+PipelineStatistics UnpackPipelineStatistics(gsl::span<const std::uint64_t, kPipelineStatisticsCount> results, std::uint64_t pixels);
+
+struct PassStatistics {
+	std::string name;
+	std::uint64_t frames = 0;  // frames the pass ran in
+	PipelineStatistics total;
+	PipelineStatistics last_frame;
+	std::uint64_t last_frame_number = 0;
+};
+
+// Pipeline statistics summed per named pass. A pass may be measured several times in a
+// frame, e.g. once per window or around work that interrupts it; its queries add up.
+class PipelineStatisticsLog {
+public:
+	using PassId = std::uint32_t;
+
+	// Passes are added up front, so recording results never allocates
+	PassId AddPass(std::string name);
+	// The results of a query of `pass` recorded in frame `frame`. Frames must be
+	// non-decreasing per pass.
+	void Add(PassId pass, std::uint64_t frame, const PipelineStatistics& statistics);
+
+	gsl::span<const PassStatistics> GetPasses() const { return passes_; }
+	// Per-frame averages of every pass that ran, with vertex reuse and overdraw ratios
+	void LogSummary() const;
+
+private:
+	std::vector<PassStatistics> passes_;
+};
+
+}  // namespace veng
@@ -0,0 +1,131 @@
+#include <precomp.h>
+#include <residency_manager.h>
+
+namespace veng {
+
+ResidencyManager::ResourceId ResidencyManager::Add(std::uint32_t heap, VkDeviceSize size, std::uint64_t frame)
+{
+	const ResourceId id = gsl::narrow_cast<ResourceId>(resources_.size());
+	Resource& resource = resources_.emplace_back();
+	resource.heap = heap;
+	resource.size = size;
+	resource.last_use = frame;
+	Link(id);
+	return id;
+}
+
+void ResidencyManager::Touch(ResourceId id, std::uint64_t frame)
+{
+	Resource& resource = resources_[id];
+	Expects(resource.resident);
+	if (resource.last_use == frame) {
+		return;
+	}
+	resource.last_use = frame;
+	Unlink(id);
+	Link(id);
+}
+
+void ResidencyManager::SetEvicted(ResourceId id)
+{
+	Resource& resource = resources_[id];
+	Expects(resource.resident);
+	Unlink(id);
+	resource.resident = false;
+	evictions_++;
+}
+
+void ResidencyManager::SetRestored(ResourceId id, std::uint64_t frame)
+{
+	Resource& resource = resources_[id];
+	Expects(!resource.resident);
+	resource.resident = true;
+	resource.last_use = frame;
+	Link(id);
+	restores_++;
+}
+
+std::pmr::vector<ResidencyManager::ResourceId> ResidencyManager::SelectEvictions(
+    gsl::span<const MemoryHeapBudget> heaps,
+    std::uint64_t frame,
+    std::float_t fill,
+    std::pmr::memory_resource* memory) const
+{
+	Expects(heaps.size() <= VK_MAX_MEMORY_HEAPS);
+	// Called every frame: nothing is allocated unless something has to go
+	std::array<VkDeviceSize, VK_MAX_MEMORY_HEAPS> excess = {};
+	bool over_budget = false;
+	for (std::size_t i = 0; i < heaps.size(); i++) {
+		const VkDeviceSize usage = heaps[i].usage - std::min(heaps[i].usage, heaps[i].releasing);
+		const VkDeviceSize limit = static_cast<VkDeviceSize>(static_cast<std::double_t>(heaps[i].budget) * fill);
+		excess[i] = usage > limit ? usage - limit : 0;
+		over_budget |= excess[i] > 0;
+	}
+
+	std::pmr::vector<ResourceId> evictions(memory);
+	if (!over_budget) {
+		return evictions;
+	}
+	// The list is ordered by last use, so the first protected resource ends the search
+	for (ResourceId id = lru_first_; id != kNone; id = resources_[id].next) {
+		const Resource& resource = resources_[id];
+		if (resource.last_use + protected_frames_ >= frame) {
+			break;
+		}
+		if (resource.heap < heaps.size() && excess[resource.heap] > 0) {
+			evictions.push_back(id);
+			excess[resource.heap] -= std::min(excess[resource.heap], resource.size);
+		}
+	}
+	return evictions;
+}
+
+ResidencyStats ResidencyManager::GetStats() const
+{
+	ResidencyStats stats;
+	stats.resources = gsl::narrow_cast<std::uint32_t>(resources_.size());
+	stats.resident = resident_count_;
+	for (ResourceId id = lru_first_; id != kNone; id = resources_[id].next) {
+		stats.resident_bytes += resources_[id].size;
+	}
+	stats.evictions = evictions_;
+	stats.restores = restores_;
+	return stats;
+}
+
+void ResidencyManager::Link(ResourceId id)
+{
+	Resource& resource = resources_[id];
+	resource.previous = lru_last_;
+	resource.next = kNone;
+	if (lru_last_ != kNone) {
+		resources_[lru_last_].next = id;
+	}
+	else {
+		lru_first_ = id;
+	}
+	lru_last_ = id;
+	resident_count_++;
+}
+
+void ResidencyManager::Unlink(ResourceId id)
+{
+	Resource& resource = resources_[id];
+	if (resource.previous != kNone) {
+		resources_[resource.previous].next = resource.next;
+	}
+	else {
+		lru_first_ = resource.next;
+	}
+	if (resource.next != kNone) {
+		resources_[resource.next].previous = resource.previous;
+	}
+	else {
+		lru_last_ = resource.previous;
+	}
+	resource.previous = kNone;
+	resource.next = kNone;
+	resident_count_--;
+}
+
+}  // namespace veng
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <array>
+#include <limits>
+#include <memory_resource>
+#include <vector>
+
+namespace veng {
+
+// One memory heap as of the latest update, from VK_EXT_memory_budget where available
+struct MemoryHeapBudget {
+	VkDeviceSize size = 0;
+	// What this process can allocate from the heap without paging or failures; the heap size
+	// without the extension
+	VkDeviceSize budget = 0;
+	// This process's allocations; only the engine's own without the extension
+	VkDeviceSize usage = 0;
+	// Part of `usage` released already, freed once the frames in flight have retired
+	VkDeviceSize releasing = 0;
+	bool device_local = false;
+};
+
+struct ResidencyStats {
+	std::uint32_t resources = 0;
+	std::uint32_t resident = 0;
+	VkDeviceSize resident_bytes = 0;
+	std::uint64_t evictions = 0;
+	std::uint64_t restores = 0;
+};
+
+// Least-recently-used bookkeeping of streamable resources: GPU copies of data that can be
+// uploaded again from a source on the CPU side. It only decides; the owner frees and
+// re-creates the resources and reports back.
+class ResidencyManager {
+public:
+	using ResourceId = std::uint32_t;
+
+	// Resources used within the last `protected_frames` frames are never picked, since frames
+	// in flight still read them and they would only come straight back
+	explicit ResidencyManager(std::uint64_t protected_frames) : protected_frames_(protected_frames) {}
+
+	// A resident resource of `size` bytes in memory heap `heap`, used in `frame`
+	ResourceId Add(std::uint32_t heap, VkDeviceSize size, std::uint64_t frame);
+	void Touch(ResourceId id, std::uint64_t frame);
+	bool IsResident(ResourceId id) const { return resources_[id].resident; }
+	void SetEvicted(ResourceId id);
+	void SetRestored(ResourceId id, std::uint64_t frame);
+
+	// Resident resources to evict, least recently used first, until the usage of every heap
+	// minus what it is releasing fits into `fill` of its budget. A heap may stay over budget
+	// when everything left in it was used recently. The list is returned in `memory`, e.g. a
+	// frame arena.
+	std::pmr::vector<ResourceId> SelectEvictions(gsl::span<const MemoryHeapBudget> heaps, std::uint64_t frame, std::float_t fill, std::pmr::memory_resource* memory) const;
+
+	ResidencyStats GetStats() const;
+
+private:
+	static constexpr ResourceId kNone = std::numeric_limits<ResourceId>::max();
+
+	struct Resource {
+		std::uint32_t heap = 0;
+		VkDeviceSize size = 0;
+		std::uint64_t last_use = 0;
+		bool resident = true;
+		// Neighbours in the LRU list, while resident
+		ResourceId previous = kNone;
+		ResourceId next = kNone;
+	};
+
+	// Append as the most recently used, and take out of the list
+	void Link(ResourceId id);
+	void Unlink(ResourceId id);
+
+	std::uint64_t protected_frames_ = 0;
+	std::vector<Resource> resources_;
+	// The resident ones, least recently used first. Linked through the resources, so touching,
+	// evicting and restoring never allocate.
+	ResourceId lru_first_ = kNone;
+	ResourceId lru_last_ = kNone;
+	std::uint32_t resident_count_ = 0;
+	std::uint64_t evictions_ = 0;
+	std::uint64_t restores_ = 0;
+};
+
+}  // namespace veng
@@ -0,0 +1,160 @@
+#include <precomp.h>
+#include <shader_variants.h>
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <bit>
+#include <chrono>
+
+namespace veng {
+
+#pragma region SPECIALIZATION_CONSTANTS
+
+SpecializationConstants& SpecializationConstants::Set(std::uint32_t id, std::uint32_t value)
+{
+	const auto position = std::lower_bound(ids_.begin(), ids_.end(), id);
+	const std::size_t index = position - ids_.begin();
+	if (position != ids_.end() && *position == id) {
+		values_[index] = value;
+		return *this;
+	}
+
+	ids_.insert(position, id);
+	values_.insert(values_.begin() + index, value);
+	entries_.resize(ids_.size());
+	for (std::size_t i = 0; i < entries_.size(); i++) {
+		entries_[i].constantID = ids_[i];
+		entries_[i].offset = gsl::narrow_cast<std::uint32_t>(i * sizeof(std::uint32_t));
+		entries_[i].size = sizeof(std::uint32_t);
+	}
+	return *this;
+}
+
+SpecializationConstants& SpecializationConstants::Set(std::uint32_t id, std::float_t value)
+{
+	return Set(id, std::bit_cast<std::uint32_t>(value));
+}
+
+VkSpecializationInfo SpecializationConstants::GetInfo() const
+{
+	VkSpecializationInfo info = {};
+	info.mapEntryCount = gsl::narrow_cast<std::uint32_t>(entries_.size());
+	info.pMapEntries = entries_.data();
+	info.dataSize = values_.size() * sizeof(std::uint32_t);
+	info.pData = values_.data();
+	return info;
+}
+
+std::size_t SpecializationConstants::GetHash() const
+{
+	std::size_t seed = ids_.size();
+	for (std::size_t i = 0; i < ids_.size(); i++) {
+		const std::uint64_t entry = std::uint64_t(ids_[i]) << 32 | values_[i];
+		seed ^= std::hash<std::uint64_t>()(entry) + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2);
+	}
+	return seed;
+}
+
+#pragma endregion
+
+#pragma region SHADER_VARIANT_CACHE
+
+ShaderVariantCache::ProgramId ShaderVariantCache::AddProgram(std::string name, Factory factory)
+{
+	std::scoped_lock lock(mutex_);
+	programs_.push_back({std::move(name), std::move(factory)});
+	return gsl::narrow_cast<ProgramId>(programs_.size() - 1);
+}
+
+VkPipeline ShaderVariantCache::Compile(const Key& key, bool precompiling)
+{
+	Factory factory;
+	{
+		std::scoped_lock lock(mutex_);
+		Expects(key.program < programs_.size());
+		factory = programs_[key.program].factory;
+	}
+
+	const VkSpecializationInfo info = key.constants.GetInfo();
+	const auto start = std::chrono::steady_clock::now();
+	UniquePipeline pipeline = factory(info);
+	const std::chrono::duration<std::double_t, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+	std::scoped_lock lock(mutex_);
+	if (pipeline == VK_NULL_HANDLE) {
+		SPDLOG_ERROR("Could not compile a variant of {}", programs_[key.program].name);
+		return VK_NULL_HANDLE;
+	}
+	stats_.compile_ms += elapsed.count();
+	const auto [variant, inserted] = variants_.try_emplace(key, std::move(pipeline));
+	if (inserted) {
+		stats_.variants++;
+		(precompiling ? stats_.precompiled : stats_.compiled_on_demand)++;
+	}
+	return variant->second;
+}
+
+bool ShaderVariantCache::Precompile(ProgramId program, gsl::span<const SpecializationConstants> variants, JobSystem* jobs)
+{
+	std::vector<Key> missing;
+	{
+		std::scoped_lock lock(mutex_);
+		for (const SpecializationConstants& constants : variants) {
+			Key key = {program, constants};
+			if (!variants_.contains(key) && std::find(missing.begin(), missing.end(), key) == missing.end()) {
+				missing.push_back(std::move(key));
+			}
+		}
+	}
+
+	std::atomic<bool> succeeded = true;
+	const auto compile_range = [&](std::size_t begin, std::size_t end) {
+		for (std::size_t i = begin; i < end; i++) {
+			if (Compile(missing[i], true) == VK_NULL_HANDLE) {
+				succeeded.store(false, std::memory_order_relaxed);
+			}
+		}
+	};
+	if (jobs != nullptr) {
+		jobs->ParallelFor(missing.size(), 1, compile_range);
+	}
+	else {
+		compile_range(0, missing.size());
+	}
+	return succeeded.load(std::memory_order_relaxed);
+}
+
+VkPipeline ShaderVariantCache::Get(ProgramId program, const SpecializationConstants& constants)
+{
+	Key key = {program, constants};
+	{
+		std::scoped_lock lock(mutex_);
+		if (const auto variant = variants_.find(key); variant != variants_.end()) {
+			stats_.hits++;
+			return variant->second;
+		}
+		SPDLOG_WARN("Variant of {} was not precompiled, compiling it now", programs_[program].name);
+	}
+	return Compile(key, false);
+}
+
+ShaderVariantStats ShaderVariantCache::GetStats() const
+{
+	std::scoped_lock lock(mutex_);
+	return stats_;
+}
+
+void ShaderVariantCache::LogStats() const
+{
+	const ShaderVariantStats stats = GetStats();
+	SPDLOG_INFO(
+	    "Shader variants: {} compiled ({} while loading, {} on demand) in {:.2f} ms, {} cache hits",
+	    stats.variants,
+	    stats.precompiled,
+	    stats.compiled_on_demand,
+	    stats.compile_ms,
+	    stats.hits);
+}
+
+#pragma endregion
+
+}  // namespace veng
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <job_system.h>
+#include <vulkan_handle.h>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace veng {
+
+// Values for a shader's specialization constants (layout(constant_id = N) in GLSL), by
+// constant id. GLSL bool, int, uint and float constants are all 32 bits wide; ids a shader
+// does not declare are ignored by the pipeline. Doubles as the key of a shader variant.
+class SpecializationConstants {
+public:
+	SpecializationConstants& Set(std::uint32_t id, std::uint32_t value);
+	SpecializationConstants& Set(std::uint32_t id, std::int32_t value) { return Set(id, static_cast<std::uint32_t>(value)); }
+	SpecializationConstants& Set(std::uint32_t id, std::float_t value);
+	SpecializationConstants& Set(std::uint32_t id, bool value) { return Set(id, static_cast<std::uint32_t>(value ? VK_TRUE : VK_FALSE)); }
+
+	bool IsEmpty() const { return ids_.empty(); }
+	// Points into this object, so it is only valid while the object is alive and unchanged
+	VkSpecializationInfo GetInfo() const;
+
+	bool operator==(const SpecializationConstants& other) const { return ids_ == other.ids_ && values_ == other.values_; }
+	std::size_t GetHash() const;
+
+private:
+	// Sorted by id, so equal sets of values compare equal whatever order they were set in
+	std::vector<std::uint32_t> ids_;
+	std::vector<std::uint32_t> values_;
+	std::vector<VkSpecializationMapEntry> entries_;  // entry i reads values_[i]
+};
+
+struct ShaderVariantStats {
+	std::uint32_t variants = 0;
+	std::uint32_t precompiled = 0;
+	// Variants first asked for by Get, each of which stalled its caller while compiling
+	std::uint32_t compiled_on_demand = 0;
+	std::uint64_t hits = 0;
+	std::double_t compile_ms = 0.0;  // summed over all variants, whatever thread built them
+};
+
+// Pipelines built from the same shader modules with different specialization constants,
+// so one SPIR-V module serves every combination of feature toggles and tunables and each
+// variant is compiled with its branches and loop bounds folded.
+//
+// A program is a function that creates the pipeline for a VkSpecializationInfo; it must stay
+// callable (its modules alive) for as long as the cache may compile variants. Variants are
+// cached per (program, constants) and owned by the cache until it is destroyed, so a
+// pipeline handed out stays valid for command buffers still in flight. Thread-safe.
+class ShaderVariantCache {
+public:
+	using ProgramId = std::uint32_t;
+	using Factory = std::function<UniquePipeline(const VkSpecializationInfo&)>;
+
+	ProgramId AddProgram(std::string name, Factory factory);
+
+	// Compiles the variants that are not cached yet, concurrently on `jobs` if given.
+	// Returns false if any failed to compile.
+	bool Precompile(ProgramId program, gsl::span<const SpecializationConstants> variants, JobSystem* jobs = nullptr);
+	// The cached variant, compiled on the spot when missing. Null if compiling failed.
+	VkPipeline Get(ProgramId program, const SpecializationConstants& constants);
+
+	ShaderVariantStats GetStats() const;
+	void LogStats() const;
+
+private:
+	struct Key {
+		ProgramId program = 0;
+		SpecializationConstants constants;
+		bool operator==(const Key& other) const { return program == other.program && constants == other.constants; }
+	};
+
+	struct KeyHash {
+		std::size_t operator()(const Key& key) const { return key.constants.GetHash() ^ (std::size_t(key.program) * 0x9e3779b97f4a7c15ull); }
+	};
+
+	struct Program {
+		std::string name;
+		Factory factory;
+	};
+
+	// Compiles outside the lock; a variant compiled twice concurrently keeps the first
+	VkPipeline Compile(const Key& key, bool precompiling);
+
+	mutable std::mutex mutex_;
+	std::vector<Program> programs_;
+	std::unordered_map<Key, UniquePipeline, KeyHash> variants_;
+	ShaderVariantStats stats_;
+};
+
+}  // namespace veng
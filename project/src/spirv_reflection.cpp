@@ -0,0 +1,575 @@
+#include <precomp.h>
+#include <spirv_reflection.h>
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+namespace veng {
+
+namespace {
+
+// The few parts of the SPIR-V grammar reflection needs
+constexpr std::uint32_t kMagic = 0x07230203;
+constexpr std::size_t kHeaderWords = 5;
+
+enum Op : std::uint16_t {
+	kOpEntryPoint = 15,
+	kOpTypeInt = 21,
+	kOpTypeFloat = 22,
+	kOpTypeVector = 23,
+	kOpTypeMatrix = 24,
+	kOpTypeImage = 25,
+	kOpTypeSampler = 26,
+	kOpTypeSampledImage = 27,
+	kOpTypeArray = 28,
+	kOpTypeRuntimeArray = 29,
+	kOpTypeStruct = 30,
+	kOpTypePointer = 32,
+	kOpConstant = 43,
+	kOpSpecConstant = 50,
+	kOpVariable = 59,
+	kOpDecorate = 71,
+	kOpMemberDecorate = 72,
+};
+
+enum Decoration : std::uint32_t {
+	kDecorationBlock = 2,
+	kDecorationBufferBlock = 3,
+	kDecorationArrayStride = 6,
+	kDecorationMatrixStride = 7,
+	kDecorationBuiltIn = 11,
+	kDecorationLocation = 30,
+	kDecorationBinding = 33,
+	kDecorationDescriptorSet = 34,
+	kDecorationOffset = 35,
+};
+
+enum StorageClass : std::uint32_t {
+	kStorageUniformConstant = 0,
+	kStorageInput = 1,
+	kStorageUniform = 2,
+	kStoragePushConstant = 9,
+	kStorageStorageBuffer = 12,
+};
+
+// Operands, result id included, that the reflection below reads from each definition
+static std::uint32_t GetMinOperandCount(std::uint16_t opcode)
+{
+	switch (opcode) {
+		case kOpTypeImage:
+			return 8;
+		case kOpTypeInt:
+		case kOpTypeVector:
+		case kOpTypeMatrix:
+		case kOpTypeArray:
+		case kOpTypePointer:
+		case kOpConstant:
+		case kOpSpecConstant:
+			return 3;
+		case kOpTypeFloat:
+		case kOpTypeSampledImage:
+		case kOpTypeRuntimeArray:
+			return 2;
+		default:
+			return 1;
+	}
+}
+
+constexpr std::uint32_t kDimBuffer = 5;
+constexpr std::uint32_t kDimSubpassData = 6;
+
+struct Instruction {
+	std::uint16_t opcode = 0;
+	std::uint32_t offset = 0;  // of the first operand
+	std::uint32_t operand_count = 0;
+};
+
+struct Decorations {
+	std::optional<std::uint32_t> set;
+	std::optional<std::uint32_t> binding;
+	std::optional<std::uint32_t> location;
+	std::optional<std::uint32_t> array_stride;
+	bool built_in = false;
+	bool buffer_block = false;
+};
+
+struct MemberDecorations {
+	std::optional<std::uint32_t> offset;
+	std::optional<std::uint32_t> matrix_stride;
+};
+
+struct Variable {
+	std::uint32_t id = 0;
+	std::uint32_t type = 0;  // the pointee
+	std::uint32_t storage_class = 0;
+};
+
+class Module {
+public:
+	explicit Module(std::vector<std::uint32_t> words) : words_(std::move(words)) {}
+
+	bool Parse();
+	std::optional<ShaderReflection> Reflect() const;
+
+private:
+	std::uint32_t Operand(const Instruction& instruction, std::uint32_t index) const { return words_[instruction.offset + index]; }
+	// Ids that are out of bounds or not a type or constant give an instruction with no opcode
+	const Instruction& Type(std::uint32_t id) const { return id < definitions_.size() ? definitions_[id] : kNoInstruction; }
+
+	static constexpr Instruction kNoInstruction = {};
+
+	std::optional<std::uint32_t> GetConstant(std::uint32_t id) const;
+	std::optional<std::uint32_t> GetSize(std::uint32_t type, std::optional<std::uint32_t> matrix_stride) const;
+	std::optional<VkPushConstantRange> GetBlockRange(std::uint32_t struct_type) const;
+	std::optional<VkDescriptorType> GetDescriptorType(std::uint32_t type, std::uint32_t storage_class) const;
+	VkFormat GetInputFormat(std::uint32_t type) const;
+	bool AddVertexInputs(std::uint32_t type, std::uint32_t location, std::vector<ReflectedVertexInput>& inputs) const;
+
+	std::vector<std::uint32_t> words_;
+	std::optional<std::uint32_t> execution_model_;
+	std::vector<Instruction> definitions_;  // types and constants, by result id
+	std::vector<Decorations> decorations_;
+	std::unordered_map<std::uint64_t, MemberDecorations> member_decorations_;  // struct id << 32 | member
+	std::vector<Variable> variables_;
+};
+
+bool Module::Parse()
+{
+	if (words_.size() < kHeaderWords || words_[0] != kMagic) {
+		SPDLOG_ERROR("Not a SPIR-V module");
+		return false;
+	}
+	const std::uint32_t bound = words_[3];
+	definitions_.resize(bound);
+	decorations_.resize(bound);
+
+	for (std::size_t position = kHeaderWords; position < words_.size();) {
+		const std::uint32_t word_count = words_[position] >> 16;
+		if (word_count == 0 || position + word_count > words_.size()) {
+			SPDLOG_ERROR("Truncated SPIR-V instruction at word {}", position);
+			return false;
+		}
+		Instruction instruction;
+		instruction.opcode = static_cast<std::uint16_t>(words_[position] & 0xffff);
+		instruction.offset = gsl::narrow_cast<std::uint32_t>(position + 1);
+		instruction.operand_count = word_count - 1;
+		position += word_count;
+
+		// Result ids of the instructions below are always below the bound
+		const auto id_in_bound = [&](std::uint32_t index) { return index < instruction.operand_count && Operand(instruction, index) < bound; };
+		const bool long_enough = instruction.operand_count >= GetMinOperandCount(instruction.opcode);
+
+		switch (instruction.opcode) {
+			case kOpEntryPoint:
+				if (!execution_model_.has_value() && instruction.operand_count > 0) {
+					execution_model_ = Operand(instruction, 0);
+				}
+				break;
+			case kOpTypeInt:
+			case kOpTypeFloat:
+			case kOpTypeVector:
+			case kOpTypeMatrix:
+			case kOpTypeImage:
+			case kOpTypeSampler:
+			case kOpTypeSampledImage:
+			case kOpTypeArray:
+			case kOpTypeRuntimeArray:
+			case kOpTypeStruct:
+			case kOpTypePointer:
+				if (!id_in_bound(0) || !long_enough) {
+					SPDLOG_ERROR("Malformed SPIR-V type at word {}", instruction.offset - 1);
+					return false;
+				}
+				definitions_[Operand(instruction, 0)] = instruction;
+				break;
+			case kOpConstant:
+			case kOpSpecConstant:
+				if (!id_in_bound(1) || !long_enough) {
+					SPDLOG_ERROR("Malformed SPIR-V constant at word {}", instruction.offset - 1);
+					return false;
+				}
+				definitions_[Operand(instruction, 1)] = instruction;
+				break;
+			case kOpVariable: {
+				// Types come before their uses, so the pointer type is already known. Its length was
+				// checked when it was defined.
+				const Instruction& pointer = Type(id_in_bound(0) ? Operand(instruction, 0) : bound);
+				if (!id_in_bound(1) || instruction.operand_count < 3 || pointer.opcode != kOpTypePointer || Operand(pointer, 2) >= bound) {
+					SPDLOG_ERROR("Malformed SPIR-V variable at word {}", instruction.offset - 1);
+					return false;
+				}
+				variables_.push_back({Operand(instruction, 1), Operand(pointer, 2), Operand(instruction, 2)});
+				break;
+			}
+			case kOpDecorate:
+				if (id_in_bound(0) && instruction.operand_count >= 2) {
+					Decorations& target = decorations_[Operand(instruction, 0)];
+					const std::optional<std::uint32_t> literal =
+					    instruction.operand_count >= 3 ? std::optional<std::uint32_t>(Operand(instruction, 2)) : std::nullopt;
+					switch (Operand(instruction, 1)) {
+						case kDecorationDescriptorSet:
+							target.set = literal;
+							break;
+						case kDecorationBinding:
+							target.binding = literal;
+							break;
+						case kDecorationLocation:
+							target.location = literal;
+							break;
+						case kDecorationArrayStride:
+							target.array_stride = literal;
+							break;
+						case kDecorationBuiltIn:
+							target.built_in = true;
+							break;
+						case kDecorationBufferBlock:
+							target.buffer_block = true;
+							break;
+						default:
+							break;
+					}
+				}
+				break;
+			case kOpMemberDecorate:
+				if (instruction.operand_count >= 4) {
+					MemberDecorations& member = member_decorations_[std::uint64_t(Operand(instruction, 0)) << 32 | Operand(instruction, 1)];
+					if (Operand(instruction, 2) == kDecorationOffset) {
+						member.offset = Operand(instruction, 3);
+					}
+					else if (Operand(instruction, 2) == kDecorationMatrixStride) {
+						member.matrix_stride = Operand(instruction, 3);
+					}
+				}
+				break;
+			default:
+				break;
+		}
+	}
+
+	if (!execution_model_.has_value()) {
+		SPDLOG_ERROR("SPIR-V module without an entry point");
+		return false;
+	}
+	return true;
+}
+
+std::optional<std::uint32_t> Module::GetConstant(std::uint32_t id) const
+{
+	const Instruction& constant = Type(id);
+	if ((constant.opcode != kOpConstant && constant.opcode != kOpSpecConstant) || constant.operand_count < 3) {
+		return std::nullopt;
+	}
+	return Operand(constant, 2);
+}
+
+std::optional<std::uint32_t> Module::GetSize(std::uint32_t type_id, std::optional<std::uint32_t> matrix_stride) const
+{
+	const Instruction& type = Type(type_id);
+	switch (type.opcode) {
+		case kOpTypeInt:
+		case kOpTypeFloat:
+			return Operand(type, 1) / 8;
+		case kOpTypeVector: {
+			const std::optional<std::uint32_t> component = GetSize(Operand(type, 1), std::nullopt);
+			return component.has_value() ? std::optional<std::uint32_t>(component.value() * Operand(type, 2)) : std::nullopt;
+		}
+		case kOpTypeMatrix: {
+			const std::optional<std::uint32_t> column = matrix_stride.has_value() ? matrix_stride : GetSize(Operand(type, 1), std::nullopt);
+			return column.has_value() ? std::optional<std::uint32_t>(column.value() * Operand(type, 2)) : std::nullopt;
+		}
+		case kOpTypeArray: {
+			const std::optional<std::uint32_t> length = GetConstant(Operand(type, 2));
+			const std::optional<std::uint32_t> stride =
+			    decorations_[type_id].array_stride.has_value() ? decorations_[type_id].array_stride : GetSize(Operand(type, 1), matrix_stride);
+			return length.has_value() && stride.has_value() ? std::optional<std::uint32_t>(length.value() * stride.value()) : std::nullopt;
+		}
+		case kOpTypeStruct: {
+			const std::optional<VkPushConstantRange> range = GetBlockRange(type_id);
+			return range.has_value() ? std::optional<std::uint32_t>(range->offset + range->size) : std::nullopt;
+		}
+		default:
+			return std::nullopt;
+	}
+}
+
+// Bytes from the first member's offset to the end of the last one
+std::optional<VkPushConstantRange> Module::GetBlockRange(std::uint32_t struct_type) const
+{
+	const Instruction& type = Type(struct_type);
+	if (type.opcode != kOpTypeStruct || type.operand_count < 2) {
+		return std::nullopt;
+	}
+
+	std::uint32_t begin = std::numeric_limits<std::uint32_t>::max();
+	std::uint32_t end = 0;
+	for (std::uint32_t member = 0; member + 1 < type.operand_count; member++) {
+		const auto decorations = member_decorations_.find(std::uint64_t(struct_type) << 32 | member);
+		if (decorations == member_decorations_.end() || !decorations->second.offset.has_value()) {
+			return std::nullopt;
+		}
+		const std::optional<std::uint32_t> size = GetSize(Operand(type, member + 1), decorations->second.matrix_stride);
+		if (!size.has_value()) {
+			return std::nullopt;
+		}
+		begin = std::min(begin, decorations->second.offset.value());
+		end = std::max(end, decorations->second.offset.value() + size.value());
+	}
+
+	VkPushConstantRange range = {};
+	range.offset = begin;
+	range.size = end - begin;
+	return range;
+}
+
+std::optional<VkDescriptorType> Module::GetDescriptorType(std::uint32_t type_id, std::uint32_t storage_class) const
+{
+	if (type_id >= decorations_.size()) {
+		return std::nullopt;
+	}
+	const Instruction& type = Type(type_id);
+	if (storage_class == kStorageStorageBuffer) {
+		return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	}
+	if (storage_class == kStorageUniform) {
+		// Storage buffers from before SPIR-V 1.3 are Uniform blocks decorated BufferBlock
+		return decorations_[type_id].buffer_block ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	}
+
+	switch (type.opcode) {
+		case kOpTypeSampler:
+			return VK_DESCRIPTOR_TYPE_SAMPLER;
+		case kOpTypeSampledImage:
+			return VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		case kOpTypeImage: {
+			// Operands: result, sampled type, dim, depth, arrayed, multisampled, sampled (2 = storage)
+			const std::uint32_t dim = Operand(type, 2);
+			const bool storage = Operand(type, 6) == 2;
+			if (dim == kDimBuffer) {
+				return storage ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+			}
+			if (dim == kDimSubpassData) {
+				return VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+			}
+			return storage ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+		}
+		default:
+			return std::nullopt;
+	}
+}
+
+VkFormat Module::GetInputFormat(std::uint32_t type_id) const
+{
+	const Instruction& type = Type(type_id);
+	const bool vector = type.opcode == kOpTypeVector;
+	const Instruction& component = vector ? Type(Operand(type, 1)) : type;
+	const std::uint32_t component_count = vector ? Operand(type, 2) : 1;
+	if ((component.opcode != kOpTypeFloat && component.opcode != kOpTypeInt) || Operand(component, 1) != 32 || component_count > 4) {
+		return VK_FORMAT_UNDEFINED;
+	}
+
+	static constexpr std::array<VkFormat, 4> kFloat = {VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT};
+	static constexpr std::array<VkFormat, 4> kSigned = {VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT};
+	static constexpr std::array<VkFormat, 4> kUnsigned = {VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT};
+	if (component.opcode == kOpTypeFloat) {
+		return kFloat[component_count - 1];
+	}
+	return Operand(component, 2) != 0 ? kSigned[component_count - 1] : kUnsigned[component_count - 1];
+}
+
+bool Module::AddVertexInputs(std::uint32_t type_id, std::uint32_t location, std::vector<ReflectedVertexInput>& inputs) const
+{
+	const Instruction& type = Type(type_id);
+	if (type.opcode == kOpTypeMatrix) {
+		for (std::uint32_t column = 0; column < Operand(type, 2); column++) {
+			inputs.push_back({location + column, GetInputFormat(Operand(type, 1))});
+		}
+		return true;
+	}
+	if (type.opcode == kOpTypeArray) {
+		const std::optional<std::uint32_t> length = GetConstant(Operand(type, 2));
+		if (!length.has_value()) {
+			return false;
+		}
+		const std::size_t first = inputs.size();
+		for (std::uint32_t element = 0; element < length.value(); element++) {
+			const std::uint32_t element_location = inputs.size() > first ? inputs.back().location + 1 : location;
+			if (!AddVertexInputs(Operand(type, 1), element_location, inputs)) {
+				return false;
+			}
+		}
+		return true;
+	}
+	inputs.push_back({location, GetInputFormat(type_id)});
+	return true;
+}
+
+std::optional<ShaderReflection> Module::Reflect() const
+{
+	ShaderReflection reflection;
+	switch (execution_model_.value()) {
+		case 0:
+			reflection.stage = VK_SHADER_STAGE_VERTEX_BIT;
+			break;
+		case 1:
+			reflection.stage = VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+			break;
+		case 2:
+			reflection.stage = VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+			break;
+		case 3:
+			reflection.stage = VK_SHADER_STAGE_GEOMETRY_BIT;
+			break;
+		case 4:
+			reflection.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+			break;
+		case 5:
+			reflection.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+			break;
+		default:
+			SPDLOG_ERROR("Unsupported SPIR-V execution model {}", execution_model_.value());
+			return std::nullopt;
+	}
+
+	for (const Variable& variable : variables_) {
+		const Decorations& decorations = decorations_[variable.id];
+
+		if (variable.storage_class == kStoragePushConstant) {
+			reflection.push_constants = GetBlockRange(variable.type);
+			if (!reflection.push_constants.has_value()) {
+				SPDLOG_ERROR("Cannot size the push constant block");
+				return std::nullopt;
+			}
+			reflection.push_constants->stageFlags = reflection.stage;
+			continue;
+		}
+
+		if (variable.storage_class == kStorageInput) {
+			if (reflection.stage == VK_SHADER_STAGE_VERTEX_BIT && !decorations.built_in && decorations.location.has_value() &&
+			    !AddVertexInputs(variable.type, decorations.location.value(), reflection.vertex_inputs)) {
+				SPDLOG_ERROR("Cannot reflect the vertex input at location {}", decorations.location.value());
+				return std::nullopt;
+			}
+			continue;
+		}
+
+		if (variable.storage_class != kStorageUniformConstant && variable.storage_class != kStorageUniform && variable.storage_class != kStorageStorageBuffer) {
+			continue;
+		}
+		if (!decorations.set.has_value() || !decorations.binding.has_value()) {
+			continue;
+		}
+
+		// Arrays of descriptors, possibly nested
+		ReflectedBinding binding;
+		binding.set = decorations.set.value();
+		binding.binding = decorations.binding.value();
+		std::uint32_t type = variable.type;
+		while (Type(type).opcode == kOpTypeArray || Type(type).opcode == kOpTypeRuntimeArray) {
+			const std::optional<std::uint32_t> length = Type(type).opcode == kOpTypeArray ? GetConstant(Operand(Type(type), 2)) : std::nullopt;
+			if (!length.has_value()) {
+				SPDLOG_ERROR("Descriptor array at set {} binding {} has no fixed size", binding.set, binding.binding);
+				return std::nullopt;
+			}
+			binding.count *= length.value();
+			type = Operand(Type(type), 1);
+		}
+
+		const std::optional<VkDescriptorType> descriptor_type = GetDescriptorType(type, variable.storage_class);
+		if (!descriptor_type.has_value()) {
+			SPDLOG_ERROR("Unsupported resource at set {} binding {}", binding.set, binding.binding);
+			return std::nullopt;
+		}
+		binding.type = descriptor_type.value();
+		reflection.bindings.push_back(binding);
+	}
+
+	std::sort(reflection.vertex_inputs.begin(), reflection.vertex_inputs.end(), [](const ReflectedVertexInput& left, const ReflectedVertexInput& right) {
+		return left.location < right.location;
+	});
+	return reflection;
+}
+
+}  // namespace
+
+std::optional<ShaderReflection> ReflectSpirv(gsl::span<const std::uint8_t> code)
+{
+	if (code.size() % sizeof(std::uint32_t) != 0) {
+		SPDLOG_ERROR("SPIR-V code size {} is not a whole number of words", code.size());
+		return std::nullopt;
+	}
+	// Copied, since the file buffer carries no alignment guarantee
+	std::vector<std::uint32_t> words(code.size() / sizeof(std::uint32_t));
+	std::memcpy(words.data(), code.data(), code.size());
+
+	Module module(std::move(words));
+	if (!module.Parse()) {
+		return std::nullopt;
+	}
+	return module.Reflect();
+}
+
+std::optional<PipelineLayoutDescription> DescribePipelineLayout(gsl::span<const ShaderReflection> shaders)
+{
+	PipelineLayoutDescription description;
+	// Extent per single stage first, then stages with equal extents share a range
+	std::vector<VkPushConstantRange> stage_ranges;
+
+	for (const ShaderReflection& shader : shaders) {
+		for (const ReflectedBinding& binding : shader.bindings) {
+			if (description.sets.size() <= binding.set) {
+				description.sets.resize(binding.set + 1);
+			}
+			std::vector<VkDescriptorSetLayoutBinding>& set = description.sets[binding.set];
+			const auto existing = std::find_if(set.begin(), set.end(), [&](const VkDescriptorSetLayoutBinding& other) { return other.binding == binding.binding; });
+			if (existing == set.end()) {
+				set.push_back({binding.binding, binding.type, binding.count, VkShaderStageFlags(shader.stage), nullptr});
+			}
+			else if (existing->descriptorType != binding.type || existing->descriptorCount != binding.count) {
+				SPDLOG_ERROR("Shaders disagree on set {} binding {}", binding.set, binding.binding);
+				return std::nullopt;
+			}
+			else {
+				existing->stageFlags |= shader.stage;
+			}
+		}
+
+		if (shader.push_constants.has_value()) {
+			const VkPushConstantRange& range = shader.push_constants.value();
+			const auto existing = std::find_if(stage_ranges.begin(), stage_ranges.end(), [&](const VkPushConstantRange& other) { return other.stageFlags == range.stageFlags; });
+			if (existing == stage_ranges.end()) {
+				stage_ranges.push_back(range);
+			}
+			else {
+				const std::uint32_t end = std::max(existing->offset + existing->size, range.offset + range.size);
+				existing->offset = std::min(existing->offset, range.offset);
+				existing->size = end - existing->offset;
+			}
+		}
+	}
+
+	for (std::vector<VkDescriptorSetLayoutBinding>& set : description.sets) {
+		std::sort(set.begin(), set.end(), [](const VkDescriptorSetLayoutBinding& left, const VkDescriptorSetLayoutBinding& right) { return left.binding < right.binding; });
+	}
+	for (const VkPushConstantRange& range : stage_ranges) {
+		const auto same_extent = std::find_if(description.push_constant_ranges.begin(), description.push_constant_ranges.end(), [&](const VkPushConstantRange& other) {
+			return other.offset == range.offset && other.size == range.size;
+		});
+		if (same_extent == description.push_constant_ranges.end()) {
+			description.push_constant_ranges.push_back(range);
+		}
+		else {
+			same_extent->stageFlags |= range.stageFlags;
+		}
+	}
+	return description;
+}
+
+bool AreVertexInputsProvided(const ShaderReflection& shader, gsl::span<const VkVertexInputAttributeDescription> attributes)
+{
+	return std::all_of(shader.vertex_inputs.begin(), shader.vertex_inputs.end(), [&](const ReflectedVertexInput& input) {
+		return std::any_of(attributes.begin(), attributes.end(), [&](const VkVertexInputAttributeDescription& attribute) { return attribute.location == input.location; });
+	});
+}
+
+}  // namespace veng
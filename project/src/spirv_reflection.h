@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <optional>
+#include <vector>
+
+namespace veng {
+
+// What a pipeline layout needs from a SPIR-V module, read straight from its decorations and
+// types, so layouts follow the shaders instead of being written out next to every pipeline.
+
+struct ReflectedBinding {
+	std::uint32_t set = 0;
+	std::uint32_t binding = 0;
+	VkDescriptorType type = VK_DESCRIPTOR_TYPE_MAX_ENUM;
+	std::uint32_t count = 1;  // array length
+};
+
+// One location per input; a matrix takes one per column
+struct ReflectedVertexInput {
+	std::uint32_t location = 0;
+	// The 32-bit format matching the shader type. The vertex buffer may still store the
+	// attribute more compactly (e.g. UNORM for a float input).
+	VkFormat format = VK_FORMAT_UNDEFINED;
+};
+
+struct ShaderReflection {
+	VkShaderStageFlagBits stage = VK_SHADER_STAGE_VERTEX_BIT;
+	std::vector<ReflectedBinding> bindings;
+	// Bytes of the push constant block the shader declares, with this shader's stage
+	std::optional<VkPushConstantRange> push_constants;
+	// Vertex shaders only, ordered by location, built-ins left out
+	std::vector<ReflectedVertexInput> vertex_inputs;
+};
+
+// Descriptor set layouts (index = set number, bindings in binding order) and push constant
+// ranges of a pipeline layout
+struct PipelineLayoutDescription {
+	std::vector<std::vector<VkDescriptorSetLayoutBinding>> sets;
+	std::vector<VkPushConstantRange> push_constant_ranges;
+};
+
+// Reflects the first entry point of a module. Logs and returns nothing for malformed code or
+// resources the layouts cannot describe (e.g. runtime-sized descriptor arrays).
+std::optional<ShaderReflection> ReflectSpirv(gsl::span<const std::uint8_t> code);
+
+// Union of the resources of `shaders`: bindings seen by several shaders get all their
+// stages, and push constants become one range per distinct extent. Shaders that declare the
+// same binding differently are an error. Passing every shader of a group of pipelines gives
+// them a single layout, so bound descriptor sets and push constants stay valid across
+// pipeline switches within the group.
+std::optional<PipelineLayoutDescription> DescribePipelineLayout(gsl::span<const ShaderReflection> shaders);
+
+// Whether `attributes` feed every input location of a vertex shader
+bool AreVertexInputsProvided(const ShaderReflection& shader, gsl::span<const VkVertexInputAttributeDescription> attributes);
+
+}  // namespace veng
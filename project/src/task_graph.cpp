@@ -0,0 +1,128 @@
+#include <precomp.h>
+#include <task_graph.h>
+#include <spdlog/spdlog.h>
+
+namespace veng {
+
+TaskGraph::TaskGraph(gsl::czstring name, JobSystem* jobs) : name_(name), jobs_(jobs)
+{
+}
+
+TaskGraph::TaskId TaskGraph::Add(gsl::czstring name, std::function<void()> function, std::initializer_list<TaskId> dependencies)
+{
+	const TaskId id = gsl::narrow_cast<TaskId>(tasks_.size());
+
+	std::unique_ptr<Task> task = std::make_unique<Task>();
+	task->name = name;
+	task->function = std::move(function);
+	task->dependency_count = gsl::narrow_cast<std::uint32_t>(dependencies.size());
+
+	for (TaskId dependency : dependencies) {
+		Expects(dependency < id);
+		tasks_[dependency]->dependents.push_back(id);
+	}
+
+	tasks_.push_back(std::move(task));
+	return id;
+}
+
+void TaskGraph::Run()
+{
+	run_begin_ = std::chrono::steady_clock::now();
+	failed_.store(false, std::memory_order_relaxed);
+	error_ = nullptr;
+
+	if (jobs_ == nullptr) {
+		for (TaskId id = 0; id < tasks_.size(); id++) {
+			Execute(id);
+		}
+		run_end_ = std::chrono::steady_clock::now();
+		if (error_ != nullptr) {
+			std::rethrow_exception(error_);
+		}
+		return;
+	}
+
+	for (std::unique_ptr<Task>& task : tasks_) {
+		task->pending_dependencies.store(task->dependency_count, std::memory_order_relaxed);
+	}
+
+	for (TaskId id = 0; id < tasks_.size(); id++) {
+		if (tasks_[id]->dependency_count == 0) {
+			Schedule(id);
+		}
+	}
+
+	jobs_->Wait(remaining_);
+	run_end_ = std::chrono::steady_clock::now();
+	if (error_ != nullptr) {
+		std::rethrow_exception(error_);
+	}
+}
+
+void TaskGraph::Schedule(TaskId id)
+{
+	Job job;
+	job.function = [](void* data, std::size_t begin, std::size_t) {
+		TaskGraph* graph = static_cast<TaskGraph*>(data);
+		const TaskId id = gsl::narrow_cast<TaskId>(begin);
+		graph->Execute(id);
+
+		// Scheduled before this job retires, so `remaining_` cannot reach zero in between
+		for (TaskId dependent : graph->tasks_[id]->dependents) {
+			if (graph->tasks_[dependent]->pending_dependencies.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+				graph->Schedule(dependent);
+			}
+		}
+	};
+	job.data = this;
+	job.begin = id;
+	job.end = id + 1;
+	jobs_->Run(job, &remaining_);
+}
+
+void TaskGraph::Execute(TaskId id)
+{
+	Task& task = *tasks_[id];
+	task.thread_index = jobs_ != nullptr ? jobs_->GetCurrentThreadIndex() : 0;
+	task.begin = std::chrono::steady_clock::now();
+
+	// Dependents still get scheduled after a failure so `remaining_` drains; they just do nothing
+	if (!failed_.load(std::memory_order_acquire)) {
+		try {
+			task.function();
+		}
+		catch (...) {
+			const std::scoped_lock lock(error_mutex_);
+			if (error_ == nullptr) {
+				error_ = std::current_exception();
+			}
+			failed_.store(true, std::memory_order_release);
+		}
+	}
+	task.end = std::chrono::steady_clock::now();
+}
+
+void TaskGraph::LogTimings() const
+{
+	using Milliseconds = std::chrono::duration<double, std::milli>;
+
+	Milliseconds summed_time(0.0);
+	for (const std::unique_ptr<Task>& task : tasks_) {
+		const Milliseconds start = task->begin - run_begin_;
+		const Milliseconds duration = task->end - task->begin;
+		summed_time += duration;
+		SPDLOG_INFO("  {:<24} start {:8.2f} ms  took {:8.2f} ms  thread {}", task->name, start.count(), duration.count(), task->thread_index);
+	}
+
+	const Milliseconds wall_time = GetWallTime();
+	SPDLOG_INFO(
+	    "{}: {} tasks in {:.2f} ms ({:.2f} ms of work, {:.1f}x overlap)",
+	    name_,
+	    tasks_.size(),
+	    wall_time.count(),
+	    summed_time.count(),
+	    wall_time.count() > 0.0 ? summed_time.count() / wall_time.count() : 1.0);
+}
+
+}  // namespace veng
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <job_system.h>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace veng {
+
+// One-shot graph of named tasks. A task starts on the job system as soon as all of its
+// dependencies have finished; each task's start, end and thread are recorded so the run
+// can be logged as a trace. A task that throws fails the run: tasks that have not started yet
+// are skipped and Run() rethrows the first exception on the calling thread.
+class TaskGraph {
+public:
+	using TaskId = std::uint32_t;
+
+	// Without a job system every task runs on the calling thread, in insertion order
+	TaskGraph(gsl::czstring name, JobSystem* jobs);
+
+	// Dependencies must have been added before (so the graph cannot have cycles)
+	TaskId Add(gsl::czstring name, std::function<void()> function, std::initializer_list<TaskId> dependencies = {});
+
+	// Runs every task and returns once all have finished. The calling thread helps.
+	// Rethrows the first exception thrown by a task.
+	void Run();
+
+	// Per-task start/duration/thread relative to Run(), plus the wall-clock versus summed
+	// task time.
+	void LogTimings() const;
+
+	std::chrono::steady_clock::duration GetWallTime() const { return run_end_ - run_begin_; }
+
+private:
+	struct Task {
+		gsl::czstring name = nullptr;
+		std::function<void()> function;
+		std::vector<TaskId> dependents;
+		std::uint32_t dependency_count = 0;
+		std::atomic<std::uint32_t> pending_dependencies = 0;
+
+		std::chrono::steady_clock::time_point begin;
+		std::chrono::steady_clock::time_point end;
+		std::uint32_t thread_index = 0;
+	};
+
+	void Schedule(TaskId id);
+	void Execute(TaskId id);
+
+	gsl::czstring name_;
+	JobSystem* jobs_;
+	std::vector<std::unique_ptr<Task>> tasks_;
+	JobCounter remaining_;
+
+	std::atomic<bool> failed_ = false;
+	std::mutex error_mutex_;
+	std::exception_ptr error_;
+
+	std::chrono::steady_clock::time_point run_begin_;
+	std::chrono::steady_clock::time_point run_end_;
+};
+
+}  // namespace veng
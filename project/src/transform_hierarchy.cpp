@@ -0,0 +1,190 @@
+#include <precomp.h>
+#include <transform_hierarchy.h>
+#include <numeric>
+
+namespace veng {
+
+// Levels smaller than this are not worth distributing across workers
+static constexpr std::size_t kParallelChunkSize = 1024;
+
+TransformHierarchy::TransformHierarchy(std::uint32_t instance_buffer_count) : instance_buffer_count_(instance_buffer_count)
+{
+	Expects(instance_buffer_count_ > 0);
+}
+
+TransformHierarchy::Handle TransformHierarchy::Add(std::optional<Handle> parent, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale)
+{
+	const Handle handle = gsl::narrow_cast<Handle>(handles_.size());
+	const std::uint32_t slot = handle;
+
+	std::uint32_t parent_slot = kNoParent;
+	std::uint32_t depth = 0;
+	if (parent.has_value()) {
+		Expects(parent.value() < handle);
+		parent_slot = slot_of_handle_[parent.value()];
+		depth = depths_[parent_slot] + 1;
+	}
+
+	// Appending keeps depth order unless the new node is shallower than the current tail
+	if (!depths_.empty() && depth < depths_.back()) {
+		layout_dirty_ = true;
+	}
+
+	parents_.push_back(parent_slot);
+	handles_.push_back(handle);
+	translations_.push_back(translation);
+	rotations_.push_back(rotation);
+	scales_.push_back(scale);
+	world_matrices_.push_back(glm::mat4(1.0f));
+	dirty_.push_back(1);
+	pending_writes_.push_back(0);
+	depths_.push_back(depth);
+	slot_of_handle_.push_back(slot);
+
+	if (!layout_dirty_) {
+		if (depth + 1 >= level_offsets_.size()) {
+			level_offsets_.resize(depth + 2, level_offsets_.empty() ? 0 : level_offsets_.back());
+		}
+		level_offsets_[depth + 1] = handles_.size();
+	}
+
+	return handle;
+}
+
+void TransformHierarchy::SetTranslation(Handle node, const glm::vec3& translation)
+{
+	const std::uint32_t slot = slot_of_handle_[node];
+	translations_[slot] = translation;
+	dirty_[slot] = 1;
+}
+
+void TransformHierarchy::SetRotation(Handle node, const glm::quat& rotation)
+{
+	const std::uint32_t slot = slot_of_handle_[node];
+	rotations_[slot] = rotation;
+	dirty_[slot] = 1;
+}
+
+void TransformHierarchy::SetScale(Handle node, const glm::vec3& scale)
+{
+	const std::uint32_t slot = slot_of_handle_[node];
+	scales_[slot] = scale;
+	dirty_[slot] = 1;
+}
+
+const glm::mat4& TransformHierarchy::GetWorldMatrix(Handle node) const
+{
+	return world_matrices_[slot_of_handle_[node]];
+}
+
+template <typename T>
+static void Permute(std::vector<T>& values, const std::vector<std::uint32_t>& order)
+{
+	std::vector<T> permuted(values.size());
+	for (std::size_t i = 0; i < order.size(); i++) {
+		permuted[i] = values[order[i]];
+	}
+	values = std::move(permuted);
+}
+
+void TransformHierarchy::RebuildLayout()
+{
+	std::vector<std::uint32_t> order(handles_.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [this](std::uint32_t left, std::uint32_t right) {
+		return depths_[left] < depths_[right];
+	});
+
+	std::vector<std::uint32_t> new_slot(order.size());
+	for (std::uint32_t i = 0; i < order.size(); i++) {
+		new_slot[order[i]] = i;
+	}
+
+	Permute(parents_, order);
+	Permute(handles_, order);
+	Permute(translations_, order);
+	Permute(rotations_, order);
+	Permute(scales_, order);
+	Permute(world_matrices_, order);
+	Permute(dirty_, order);
+	Permute(pending_writes_, order);
+	Permute(depths_, order);
+
+	for (std::uint32_t& parent : parents_) {
+		if (parent != kNoParent) {
+			parent = new_slot[parent];
+		}
+	}
+	for (std::uint32_t i = 0; i < handles_.size(); i++) {
+		slot_of_handle_[handles_[i]] = i;
+	}
+
+	level_offsets_.assign(depths_.back() + 2, 0);
+	for (std::uint32_t depth : depths_) {
+		level_offsets_[depth + 1]++;
+	}
+	std::partial_sum(level_offsets_.begin(), level_offsets_.end(), level_offsets_.begin());
+
+	layout_dirty_ = false;
+}
+
+void TransformHierarchy::UpdateRange(std::size_t begin, std::size_t end, gsl::span<glm::mat4> instances)
+{
+	for (std::size_t i = begin; i < end; i++) {
+		const std::uint32_t parent = parents_[i];
+
+		// Parents live in an earlier level, so their flag is final by now
+		if (parent != kNoParent) {
+			dirty_[i] |= dirty_[parent];
+		}
+
+		if (dirty_[i]) {
+			glm::mat4 local = glm::mat4_cast(rotations_[i]);
+			local[0] *= scales_[i].x;
+			local[1] *= scales_[i].y;
+			local[2] *= scales_[i].z;
+			local[3] = glm::vec4(translations_[i], 1.0f);
+
+			world_matrices_[i] = parent != kNoParent ? world_matrices_[parent] * local : local;
+			pending_writes_[i] = gsl::narrow_cast<std::uint8_t>(instance_buffer_count_);
+		}
+
+		if (pending_writes_[i] > 0) {
+			instances[handles_[i]] = world_matrices_[i];
+			pending_writes_[i]--;
+		}
+	}
+}
+
+void TransformHierarchy::Update(gsl::span<glm::mat4> instances, JobSystem* jobs)
+{
+	Expects(instances.size() >= handles_.size());
+
+	if (handles_.empty()) {
+		return;
+	}
+
+	if (layout_dirty_) {
+		RebuildLayout();
+	}
+
+	for (std::size_t level = 0; level + 1 < level_offsets_.size(); level++) {
+		const std::size_t level_begin = level_offsets_[level];
+		const std::size_t level_end = level_offsets_[level + 1];
+		const std::size_t chunk_count = (level_end - level_begin + kParallelChunkSize - 1) / kParallelChunkSize;
+
+		if (chunk_count <= 1 || jobs == nullptr) {
+			UpdateRange(level_begin, level_end, instances);
+			continue;
+		}
+
+		// Nodes within one level never depend on each other
+		jobs->ParallelFor(level_end - level_begin, kParallelChunkSize, [this, level_begin, instances](std::size_t begin, std::size_t end) {
+			UpdateRange(level_begin + begin, level_begin + end, instances);
+		});
+	}
+
+	std::fill(dirty_.begin(), dirty_.end(), std::uint8_t(0));
+}
+
+}  // namespace veng
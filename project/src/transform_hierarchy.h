@@ -0,0 +1,63 @@
+#pragma once
+
+#include <glm/gtc/quaternion.hpp>
+#include <job_system.h>
+#include <optional>
+#include <vector>
+
+namespace veng {
+
+// Scene transforms stored as flat arrays sorted by depth, so every parent precedes its
+// children and each depth level can be updated in parallel. Only nodes whose local
+// transform (or an ancestor's) changed are recomputed.
+//
+// Nodes are addressed by a stable handle which also is their slot in the GPU instance
+// buffer; the dense storage order is private and rebuilt when nodes are added.
+class TransformHierarchy {
+public:
+	using Handle = std::uint32_t;
+
+	// `instance_buffer_count`: how many mapped instance buffers are cycled through (one per
+	// frame in flight). A changed matrix is written to each of them once.
+	explicit TransformHierarchy(std::uint32_t instance_buffer_count = 1);
+
+	Handle Add(std::optional<Handle> parent, const glm::vec3& translation = glm::vec3(0.0f), const glm::quat& rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f), const glm::vec3& scale = glm::vec3(1.0f));
+
+	void SetTranslation(Handle node, const glm::vec3& translation);
+	void SetRotation(Handle node, const glm::quat& rotation);
+	void SetScale(Handle node, const glm::vec3& scale);
+
+	const glm::mat4& GetWorldMatrix(Handle node) const;
+	std::size_t Size() const { return parents_.size(); }
+
+	// Recomputes dirty world matrices and writes every matrix still pending for this buffer
+	// to `instances[handle]`. `instances` is typically persistently mapped GPU memory.
+	// Large depth levels are split across `jobs` when given.
+	void Update(gsl::span<glm::mat4> instances, JobSystem* jobs = nullptr);
+
+private:
+	static constexpr std::uint32_t kNoParent = std::numeric_limits<std::uint32_t>::max();
+
+	void RebuildLayout();
+	void UpdateRange(std::size_t begin, std::size_t end, gsl::span<glm::mat4> instances);
+
+	std::uint32_t instance_buffer_count_;
+	bool layout_dirty_ = false;
+
+	// Dense SoA storage, ordered by depth
+	std::vector<std::uint32_t> parents_;
+	std::vector<Handle> handles_;
+	std::vector<glm::vec3> translations_;
+	std::vector<glm::quat> rotations_;
+	std::vector<glm::vec3> scales_;
+	std::vector<glm::mat4> world_matrices_;
+	std::vector<std::uint8_t> dirty_;
+	std::vector<std::uint8_t> pending_writes_;
+	std::vector<std::uint32_t> depths_;
+
+	// [level_offsets_[d], level_offsets_[d + 1]) is the slot range of depth d
+	std::vector<std::size_t> level_offsets_;
+	std::vector<std::uint32_t> slot_of_handle_;
+};
+
+}  // namespace veng
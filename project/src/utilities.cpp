@@ -26,3 +26,15 @@ std::vector<std::uint8_t> veng::ReadFile(std::filesystem::path shader_path)
 	file.read(reinterpret_cast<char*>(buffer.data()), size);
 	return buffer;
 }
+
+glm::mat4 veng::PerspectiveReverseZ(std::float_t fov_y, std::float_t aspect, std::float_t z_near)
+{
+	const std::float_t focal = 1.0f / std::tan(fov_y * 0.5f);
+
+	glm::mat4 projection(0.0f);
+	projection[0][0] = focal / aspect;
+	projection[1][1] = -focal;  // Vulkan clip space has Y pointing down
+	projection[2][3] = -1.0f;
+	projection[3][2] = z_near;
+	return projection;
+}
@@ -4,4 +4,7 @@
 namespace veng {
 bool streq(gsl::czstring left, gsl::czstring right);
 std::vector<std::uint8_t> ReadFile(std::filesystem::path shader_path);
+
+// Infinite far plane, reverse-Z (near -> 1.0, infinity -> 0.0), Vulkan [0, 1] clip depth
+glm::mat4 PerspectiveReverseZ(std::float_t fov_y, std::float_t aspect, std::float_t z_near);
 }
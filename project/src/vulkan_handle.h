@@ -0,0 +1,140 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <utility>
+
+namespace veng {
+
+// Move-only owner of a Vulkan object created from `Parent` (a VkInstance or VkDevice) and
+// destroyed with `Destroy(parent, handle, allocator)`, `allocator` being the callbacks it was
+// created with (null for the driver's own). Converts implicitly to the raw handle so it can
+// be passed straight to Vulkan calls.
+template <typename Parent, typename T, auto Destroy>
+class VulkanHandle {
+public:
+	using ParentType = Parent;
+	using HandleType = T;
+
+	VulkanHandle() = default;
+	VulkanHandle(Parent parent, T handle, const VkAllocationCallbacks* allocator = nullptr) : parent_(parent), handle_(handle), allocator_(allocator) {}
+	~VulkanHandle() { Reset(); }
+
+	VulkanHandle(const VulkanHandle&) = delete;
+	VulkanHandle& operator=(const VulkanHandle&) = delete;
+
+	VulkanHandle(VulkanHandle&& other) noexcept : parent_(other.parent_), handle_(other.Release()), allocator_(other.allocator_) {}
+	VulkanHandle& operator=(VulkanHandle&& other) noexcept
+	{
+		if (this != &other) {
+			Reset();
+			parent_ = other.parent_;
+			allocator_ = other.allocator_;
+			handle_ = other.Release();
+		}
+		return *this;
+	}
+
+	// Destroys the current object and returns the slot for a vkCreate* call to fill in;
+	// `allocator` must be the one passed to that call
+	T* Put(Parent parent, const VkAllocationCallbacks* allocator = nullptr)
+	{
+		Reset();
+		parent_ = parent;
+		allocator_ = allocator;
+		return &handle_;
+	}
+
+	void Reset()
+	{
+		if (handle_ != VK_NULL_HANDLE) {
+			Destroy(parent_, handle_, allocator_);
+			handle_ = VK_NULL_HANDLE;
+		}
+	}
+
+	// Gives up ownership without destroying
+	T Release() { return std::exchange(handle_, T(VK_NULL_HANDLE)); }
+
+	T Get() const { return handle_; }
+	// For Vulkan calls taking arrays of handles
+	const T* GetAddress() const { return &handle_; }
+	Parent GetParent() const { return parent_; }
+	const VkAllocationCallbacks* GetAllocator() const { return allocator_; }
+
+	operator T() const { return handle_; }
+
+private:
+	Parent parent_ = VK_NULL_HANDLE;
+	T handle_ = VK_NULL_HANDLE;
+	const VkAllocationCallbacks* allocator_ = nullptr;
+};
+
+// Same for the instance and device themselves, destroyed with `Destroy(handle, allocator)`
+template <typename T, auto Destroy>
+class VulkanRootHandle {
+public:
+	VulkanRootHandle() = default;
+	~VulkanRootHandle() { Reset(); }
+
+	VulkanRootHandle(const VulkanRootHandle&) = delete;
+	VulkanRootHandle& operator=(const VulkanRootHandle&) = delete;
+
+	VulkanRootHandle(VulkanRootHandle&& other) noexcept : handle_(std::exchange(other.handle_, T(VK_NULL_HANDLE))), allocator_(other.allocator_) {}
+	VulkanRootHandle& operator=(VulkanRootHandle&& other) noexcept
+	{
+		if (this != &other) {
+			Reset();
+			allocator_ = other.allocator_;
+			handle_ = std::exchange(other.handle_, T(VK_NULL_HANDLE));
+		}
+		return *this;
+	}
+
+	T* Put(const VkAllocationCallbacks* allocator = nullptr)
+	{
+		Reset();
+		allocator_ = allocator;
+		return &handle_;
+	}
+
+	void Reset()
+	{
+		if (handle_ != VK_NULL_HANDLE) {
+			Destroy(handle_, allocator_);
+			handle_ = VK_NULL_HANDLE;
+		}
+	}
+
+	T Get() const { return handle_; }
+	operator T() const { return handle_; }
+
+private:
+	T handle_ = VK_NULL_HANDLE;
+	const VkAllocationCallbacks* allocator_ = nullptr;
+};
+
+using UniqueInstance = VulkanRootHandle<VkInstance, vkDestroyInstance>;
+using UniqueDevice = VulkanRootHandle<VkDevice, vkDestroyDevice>;
+
+using UniqueSurface = VulkanHandle<VkInstance, VkSurfaceKHR, vkDestroySurfaceKHR>;
+using UniqueDebugMessenger = VulkanHandle<VkInstance, VkDebugUtilsMessengerEXT, vkDestroyDebugUtilsMessengerEXT>;
+
+using UniqueSwapchain = VulkanHandle<VkDevice, VkSwapchainKHR, vkDestroySwapchainKHR>;
+using UniqueImage = VulkanHandle<VkDevice, VkImage, vkDestroyImage>;
+using UniqueImageView = VulkanHandle<VkDevice, VkImageView, vkDestroyImageView>;
+using UniqueBuffer = VulkanHandle<VkDevice, VkBuffer, vkDestroyBuffer>;
+using UniqueDeviceMemory = VulkanHandle<VkDevice, VkDeviceMemory, vkFreeMemory>;
+using UniqueFramebuffer = VulkanHandle<VkDevice, VkFramebuffer, vkDestroyFramebuffer>;
+using UniqueRenderPass = VulkanHandle<VkDevice, VkRenderPass, vkDestroyRenderPass>;
+using UniqueShaderModule = VulkanHandle<VkDevice, VkShaderModule, vkDestroyShaderModule>;
+using UniquePipelineLayout = VulkanHandle<VkDevice, VkPipelineLayout, vkDestroyPipelineLayout>;
+using UniquePipeline = VulkanHandle<VkDevice, VkPipeline, vkDestroyPipeline>;
+using UniqueCommandPool = VulkanHandle<VkDevice, VkCommandPool, vkDestroyCommandPool>;
+using UniqueSemaphore = VulkanHandle<VkDevice, VkSemaphore, vkDestroySemaphore>;
+using UniqueFence = VulkanHandle<VkDevice, VkFence, vkDestroyFence>;
+using UniqueQueryPool = VulkanHandle<VkDevice, VkQueryPool, vkDestroyQueryPool>;
+using UniqueSampler = VulkanHandle<VkDevice, VkSampler, vkDestroySampler>;
+using UniqueDescriptorSetLayout = VulkanHandle<VkDevice, VkDescriptorSetLayout, vkDestroyDescriptorSetLayout>;
+using UniqueDescriptorPool = VulkanHandle<VkDevice, VkDescriptorPool, vkDestroyDescriptorPool>;
+
+}  // namespace veng
@@ -0,0 +1,138 @@
+#include <precomp.h>
+#include <lod_selection.h>
+#include <test_check.h>
+#include <array>
+
+// Selects LODs for spheres at chosen distances from the camera and checks the result against
+// the projected errors: the coarsest LOD under the threshold at each distance and resolution,
+// no switch inside the hysteresis band, and a switch just past either edge of it.
+
+namespace {
+
+// Errors double twice per step; with a mesh radius of 1, a sphere of radius 1 and 512 pixels
+// per unit, LOD n shows lods[n].error * 512 / distance pixels
+constexpr std::array<veng::MeshLod, 4> kLods = {{
+    {0, 3000, 0.0f},
+    {3000, 1200, 1.0f / 128.0f},
+    {4200, 480, 1.0f / 32.0f},
+    {4680, 96, 1.0f / 8.0f},
+}};
+constexpr std::float_t kMeshRadius = 1.0f;
+constexpr std::float_t kPixelsPerUnit = 512.0f;
+
+veng::LodProjection MakeProjection(std::float_t pixels_per_unit)
+{
+	veng::LodProjection projection;
+	projection.camera_position = glm::vec3(0.0f);
+	projection.pixels_per_unit = pixels_per_unit;
+	return projection;
+}
+
+// A sphere whose nearest point is `distance` from the camera at the origin
+glm::vec4 SphereAt(std::float_t distance, std::float_t radius = 1.0f)
+{
+	return glm::vec4(0.0f, 0.0f, -(distance + radius), radius);
+}
+
+// LOD of a single instance for a selector that starts at LOD 0
+std::uint32_t SelectFresh(const glm::vec4& sphere, std::float_t pixels_per_unit = kPixelsPerUnit)
+{
+	veng::LodSelector selector;
+	selector.Resize(1);
+	const std::array<std::uint32_t, 1> instances = {0};
+	const std::array<glm::vec4, 1> spheres = {sphere};
+	selector.Select(instances, spheres, kLods, kMeshRadius, MakeProjection(pixels_per_unit));
+	return selector.GetLod(0);
+}
+
+}  // namespace
+
+int main()
+{
+	veng::TestChecks checks;
+
+	// 60 degrees over 1000 pixels
+	const veng::LodProjection perspective = veng::LodProjection::FromPerspective(glm::vec3(1.0f, 2.0f, 3.0f), glm::radians(60.0f), 1000.0f);
+	checks.Check(std::abs(perspective.pixels_per_unit - 866.025f) < 0.01f, "pixels per unit at 60 degrees: {}", perspective.pixels_per_unit);
+
+	// Distance, with the default 1 pixel threshold and 0.2 hysteresis: a fresh selector
+	// coarsens while the next LOD shows at most 0.8 pixels. LOD 1 gets there at 5 units,
+	// LOD 2 at 20, LOD 3 at 80.
+	const std::array<std::pair<std::float_t, std::uint32_t>, 7> by_distance = {{
+	    {1.0f, 0},
+	    {4.9f, 0},
+	    {5.1f, 1},
+	    {19.0f, 1},
+	    {21.0f, 2},
+	    {81.0f, 3},
+	    {10000.0f, 3},
+	}};
+	for (const auto& [distance, lod] : by_distance) {
+		checks.Check(SelectFresh(SphereAt(distance)) == lod, "LOD {} at distance {}, got {}", lod, distance, SelectFresh(SphereAt(distance)));
+	}
+	checks.Check(SelectFresh(glm::vec4(0.0f, 0.0f, -0.5f, 1.0f)) == 0, "the finest LOD with the camera inside the bounds");
+
+	// Screen-space error: more pixels per unit or a larger copy of the mesh project the same
+	// errors larger, so the same distance needs a finer LOD
+	checks.Check(SelectFresh(SphereAt(21.0f), kPixelsPerUnit * 4.0f) == 1, "a finer LOD at four times the resolution");
+	checks.Check(SelectFresh(SphereAt(21.0f), kPixelsPerUnit / 4.0f) == 3, "a coarser LOD at a quarter of the resolution");
+	checks.Check(SelectFresh(SphereAt(21.0f, 4.0f)) == 1, "a finer LOD for a copy scaled up four times");
+
+	// Hysteresis around LOD 0/1: coarsen once LOD 1 shows at most 0.8 pixels (5 units), refine
+	// once it shows more than 1 pixel (4 units); in between the LOD stays
+	{
+		veng::LodSelector selector;
+		selector.Resize(1);
+		const std::array<std::uint32_t, 1> instances = {0};
+		std::array<glm::vec4, 1> spheres = {};
+		const auto move_to = [&](std::float_t distance) {
+			spheres[0] = SphereAt(distance);
+			selector.Select(instances, spheres, kLods, kMeshRadius, MakeProjection(kPixelsPerUnit));
+			return selector.GetLod(0);
+		};
+		checks.Check(move_to(3.0f) == 0, "LOD 0 close up");
+		checks.Check(move_to(4.5f) == 0, "LOD 0 kept inside the band when moving away");
+		checks.Check(move_to(4.99f) == 0, "LOD 0 kept just below the coarsening edge");
+		checks.Check(move_to(5.01f) == 1, "LOD 1 just past the coarsening edge");
+		checks.Check(move_to(4.5f) == 1, "LOD 1 kept inside the band when moving closer");
+		checks.Check(move_to(4.01f) == 1, "LOD 1 kept just above the refining edge");
+		checks.Check(move_to(3.99f) == 0, "LOD 0 just past the refining edge");
+		checks.Check(move_to(100.0f) == 3, "straight to the coarsest LOD far away");
+		checks.Check(move_to(1.0f) == 0, "straight back to LOD 0 close up");
+	}
+
+	// Only the listed instances change, and runs of consecutive instances at one LOD merge
+	{
+		veng::LodSelector selector;
+		selector.Resize(8);
+		const std::array<glm::vec4, 8> spheres = {
+		    SphereAt(1.0f), SphereAt(2.0f), SphereAt(30.0f), SphereAt(31.0f), SphereAt(1.0f), SphereAt(100.0f), SphereAt(100.0f), SphereAt(100.0f)};
+		const std::array<std::uint32_t, 6> visible = {0, 1, 2, 3, 6, 7};
+		selector.Select(visible, spheres, kLods, kMeshRadius, MakeProjection(kPixelsPerUnit));
+		checks.Check(selector.GetLod(5) == 0, "instances left out keep their LOD");
+
+		std::array<veng::DrawIndexedCommand, visible.size()> draws;
+		const std::size_t draw_count = selector.BuildDraws(visible, kLods, draws);
+		const std::array<veng::DrawIndexedCommand, 3> expected = {{
+		    {kLods[0].index_count, 2, kLods[0].first_index, 0, 0},
+		    {kLods[2].index_count, 2, kLods[2].first_index, 0, 2},
+		    {kLods[3].index_count, 2, kLods[3].first_index, 0, 6},
+		}};
+		if (checks.Check(draw_count == expected.size(), "{} draws, got {}", expected.size(), draw_count)) {
+			for (std::size_t i = 0; i < expected.size(); i++) {
+				checks.Check(
+				    draws[i].index_count == expected[i].index_count && draws[i].instance_count == expected[i].instance_count &&
+				        draws[i].first_index == expected[i].first_index && draws[i].first_instance == expected[i].first_instance,
+				    "draw {} covers instances {}+{} at index {}",
+				    i,
+				    expected[i].first_instance,
+				    expected[i].instance_count,
+				    expected[i].first_index);
+			}
+			const std::uint64_t triangles = veng::CountTriangles(gsl::span(draws).first(draw_count));
+			checks.Check(triangles == 2 * (1000 + 160 + 32), "triangles of the draws: {}", triangles);
+		}
+	}
+
+	return checks.Finish();
+}
@@ -0,0 +1,133 @@
+#include <precomp.h>
+#include <mesh_cooker.h>
+#include <mesh_file.h>
+#include <test_check.h>
+#include <fstream>
+
+// Cooks a sphere the way veng_meshcook does, writes it and opens it with MeshFile::Open,
+// which must hand back exactly what was cooked. Then opens truncated and corrupted copies of
+// the file, which it must all reject.
+
+namespace {
+
+// Enough triangles for several LODs
+veng::ImportedMesh MakeSphere(std::uint32_t rings, std::uint32_t segments)
+{
+	veng::ImportedMesh mesh;
+	for (std::uint32_t ring = 0; ring <= rings; ring++) {
+		const std::float_t polar = glm::radians(180.0f) * static_cast<std::float_t>(ring) / rings;
+		for (std::uint32_t segment = 0; segment <= segments; segment++) {
+			const std::float_t azimuth = glm::radians(360.0f) * static_cast<std::float_t>(segment) / segments;
+			veng::ImportedVertex vertex;
+			vertex.normal = glm::vec3(std::sin(polar) * std::cos(azimuth), std::cos(polar), std::sin(polar) * std::sin(azimuth));
+			vertex.position = vertex.normal * 2.0f;
+			vertex.uv = glm::vec2(static_cast<std::float_t>(segment) / segments, static_cast<std::float_t>(ring) / rings);
+			mesh.vertices.push_back(vertex);
+		}
+	}
+	for (std::uint32_t ring = 0; ring < rings; ring++) {
+		for (std::uint32_t segment = 0; segment < segments; segment++) {
+			const std::uint32_t corner = ring * (segments + 1) + segment;
+			const std::uint32_t below = corner + segments + 1;
+			mesh.indices.insert(mesh.indices.end(), {corner, below, corner + 1, corner + 1, below, below + 1});
+		}
+	}
+	return mesh;
+}
+
+std::vector<std::uint8_t> ReadBytes(const std::filesystem::path& path)
+{
+	std::ifstream file(path, std::ios::binary);
+	return std::vector<std::uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+bool OpensAfterWriting(const std::filesystem::path& path, gsl::span<const std::uint8_t> bytes)
+{
+	{
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+	}
+	return veng::MeshFile::Open(path).has_value();
+}
+
+// A copy of `bytes` with `change` applied to its header or LOD table
+template <typename Change>
+std::vector<std::uint8_t> Corrupt(gsl::span<const std::uint8_t> bytes, Change&& change)
+{
+	std::vector<std::uint8_t> copy(bytes.begin(), bytes.end());
+	veng::MeshFileHeader header;
+	std::memcpy(&header, copy.data(), sizeof(header));
+	const std::uint64_t lod_offset = header.lod_offset;
+	std::vector<veng::MeshLod> lods(header.lod_count);
+	std::memcpy(lods.data(), copy.data() + lod_offset, lods.size() * sizeof(veng::MeshLod));
+
+	change(header, lods);
+	std::memcpy(copy.data(), &header, sizeof(header));
+	std::memcpy(copy.data() + lod_offset, lods.data(), lods.size() * sizeof(veng::MeshLod));
+	return copy;
+}
+
+}  // namespace
+
+int main()
+{
+	veng::TestChecks checks;
+	const std::filesystem::path directory = std::filesystem::temp_directory_path() / "veng_mesh_file_test";
+	std::filesystem::create_directories(directory);
+	const std::filesystem::path cooked_path = directory / "sphere.vmsh";
+	const std::filesystem::path broken_path = directory / "broken.vmsh";
+
+	const veng::CookedMesh cooked = veng::CookMesh(MakeSphere(24, 48), veng::MeshCookSettings());
+	checks.Check(veng::WriteMeshFile(cooked_path, cooked), "writing {}", cooked_path.string());
+
+	// Round trip
+	{
+		const std::optional<veng::MeshFile> mesh = veng::MeshFile::Open(cooked_path);
+		if (checks.Check(mesh.has_value(), "the cooked mesh opens")) {
+			checks.Check(std::memcmp(&mesh->GetHeader(), &cooked.header, sizeof(veng::MeshFileHeader)) == 0, "header matches");
+			checks.Check(cooked.lods.size() > 1, "the sphere has several LODs");
+			const gsl::span<const veng::MeshLod> lods = mesh->GetLods();
+			checks.Check(
+			    lods.size() == cooked.lods.size() && std::memcmp(lods.data(), cooked.lods.data(), lods.size_bytes()) == 0, "LOD table matches");
+			const gsl::span<const std::uint8_t> vertices = mesh->GetVertexBytes();
+			checks.Check(
+			    vertices.size() == cooked.vertices.size() * sizeof(veng::PackedVertex) &&
+			        std::memcmp(vertices.data(), cooked.vertices.data(), vertices.size()) == 0,
+			    "vertices match");
+			const gsl::span<const std::uint8_t> indices = mesh->GetIndexBytes();
+			checks.Check(std::equal(indices.begin(), indices.end(), cooked.indices.begin(), cooked.indices.end()), "indices match");
+		}
+	}
+
+	const std::vector<std::uint8_t> bytes = ReadBytes(cooked_path);
+	const gsl::span<const std::uint8_t> all(bytes);
+
+	// Truncated
+	checks.Check(!OpensAfterWriting(broken_path, {}), "an empty file is rejected");
+	checks.Check(!OpensAfterWriting(broken_path, all.first(sizeof(veng::MeshFileHeader) - 1)), "a partial header is rejected");
+	checks.Check(!OpensAfterWriting(broken_path, all.first(sizeof(veng::MeshFileHeader))), "a header without data is rejected");
+	checks.Check(!OpensAfterWriting(broken_path, all.first(bytes.size() - 1)), "a file missing its last byte is rejected");
+
+	// Corrupt header and LOD table
+	const auto rejects = [&](std::string_view what, auto&& change) {
+		checks.Check(!OpensAfterWriting(broken_path, Corrupt(all, change)), "{} is rejected", what);
+	};
+	rejects("a wrong magic", [](veng::MeshFileHeader& header, auto&) { header.magic = 0; });
+	rejects("another version", [](veng::MeshFileHeader& header, auto&) { header.version = veng::kMeshFileVersion + 1; });
+	rejects("another vertex stride", [](veng::MeshFileHeader& header, auto&) { header.vertex_stride = 32; });
+	rejects("a 3 byte index", [](veng::MeshFileHeader& header, auto&) { header.index_size = 3; });
+	rejects("no LODs", [](veng::MeshFileHeader& header, auto&) { header.lod_count = 0; });
+	rejects("too many LODs", [](veng::MeshFileHeader& header, auto&) { header.lod_count = veng::kMaxMeshLods + 1; });
+	rejects("a misaligned vertex offset", [](veng::MeshFileHeader& header, auto&) { header.vertex_offset += 4; });
+	rejects("an index offset past the end", [](veng::MeshFileHeader& header, auto&) { header.index_offset += veng::AlignMeshOffset(1 << 20); });
+	rejects("an offset that wraps around", [](veng::MeshFileHeader& header, auto&) { header.index_offset = ~std::uint64_t(0) & ~(veng::kMeshDataAlignment - 1); });
+	rejects("an index count past the end", [](veng::MeshFileHeader& header, auto&) { header.index_count *= 2; });
+	rejects("an index past the last vertex", [](veng::MeshFileHeader& header, auto&) { header.vertex_count = 1; });
+	rejects("an LOD past the index buffer", [](veng::MeshFileHeader& header, std::vector<veng::MeshLod>& lods) {
+		lods.back().first_index = header.index_count - lods.back().index_count + 3;
+	});
+	rejects("an LOD of partial triangles", [](veng::MeshFileHeader&, std::vector<veng::MeshLod>& lods) { lods.front().index_count -= 1; });
+
+	std::filesystem::remove_all(directory);
+	return checks.Finish();
+}
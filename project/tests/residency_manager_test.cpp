@@ -0,0 +1,102 @@
+#include <precomp.h>
+#include <residency_manager.h>
+#include <test_check.h>
+#include <algorithm>
+#include <array>
+
+// Drives the LRU bookkeeping through uses, evictions and restores and checks which resources
+// SelectEvictions picks: least recently used first, none used within the protected frames,
+// and only as many as bring each heap back under its share of the budget.
+
+namespace {
+
+using ResourceId = veng::ResidencyManager::ResourceId;
+
+constexpr std::uint64_t kProtectedFrames = 2;
+constexpr VkDeviceSize kMiB = 1024 * 1024;
+
+veng::MemoryHeapBudget MakeHeap(VkDeviceSize budget, VkDeviceSize usage, VkDeviceSize releasing = 0)
+{
+	veng::MemoryHeapBudget heap;
+	heap.size = budget;
+	heap.budget = budget;
+	heap.usage = usage;
+	heap.releasing = releasing;
+	heap.device_local = true;
+	return heap;
+}
+
+std::string Join(gsl::span<const ResourceId> ids)
+{
+	std::string text;
+	for (const ResourceId id : ids) {
+		text += fmt::format("{} ", id);
+	}
+	return text;
+}
+
+bool Equals(gsl::span<const ResourceId> ids, std::initializer_list<ResourceId> expected)
+{
+	return std::equal(ids.begin(), ids.end(), expected.begin(), expected.end());
+}
+
+}  // namespace
+
+int main()
+{
+	veng::TestChecks checks;
+	std::pmr::monotonic_buffer_resource memory;
+
+	// Four 1 MiB resources in heap 0, first used in frames 0 to 3
+	veng::ResidencyManager residency(kProtectedFrames);
+	std::array<ResourceId, 4> ids = {};
+	for (std::uint32_t i = 0; i < ids.size(); i++) {
+		ids[i] = residency.Add(0, kMiB, i);
+	}
+	const std::array<veng::MemoryHeapBudget, 2> within = {MakeHeap(8 * kMiB, 4 * kMiB), MakeHeap(8 * kMiB, 0)};
+	checks.Check(residency.SelectEvictions(within, 10, 1.0f, &memory).empty(), "nothing to evict within the budget");
+
+	// 4 MiB used against a 2 MiB target: the two used longest ago go
+	const std::array<veng::MemoryHeapBudget, 1> over = {MakeHeap(4 * kMiB, 4 * kMiB)};
+	std::pmr::vector<ResourceId> evictions = residency.SelectEvictions(over, 10, 0.5f, &memory);
+	checks.Check(Equals(evictions, {ids[0], ids[1]}), "least recently used first: {}", Join(evictions));
+
+	// Touching moves a resource to the end of the list
+	residency.Touch(ids[0], 5);
+	evictions = residency.SelectEvictions(over, 10, 0.5f, &memory);
+	checks.Check(Equals(evictions, {ids[1], ids[2]}), "a touched resource is used most recently: {}", Join(evictions));
+
+	// Resources used within the protected frames stay, even when the heap remains over budget
+	evictions = residency.SelectEvictions(over, 4, 0.0f, &memory);
+	checks.Check(Equals(evictions, {ids[1]}), "frames 2 and later protected at frame 4: {}", Join(evictions));
+	evictions = residency.SelectEvictions(over, 8, 0.0f, &memory);
+	checks.Check(Equals(evictions, {ids[1], ids[2], ids[3], ids[0]}), "everything unprotected at fill 0: {}", Join(evictions));
+
+	// Memory already being released counts as gone
+	const std::array<veng::MemoryHeapBudget, 1> releasing = {MakeHeap(4 * kMiB, 4 * kMiB, 1 * kMiB)};
+	evictions = residency.SelectEvictions(releasing, 10, 0.5f, &memory);
+	checks.Check(Equals(evictions, {ids[1]}), "releasing memory subtracted from the usage: {}", Join(evictions));
+
+	// Only resources in heaps over budget are picked
+	const ResourceId other_heap = residency.Add(1, kMiB, 0);
+	const std::array<veng::MemoryHeapBudget, 2> second_over = {MakeHeap(8 * kMiB, 4 * kMiB), MakeHeap(2 * kMiB, 2 * kMiB)};
+	evictions = residency.SelectEvictions(second_over, 10, 0.5f, &memory);
+	checks.Check(Equals(evictions, {other_heap}), "only the heap over budget: {}", Join(evictions));
+
+	// Evicted resources are out of the list until restored, then used most recently
+	residency.SetEvicted(ids[1]);
+	residency.SetEvicted(other_heap);
+	checks.Check(!residency.IsResident(ids[1]) && residency.IsResident(ids[2]), "residency after evicting");
+	evictions = residency.SelectEvictions(over, 10, 0.5f, &memory);
+	checks.Check(Equals(evictions, {ids[2], ids[3]}), "evicted resources not picked again: {}", Join(evictions));
+	residency.SetRestored(ids[1], 6);
+	checks.Check(residency.IsResident(ids[1]), "resident after restoring");
+	evictions = residency.SelectEvictions(over, 10, 0.0f, &memory);
+	checks.Check(Equals(evictions, {ids[2], ids[3], ids[0], ids[1]}), "a restored resource used most recently: {}", Join(evictions));
+
+	const veng::ResidencyStats stats = residency.GetStats();
+	checks.Check(stats.resources == 5 && stats.resident == 4 && stats.resident_bytes == 4 * kMiB, "{} of {} resident in {} bytes", stats.resident, stats.resources, stats.resident_bytes);
+	checks.Check(stats.evictions == 2 && stats.restores == 1, "{} evictions and {} restores", stats.evictions, stats.restores);
+
+	return checks.Finish();
+}
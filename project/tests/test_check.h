@@ -0,0 +1,34 @@
+#pragma once
+
+#include <spdlog/spdlog.h>
+
+namespace veng {
+
+// The tests are plain executables run by ctest: every check logs when it fails, and main
+// returns EXIT_FAILURE once any has
+class TestChecks {
+public:
+	template <typename... Args>
+	bool Check(bool condition, fmt::format_string<Args...> what, Args&&... args)
+	{
+		if (!condition) {
+			spdlog::error("Check failed: {}", fmt::format(what, std::forward<Args>(args)...));
+			failures_++;
+		}
+		return condition;
+	}
+
+	int Finish() const
+	{
+		if (failures_ > 0) {
+			spdlog::error("{} checks failed", failures_);
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+
+private:
+	std::uint32_t failures_ = 0;
+};
+
+}  // namespace veng
@@ -0,0 +1,256 @@
+#include <precomp.h>
+#include <json.h>
+#include <charconv>
+
+namespace veng {
+
+const JsonValue* JsonValue::Find(std::string_view key) const
+{
+	for (const std::pair<std::string, JsonValue>& member : object) {
+		if (member.first == key) {
+			return &member.second;
+		}
+	}
+	return nullptr;
+}
+
+std::double_t JsonValue::GetNumber(std::string_view key, std::double_t fallback) const
+{
+	const JsonValue* value = Find(key);
+	return (value != nullptr && value->type == Type::kNumber) ? value->number : fallback;
+}
+
+std::string_view JsonValue::GetString(std::string_view key, std::string_view fallback) const
+{
+	const JsonValue* value = Find(key);
+	return (value != nullptr && value->type == Type::kString) ? std::string_view(value->string) : fallback;
+}
+
+namespace {
+
+class JsonParser {
+public:
+	explicit JsonParser(std::string_view text) : text_(text) {}
+
+	std::optional<JsonValue> ParseDocument()
+	{
+		JsonValue value;
+		if (!ParseValue(value, 0)) {
+			return std::nullopt;
+		}
+		SkipWhitespace();
+		if (position_ != text_.size()) {
+			return std::nullopt;
+		}
+		return value;
+	}
+
+private:
+	// Deeper documents are rejected rather than overflowing the stack
+	static constexpr std::uint32_t kMaxDepth = 128;
+
+	void SkipWhitespace()
+	{
+		while (position_ < text_.size() && (text_[position_] == ' ' || text_[position_] == '\t' || text_[position_] == '\n' || text_[position_] == '\r')) {
+			position_++;
+		}
+	}
+
+	bool Consume(char expected)
+	{
+		SkipWhitespace();
+		if (position_ < text_.size() && text_[position_] == expected) {
+			position_++;
+			return true;
+		}
+		return false;
+	}
+
+	bool ConsumeLiteral(std::string_view literal)
+	{
+		if (text_.substr(position_, literal.size()) != literal) {
+			return false;
+		}
+		position_ += literal.size();
+		return true;
+	}
+
+	bool ParseValue(JsonValue& value, std::uint32_t depth)
+	{
+		SkipWhitespace();
+		if (position_ >= text_.size() || depth > kMaxDepth) {
+			return false;
+		}
+
+		switch (text_[position_]) {
+			case '{':
+				value.type = JsonValue::Type::kObject;
+				return ParseObject(value, depth);
+			case '[':
+				value.type = JsonValue::Type::kArray;
+				return ParseArray(value, depth);
+			case '"':
+				value.type = JsonValue::Type::kString;
+				return ParseString(value.string);
+			case 't':
+				value.type = JsonValue::Type::kBool;
+				value.boolean = true;
+				return ConsumeLiteral("true");
+			case 'f':
+				value.type = JsonValue::Type::kBool;
+				return ConsumeLiteral("false");
+			case 'n':
+				return ConsumeLiteral("null");
+			default:
+				value.type = JsonValue::Type::kNumber;
+				return ParseNumber(value.number);
+		}
+	}
+
+	bool ParseObject(JsonValue& value, std::uint32_t depth)
+	{
+		position_++;
+		if (Consume('}')) {
+			return true;
+		}
+		do {
+			SkipWhitespace();
+			std::pair<std::string, JsonValue>& member = value.object.emplace_back();
+			if (position_ >= text_.size() || text_[position_] != '"' || !ParseString(member.first) || !Consume(':') || !ParseValue(member.second, depth + 1)) {
+				return false;
+			}
+		} while (Consume(','));
+		return Consume('}');
+	}
+
+	bool ParseArray(JsonValue& value, std::uint32_t depth)
+	{
+		position_++;
+		if (Consume(']')) {
+			return true;
+		}
+		do {
+			if (!ParseValue(value.array.emplace_back(), depth + 1)) {
+				return false;
+			}
+		} while (Consume(','));
+		return Consume(']');
+	}
+
+	bool ParseNumber(std::double_t& number)
+	{
+		// from_chars rejects the leading '+' JSON does not allow either
+		const char* begin = text_.data() + position_;
+		const std::from_chars_result result = std::from_chars(begin, text_.data() + text_.size(), number);
+		if (result.ec != std::errc()) {
+			return false;
+		}
+		position_ += result.ptr - begin;
+		return true;
+	}
+
+	bool ParseHex4(std::uint32_t& code)
+	{
+		if (position_ + 4 > text_.size()) {
+			return false;
+		}
+		const char* begin = text_.data() + position_;
+		const std::from_chars_result result = std::from_chars(begin, begin + 4, code, 16);
+		position_ += 4;
+		return result.ec == std::errc() && result.ptr == begin + 4;
+	}
+
+	static void AppendUtf8(std::string& out, std::uint32_t code)
+	{
+		if (code < 0x80) {
+			out += static_cast<char>(code);
+		}
+		else if (code < 0x800) {
+			out += static_cast<char>(0xC0 | (code >> 6));
+			out += static_cast<char>(0x80 | (code & 0x3F));
+		}
+		else if (code < 0x10000) {
+			out += static_cast<char>(0xE0 | (code >> 12));
+			out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+			out += static_cast<char>(0x80 | (code & 0x3F));
+		}
+		else {
+			out += static_cast<char>(0xF0 | (code >> 18));
+			out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+			out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+			out += static_cast<char>(0x80 | (code & 0x3F));
+		}
+	}
+
+	bool ParseString(std::string& out)
+	{
+		position_++;  // opening quote
+		while (position_ < text_.size()) {
+			const char c = text_[position_++];
+			if (c == '"') {
+				return true;
+			}
+			if (c != '\\') {
+				out += c;
+				continue;
+			}
+			if (position_ >= text_.size()) {
+				return false;
+			}
+			const char escape = text_[position_++];
+			switch (escape) {
+				case '"':
+				case '\\':
+				case '/':
+					out += escape;
+					break;
+				case 'b':
+					out += '\b';
+					break;
+				case 'f':
+					out += '\f';
+					break;
+				case 'n':
+					out += '\n';
+					break;
+				case 'r':
+					out += '\r';
+					break;
+				case 't':
+					out += '\t';
+					break;
+				case 'u': {
+					std::uint32_t code = 0;
+					if (!ParseHex4(code)) {
+						return false;
+					}
+					// Characters outside the BMP come as a surrogate pair
+					if (code >= 0xD800 && code < 0xDC00) {
+						std::uint32_t low = 0;
+						if (!ConsumeLiteral("\\u") || !ParseHex4(low) || low < 0xDC00 || low >= 0xE000) {
+							return false;
+						}
+						code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+					}
+					AppendUtf8(out, code);
+					break;
+				}
+				default:
+					return false;
+			}
+		}
+		return false;
+	}
+
+	std::string_view text_;
+	std::size_t position_ = 0;
+};
+
+}  // namespace
+
+std::optional<JsonValue> ParseJson(std::string_view text)
+{
+	return JsonParser(text).ParseDocument();
+}
+
+}  // namespace veng
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <optional>
+#include <vector>
+
+namespace veng {
+
+// Just enough JSON for glTF: a DOM with objects kept in document order
+struct JsonValue {
+	enum class Type { kNull, kBool, kNumber, kString, kArray, kObject };
+
+	Type type = Type::kNull;
+	bool boolean = false;
+	std::double_t number = 0.0;
+	std::string string;
+	std::vector<JsonValue> array;
+	std::vector<std::pair<std::string, JsonValue>> object;
+
+	// nullptr if this is not an object or has no such member
+	const JsonValue* Find(std::string_view key) const;
+
+	// Member `key` as a number or string, or `fallback` if it is missing or of another type
+	std::double_t GetNumber(std::string_view key, std::double_t fallback) const;
+	std::string_view GetString(std::string_view key, std::string_view fallback = {}) const;
+};
+
+// Returns nothing on a syntax error
+std::optional<JsonValue> ParseJson(std::string_view text);
+
+}  // namespace veng
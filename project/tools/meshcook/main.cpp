@@ -0,0 +1,77 @@
+#include <precomp.h>
+#include <chrono>
+#include <mesh_cooker.h>
+#include <mesh_import.h>
+#include <spdlog/spdlog.h>
+
+// veng_meshcook <input.obj|.gltf|.glb> <output.vmesh> [--cache-size=<n>] [--overdraw-threshold=<f>] [--keep-order]
+//               [--lods=<n>] [--lod-reduction=<f>]
+//
+// Cooks a mesh into the memory-mappable format of mesh_format.h. --keep-order skips the
+// triangle reordering, e.g. to compare against the optimized result. --lods=1 writes the
+// full mesh only.
+
+int main(int argc, gsl::zstring* argv)
+{
+	std::optional<std::filesystem::path> input;
+	std::optional<std::filesystem::path> output;
+	veng::MeshCookSettings settings;
+	for (int i = 1; i < argc; i++) {
+		const std::string_view argument = argv[i];
+		if (argument.starts_with("--cache-size=")) {
+			settings.cache_size = std::clamp(static_cast<std::uint32_t>(std::strtoul(argv[i] + 13, nullptr, 10)), 3u, 64u);
+		}
+		else if (argument.starts_with("--overdraw-threshold=")) {
+			settings.overdraw_threshold = std::max(1.0, std::atof(argv[i] + 21));
+		}
+		else if (argument == "--keep-order") {
+			settings.reorder_triangles = false;
+		}
+		else if (argument.starts_with("--lods=")) {
+			settings.lod_count = std::clamp(static_cast<std::uint32_t>(std::strtoul(argv[i] + 7, nullptr, 10)), 1u, veng::kMaxMeshLods);
+		}
+		else if (argument.starts_with("--lod-reduction=")) {
+			settings.lod_reduction = std::clamp(std::atof(argv[i] + 16), 0.05, 0.9);
+		}
+		else if (!input.has_value()) {
+			input = std::filesystem::path(argument);
+		}
+		else if (!output.has_value()) {
+			output = std::filesystem::path(argument);
+		}
+		else {
+			SPDLOG_ERROR("Unexpected argument: {}", argument);
+			return EXIT_FAILURE;
+		}
+	}
+	if (!input.has_value() || !output.has_value()) {
+		SPDLOG_ERROR(
+		    "Usage: veng_meshcook <input.obj|.gltf|.glb> <output.vmesh> [--cache-size=<n>] [--overdraw-threshold=<f>] [--keep-order] [--lods=<n>] "
+		    "[--lod-reduction=<f>]");
+		return EXIT_FAILURE;
+	}
+
+	using Milliseconds = std::chrono::duration<double, std::milli>;
+	const std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+
+	std::optional<veng::ImportedMesh> mesh = veng::ImportMesh(input.value());
+	if (!mesh.has_value()) {
+		return EXIT_FAILURE;
+	}
+	const std::chrono::steady_clock::time_point imported = std::chrono::steady_clock::now();
+
+	const veng::CookedMesh cooked = veng::CookMesh(std::move(mesh.value()), settings);
+	if (!veng::WriteMeshFile(output.value(), cooked)) {
+		SPDLOG_ERROR("Could not write {}", output->string());
+		return EXIT_FAILURE;
+	}
+
+	const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	SPDLOG_INFO(
+	    "Wrote {} ({} bytes) in {:.1f} ms, {:.1f} ms of it importing",
+	    output->string(),
+	    std::filesystem::file_size(output.value()),
+	    Milliseconds(end - begin).count(),
+	    Milliseconds(imported - begin).count());
+	return EXIT_SUCCESS;
+}
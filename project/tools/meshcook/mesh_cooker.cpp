@@ -0,0 +1,195 @@
+#include <precomp.h>
+#include <mesh_cooker.h>
+#include <mesh_optimizer.h>
+#include <mesh_simplifier.h>
+#include <fstream>
+#include <glm/gtc/packing.hpp>
+#include <spdlog/spdlog.h>
+
+namespace veng {
+
+namespace {
+
+// Below this a further LOD saves less than its draw costs
+constexpr std::size_t kMinLodTriangles = 16;
+
+PackedVertex QuantizeVertex(const ImportedVertex& vertex, const glm::vec3& bounds_min, const glm::vec3& inverse_extent)
+{
+	PackedVertex packed;
+	const glm::vec3 relative = (vertex.position - bounds_min) * inverse_extent;
+	for (std::uint32_t axis = 0; axis < 3; axis++) {
+		packed.position[axis] = static_cast<std::uint16_t>(std::lround(std::clamp(relative[axis], 0.0f, 1.0f) * 65535.0f));
+	}
+	packed.normal = glm::packSnorm3x10_1x2(glm::vec4(vertex.normal, 0.0f));
+	packed.uv = {glm::packHalf1x16(vertex.uv.x), glm::packHalf1x16(vertex.uv.y)};
+	return packed;
+}
+
+}  // namespace
+
+CookedMesh CookMesh(ImportedMesh mesh, const MeshCookSettings& settings)
+{
+	if (!mesh.has_normals) {
+		GenerateNormals(mesh);
+	}
+
+	CookedMesh cooked;
+	glm::vec3 bounds_min(std::numeric_limits<std::float_t>::max());
+	glm::vec3 bounds_max(std::numeric_limits<std::float_t>::lowest());
+	for (const ImportedVertex& vertex : mesh.vertices) {
+		bounds_min = glm::min(bounds_min, vertex.position);
+		bounds_max = glm::max(bounds_max, vertex.position);
+	}
+	cooked.header.bounds_min = bounds_min;
+	cooked.header.bounds_max = bounds_max;
+
+	// A flat axis quantizes to 0
+	const glm::vec3 extent = bounds_max - bounds_min;
+	const glm::vec3 inverse_extent(extent.x > 0.0f ? 1.0f / extent.x : 0.0f, extent.y > 0.0f ? 1.0f / extent.y : 0.0f, extent.z > 0.0f ? 1.0f / extent.z : 0.0f);
+
+	// Deduplicating after quantization also merges vertices that differ below its precision
+	std::vector<PackedVertex> packed;
+	std::vector<glm::vec3> positions;
+	packed.reserve(mesh.vertices.size());
+	positions.reserve(mesh.vertices.size());
+	for (const ImportedVertex& vertex : mesh.vertices) {
+		packed.push_back(QuantizeVertex(vertex, bounds_min, inverse_extent));
+		positions.push_back(vertex.position);
+	}
+
+	std::uint32_t vertex_count = 0;
+	const std::vector<std::uint32_t> unique_remap = GenerateVertexRemap<PackedVertex>(packed, vertex_count);
+	packed = RemapVertices<PackedVertex>(packed, unique_remap, vertex_count);
+	positions = RemapVertices<glm::vec3>(positions, unique_remap, vertex_count);
+	RemapIndices(mesh.indices, unique_remap);
+
+	// Triangles that collapsed onto an edge or a point only cost vertex shader work
+	std::vector<std::uint32_t> indices;
+	indices.reserve(mesh.indices.size());
+	for (std::size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+		const std::uint32_t a = mesh.indices[i];
+		const std::uint32_t b = mesh.indices[i + 1];
+		const std::uint32_t c = mesh.indices[i + 2];
+		if (a != b && b != c && a != c) {
+			indices.insert(indices.end(), {a, b, c});
+		}
+	}
+	const VertexCacheStats before = AnalyzeVertexCache(indices, vertex_count, settings.cache_size);
+
+	// One simplifier run produces the whole chain; errors stay relative to the source surface
+	std::vector<std::vector<std::uint32_t>> lods;
+	std::vector<std::float_t> lod_errors = {0.0f};
+	lods.push_back(std::move(indices));
+	MeshSimplifier simplifier(lods.front(), positions);
+	const std::float_t max_error = static_cast<std::float_t>(settings.lod_max_error) * glm::length(extent);
+	while (lods.size() < std::min(settings.lod_count, kMaxMeshLods)) {
+		const std::size_t previous_count = lods.back().size();
+		const std::size_t target_count = static_cast<std::size_t>(static_cast<std::double_t>(previous_count / 3) * settings.lod_reduction) * 3;
+		if (target_count < kMinLodTriangles * 3) {
+			break;
+		}
+		const std::float_t error = simplifier.Simplify(target_count, max_error);
+		const gsl::span<const std::uint32_t> simplified = simplifier.GetIndices();
+		// Locked borders and seams or the error limit stopped the simplifier early
+		if (simplified.empty() || simplified.size() * 10 > previous_count * 9) {
+			break;
+		}
+		lods.emplace_back(simplified.begin(), simplified.end());
+		lod_errors.push_back(error);
+	}
+
+	if (settings.reorder_triangles) {
+		for (std::vector<std::uint32_t>& lod : lods) {
+			const std::vector<std::uint32_t> clusters = OptimizeVertexCache(lod, vertex_count, settings.cache_size);
+			OptimizeOverdraw(lod, positions, clusters, settings.cache_size, settings.overdraw_threshold);
+		}
+	}
+
+	// One index buffer, finest LOD first, so vertex fetch order follows the full mesh
+	std::vector<std::uint32_t> indices_all;
+	for (std::size_t level = 0; level < lods.size(); level++) {
+		MeshLod lod;
+		lod.first_index = gsl::narrow_cast<std::uint32_t>(indices_all.size());
+		lod.index_count = gsl::narrow_cast<std::uint32_t>(lods[level].size());
+		lod.error = lod_errors[level];
+		cooked.lods.push_back(lod);
+		indices_all.insert(indices_all.end(), lods[level].begin(), lods[level].end());
+	}
+	indices = std::move(indices_all);
+
+	std::uint32_t used_count = 0;
+	const std::vector<std::uint32_t> fetch_remap = OptimizeVertexFetch(indices, vertex_count, used_count);
+	cooked.vertices = RemapVertices<PackedVertex>(packed, fetch_remap, used_count);
+	const gsl::span<const std::uint32_t> full_mesh(indices.data(), cooked.lods[0].index_count);
+	const VertexCacheStats after = AnalyzeVertexCache(full_mesh, used_count, settings.cache_size);
+
+	// 16-bit indices halve the index fetch whenever the vertex count allows it
+	const std::uint32_t index_size = used_count <= 65536 ? 2 : 4;
+	cooked.indices.resize(indices.size() * index_size);
+	for (std::size_t i = 0; i < indices.size(); i++) {
+		if (index_size == 2) {
+			const std::uint16_t index = static_cast<std::uint16_t>(indices[i]);
+			std::memcpy(cooked.indices.data() + i * 2, &index, 2);
+		}
+		else {
+			std::memcpy(cooked.indices.data() + i * 4, &indices[i], 4);
+		}
+	}
+
+	MeshFileHeader& header = cooked.header;
+	header.vertex_count = used_count;
+	header.index_count = gsl::narrow_cast<std::uint32_t>(indices.size());
+	header.vertex_stride = sizeof(PackedVertex);
+	header.index_size = index_size;
+	header.lod_count = gsl::narrow_cast<std::uint32_t>(cooked.lods.size());
+	header.lod_offset = AlignMeshOffset(sizeof(MeshFileHeader));
+	header.vertex_offset = AlignMeshOffset(header.lod_offset + std::uint64_t(header.lod_count) * sizeof(MeshLod));
+	header.index_offset = AlignMeshOffset(header.vertex_offset + std::uint64_t(used_count) * sizeof(PackedVertex));
+
+	SPDLOG_INFO(
+	    "{} source vertices -> {} unique, {} triangles ({} degenerate removed), {}-bit indices",
+	    mesh.vertices.size(),
+	    used_count,
+	    full_mesh.size() / 3,
+	    (mesh.indices.size() - full_mesh.size()) / 3,
+	    index_size * 8);
+	SPDLOG_INFO("Vertex cache ({} entries): ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}", settings.cache_size, before.acmr, after.acmr, before.atvr, after.atvr);
+	for (std::size_t level = 1; level < cooked.lods.size(); level++) {
+		const MeshLod& lod = cooked.lods[level];
+		SPDLOG_INFO(
+		    "LOD {}: {} triangles ({:.2f}% of the full mesh), error {:.3g}, ACMR {:.3f}",
+		    level,
+		    lod.index_count / 3,
+		    100.0 * lod.index_count / full_mesh.size(),
+		    lod.error,
+		    AnalyzeVertexCache(gsl::span<const std::uint32_t>(indices).subspan(lod.first_index, lod.index_count), used_count, settings.cache_size).acmr);
+	}
+	return cooked;
+}
+
+bool WriteMeshFile(const std::filesystem::path& path, const CookedMesh& mesh)
+{
+	std::ofstream file(path, std::ios::binary);
+	if (!file) {
+		return false;
+	}
+
+	const MeshFileHeader& header = mesh.header;
+	const auto pad_to = [&file](std::uint64_t offset) {
+		const std::uint64_t position = static_cast<std::uint64_t>(file.tellp());
+		for (std::uint64_t i = position; i < offset; i++) {
+			file.put(0);
+		}
+	};
+
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	pad_to(header.lod_offset);
+	file.write(reinterpret_cast<const char*>(mesh.lods.data()), mesh.lods.size() * sizeof(MeshLod));
+	pad_to(header.vertex_offset);
+	file.write(reinterpret_cast<const char*>(mesh.vertices.data()), mesh.vertices.size() * sizeof(PackedVertex));
+	pad_to(header.index_offset);
+	file.write(reinterpret_cast<const char*>(mesh.indices.data()), mesh.indices.size());
+	return static_cast<bool>(file);
+}
+
+}  // namespace veng
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <filesystem>
+#include <mesh_format.h>
+#include <mesh_import.h>
+#include <vector>
+
+namespace veng {
+
+struct MeshCookSettings {
+	// Post-transform cache size the triangle order is tuned for; 16 to 32 covers current GPUs
+	std::uint32_t cache_size = 16;
+	// Cache efficiency the overdraw pass may give up, as a factor of the cache-optimized ACMR
+	std::double_t overdraw_threshold = 1.05;
+	// Off: only deduplicate, quantize and compact, keeping the source triangle order
+	bool reorder_triangles = true;
+	// Levels of detail written, including the full mesh; 1 skips simplification
+	std::uint32_t lod_count = kMaxMeshLods;
+	// Triangle count of each LOD as a fraction of the one before
+	std::double_t lod_reduction = 0.5;
+	// Simplification error (MeshLod::error) a LOD may reach, relative to the bounds diagonal;
+	// the chain ends early rather than exceed it
+	std::double_t lod_max_error = 0.1;
+};
+
+struct CookedMesh {
+	MeshFileHeader header;
+	std::vector<MeshLod> lods;
+	std::vector<PackedVertex> vertices;
+	std::vector<std::uint8_t> indices;  // header.index_size bytes per index
+};
+
+// Quantizes, deduplicates, simplifies into a LOD chain and reorders `mesh` for the GPU,
+// logging the vertex cache statistics before and after
+CookedMesh CookMesh(ImportedMesh mesh, const MeshCookSettings& settings);
+
+bool WriteMeshFile(const std::filesystem::path& path, const CookedMesh& mesh);
+
+}  // namespace veng
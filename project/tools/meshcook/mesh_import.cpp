@@ -0,0 +1,691 @@
+#include <precomp.h>
+#include <mesh_import.h>
+#include <json.h>
+#include <bit>
+#include <charconv>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <spdlog/spdlog.h>
+#include <unordered_map>
+
+namespace veng {
+
+namespace {
+
+#pragma region OBJ
+
+std::string_view NextToken(std::string_view& line)
+{
+	const std::size_t begin = line.find_first_not_of(" \t");
+	if (begin == std::string_view::npos) {
+		line = {};
+		return {};
+	}
+	line.remove_prefix(begin);
+	const std::size_t end = std::min(line.find_first_of(" \t"), line.size());
+	const std::string_view token = line.substr(0, end);
+	line.remove_prefix(end);
+	return token;
+}
+
+// Missing trailing values keep their defaults, e.g. the optional w of "v"
+bool ParseFloats(std::string_view line, gsl::span<std::float_t> values)
+{
+	for (std::float_t& value : values) {
+		const std::string_view token = NextToken(line);
+		if (token.empty()) {
+			return true;
+		}
+		if (std::from_chars(token.data(), token.data() + token.size(), value).ec != std::errc()) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// OBJ indices are 1-based, or relative to the end when negative
+std::optional<std::uint32_t> ResolveObjIndex(std::string_view token, std::size_t count)
+{
+	std::int64_t index = 0;
+	if (std::from_chars(token.data(), token.data() + token.size(), index).ec != std::errc() || index == 0) {
+		return std::nullopt;
+	}
+	const std::int64_t resolved = index > 0 ? index - 1 : static_cast<std::int64_t>(count) + index;
+	if (resolved < 0 || resolved >= static_cast<std::int64_t>(count)) {
+		return std::nullopt;
+	}
+	return static_cast<std::uint32_t>(resolved);
+}
+
+#pragma endregion
+
+#pragma region GLTF
+
+constexpr std::uint32_t kGlbMagic = 0x46546C67;  // "glTF"
+constexpr std::uint32_t kGlbJsonChunk = 0x4E4F534A;
+constexpr std::uint32_t kGlbBinaryChunk = 0x004E4942;
+
+constexpr std::uint32_t kComponentByte = 5120;
+constexpr std::uint32_t kComponentUnsignedByte = 5121;
+constexpr std::uint32_t kComponentShort = 5122;
+constexpr std::uint32_t kComponentUnsignedShort = 5123;
+constexpr std::uint32_t kComponentUnsignedInt = 5125;
+constexpr std::uint32_t kComponentFloat = 5126;
+
+constexpr std::uint32_t kModeTriangles = 4;
+
+std::uint32_t ReadLittleEndian32(gsl::span<const std::uint8_t> bytes, std::size_t offset)
+{
+	return std::uint32_t(bytes[offset]) | (std::uint32_t(bytes[offset + 1]) << 8) | (std::uint32_t(bytes[offset + 2]) << 16) | (std::uint32_t(bytes[offset + 3]) << 24);
+}
+
+std::optional<std::vector<std::uint8_t>> DecodeBase64(std::string_view text)
+{
+	const auto decode = [](char c) -> std::int32_t {
+		if (c >= 'A' && c <= 'Z') {
+			return c - 'A';
+		}
+		if (c >= 'a' && c <= 'z') {
+			return c - 'a' + 26;
+		}
+		if (c >= '0' && c <= '9') {
+			return c - '0' + 52;
+		}
+		if (c == '+') {
+			return 62;
+		}
+		if (c == '/') {
+			return 63;
+		}
+		return -1;
+	};
+
+	std::vector<std::uint8_t> bytes;
+	bytes.reserve(text.size() / 4 * 3);
+	std::uint32_t bits = 0;
+	std::uint32_t bit_count = 0;
+	for (char c : text) {
+		if (c == '=') {
+			break;
+		}
+		const std::int32_t value = decode(c);
+		if (value < 0) {
+			return std::nullopt;
+		}
+		bits = (bits << 6) | static_cast<std::uint32_t>(value);
+		bit_count += 6;
+		if (bit_count >= 8) {
+			bit_count -= 8;
+			bytes.push_back(static_cast<std::uint8_t>(bits >> bit_count));
+		}
+	}
+	return bytes;
+}
+
+std::string DecodeUri(std::string_view uri)
+{
+	std::string decoded;
+	for (std::size_t i = 0; i < uri.size(); i++) {
+		std::uint32_t code = 0;
+		if (uri[i] == '%' && i + 2 < uri.size() && std::from_chars(uri.data() + i + 1, uri.data() + i + 3, code, 16).ec == std::errc()) {
+			decoded += static_cast<char>(code);
+			i += 2;
+		}
+		else {
+			decoded += uri[i];
+		}
+	}
+	return decoded;
+}
+
+std::uint32_t GetComponentSize(std::uint32_t component_type)
+{
+	switch (component_type) {
+		case kComponentByte:
+		case kComponentUnsignedByte:
+			return 1;
+		case kComponentShort:
+		case kComponentUnsignedShort:
+			return 2;
+		case kComponentUnsignedInt:
+		case kComponentFloat:
+			return 4;
+	}
+	return 0;
+}
+
+std::uint32_t GetComponentCount(std::string_view type)
+{
+	if (type == "SCALAR") {
+		return 1;
+	}
+	if (type == "VEC2") {
+		return 2;
+	}
+	if (type == "VEC3") {
+		return 3;
+	}
+	if (type == "VEC4") {
+		return 4;
+	}
+	return 0;
+}
+
+// A validated accessor: every element lies within its buffer
+struct GltfAccessor {
+	const std::uint8_t* data = nullptr;
+	std::size_t count = 0;
+	std::size_t stride = 0;
+	std::uint32_t component_type = 0;
+	std::uint32_t component_count = 0;
+	bool normalized = false;
+
+	std::float_t ReadFloat(std::size_t element, std::uint32_t component) const
+	{
+		const std::uint8_t* source = data + element * stride + component * GetComponentSize(component_type);
+		switch (component_type) {
+			case kComponentFloat:
+				return Load<std::float_t>(source);
+			case kComponentUnsignedByte:
+				return normalized ? source[0] / 255.0f : source[0];
+			case kComponentByte: {
+				const std::int8_t value = Load<std::int8_t>(source);
+				return normalized ? std::max(value / 127.0f, -1.0f) : value;
+			}
+			case kComponentUnsignedShort: {
+				const std::uint16_t value = Load<std::uint16_t>(source);
+				return normalized ? value / 65535.0f : value;
+			}
+			case kComponentShort: {
+				const std::int16_t value = Load<std::int16_t>(source);
+				return normalized ? std::max(value / 32767.0f, -1.0f) : value;
+			}
+		}
+		return 0.0f;
+	}
+
+	std::uint32_t ReadIndex(std::size_t element) const
+	{
+		const std::uint8_t* source = data + element * stride;
+		switch (component_type) {
+			case kComponentUnsignedByte:
+				return source[0];
+			case kComponentUnsignedShort:
+				return Load<std::uint16_t>(source);
+			case kComponentUnsignedInt:
+				return Load<std::uint32_t>(source);
+		}
+		return 0;
+	}
+
+	// Buffer data carries no alignment guarantee for a byte stride that is not a multiple
+	template <typename T>
+	static T Load(const std::uint8_t* source)
+	{
+		T value;
+		std::memcpy(&value, source, sizeof(T));
+		return value;
+	}
+};
+
+class GltfImporter {
+public:
+	explicit GltfImporter(std::filesystem::path path) : path_(std::move(path)) {}
+
+	std::optional<ImportedMesh> Import()
+	{
+		const std::vector<std::uint8_t> file = ReadFile(path_);
+		if (file.empty()) {
+			SPDLOG_ERROR("Could not read {}", path_.string());
+			return std::nullopt;
+		}
+
+		std::string_view json_text(reinterpret_cast<const char*>(file.data()), file.size());
+		gsl::span<const std::uint8_t> binary_chunk;
+		if (file.size() >= 12 && ReadLittleEndian32(file, 0) == kGlbMagic) {
+			if (!SplitGlb(file, json_text, binary_chunk)) {
+				SPDLOG_ERROR("{} is not a valid GLB container", path_.string());
+				return std::nullopt;
+			}
+		}
+
+		std::optional<JsonValue> document = ParseJson(json_text);
+		if (!document.has_value()) {
+			SPDLOG_ERROR("{} is not valid JSON", path_.string());
+			return std::nullopt;
+		}
+		document_ = std::move(document.value());
+		if (!LoadBuffers(binary_chunk)) {
+			return std::nullopt;
+		}
+
+		// Without scenes every mesh is imported once, untransformed
+		const JsonValue* scenes = document_.Find("scenes");
+		if (scenes == nullptr || scenes->array.empty()) {
+			const JsonValue* meshes = document_.Find("meshes");
+			for (std::size_t i = 0; meshes != nullptr && i < meshes->array.size(); i++) {
+				ImportMeshInstance(meshes->array[i], glm::mat4(1.0f));
+			}
+		}
+		else {
+			const std::size_t scene_index = static_cast<std::size_t>(document_.GetNumber("scene", 0.0));
+			if (scene_index >= scenes->array.size()) {
+				SPDLOG_ERROR("{} has no scene {}", path_.string(), scene_index);
+				return std::nullopt;
+			}
+			const JsonValue* roots = scenes->array[scene_index].Find("nodes");
+			for (std::size_t i = 0; roots != nullptr && i < roots->array.size(); i++) {
+				ImportNode(static_cast<std::size_t>(roots->array[i].number), glm::mat4(1.0f), 0);
+			}
+		}
+
+		if (failed_) {
+			return std::nullopt;
+		}
+		return std::move(mesh_);
+	}
+
+private:
+	// glTF forbids cycles; this only guards against files that have them anyway
+	static constexpr std::uint32_t kMaxNodeDepth = 256;
+
+	static bool SplitGlb(gsl::span<const std::uint8_t> file, std::string_view& json_text, gsl::span<const std::uint8_t>& binary_chunk)
+	{
+		std::size_t offset = 12;
+		bool has_json = false;
+		while (offset + 8 <= file.size()) {
+			const std::size_t length = ReadLittleEndian32(file, offset);
+			const std::uint32_t type = ReadLittleEndian32(file, offset + 4);
+			offset += 8;
+			if (length > file.size() - offset) {
+				return false;
+			}
+			if (type == kGlbJsonChunk && !has_json) {
+				json_text = std::string_view(reinterpret_cast<const char*>(file.data() + offset), length);
+				has_json = true;
+			}
+			else if (type == kGlbBinaryChunk && binary_chunk.empty()) {
+				binary_chunk = file.subspan(offset, length);
+			}
+			offset += length;
+		}
+		return has_json;
+	}
+
+	bool LoadBuffers(gsl::span<const std::uint8_t> binary_chunk)
+	{
+		const JsonValue* buffers = document_.Find("buffers");
+		for (std::size_t i = 0; buffers != nullptr && i < buffers->array.size(); i++) {
+			const JsonValue& buffer = buffers->array[i];
+			const std::string_view uri = buffer.GetString("uri");
+			std::vector<std::uint8_t>& data = buffers_.emplace_back();
+
+			if (uri.empty()) {
+				// Only the first buffer of a GLB may refer to the binary chunk
+				data.assign(binary_chunk.begin(), binary_chunk.end());
+			}
+			else if (uri.starts_with("data:")) {
+				const std::size_t base64 = uri.find(";base64,");
+				std::optional<std::vector<std::uint8_t>> decoded = base64 != std::string_view::npos ? DecodeBase64(uri.substr(base64 + 8)) : std::nullopt;
+				if (!decoded.has_value()) {
+					SPDLOG_ERROR("Buffer {} of {} has an unsupported data URI", i, path_.string());
+					return false;
+				}
+				data = std::move(decoded.value());
+			}
+			else {
+				data = ReadFile(path_.parent_path() / std::filesystem::u8path(DecodeUri(uri)));
+			}
+
+			if (data.size() < static_cast<std::size_t>(buffer.GetNumber("byteLength", 0.0))) {
+				SPDLOG_ERROR("Buffer {} of {} is missing or shorter than declared", i, path_.string());
+				return false;
+			}
+		}
+		return true;
+	}
+
+	std::optional<GltfAccessor> GetAccessor(std::size_t index)
+	{
+		const JsonValue* accessors = document_.Find("accessors");
+		const JsonValue* views = document_.Find("bufferViews");
+		if (accessors == nullptr || index >= accessors->array.size()) {
+			return std::nullopt;
+		}
+		const JsonValue& accessor = accessors->array[index];
+		if (accessor.Find("sparse") != nullptr || accessor.Find("bufferView") == nullptr || views == nullptr) {
+			return std::nullopt;
+		}
+		const std::size_t view_index = static_cast<std::size_t>(accessor.GetNumber("bufferView", 0.0));
+		if (view_index >= views->array.size()) {
+			return std::nullopt;
+		}
+		const JsonValue& view = views->array[view_index];
+		const std::size_t buffer_index = static_cast<std::size_t>(view.GetNumber("buffer", 0.0));
+		if (buffer_index >= buffers_.size()) {
+			return std::nullopt;
+		}
+
+		GltfAccessor result;
+		result.component_type = static_cast<std::uint32_t>(accessor.GetNumber("componentType", 0.0));
+		result.component_count = GetComponentCount(accessor.GetString("type"));
+		result.count = static_cast<std::size_t>(accessor.GetNumber("count", 0.0));
+		result.normalized = accessor.Find("normalized") != nullptr && accessor.Find("normalized")->boolean;
+		const std::size_t element_size = std::size_t(GetComponentSize(result.component_type)) * result.component_count;
+		result.stride = static_cast<std::size_t>(view.GetNumber("byteStride", static_cast<std::double_t>(element_size)));
+		if (element_size == 0 || result.stride < element_size) {
+			return std::nullopt;
+		}
+
+		const std::size_t offset = static_cast<std::size_t>(view.GetNumber("byteOffset", 0.0)) + static_cast<std::size_t>(accessor.GetNumber("byteOffset", 0.0));
+		const std::size_t view_end = static_cast<std::size_t>(view.GetNumber("byteOffset", 0.0)) + static_cast<std::size_t>(view.GetNumber("byteLength", 0.0));
+		const std::size_t end = result.count == 0 ? offset : offset + (result.count - 1) * result.stride + element_size;
+		if (end > view_end || view_end > buffers_[buffer_index].size()) {
+			return std::nullopt;
+		}
+		result.data = buffers_[buffer_index].data() + offset;
+		return result;
+	}
+
+	static glm::mat4 GetNodeMatrix(const JsonValue& node)
+	{
+		const JsonValue* matrix = node.Find("matrix");
+		if (matrix != nullptr && matrix->array.size() == 16) {
+			glm::mat4 result(1.0f);
+			for (std::uint32_t column = 0; column < 4; column++) {
+				for (std::uint32_t row = 0; row < 4; row++) {
+					result[column][row] = static_cast<std::float_t>(matrix->array[column * 4 + row].number);
+				}
+			}
+			return result;
+		}
+
+		const auto read = [&node](std::string_view key, gsl::span<std::float_t> values) {
+			const JsonValue* array = node.Find(key);
+			for (std::size_t i = 0; array != nullptr && i < values.size() && i < array->array.size(); i++) {
+				values[i] = static_cast<std::float_t>(array->array[i].number);
+			}
+		};
+		std::array<std::float_t, 3> translation = {0.0f, 0.0f, 0.0f};
+		std::array<std::float_t, 4> rotation = {0.0f, 0.0f, 0.0f, 1.0f};  // x, y, z, w
+		std::array<std::float_t, 3> scale = {1.0f, 1.0f, 1.0f};
+		read("translation", translation);
+		read("rotation", rotation);
+		read("scale", scale);
+
+		return glm::translate(glm::mat4(1.0f), glm::vec3(translation[0], translation[1], translation[2])) *
+		       glm::mat4_cast(glm::quat(rotation[3], rotation[0], rotation[1], rotation[2])) * glm::scale(glm::mat4(1.0f), glm::vec3(scale[0], scale[1], scale[2]));
+	}
+
+	void ImportNode(std::size_t index, const glm::mat4& parent, std::uint32_t depth)
+	{
+		const JsonValue* nodes = document_.Find("nodes");
+		if (nodes == nullptr || index >= nodes->array.size() || depth > kMaxNodeDepth) {
+			SPDLOG_WARN("Skipping invalid node {} in {}", index, path_.string());
+			return;
+		}
+		const JsonValue& node = nodes->array[index];
+		const glm::mat4 world = parent * GetNodeMatrix(node);
+
+		const JsonValue* meshes = document_.Find("meshes");
+		if (node.Find("mesh") != nullptr && meshes != nullptr) {
+			const std::size_t mesh_index = static_cast<std::size_t>(node.GetNumber("mesh", 0.0));
+			if (mesh_index < meshes->array.size()) {
+				ImportMeshInstance(meshes->array[mesh_index], world);
+			}
+		}
+
+		const JsonValue* children = node.Find("children");
+		for (std::size_t i = 0; children != nullptr && i < children->array.size(); i++) {
+			ImportNode(static_cast<std::size_t>(children->array[i].number), world, depth + 1);
+		}
+	}
+
+	void ImportMeshInstance(const JsonValue& mesh, const glm::mat4& world)
+	{
+		const JsonValue* primitives = mesh.Find("primitives");
+		for (std::size_t i = 0; primitives != nullptr && i < primitives->array.size(); i++) {
+			const JsonValue& primitive = primitives->array[i];
+			if (static_cast<std::uint32_t>(primitive.GetNumber("mode", kModeTriangles)) != kModeTriangles) {
+				SPDLOG_WARN("Skipping a non-triangle primitive of mesh '{}'", mesh.GetString("name"));
+				continue;
+			}
+			if (!ImportPrimitive(primitive, world)) {
+				SPDLOG_ERROR("Primitive {} of mesh '{}' in {} has invalid accessors", i, mesh.GetString("name"), path_.string());
+				failed_ = true;
+			}
+		}
+	}
+
+	bool ImportPrimitive(const JsonValue& primitive, const glm::mat4& world)
+	{
+		const JsonValue* attributes = primitive.Find("attributes");
+		if (attributes == nullptr || attributes->Find("POSITION") == nullptr) {
+			return false;
+		}
+		const auto attribute = [this, attributes](std::string_view name) -> std::optional<GltfAccessor> {
+			return attributes->Find(name) != nullptr ? GetAccessor(static_cast<std::size_t>(attributes->GetNumber(name, 0.0))) : std::nullopt;
+		};
+
+		const std::optional<GltfAccessor> positions = attribute("POSITION");
+		const std::optional<GltfAccessor> normals = attribute("NORMAL");
+		const std::optional<GltfAccessor> uvs = attribute("TEXCOORD_0");
+		if (!positions.has_value() || positions->component_count != 3 || (attributes->Find("NORMAL") != nullptr && !normals.has_value()) ||
+		    (attributes->Find("TEXCOORD_0") != nullptr && !uvs.has_value())) {
+			return false;
+		}
+		if ((normals.has_value() && normals->count < positions->count) || (uvs.has_value() && uvs->count < positions->count)) {
+			return false;
+		}
+
+		// Normals take the inverse transpose; mirroring transforms flip the winding
+		const glm::mat3 linear(world);
+		const glm::mat3 normal_matrix = glm::transpose(glm::inverse(linear));
+		const bool mirrored = glm::determinant(linear) < 0.0f;
+
+		const std::uint32_t base = gsl::narrow_cast<std::uint32_t>(mesh_.vertices.size());
+		for (std::size_t i = 0; i < positions->count; i++) {
+			ImportedVertex vertex;
+			vertex.position = glm::vec3(world * glm::vec4(positions->ReadFloat(i, 0), positions->ReadFloat(i, 1), positions->ReadFloat(i, 2), 1.0f));
+			if (normals.has_value()) {
+				const glm::vec3 normal = normal_matrix * glm::vec3(normals->ReadFloat(i, 0), normals->ReadFloat(i, 1), normals->ReadFloat(i, 2));
+				vertex.normal = glm::length(normal) > 0.0f ? glm::normalize(normal) : normal;
+			}
+			if (uvs.has_value()) {
+				vertex.uv = glm::vec2(uvs->ReadFloat(i, 0), uvs->ReadFloat(i, 1));
+			}
+			mesh_.vertices.push_back(vertex);
+		}
+		mesh_.has_normals = mesh_.has_normals && normals.has_value();
+
+		std::vector<std::uint32_t> indices;
+		if (primitive.Find("indices") != nullptr) {
+			const std::optional<GltfAccessor> index_accessor = GetAccessor(static_cast<std::size_t>(primitive.GetNumber("indices", 0.0)));
+			if (!index_accessor.has_value() || index_accessor->component_count != 1) {
+				return false;
+			}
+			for (std::size_t i = 0; i < index_accessor->count; i++) {
+				indices.push_back(index_accessor->ReadIndex(i));
+			}
+		}
+		else {
+			for (std::uint32_t i = 0; i < positions->count; i++) {
+				indices.push_back(i);
+			}
+		}
+
+		for (std::size_t i = 0; i + 2 < indices.size(); i += 3) {
+			if (indices[i] >= positions->count || indices[i + 1] >= positions->count || indices[i + 2] >= positions->count) {
+				return false;
+			}
+			mesh_.indices.push_back(base + indices[i]);
+			mesh_.indices.push_back(base + indices[mirrored ? i + 2 : i + 1]);
+			mesh_.indices.push_back(base + indices[mirrored ? i + 1 : i + 2]);
+		}
+		return true;
+	}
+
+	std::filesystem::path path_;
+	JsonValue document_;
+	std::vector<std::vector<std::uint8_t>> buffers_;
+	ImportedMesh mesh_;
+	bool failed_ = false;
+};
+
+#pragma endregion
+
+struct PositionHash {
+	std::size_t operator()(const glm::vec3& position) const
+	{
+		const std::uint32_t x = std::bit_cast<std::uint32_t>(position.x);
+		const std::uint32_t y = std::bit_cast<std::uint32_t>(position.y);
+		const std::uint32_t z = std::bit_cast<std::uint32_t>(position.z);
+		return (std::size_t(x) * 73856093u) ^ (std::size_t(y) * 19349663u) ^ (std::size_t(z) * 83492791u);
+	}
+};
+
+}  // namespace
+
+std::optional<ImportedMesh> ImportObj(const std::filesystem::path& path)
+{
+	const std::vector<std::uint8_t> file = ReadFile(path);
+	if (file.empty()) {
+		SPDLOG_ERROR("Could not read {}", path.string());
+		return std::nullopt;
+	}
+
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> normals;
+	std::vector<glm::vec2> uvs;
+	ImportedMesh mesh;
+
+	std::string_view text(reinterpret_cast<const char*>(file.data()), file.size());
+	for (std::size_t line_number = 1; !text.empty(); line_number++) {
+		const std::size_t line_end = std::min(text.find('\n'), text.size());
+		std::string_view line = text.substr(0, line_end);
+		text.remove_prefix(std::min(line_end + 1, text.size()));
+		line = line.substr(0, std::min(line.find_first_of("#\r"), line.size()));
+
+		const std::string_view keyword = NextToken(line);
+		bool valid = true;
+		if (keyword == "v") {
+			std::array<std::float_t, 3> values = {};
+			valid = ParseFloats(line, values);
+			positions.emplace_back(values[0], values[1], values[2]);
+		}
+		else if (keyword == "vn") {
+			std::array<std::float_t, 3> values = {};
+			valid = ParseFloats(line, values);
+			normals.emplace_back(values[0], values[1], values[2]);
+		}
+		else if (keyword == "vt") {
+			// OBJ puts the texture origin at the bottom left
+			std::array<std::float_t, 2> values = {};
+			valid = ParseFloats(line, values);
+			uvs.emplace_back(values[0], 1.0f - values[1]);
+		}
+		else if (keyword == "f") {
+			// Polygons become a triangle fan around their first corner
+			const std::uint32_t first_corner = gsl::narrow_cast<std::uint32_t>(mesh.vertices.size());
+			std::uint32_t corner_count = 0;
+			for (std::string_view corner = NextToken(line); valid && !corner.empty(); corner = NextToken(line)) {
+				const std::size_t first_slash = std::min(corner.find('/'), corner.size());
+				const std::string_view position_token = corner.substr(0, first_slash);
+				const std::string_view rest = corner.substr(std::min(first_slash + 1, corner.size()));
+				const std::size_t second_slash = std::min(rest.find('/'), rest.size());
+				const std::string_view uv_token = first_slash < corner.size() ? rest.substr(0, second_slash) : std::string_view();
+				const std::string_view normal_token = rest.substr(std::min(second_slash + 1, rest.size()));
+
+				ImportedVertex vertex;
+				const std::optional<std::uint32_t> position = ResolveObjIndex(position_token, positions.size());
+				valid = position.has_value();
+				if (valid) {
+					vertex.position = positions[position.value()];
+				}
+				if (!uv_token.empty()) {
+					const std::optional<std::uint32_t> uv = ResolveObjIndex(uv_token, uvs.size());
+					valid = valid && uv.has_value();
+					vertex.uv = uv.has_value() ? uvs[uv.value()] : glm::vec2(0.0f);
+				}
+				if (second_slash < rest.size() && !normal_token.empty()) {
+					const std::optional<std::uint32_t> normal = ResolveObjIndex(normal_token, normals.size());
+					valid = valid && normal.has_value();
+					vertex.normal = normal.has_value() ? normals[normal.value()] : glm::vec3(0.0f);
+				}
+				else {
+					mesh.has_normals = false;
+				}
+				mesh.vertices.push_back(vertex);
+				corner_count++;
+			}
+			for (std::uint32_t i = 2; valid && i < corner_count; i++) {
+				mesh.indices.push_back(first_corner);
+				mesh.indices.push_back(first_corner + i - 1);
+				mesh.indices.push_back(first_corner + i);
+			}
+		}
+
+		if (!valid) {
+			SPDLOG_ERROR("{}:{}: malformed '{}' record", path.string(), line_number, keyword);
+			return std::nullopt;
+		}
+	}
+
+	return mesh;
+}
+
+std::optional<ImportedMesh> ImportGltf(const std::filesystem::path& path)
+{
+	return GltfImporter(path).Import();
+}
+
+std::optional<ImportedMesh> ImportMesh(const std::filesystem::path& path)
+{
+	std::optional<ImportedMesh> mesh;
+	const std::string extension = path.extension().string();
+	if (extension == ".obj") {
+		mesh = ImportObj(path);
+	}
+	else if (extension == ".gltf" || extension == ".glb") {
+		mesh = ImportGltf(path);
+	}
+	else {
+		SPDLOG_ERROR("Unsupported mesh format '{}', expected .obj, .gltf or .glb", extension);
+		return std::nullopt;
+	}
+
+	if (mesh.has_value() && mesh->indices.empty()) {
+		SPDLOG_ERROR("{} contains no triangles", path.string());
+		return std::nullopt;
+	}
+	return mesh;
+}
+
+void GenerateNormals(ImportedMesh& mesh)
+{
+	// Unnormalized face normals are weighted by the triangle area
+	std::unordered_map<glm::vec3, glm::vec3, PositionHash> accumulated;
+	for (std::size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+		const glm::vec3& a = mesh.vertices[mesh.indices[i]].position;
+		const glm::vec3& b = mesh.vertices[mesh.indices[i + 1]].position;
+		const glm::vec3& c = mesh.vertices[mesh.indices[i + 2]].position;
+		const glm::vec3 face_normal = glm::cross(b - a, c - a);
+		for (const glm::vec3& corner : {a, b, c}) {
+			glm::vec3& sum = accumulated.try_emplace(corner, 0.0f).first->second;
+			sum = sum + face_normal;
+		}
+	}
+
+	for (ImportedVertex& vertex : mesh.vertices) {
+		if (glm::dot(vertex.normal, vertex.normal) > 0.0f) {
+			continue;
+		}
+		const std::unordered_map<glm::vec3, glm::vec3, PositionHash>::const_iterator sum = accumulated.find(vertex.position);
+		if (sum != accumulated.end() && glm::length(sum->second) > 0.0f) {
+			vertex.normal = glm::normalize(sum->second);
+		}
+	}
+	mesh.has_normals = true;
+}
+
+}  // namespace veng
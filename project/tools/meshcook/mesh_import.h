@@ -0,0 +1,36 @@
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+namespace veng {
+
+struct ImportedVertex {
+	glm::vec3 position = glm::vec3(0.0f);
+	glm::vec3 normal = glm::vec3(0.0f);
+	glm::vec2 uv = glm::vec2(0.0f);  // origin at the top left, like Vulkan texture coordinates
+};
+
+// Everything in the source file merged into one indexed triangle list, in the source's
+// vertex order and without any deduplication
+struct ImportedMesh {
+	std::vector<ImportedVertex> vertices;
+	std::vector<std::uint32_t> indices;
+	// False if the source lacked normals for some of the vertices; GenerateNormals fills them in
+	bool has_normals = true;
+};
+
+// Wavefront OBJ: v, vt, vn and polygonal f records; groups and materials are ignored
+std::optional<ImportedMesh> ImportObj(const std::filesystem::path& path);
+// glTF 2.0, .gltf with external or embedded buffers, or .glb. Triangle primitives of the
+// default scene are baked into scene space; sparse accessors are not supported.
+std::optional<ImportedMesh> ImportGltf(const std::filesystem::path& path);
+// Picks the importer by extension; logs why a file could not be imported
+std::optional<ImportedMesh> ImportMesh(const std::filesystem::path& path);
+
+// Fills in the normals the source lacked with smooth, area-weighted ones shared by every
+// vertex at the same position
+void GenerateNormals(ImportedMesh& mesh);
+
+}  // namespace veng
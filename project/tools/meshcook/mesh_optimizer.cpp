@@ -0,0 +1,248 @@
+#include <precomp.h>
+#include <mesh_optimizer.h>
+#include <algorithm>
+#include <numeric>
+
+namespace veng {
+
+namespace {
+
+// FIFO cache simulation: a vertex is cached while fewer than cache_size misses happened since
+// its own. Timestamps start at cache_size + 1 so an initial 0 always misses.
+class FifoCache {
+public:
+	FifoCache(std::uint32_t vertex_count, std::uint32_t cache_size) : cache_size_(cache_size), timestamp_(cache_size + 1), times_(vertex_count, 0) {}
+
+	// Returns true on a miss, which inserts the vertex
+	bool Access(std::uint32_t vertex)
+	{
+		if (timestamp_ - times_[vertex] > cache_size_) {
+			times_[vertex] = timestamp_++;
+			return true;
+		}
+		return false;
+	}
+
+	std::uint32_t GetAge(std::uint32_t vertex) const { return timestamp_ - times_[vertex]; }
+
+	void Flush() { timestamp_ += cache_size_ + 1; }
+
+private:
+	std::uint32_t cache_size_;
+	std::uint32_t timestamp_;
+	std::vector<std::uint32_t> times_;
+};
+
+}  // namespace
+
+VertexCacheStats AnalyzeVertexCache(gsl::span<const std::uint32_t> indices, std::uint32_t vertex_count, std::uint32_t cache_size)
+{
+	FifoCache cache(vertex_count, cache_size);
+	std::uint64_t misses = 0;
+	for (std::uint32_t index : indices) {
+		misses += cache.Access(index) ? 1 : 0;
+	}
+
+	VertexCacheStats stats;
+	stats.acmr = indices.empty() ? 0.0 : static_cast<std::double_t>(misses) / (indices.size() / 3);
+	stats.atvr = vertex_count == 0 ? 0.0 : static_cast<std::double_t>(misses) / vertex_count;
+	return stats;
+}
+
+void RemapIndices(gsl::span<std::uint32_t> indices, gsl::span<const std::uint32_t> remap)
+{
+	for (std::uint32_t& index : indices) {
+		index = remap[index];
+	}
+}
+
+std::vector<std::uint32_t> OptimizeVertexCache(gsl::span<std::uint32_t> indices, std::uint32_t vertex_count, std::uint32_t cache_size)
+{
+	Expects(indices.size() % 3 == 0);
+	const std::uint32_t triangle_count = gsl::narrow_cast<std::uint32_t>(indices.size() / 3);
+
+	// Triangles around each vertex, as ranges of one shared array
+	std::vector<std::uint32_t> live(vertex_count, 0);
+	for (std::uint32_t index : indices) {
+		live[index]++;
+	}
+	std::vector<std::uint32_t> offsets(vertex_count + 1, 0);
+	std::inclusive_scan(live.begin(), live.end(), offsets.begin() + 1);
+	std::vector<std::uint32_t> adjacency(indices.size());
+	{
+		std::vector<std::uint32_t> fill(offsets.begin(), offsets.end() - 1);
+		for (std::uint32_t i = 0; i < indices.size(); i++) {
+			adjacency[fill[indices[i]]++] = i / 3;
+		}
+	}
+
+	FifoCache cache(vertex_count, cache_size);
+	std::vector<bool> emitted(triangle_count, false);
+	std::vector<std::uint32_t> dead_end;
+	std::vector<std::uint32_t> candidates;
+	std::vector<std::uint32_t> output;
+	std::vector<std::uint32_t> cluster_starts;
+	dead_end.reserve(indices.size());
+	output.reserve(indices.size());
+
+	std::uint32_t fanning = indices.empty() ? kUnusedVertex : indices[0];
+	std::uint32_t cursor = 0;
+	if (fanning != kUnusedVertex) {
+		cluster_starts.push_back(0);
+	}
+
+	while (fanning != kUnusedVertex) {
+		// Emit every remaining triangle around the fanning vertex
+		candidates.clear();
+		for (std::uint32_t i = offsets[fanning]; i < offsets[fanning + 1]; i++) {
+			const std::uint32_t triangle = adjacency[i];
+			if (emitted[triangle]) {
+				continue;
+			}
+			emitted[triangle] = true;
+			for (std::uint32_t corner = 0; corner < 3; corner++) {
+				const std::uint32_t vertex = indices[triangle * 3 + corner];
+				output.push_back(vertex);
+				dead_end.push_back(vertex);
+				candidates.push_back(vertex);
+				live[vertex]--;
+				cache.Access(vertex);
+			}
+		}
+
+		// Next, prefer the oldest candidate whose remaining triangles still fit before it is
+		// evicted; each adds at most two new vertices
+		std::uint32_t next = kUnusedVertex;
+		std::int64_t best_priority = -1;
+		for (std::uint32_t vertex : candidates) {
+			if (live[vertex] == 0) {
+				continue;
+			}
+			const std::uint32_t age = cache.GetAge(vertex);
+			const std::int64_t priority = age + 2 * live[vertex] <= cache_size ? age : 0;
+			if (priority > best_priority) {
+				best_priority = priority;
+				next = vertex;
+			}
+		}
+
+		if (next == kUnusedVertex) {
+			// Dead end: go back to a recently used vertex, or failing that to any unfinished one
+			while (!dead_end.empty() && next == kUnusedVertex) {
+				const std::uint32_t vertex = dead_end.back();
+				dead_end.pop_back();
+				next = live[vertex] > 0 ? vertex : kUnusedVertex;
+			}
+			while (next == kUnusedVertex && cursor < vertex_count) {
+				next = live[cursor] > 0 ? cursor : kUnusedVertex;
+				cursor++;
+			}
+			if (next != kUnusedVertex) {
+				cluster_starts.push_back(gsl::narrow_cast<std::uint32_t>(output.size() / 3));
+			}
+		}
+		fanning = next;
+	}
+
+	std::copy(output.begin(), output.end(), indices.begin());
+	return cluster_starts;
+}
+
+void OptimizeOverdraw(
+    gsl::span<std::uint32_t> indices,
+    gsl::span<const glm::vec3> positions,
+    gsl::span<const std::uint32_t> cluster_starts,
+    std::uint32_t cache_size,
+    std::double_t threshold)
+{
+	const std::uint32_t vertex_count = gsl::narrow_cast<std::uint32_t>(positions.size());
+	const std::uint32_t triangle_count = gsl::narrow_cast<std::uint32_t>(indices.size() / 3);
+	if (triangle_count == 0) {
+		return;
+	}
+	const std::double_t target_acmr = AnalyzeVertexCache(indices, vertex_count, cache_size).acmr * threshold;
+
+	// Split each cluster as soon as the part so far, starting with a cold cache, is within the
+	// target; reordering such parts cannot push the whole buffer much beyond it
+	std::vector<std::uint32_t> clusters;
+	FifoCache cache(vertex_count, cache_size);
+	for (std::size_t c = 0; c < cluster_starts.size(); c++) {
+		const std::uint32_t end = c + 1 < cluster_starts.size() ? cluster_starts[c + 1] : triangle_count;
+		std::uint32_t start = cluster_starts[c];
+		std::uint32_t misses = 0;
+		clusters.push_back(start);
+		cache.Flush();
+		for (std::uint32_t triangle = start; triangle < end; triangle++) {
+			for (std::uint32_t corner = 0; corner < 3; corner++) {
+				misses += cache.Access(indices[triangle * 3 + corner]) ? 1 : 0;
+			}
+			const std::double_t acmr = static_cast<std::double_t>(misses) / (triangle - start + 1);
+			if (triangle + 1 < end && acmr <= target_acmr) {
+				start = triangle + 1;
+				misses = 0;
+				clusters.push_back(start);
+				cache.Flush();
+			}
+		}
+	}
+
+	// Area-weighted centroid and normal of each cluster and of the whole mesh
+	struct ClusterInfo {
+		std::uint32_t start = 0;
+		std::uint32_t end = 0;
+		std::float_t sort_key = 0.0f;
+	};
+	std::vector<ClusterInfo> infos(clusters.size());
+	std::vector<glm::vec3> centroids(clusters.size(), glm::vec3(0.0f));
+	std::vector<glm::vec3> normals(clusters.size(), glm::vec3(0.0f));
+	glm::vec3 mesh_centroid(0.0f);
+	std::float_t mesh_area = 0.0f;
+	for (std::size_t c = 0; c < clusters.size(); c++) {
+		infos[c].start = clusters[c];
+		infos[c].end = c + 1 < clusters.size() ? clusters[c + 1] : triangle_count;
+
+		std::float_t area = 0.0f;
+		for (std::uint32_t triangle = infos[c].start; triangle < infos[c].end; triangle++) {
+			const glm::vec3& a = positions[indices[triangle * 3]];
+			const glm::vec3& b = positions[indices[triangle * 3 + 1]];
+			const glm::vec3& d = positions[indices[triangle * 3 + 2]];
+			const glm::vec3 normal = glm::cross(b - a, d - a);
+			const std::float_t triangle_area = glm::length(normal);
+			centroids[c] = centroids[c] + (a + b + d) * (triangle_area / 3.0f);
+			normals[c] = normals[c] + normal;
+			area += triangle_area;
+		}
+		mesh_centroid = mesh_centroid + centroids[c];
+		mesh_area += area;
+		centroids[c] = area > 0.0f ? centroids[c] / area : positions[indices[infos[c].start * 3]];
+	}
+	mesh_centroid = mesh_area > 0.0f ? mesh_centroid / mesh_area : glm::vec3(0.0f);
+
+	for (std::size_t c = 0; c < clusters.size(); c++) {
+		const std::float_t normal_length = glm::length(normals[c]);
+		infos[c].sort_key = normal_length > 0.0f ? glm::dot(centroids[c] - mesh_centroid, normals[c] / normal_length) : 0.0f;
+	}
+	std::stable_sort(infos.begin(), infos.end(), [](const ClusterInfo& left, const ClusterInfo& right) { return left.sort_key > right.sort_key; });
+
+	std::vector<std::uint32_t> sorted;
+	sorted.reserve(indices.size());
+	for (const ClusterInfo& info : infos) {
+		sorted.insert(sorted.end(), indices.begin() + info.start * 3, indices.begin() + info.end * 3);
+	}
+	std::copy(sorted.begin(), sorted.end(), indices.begin());
+}
+
+std::vector<std::uint32_t> OptimizeVertexFetch(gsl::span<std::uint32_t> indices, std::uint32_t vertex_count, std::uint32_t& used_count)
+{
+	std::vector<std::uint32_t> remap(vertex_count, kUnusedVertex);
+	used_count = 0;
+	for (std::uint32_t& index : indices) {
+		if (remap[index] == kUnusedVertex) {
+			remap[index] = used_count++;
+		}
+		index = remap[index];
+	}
+	return remap;
+}
+
+}  // namespace veng
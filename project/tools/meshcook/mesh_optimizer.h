@@ -0,0 +1,96 @@
+#pragma once
+
+#include <vector>
+
+namespace veng {
+
+// Post-transform cache behaviour of an index buffer on a FIFO cache of `cache_size` entries
+struct VertexCacheStats {
+	std::double_t acmr = 0.0;  // average cache misses (vertex shader runs) per triangle, 0.5 at best
+	std::double_t atvr = 0.0;  // ... per vertex, 1 at best
+};
+
+VertexCacheStats AnalyzeVertexCache(gsl::span<const std::uint32_t> indices, std::uint32_t vertex_count, std::uint32_t cache_size);
+
+// Collapses bitwise identical vertices. Returns the remap table from old to new vertex
+// index; `unique_count` receives the number of distinct vertices.
+template <typename Vertex>
+std::vector<std::uint32_t> GenerateVertexRemap(gsl::span<const Vertex> vertices, std::uint32_t& unique_count);
+
+// Moves every vertex to remap[index]; vertices remapped to kUnusedVertex are dropped
+template <typename Vertex>
+std::vector<Vertex> RemapVertices(gsl::span<const Vertex> vertices, gsl::span<const std::uint32_t> remap, std::uint32_t new_count);
+void RemapIndices(gsl::span<std::uint32_t> indices, gsl::span<const std::uint32_t> remap);
+
+constexpr std::uint32_t kUnusedVertex = ~0u;
+
+// Reorders triangles for the post-transform vertex cache with Tipsify (Sander et al. 2007),
+// which runs in linear time. Returns the first triangle of every cluster, i.e. where the
+// walk had to jump to an unconnected part of the mesh.
+std::vector<std::uint32_t> OptimizeVertexCache(gsl::span<std::uint32_t> indices, std::uint32_t vertex_count, std::uint32_t cache_size);
+
+// Reorders the clusters of a cache-optimized index buffer so those facing away from the mesh
+// center, which tend to occlude the rest, are drawn first. Clusters are split further while
+// that keeps their ACMR within `threshold` times the input's, so overdraw can drop at a
+// bounded cache cost.
+void OptimizeOverdraw(
+    gsl::span<std::uint32_t> indices,
+    gsl::span<const glm::vec3> positions,
+    gsl::span<const std::uint32_t> cluster_starts,
+    std::uint32_t cache_size,
+    std::double_t threshold);
+
+// Numbers vertices in order of first use so vertex fetch walks memory linearly. Returns the
+// remap table for RemapVertices; unreferenced vertices map to kUnusedVertex.
+std::vector<std::uint32_t> OptimizeVertexFetch(gsl::span<std::uint32_t> indices, std::uint32_t vertex_count, std::uint32_t& used_count);
+
+template <typename Vertex>
+std::vector<std::uint32_t> GenerateVertexRemap(gsl::span<const Vertex> vertices, std::uint32_t& unique_count)
+{
+	// Open addressing over the vertex bytes; the table is at least twice the vertex count
+	std::size_t table_size = 1;
+	while (table_size < vertices.size() * 2) {
+		table_size *= 2;
+	}
+	std::vector<std::uint32_t> table(table_size, kUnusedVertex);
+	const auto hash = [](const Vertex& vertex) {
+		// FNV-1a
+		const std::uint8_t* bytes = reinterpret_cast<const std::uint8_t*>(&vertex);
+		std::uint64_t value = 14695981039346656037ull;
+		for (std::size_t i = 0; i < sizeof(Vertex); i++) {
+			value = (value ^ bytes[i]) * 1099511628211ull;
+		}
+		return static_cast<std::size_t>(value);
+	};
+
+	std::vector<std::uint32_t> remap(vertices.size());
+	unique_count = 0;
+	for (std::uint32_t i = 0; i < vertices.size(); i++) {
+		std::size_t slot = hash(vertices[i]) & (table_size - 1);
+		while (table[slot] != kUnusedVertex && std::memcmp(&vertices[table[slot]], &vertices[i], sizeof(Vertex)) != 0) {
+			slot = (slot + 1) & (table_size - 1);
+		}
+		if (table[slot] == kUnusedVertex) {
+			table[slot] = i;
+			remap[i] = unique_count++;
+		}
+		else {
+			remap[i] = remap[table[slot]];
+		}
+	}
+	return remap;
+}
+
+template <typename Vertex>
+std::vector<Vertex> RemapVertices(gsl::span<const Vertex> vertices, gsl::span<const std::uint32_t> remap, std::uint32_t new_count)
+{
+	std::vector<Vertex> result(new_count);
+	for (std::size_t i = 0; i < vertices.size(); i++) {
+		if (remap[i] != kUnusedVertex) {
+			result[remap[i]] = vertices[i];
+		}
+	}
+	return result;
+}
+
+}  // namespace veng
@@ -0,0 +1,235 @@
+#include <precomp.h>
+#include <mesh_simplifier.h>
+#include <mesh_optimizer.h>
+#include <algorithm>
+#include <array>
+#include <numeric>
+#include <unordered_map>
+
+namespace veng {
+
+namespace {
+
+struct Collapse {
+	std::uint32_t from = 0;
+	std::uint32_t to = 0;
+	std::double_t cost = 0.0;
+};
+
+// Vertices that must not move: open borders, non-manifold edges and attribute seams
+std::vector<bool> FindLockedVertices(gsl::span<const std::uint32_t> indices, gsl::span<const glm::vec3> positions)
+{
+	std::uint32_t position_count = 0;
+	const std::vector<std::uint32_t> position_ids = GenerateVertexRemap<glm::vec3>(positions, position_count);
+
+	std::vector<bool> locked(positions.size(), false);
+	std::vector<std::uint32_t> wedges(position_count, 0);
+	for (std::uint32_t id : position_ids) {
+		wedges[id]++;
+	}
+	for (std::size_t vertex = 0; vertex < positions.size(); vertex++) {
+		locked[vertex] = wedges[position_ids[vertex]] > 1;
+	}
+
+	// Edges are compared by position so seams do not read as borders. A consistently wound
+	// closed surface has every directed edge exactly once, next to its reverse.
+	const auto key = [&position_ids](std::uint32_t from, std::uint32_t to) { return (std::uint64_t(position_ids[from]) << 32) | position_ids[to]; };
+	std::unordered_map<std::uint64_t, std::uint32_t> edges;
+	edges.reserve(indices.size());
+	for (std::size_t i = 0; i < indices.size(); i++) {
+		edges[key(indices[i], indices[i - i % 3 + (i + 1) % 3])]++;
+	}
+	for (std::size_t i = 0; i < indices.size(); i++) {
+		const std::uint32_t from = indices[i];
+		const std::uint32_t to = indices[i - i % 3 + (i + 1) % 3];
+		const auto reverse = edges.find(key(to, from));
+		if (edges[key(from, to)] != 1 || reverse == edges.end() || reverse->second != 1) {
+			locked[from] = true;
+			locked[to] = true;
+		}
+	}
+	return locked;
+}
+
+}  // namespace
+
+#pragma region QUADRIC
+
+MeshSimplifier::Quadric MeshSimplifier::Quadric::FromPlane(const glm::vec3& normal, std::double_t distance, std::double_t weight)
+{
+	const std::double_t a = normal.x;
+	const std::double_t b = normal.y;
+	const std::double_t c = normal.z;
+	const std::double_t d = distance;
+	Quadric quadric;
+	quadric.a2 = a * a * weight;
+	quadric.ab = a * b * weight;
+	quadric.ac = a * c * weight;
+	quadric.ad = a * d * weight;
+	quadric.b2 = b * b * weight;
+	quadric.bc = b * c * weight;
+	quadric.bd = b * d * weight;
+	quadric.c2 = c * c * weight;
+	quadric.cd = c * d * weight;
+	quadric.d2 = d * d * weight;
+	quadric.weight = weight;
+	return quadric;
+}
+
+MeshSimplifier::Quadric& MeshSimplifier::Quadric::operator+=(const Quadric& other)
+{
+	a2 += other.a2;
+	ab += other.ab;
+	ac += other.ac;
+	ad += other.ad;
+	b2 += other.b2;
+	bc += other.bc;
+	bd += other.bd;
+	c2 += other.c2;
+	cd += other.cd;
+	d2 += other.d2;
+	weight += other.weight;
+	return *this;
+}
+
+std::double_t MeshSimplifier::Quadric::Evaluate(const glm::vec3& point) const
+{
+	const std::double_t x = point.x;
+	const std::double_t y = point.y;
+	const std::double_t z = point.z;
+	const std::double_t sum = a2 * x * x + b2 * y * y + c2 * z * z + d2 + 2.0 * (ab * x * y + ac * x * z + bc * y * z + ad * x + bd * y + cd * z);
+	// Planes are weighted by triangle area; dividing it out keeps errors independent of the tessellation
+	return weight > 0.0 ? std::abs(sum) / weight : 0.0;
+}
+
+#pragma endregion
+
+#pragma region SIMPLIFIER
+
+MeshSimplifier::MeshSimplifier(gsl::span<const std::uint32_t> indices, gsl::span<const glm::vec3> positions)
+    : positions_(positions), indices_(indices.begin(), indices.end()), quadrics_(positions.size()), locked_(FindLockedVertices(indices, positions)),
+      offsets_(positions.size() + 1)
+{
+	Expects(indices.size() % 3 == 0);
+	for (std::size_t i = 0; i < indices.size(); i += 3) {
+		const glm::vec3& a = positions[indices[i]];
+		const glm::vec3 normal = glm::cross(positions[indices[i + 1]] - a, positions[indices[i + 2]] - a);
+		const std::float_t length = glm::length(normal);
+		if (length == 0.0f) {
+			continue;
+		}
+		const glm::vec3 unit = normal / length;
+		const Quadric plane = Quadric::FromPlane(unit, -glm::dot(unit, a), length * 0.5);
+		for (std::size_t corner = 0; corner < 3; corner++) {
+			quadrics_[indices[i + corner]] += plane;
+		}
+	}
+}
+
+std::float_t MeshSimplifier::Simplify(std::size_t target_index_count, std::float_t max_error)
+{
+	const std::uint32_t vertex_count = gsl::narrow_cast<std::uint32_t>(positions_.size());
+	const std::double_t max_cost = std::double_t(max_error) * max_error;
+	std::vector<Collapse> collapses;
+	std::vector<bool> touched(vertex_count);
+	std::vector<std::uint32_t> remap(vertex_count);
+
+	// Each pass collapses a set of independent edges, cheapest first, then compacts
+	while (indices_.size() > target_index_count) {
+		// Triangles around each vertex, as in OptimizeVertexCache
+		std::fill(offsets_.begin(), offsets_.end(), 0);
+		for (std::uint32_t index : indices_) {
+			offsets_[index + 1]++;
+		}
+		std::partial_sum(offsets_.begin(), offsets_.end(), offsets_.begin());
+		adjacency_.resize(indices_.size());
+		{
+			std::vector<std::uint32_t> fill(offsets_.begin(), offsets_.end() - 1);
+			for (std::uint32_t i = 0; i < indices_.size(); i++) {
+				adjacency_[fill[indices_[i]]++] = i / 3;
+			}
+		}
+
+		collapses.clear();
+		for (std::size_t i = 0; i < indices_.size(); i++) {
+			const std::uint32_t a = indices_[i];
+			const std::uint32_t b = indices_[i - i % 3 + (i + 1) % 3];
+			for (const auto& [from, to] : {std::pair(a, b), std::pair(b, a)}) {
+				if (!locked_[from]) {
+					Quadric merged = quadrics_[from];
+					merged += quadrics_[to];
+					collapses.push_back({from, to, merged.Evaluate(positions_[to])});
+				}
+			}
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& left, const Collapse& right) { return left.cost < right.cost; });
+
+		// Every collapse removes about two triangles; stop once the target is in reach
+		const std::size_t triangles_to_remove = (indices_.size() - target_index_count + 2) / 3;
+		std::size_t triangles_removed = 0;
+		std::fill(touched.begin(), touched.end(), false);
+		std::iota(remap.begin(), remap.end(), 0u);
+		for (const Collapse& collapse : collapses) {
+			if (triangles_removed >= triangles_to_remove || collapse.cost > max_cost) {
+				break;
+			}
+			if (touched[collapse.from] || touched[collapse.to] || CollapseFlips(collapse.from, collapse.to)) {
+				continue;
+			}
+
+			// Freezing the whole neighbourhood keeps the flip test of later collapses exact
+			for (std::uint32_t i = offsets_[collapse.from]; i < offsets_[collapse.from + 1]; i++) {
+				const std::uint32_t* triangle = &indices_[adjacency_[i] * 3];
+				for (std::uint32_t corner = 0; corner < 3; corner++) {
+					touched[triangle[corner]] = true;
+				}
+				triangles_removed += (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to) ? 1 : 0;
+			}
+			remap[collapse.from] = collapse.to;
+			quadrics_[collapse.to] += quadrics_[collapse.from];
+			error_ = std::max(error_, static_cast<std::float_t>(std::sqrt(collapse.cost)));
+		}
+		if (triangles_removed == 0) {
+			break;
+		}
+
+		std::size_t write = 0;
+		for (std::size_t i = 0; i < indices_.size(); i += 3) {
+			const std::uint32_t a = remap[indices_[i]];
+			const std::uint32_t b = remap[indices_[i + 1]];
+			const std::uint32_t c = remap[indices_[i + 2]];
+			if (a != b && b != c && a != c) {
+				indices_[write++] = a;
+				indices_[write++] = b;
+				indices_[write++] = c;
+			}
+		}
+		indices_.resize(write);
+	}
+	return error_;
+}
+
+bool MeshSimplifier::CollapseFlips(std::uint32_t from, std::uint32_t to) const
+{
+	// Moving `from` onto `to` must not turn any surviving triangle around `from` over
+	for (std::uint32_t i = offsets_[from]; i < offsets_[from + 1]; i++) {
+		const std::uint32_t* triangle = &indices_[adjacency_[i] * 3];
+		if (triangle[0] == to || triangle[1] == to || triangle[2] == to) {
+			continue;  // collapses away
+		}
+		std::array<glm::vec3, 3> corners = {positions_[triangle[0]], positions_[triangle[1]], positions_[triangle[2]]};
+		const glm::vec3 before = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+		for (std::uint32_t corner = 0; corner < 3; corner++) {
+			corners[corner] = triangle[corner] == from ? positions_[to] : corners[corner];
+		}
+		const glm::vec3 after = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+		if (glm::dot(before, after) <= 0.0f) {
+			return true;
+		}
+	}
+	return false;
+}
+
+#pragma endregion
+
+}  // namespace veng
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+
+namespace veng {
+
+// Quadric error metric simplification (Garland & Heckbert 1997) restricted to collapsing a
+// vertex onto one of its neighbours, so the result indexes the input vertices and every LOD
+// of a mesh can share one vertex buffer. Vertices on open borders and attribute seams
+// (several vertices at one position) are locked, which keeps the outline and any UV or
+// normal discontinuities in place.
+//
+// Simplify() can be called repeatedly with falling targets to produce a LOD chain in one
+// run; the quadrics carry over, so errors stay relative to the input surface.
+class MeshSimplifier {
+public:
+	MeshSimplifier(gsl::span<const std::uint32_t> indices, gsl::span<const glm::vec3> positions);
+
+	// Collapses until at most `target_index_count` indices are left or the next collapse
+	// would have an error above `max_error`. A collapse's error is the area-weighted RMS
+	// distance of the kept vertex to the original planes around both vertices. Returns the
+	// largest error so far, in position units (see MeshLod::error).
+	std::float_t Simplify(std::size_t target_index_count, std::float_t max_error);
+
+	gsl::span<const std::uint32_t> GetIndices() const { return indices_; }
+
+private:
+	struct Quadric {
+		std::double_t a2 = 0.0, ab = 0.0, ac = 0.0, ad = 0.0;
+		std::double_t b2 = 0.0, bc = 0.0, bd = 0.0;
+		std::double_t c2 = 0.0, cd = 0.0;
+		std::double_t d2 = 0.0;
+		std::double_t weight = 0.0;
+
+		static Quadric FromPlane(const glm::vec3& normal, std::double_t distance, std::double_t weight);
+		Quadric& operator+=(const Quadric& other);
+		// Mean squared distance of `point` to the planes
+		std::double_t Evaluate(const glm::vec3& point) const;
+	};
+
+	bool CollapseFlips(std::uint32_t from, std::uint32_t to) const;
+
+	gsl::span<const glm::vec3> positions_;
+	std::vector<std::uint32_t> indices_;
+	std::vector<Quadric> quadrics_;
+	std::vector<bool> locked_;
+	std::float_t error_ = 0.0f;
+
+	// Triangles around each vertex, rebuilt every pass
+	std::vector<std::uint32_t> offsets_;
+	std::vector<std::uint32_t> adjacency_;
+};
+
+}  // namespace veng